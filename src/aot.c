@@ -0,0 +1,48 @@
+#include "aot.h"
+#include "stdinc.h"
+#include <stddef.h>
+
+u32 AotImage_hash(const u8 *const rom, const size_t rom_len)
+{
+    u32 hash = 0x811C9DC5;
+
+    for (size_t i = 0; i < rom_len; ++i) {
+        hash ^= rom[i];
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+bool AotImage_matches(const AotImage *const self, const u8 *const rom,
+                      const size_t rom_len)
+{
+    return self->rom_len == rom_len &&
+           self->rom_hash == AotImage_hash(rom, rom_len);
+}
+
+const AotBlock *AotImage_find(const AotImage *const self, const u16 bank,
+                              const u16 pc)
+{
+    const u32 key = ((u32)bank << 16) | pc;
+
+    size_t lo = 0;
+    size_t hi = self->block_count;
+
+    while (lo < hi) {
+        const size_t mid = lo + ((hi - lo) / 2);
+        const AotBlock *const block = &self->blocks[mid];
+        const u32 block_key = ((u32)block->bank << 16) | block->pc;
+
+        if (block_key == key)
+            return block;
+
+        if (block_key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,71 @@
+#ifndef GEMU_AOT_H
+#define GEMU_AOT_H
+
+#include "cpu.h"
+#include "stdinc.h"
+#include <stddef.h>
+
+/**
+ * A basic block of ROM code compiled ahead of time by tools/gemu_aot.rb.
+ */
+typedef struct {
+    u16 bank;    // ROM bank the block lives in
+    u16 pc;      // Address of the first instruction
+    u8 op_count; // Number of instructions run, for statistics
+    // Runs the whole block as if Cpu_tick was called once per instruction
+    CpuOpHandler run;
+} AotBlock;
+
+/**
+ * The compiled blocks of one specific ROM.
+ */
+typedef struct {
+    size_t rom_len;
+    u32 rom_hash; // See AotImage_hash
+    size_t block_count;
+    const AotBlock *blocks; // Sorted by bank, then pc
+} AotImage;
+
+/**
+ * \brief Hashes ROM data the same way tools/gemu_aot.rb does (32-bit FNV-1a).
+ *
+ * \param rom the ROM data to hash.
+ * \param rom_len length of rom.
+ *
+ * \return the hash of rom.
+ */
+[[nodiscard]] u32 AotImage_hash(const u8 *rom, size_t rom_len);
+
+/**
+ * \brief Checks whether an image was compiled from the given ROM.
+ *
+ * \param self the image to check.
+ * \param rom the ROM data to check against.
+ * \param rom_len length of rom.
+ *
+ * \return whether the blocks of self may run on rom.
+ */
+[[nodiscard]] bool AotImage_matches(const AotImage *self, const u8 *rom,
+                                    size_t rom_len);
+
+/**
+ * \brief Finds the compiled block starting at the given address.
+ *
+ * \param self the image to search.
+ * \param bank the ROM bank mapped at pc.
+ * \param pc the address of the block.
+ *
+ * \return the block, or NULL if that code was not compiled.
+ */
+[[nodiscard]] const AotBlock *AotImage_find(const AotImage *self, u16 bank,
+                                            u16 pc);
+
+#ifdef GEMU_AOT
+/**
+ * The image linked into a ROM-specific build of gemu (see
+ * gemu_add_aot_executable in CMakeLists.txt).
+ */
+extern const AotImage AOT_IMAGE;
+#endif
+
+#endif
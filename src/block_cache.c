@@ -0,0 +1,483 @@
+#include "block_cache.h"
+#include "cpu.h"
+#include "instructions.h"
+#include "macros.h"
+#include "num.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern inline const BlockOp *BlockCache_next(BlockCache *self, u16 pc);
+
+extern inline void BlockCache_reset_cursor(BlockCache *self);
+
+extern inline size_t BlockCache_ram_index(u16 addr);
+
+extern inline void BlockCache_write_ram(BlockCache *self, u16 addr);
+
+BlockCache *BlockCache_new(void)
+{
+    BlockCache *const self = calloc(1, sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    return self;
+}
+
+void BlockCache_destroy(BlockCache *const self)
+{
+    free(self);
+}
+
+void BlockCache_clear(BlockCache *const self)
+{
+    for (size_t i = 0; i < BLOCK_CACHE_LEN; ++i)
+        self->blocks[i].op_count = 0;
+
+    memset(self->ram_code, 0, sizeof(self->ram_code));
+    BlockCache_reset_cursor(self);
+}
+
+void BlockCache_flush_ram(BlockCache *const self)
+{
+    // Stale RAM blocks are told apart by their generation, so there is no need
+    // to walk the whole cache unless the counter wraps around
+    if (++self->ram_generation == 0) {
+        BlockCache_clear(self);
+        return;
+    }
+
+    memset(self->ram_code, 0, sizeof(self->ram_code));
+    BlockCache_reset_cursor(self);
+}
+
+static size_t BlockCache_slot(const u16 bank, const u16 pc)
+{
+    return (pc ^ ((size_t)bank * 0x9E5)) & (BLOCK_CACHE_LEN - 1);
+}
+
+static void BlockCache_mark_ram_code(BlockCache *const self, const u16 pc,
+                                     const size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        const size_t index = BlockCache_ram_index(pc + i);
+        self->ram_code[index / 8] |= 1 << (index % 8);
+    }
+}
+
+// Which inputs that change on their own a read from addr sees, as BlockIdle
+// flags
+static u8 BlockIdle_reads(const u16 addr)
+{
+    switch (addr) {
+    case 0xFF04:
+        return BlockIdle_ReadsDiv;
+    case 0xFF05:
+        return BlockIdle_ReadsTima;
+    case 0xFF41:
+    case 0xFF44:
+        return BlockIdle_ReadsLcd;
+    default:
+        return 0;
+    }
+}
+
+// Which inputs that change on their own an instruction may read, as BlockIdle
+// flags. Reads through a register are assumed to see any of them.
+static u8 BlockOp_idle_reads(const BlockOp *const op)
+{
+    static constexpr u8 ANY = BlockIdle_ReadsLcd | BlockIdle_ReadsDiv |
+                              BlockIdle_ReadsTima;
+    const u8 opcode = op->code[0];
+
+    switch (opcode) {
+    case 0xF0: // ldh a, [n8]
+        return BlockIdle_reads(0xFF00 | op->code[1]);
+    case 0xFA: // ld a, [a16]
+        return BlockIdle_reads(concat_u16(op->code[2], op->code[1]));
+    case 0xF2: // ldh a, [c]
+    case 0x0A: // ld a, [bc]
+    case 0x1A: // ld a, [de]
+    case 0x2A: // ld a, [hl+]
+    case 0x3A: // ld a, [hl-]
+        return ANY;
+    case 0xCB:
+        return (op->code[1] & 0b111) == CpuTableR_HL ? ANY : 0;
+    default:
+        break;
+    }
+
+    // ld r, [hl] and the ALU ops on [hl]
+    const bool reads_hl = opcode >= 0x40 && opcode <= 0xBF &&
+                          (opcode & 0b111) == CpuTableR_HL;
+    return reads_hl ? ANY : 0;
+}
+
+// Checks whether a decoded block ends with a direct jump back to its start
+static bool Block_loops_back(const Block *const block, const u8 *const code)
+{
+    if (block->op_count == 0)
+        return false;
+
+    const BlockOp *const last = &block->ops[block->op_count - 1];
+    const u16 last_pc = block->pc + (last->code - code);
+    u16 target;
+
+    switch (last->code[0]) {
+    case 0x18: // jr e8
+    case 0x20: // jr nz, e8
+    case 0x28: // jr z, e8
+    case 0x30: // jr nc, e8
+    case 0x38: // jr c, e8
+        target = last_pc + 2 + (i8)last->code[1];
+        break;
+    case 0xC3: // jp a16
+    case 0xC2: // jp nz, a16
+    case 0xCA: // jp z, a16
+    case 0xD2: // jp nc, a16
+    case 0xDA: // jp c, a16
+        target = concat_u16(last->code[2], last->code[1]);
+        break;
+    default:
+        return false;
+    }
+
+    return target == block->pc;
+}
+
+// Checks whether a decoded block is an idle loop (see BlockIdle)
+static u8 Block_idle(const Block *const block, const u8 *const code)
+{
+    if (!Block_loops_back(block, code))
+        return 0;
+
+    u8 idle = BlockIdle_Loop;
+
+    for (size_t i = 0; i + 1 < block->op_count; ++i) {
+        const BlockOp *const op = &block->ops[i];
+        const u8 opcode = op->code[0];
+
+        // Prefixed instructions only write memory when operating on [hl],
+        // except for bit, which never does
+        const bool side_effect_free =
+            opcode == 0xCB ? (op->code[1] >> 6) == 1 ||
+                                 (op->code[1] & 0b111) != CpuTableR_HL
+                           : Cpu_opcode_is_side_effect_free(opcode);
+
+        if (!side_effect_free)
+            return 0;
+
+        idle |= BlockOp_idle_reads(op);
+    }
+
+    return idle;
+}
+
+// What A holds at some point of a bulk loop iteration
+typedef enum : u8 {
+    BulkA_Start,  // Whatever it held when the iteration started
+    BulkA_Loaded, // The byte loaded by the iteration
+    BulkA_Const,  // An immediate value
+    BulkA_Other,
+} BulkA;
+
+// What the Z flag last came from in a bulk loop iteration
+typedef enum : u8 {
+    BulkZ_None,
+    BulkZ_R8, // inc/dec of an 8-bit register
+    BulkZ_Rp, // ld a, <high byte>; or <low byte> of a pair
+} BulkZ;
+
+// The pair an 8-bit register (other than A) belongs to
+static u8 CpuTableR_pair(const u8 r)
+{
+    return r >> 1;
+}
+
+// Works out the shape of a bulk copy or fill loop (see BlockBulk), by
+// following what each instruction of one iteration does to the registers
+static BlockBulk Block_bulk(const Block *const block, const u8 *const code)
+{
+    static const BlockBulk NONE = {.kind = BlockBulk_None};
+
+    if (!Block_loops_back(block, code) ||
+        block->ops[block->op_count - 1].code[0] != 0x20) // jr nz, e8
+        return NONE;
+
+    BlockBulk bulk = {.cycles = BLOCK_BULK_JUMP_CYCLES};
+
+    i8 wide[3] = {};   // How far each pair moved through 16-bit inc/dec
+    i8 narrow[8] = {}; // How far each 8-bit register moved through inc/dec
+    u8 narrow_ops[8] = {};
+    BulkA a = BulkA_Start;
+    u8 a_const = 0;
+    u8 a_copy_of = CpuTableR_A;
+    bool a_changed = false;
+    BulkZ z = BulkZ_None;
+    u8 z_reg = 0;
+    i8 z_moved = 0;
+    bool loaded = false;
+    bool stored = false;
+    u8 accessed = 0; // Pairs (1 << CpuTableRp) loaded or stored through
+
+    for (size_t i = 0; i + 1 < block->op_count; ++i) {
+        const u8 *const op = block->ops[i].code;
+        const u8 opcode = op[0];
+
+        // 8-bit registers except [hl] and A, and 16-bit pairs except SP
+        const u8 r = (opcode >> 3) & 0b111;
+        const u8 src_r = opcode & 0b111;
+        const u8 rp = (opcode >> 4) & 0b11;
+        const bool is_r = r != CpuTableR_HL && r != CpuTableR_A;
+        const bool is_src_r = src_r != CpuTableR_HL && src_r != CpuTableR_A;
+
+        int cycles = 2;
+        i8 moved = 0;  // How far the pair accessed moves afterwards (hl+/hl-)
+        u8 pair = 0;   // The pair accessed
+        int access = 0; // 1 for a load into A, 2 for a store from A
+
+        switch (opcode) {
+        case 0x0A: // ld a, [bc]
+        case 0x1A: // ld a, [de]
+            pair = rp;
+            access = 1;
+            break;
+        case 0x2A: // ld a, [hl+]
+        case 0x3A: // ld a, [hl-]
+            pair = CpuTableRp_HL;
+            moved = opcode == 0x2A ? 1 : -1;
+            access = 1;
+            break;
+        case 0x7E: // ld a, [hl]
+            pair = CpuTableRp_HL;
+            access = 1;
+            break;
+        case 0x02: // ld [bc], a
+        case 0x12: // ld [de], a
+            pair = rp;
+            access = 2;
+            break;
+        case 0x22: // ld [hl+], a
+        case 0x32: // ld [hl-], a
+            pair = CpuTableRp_HL;
+            moved = opcode == 0x22 ? 1 : -1;
+            access = 2;
+            break;
+        case 0x77: // ld [hl], a
+            pair = CpuTableRp_HL;
+            access = 2;
+            break;
+        case 0x3E: // ld a, n8
+            a = BulkA_Const;
+            a_changed = true;
+            a_const = op[1];
+            break;
+        case 0x03: // inc bc
+        case 0x13: // inc de
+        case 0x23: // inc hl
+            wide[rp]++;
+            break;
+        case 0x0B: // dec bc
+        case 0x1B: // dec de
+        case 0x2B: // dec hl
+            wide[rp]--;
+            break;
+        default:
+            if (opcode >= 0x78 && opcode <= 0x7D) {
+                // ld a, r8
+                cycles = 1;
+                a = BulkA_Other;
+                a_changed = true;
+                a_copy_of = src_r;
+            } else if (opcode >= 0xB0 && opcode <= 0xB5) {
+                // or r8, only as the second half of a test for a pair being 0
+                if (a != BulkA_Other || (a_copy_of ^ 1) != src_r ||
+                    !is_src_r)
+                    return NONE;
+
+                cycles = 1;
+                a_copy_of = CpuTableR_A;
+                z = BulkZ_Rp;
+                z_reg = CpuTableR_pair(src_r);
+                z_moved = wide[z_reg];
+            } else if ((opcode & 0b11000110) == 0b00000100 && is_r) {
+                // inc/dec r8
+                cycles = 1;
+                narrow[r] += (opcode & 1) == 0 ? 1 : -1;
+                narrow_ops[r]++;
+                z = BulkZ_R8;
+                z_reg = r;
+            } else {
+                return NONE;
+            }
+        }
+
+        bulk.cycles += cycles;
+
+        if (access == 0)
+            continue;
+
+        // How far the accessed pair has moved so far in this iteration
+        const i8 off = wide[pair] + narrow[(pair << 1) | 1];
+        accessed |= 1 << pair;
+
+        if (access == 1) {
+            if (loaded || stored)
+                return NONE;
+
+            loaded = true;
+            a = BulkA_Loaded;
+            a_changed = true;
+            bulk.src = pair;
+            bulk.src_off = off;
+        } else {
+            if (stored)
+                return NONE;
+
+            if (a == BulkA_Loaded) {
+                bulk.kind = BlockBulk_Copy;
+            } else if (a == BulkA_Const || a == BulkA_Start) {
+                bulk.kind = BlockBulk_Fill;
+                bulk.fill_a = a == BulkA_Start;
+                bulk.fill_value = a_const;
+            } else {
+                return NONE;
+            }
+
+            stored = true;
+            bulk.dst = pair;
+            bulk.dst_off = off;
+        }
+
+        wide[pair] += moved;
+    }
+
+    // Storing A as it was when the iteration started only fills if nothing
+    // changes it
+    if (!stored || (bulk.fill_a && a_changed))
+        return NONE;
+
+    // The jr nz must test a counter counting down by one per iteration
+    if (z == BulkZ_R8) {
+        if (narrow[z_reg] != -1 || narrow_ops[z_reg] != 1)
+            return NONE;
+
+        bulk.counter = z_reg;
+        bulk.wide_counter = false;
+    } else if (z == BulkZ_Rp) {
+        if (wide[z_reg] != -1 || z_moved != -1)
+            return NONE;
+
+        bulk.counter = z_reg;
+        bulk.wide_counter = true;
+    } else {
+        return NONE;
+    }
+
+    const u8 counter_pair =
+        bulk.wide_counter ? bulk.counter : CpuTableR_pair(bulk.counter);
+
+    for (u8 pair = CpuTableRp_BC; pair <= CpuTableRp_HL; ++pair) {
+        const i8 hi = narrow[pair << 1];
+        const i8 lo = narrow[(pair << 1) | 1];
+
+        if (pair == counter_pair) {
+            // The counter must not double as anything else
+            const bool other_moved =
+                bulk.wide_counter ? hi != 0 || lo != 0
+                                  : wide[pair] != 0 ||
+                                        narrow[bulk.counter ^ 1] != 0;
+            if (other_moved || (accessed & (1 << pair)) != 0)
+                return NONE;
+
+            continue;
+        }
+
+        // Pointers may be moved through their low byte, as long as it does
+        // not carry into the high one (which is checked before running)
+        if (hi != 0 || (wide[pair] != 0 && lo != 0))
+            return NONE;
+
+        bulk.step[pair] = wide[pair] + lo;
+        if (lo != 0)
+            bulk.narrow |= 1 << pair;
+    }
+
+    // Both ends must move one byte at a time, in the same direction
+    const i8 dst_step = bulk.step[bulk.dst];
+    if (dst_step != 1 && dst_step != -1)
+        return NONE;
+
+    if (bulk.kind == BlockBulk_Copy &&
+        (bulk.src == bulk.dst || bulk.step[bulk.src] != dst_step))
+        return NONE;
+
+    return bulk;
+}
+
+static void Block_decode(Block *const block, const u8 *const code,
+                         const size_t code_len)
+{
+    size_t offset = 0;
+    block->op_count = 0;
+    block->hits = 0;
+    block->native = nullptr;
+    block->native_op_count = 0;
+    block->native_cycles = 0;
+
+    while (block->op_count < BLOCK_MAX_OPS && offset < code_len) {
+        const u8 opcode = code[offset];
+        const u8 length = Cpu_opcode_length(opcode);
+
+        if (offset + length > code_len)
+            break;
+
+        block->ops[block->op_count++] = (BlockOp){
+            .handler = Cpu_decode(opcode),
+            .code = &code[offset],
+            .length = length,
+        };
+        offset += length;
+
+        if (Cpu_opcode_ends_block(opcode))
+            break;
+    }
+
+    block->idle = Block_idle(block, code);
+    block->bulk = Block_bulk(block, code);
+}
+
+const BlockOp *BlockCache_lookup(BlockCache *const self, const u16 bank,
+                                 const u16 pc, const u8 *const code,
+                                 const size_t code_len)
+{
+    Block *const block = &self->blocks[BlockCache_slot(bank, pc)];
+
+    const bool hit = block->op_count != 0 && block->bank == bank &&
+                     block->pc == pc &&
+                     (bank != BLOCK_BANK_RAM ||
+                      block->generation == self->ram_generation);
+
+    if (!hit) {
+        block->bank = bank;
+        block->pc = pc;
+        block->generation = self->ram_generation;
+        Block_decode(block, code, code_len);
+
+        if (bank == BLOCK_BANK_RAM && block->op_count != 0) {
+            const BlockOp *const last = &block->ops[block->op_count - 1];
+            BlockCache_mark_ram_code(self, pc,
+                                     (last->code - code) + last->length);
+        }
+    }
+
+    if (block->hits < UINT8_MAX)
+        block->hits++;
+
+    self->block = block;
+    self->next_op = block->ops;
+    self->ops_end = &block->ops[block->op_count];
+    self->next_pc = pc;
+
+    return BlockCache_next(self, pc);
+}
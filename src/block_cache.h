@@ -0,0 +1,242 @@
+#ifndef GEMU_BLOCK_CACHE_H
+#define GEMU_BLOCK_CACHE_H
+
+#include "cpu.h"
+#include "stdinc.h"
+#include <stddef.h>
+
+constexpr size_t BLOCK_CACHE_LEN = 1024;
+constexpr size_t BLOCK_MAX_OPS = 16;
+
+// Bank used to key blocks in WRAM (C000-DFFF) and HRAM (FF80-FFFE)
+constexpr u16 BLOCK_BANK_RAM = 0xFFFF;
+
+// WRAM followed by HRAM
+constexpr size_t BLOCK_CACHE_RAM_LEN = 0x2000 + 0x7F;
+
+/**
+ * A pre-decoded instruction.
+ *
+ * Every byte of the instruction costs one M-cycle to fetch, so length is also
+ * its fixed fetch cost. Anything beyond that depends on the operands and is
+ * charged by the handler as it runs.
+ */
+typedef struct {
+    CpuOpHandler handler;
+    const u8 *code; // The instruction's bytes, starting with its opcode
+    u8 length;
+} BlockOp;
+
+/**
+ * Flags for a block that jumps back to its own start without side effects, so
+ * that once it has looped with some inputs, it keeps looping the same way until
+ * one of them changes. Inputs that change on their own are listed separately.
+ */
+typedef enum : u8 {
+    BlockIdle_Loop = 1 << 0,      // The block is such a loop
+    BlockIdle_ReadsLcd = 1 << 1,  // It may read LY or STAT
+    BlockIdle_ReadsDiv = 1 << 2,  // It may read DIV
+    BlockIdle_ReadsTima = 1 << 3, // It may read TIMA
+} BlockIdle;
+
+typedef enum : u8 {
+    BlockBulk_None,
+    BlockBulk_Fill, // Stores the same byte on every iteration
+    BlockBulk_Copy, // Loads a byte and stores it elsewhere on every iteration
+} BlockBulkKind;
+
+// What the jr nz ending a bulk loop costs when it jumps back
+constexpr u8 BLOCK_BULK_JUMP_CYCLES = 3;
+
+/**
+ * The shape of a block that copies or fills memory one byte per iteration
+ * while counting down a register, such as
+ *
+ *     ld a, [hl+]
+ *     ld [de], a
+ *     inc de
+ *     dec bc
+ *     ld a, b
+ *     or c
+ *     jr nz, <start of block>
+ *
+ * Such a loop only ever changes the counter, the pointers it moves by a fixed
+ * step, A, the flags and the bytes it stores, so any number of its iterations
+ * can be worked out at once. A and the flags are always set anew before being
+ * used, so they only need to be right after the last iteration.
+ */
+typedef struct {
+    u8 kind;   // BlockBulkKind
+    u8 cycles; // M-cycles per iteration, with the jump back taken
+    // CpuTableRp of the counter if wide_counter, CpuTableR otherwise. It is
+    // decremented once per iteration and the loop ends when it reaches 0.
+    u8 counter;
+    bool wide_counter;
+    i8 step[3];  // How much each of BC, DE and HL moves per iteration
+    u8 narrow;   // Pairs (1 << CpuTableRp) moved through their low byte only
+    u8 src;      // CpuTableRp loaded through, for copies
+    i8 src_off;  // How far src has moved in the iteration when loaded through
+    u8 dst;      // CpuTableRp stored through
+    i8 dst_off;  // How far dst has moved in the iteration when stored through
+    bool fill_a; // Whether a fill stores A, rather than fill_value
+    u8 fill_value;
+} BlockBulk;
+
+/**
+ * A run of straight-line code, decoded up to (and including) the first
+ * instruction that may jump elsewhere.
+ */
+typedef struct {
+    u32 generation; // For RAM blocks, the BlockCache.ram_generation decoded in
+    u16 bank;
+    u16 pc;
+    u8 op_count; // Zero if this slot is unused
+    u8 hits;     // How many times the block was entered, up to UINT8_MAX
+    CpuOpHandler native; // Compiled code for the block, if any (see jit.h)
+    u8 native_op_count;  // How many of the ops native runs
+    u8 native_cycles;    // The most M-cycles native may take
+    u8 idle;             // BlockIdle flags
+    BlockBulk bulk;
+    BlockOp ops[BLOCK_MAX_OPS];
+} Block;
+
+/**
+ * A direct-mapped cache of decoded blocks, keyed by mapped bank and PC.
+ *
+ * ROM never changes under a given bank, so ROM blocks stay valid until a new
+ * ROM is loaded. Code in WRAM/HRAM can be overwritten, so every RAM byte that
+ * belongs to a decoded block is tracked in ram_code, and writing to one drops
+ * all RAM blocks at once.
+ */
+typedef struct {
+    Block blocks[BLOCK_CACHE_LEN];
+    u32 ram_generation;
+    u8 ram_code[(BLOCK_CACHE_RAM_LEN + 7) / 8];
+    // The block last returned from BlockCache_lookup, and the op expected to
+    // run next if execution keeps going straight ahead
+    Block *block;
+    const BlockOp *next_op;
+    const BlockOp *ops_end;
+    u16 next_pc;
+} BlockCache;
+
+/**
+ * \brief Allocates an empty block cache.
+ *
+ * The created cache must eventually be destroyed with BlockCache_destroy.
+ *
+ * \return the created cache.
+ *
+ * \sa BlockCache_destroy
+ */
+[[nodiscard]] BlockCache *BlockCache_new(void);
+
+/**
+ * \brief Frees a block cache created with BlockCache_new.
+ *
+ * \param self the cache to free. May be NULL.
+ *
+ * \sa BlockCache_new
+ */
+void BlockCache_destroy(BlockCache *self);
+
+/**
+ * \brief Drops every decoded block.
+ *
+ * Must be called whenever the memory that blocks were decoded from is freed
+ * or replaced, such as when loading a new ROM.
+ *
+ * \param self the cache to clear.
+ */
+void BlockCache_clear(BlockCache *self);
+
+/**
+ * \brief Drops every block decoded from WRAM or HRAM.
+ *
+ * \param self the cache to flush.
+ *
+ * \sa BlockCache_write_ram
+ */
+void BlockCache_flush_ram(BlockCache *self);
+
+/**
+ * \brief Finds the block starting at pc in the given bank, decoding it from
+ * code if it is not cached yet, and returns its first op.
+ *
+ * Following ops of the same block are then returned by BlockCache_next.
+ *
+ * \param self the cache to look in.
+ * \param bank the ROM bank mapped at pc, or BLOCK_BANK_RAM.
+ * \param pc the address of the block.
+ * \param code the bytes at pc.
+ * \param code_len how many bytes starting at code may be decoded. Decoding
+ * stops before an instruction that would run past this.
+ *
+ * \return the op at pc, or NULL if the instruction there could not be
+ * decoded.
+ *
+ * \sa BlockCache_next
+ */
+[[nodiscard]] const BlockOp *BlockCache_lookup(BlockCache *self, u16 bank,
+                                               u16 pc, const u8 *code,
+                                               size_t code_len);
+
+/**
+ * \brief Returns the op at pc if it directly follows the last one returned,
+ * within the same block.
+ *
+ * \param self the cache to look in.
+ * \param pc the address of the next instruction.
+ *
+ * \return the next op, or NULL if execution left the block.
+ *
+ * \sa BlockCache_lookup
+ */
+[[nodiscard]] inline const BlockOp *BlockCache_next(BlockCache *const self,
+                                                    const u16 pc)
+{
+    if (self->next_op == self->ops_end || pc != self->next_pc)
+        return nullptr;
+
+    const BlockOp *const op = self->next_op++;
+    self->next_pc += op->length;
+    return op;
+}
+
+/**
+ * \brief Forgets where execution was, so the next instruction is looked up
+ * afresh.
+ *
+ * Must be called whenever the mapping of an address containing code may have
+ * changed, such as on a bank switch.
+ *
+ * \param self the cache to reset.
+ */
+inline void BlockCache_reset_cursor(BlockCache *const self)
+{
+    self->next_op = nullptr;
+    self->ops_end = nullptr;
+}
+
+[[nodiscard]] inline size_t BlockCache_ram_index(const u16 addr)
+{
+    return addr >= 0xFF80 ? 0x2000 + (addr - 0xFF80) : addr - 0xC000;
+}
+
+/**
+ * \brief Must be called on every write to WRAM or HRAM, so that blocks
+ * decoded from overwritten bytes get dropped.
+ *
+ * \param self the cache to notify.
+ * \param addr the written address, in C000-DFFF or FF80-FFFE. Echo RAM
+ * writes must be passed as the WRAM address they mirror.
+ */
+inline void BlockCache_write_ram(BlockCache *const self, const u16 addr)
+{
+    const size_t index = BlockCache_ram_index(addr);
+
+    if ((self->ram_code[index / 8] & (1 << (index % 8))) != 0)
+        BlockCache_flush_ram(self);
+}
+
+#endif
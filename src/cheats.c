@@ -0,0 +1,248 @@
+#include "cheats.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+constexpr size_t CHEAT_BANK_LEN = 0x4000;
+constexpr size_t CHEAT_ROM_PAGES = 0x8000 / CHEAT_PAGE_LEN;
+
+// A page of ROM with patches applied
+typedef struct {
+    size_t bank;
+    u8 page; // Index of the page in 0000-7FFF
+    u8 data[CHEAT_PAGE_LEN];
+} CheatOverlay;
+
+struct Cheats {
+    const u8 *rom;
+    size_t rom_len;
+    CheatOverlay *overlays;
+    size_t overlay_count;
+    Cheat *ram_writes;
+    size_t ram_write_count;
+    // Whether each page has an overlay in any bank, so that pages without
+    // one are never searched for it
+    bool patched[CHEAT_ROM_PAGES];
+    u16 next_patched[CHEAT_ROM_PAGES]; // See Cheats_next_patched
+};
+
+static int hex_digit(const char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
+}
+
+bool Cheat_parse(const char *const str, Cheat *const out)
+{
+    u8 digits[9];
+    size_t len = 0;
+    bool dashed = false;
+
+    for (const char *c = str; *c != '\0'; ++c) {
+        if (*c == '-') {
+            dashed = true;
+            continue;
+        }
+
+        const int digit = hex_digit(*c);
+
+        if (digit < 0 || len == sizeof(digits))
+            return false;
+
+        digits[len++] = digit;
+    }
+
+    if (len == 8 && !dashed) {
+        // GameShark: TTVVLLHH
+        *out = (Cheat){
+            .kind = CheatKind_RamWrite,
+            .addr = (digits[6] << 12) | (digits[7] << 8) | (digits[4] << 4) |
+                    digits[5],
+            .value = (digits[2] << 4) | digits[3],
+            .has_compare = false,
+            .compare = 0,
+        };
+        return out->addr >= 0x8000;
+    }
+
+    if (len != 6 && len != 9)
+        return false;
+
+    // Game Genie: ABC-DEF-GHI, where AB is the value, FCDE the address XORed
+    // with $F000 and GI the compare value XORed with $BA and rotated left by
+    // two. H is unused.
+    const u16 addr = ((digits[5] << 12) | (digits[2] << 8) | (digits[3] << 4) |
+                      digits[4]) ^
+                     0xF000;
+    const u8 compare = len == 9 ? (digits[6] << 4) | digits[8] : 0;
+
+    *out = (Cheat){
+        .kind = CheatKind_RomPatch,
+        .addr = addr,
+        .value = (digits[0] << 4) | digits[1],
+        .has_compare = len == 9,
+        .compare = (u8)((compare >> 2) | (compare << 6)) ^ 0xBA,
+    };
+    return addr < 0x8000;
+}
+
+Cheats *Cheats_new(const u8 *const rom, const size_t rom_len)
+{
+    Cheats *const self = calloc(1, sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    self->rom = rom;
+    self->rom_len = rom_len;
+
+    for (size_t page = 0; page < CHEAT_ROM_PAGES; ++page)
+        self->next_patched[page] = 0x8000;
+
+    return self;
+}
+
+// Copies count elements of len bytes each, or returns NULL if there are none
+static void *copy_array(const void *const src, const size_t count,
+                        const size_t len)
+{
+    if (count == 0)
+        return nullptr;
+
+    void *const copy = malloc(count * len);
+    BAIL_IF_NULL(copy);
+
+    memcpy(copy, src, count * len);
+    return copy;
+}
+
+Cheats *Cheats_clone(const Cheats *const src)
+{
+    Cheats *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    *self = *src;
+    self->overlays = copy_array(src->overlays, src->overlay_count,
+                                sizeof(*src->overlays));
+    self->ram_writes = copy_array(src->ram_writes, src->ram_write_count,
+                                  sizeof(*src->ram_writes));
+
+    return self;
+}
+
+void Cheats_destroy(Cheats *const self)
+{
+    if (self == nullptr)
+        return;
+
+    free(self->overlays);
+    free(self->ram_writes);
+    free(self);
+}
+
+static CheatOverlay *Cheats_find_overlay(const Cheats *const self,
+                                         const size_t bank, const u8 page)
+{
+    if (!self->patched[page])
+        return nullptr;
+
+    for (size_t i = 0; i < self->overlay_count; ++i) {
+        CheatOverlay *const overlay = &self->overlays[i];
+
+        if (overlay->bank == bank && overlay->page == page)
+            return overlay;
+    }
+
+    return nullptr;
+}
+
+// Patches the byte at addr when the given bank is mapped there, copying the
+// page into a new overlay first if it has none yet
+static void Cheats_patch(Cheats *const self, const size_t bank, const u16 addr,
+                         const u8 value)
+{
+    const u8 page = addr / CHEAT_PAGE_LEN;
+    CheatOverlay *overlay = Cheats_find_overlay(self, bank, page);
+
+    if (overlay == nullptr) {
+        CheatOverlay *const overlays =
+            realloc(self->overlays,
+                    (self->overlay_count + 1) * sizeof(*self->overlays));
+        BAIL_IF_NULL(overlays);
+        self->overlays = overlays;
+
+        overlay = &overlays[self->overlay_count++];
+        overlay->bank = bank;
+        overlay->page = page;
+
+        const size_t offset = (bank * CHEAT_BANK_LEN) +
+                              ((page * CHEAT_PAGE_LEN) % CHEAT_BANK_LEN);
+        memcpy(overlay->data, &self->rom[offset], CHEAT_PAGE_LEN);
+        self->patched[page] = true;
+
+        for (size_t before = 0; before < page; ++before) {
+            if (self->next_patched[before] > page * CHEAT_PAGE_LEN)
+                self->next_patched[before] = page * CHEAT_PAGE_LEN;
+        }
+    }
+
+    overlay->data[addr % CHEAT_PAGE_LEN] = value;
+}
+
+void Cheats_add(Cheats *const self, const Cheat *const cheat)
+{
+    if (cheat->kind == CheatKind_RamWrite) {
+        Cheat *const ram_writes =
+            realloc(self->ram_writes,
+                    (self->ram_write_count + 1) * sizeof(*self->ram_writes));
+        BAIL_IF_NULL(ram_writes);
+
+        self->ram_writes = ram_writes;
+        ram_writes[self->ram_write_count++] = *cheat;
+        return;
+    }
+
+    // Like the real thing, patches apply whichever bank is mapped, as long as
+    // it holds the compare value if there is one
+    const size_t banks = self->rom_len / CHEAT_BANK_LEN;
+    const size_t offset = cheat->addr % CHEAT_BANK_LEN;
+
+    for (size_t bank = 0; bank < banks; ++bank) {
+        if (!cheat->has_compare ||
+            self->rom[(bank * CHEAT_BANK_LEN) + offset] == cheat->compare)
+            Cheats_patch(self, bank, cheat->addr, cheat->value);
+    }
+}
+
+bool Cheats_patches_rom(const Cheats *const self)
+{
+    return self->overlay_count != 0;
+}
+
+const u8 *Cheats_rom_page(const Cheats *const self, const size_t bank,
+                          const u16 addr)
+{
+    const CheatOverlay *const overlay =
+        Cheats_find_overlay(self, bank, addr / CHEAT_PAGE_LEN);
+
+    return overlay == nullptr ? nullptr : overlay->data;
+}
+
+u16 Cheats_next_patched(const Cheats *const self, const u16 addr)
+{
+    return self->next_patched[addr / CHEAT_PAGE_LEN];
+}
+
+const Cheat *Cheats_ram_writes(const Cheats *const self, size_t *const count)
+{
+    *count = self->ram_write_count;
+    return self->ram_writes;
+}
@@ -0,0 +1,137 @@
+#ifndef GEMU_CHEATS_H
+#define GEMU_CHEATS_H
+
+// Game Genie and GameShark codes for one ROM.
+//
+// Game Genie codes patch ROM, which is done by copying each page they patch
+// into an overlay that the GameBoy maps in place of the ROM page, so that only
+// reads from patched pages are affected. GameShark codes write RAM, which the
+// GameBoy does once per frame (see GameBoy_apply_cheats).
+
+#include "stdinc.h"
+#include <stddef.h>
+
+// Granularity of ROM overlays, the same as that of the GameBoy page tables
+constexpr size_t CHEAT_PAGE_LEN = 0x100;
+
+typedef enum : u8 {
+    CheatKind_RomPatch, // Game Genie
+    CheatKind_RamWrite, // GameShark
+} CheatKind;
+
+typedef struct {
+    CheatKind kind;
+    u16 addr;
+    u8 value;
+    // Whether a ROM patch only applies to banks holding compare at addr
+    bool has_compare;
+    u8 compare;
+} Cheat;
+
+typedef struct Cheats Cheats;
+
+/**
+ * \brief Parses a cheat code.
+ *
+ * Game Genie codes are 6 or 9 hex digits (ABC-DEF or ABC-DEF-GHI, the dashes
+ * being optional) and patch 0000-7FFF. GameShark codes are 8 hex digits
+ * without dashes (TTVVLLHH) and write 8000-FFFF, whatever bank is mapped
+ * there, so their type TT is ignored.
+ *
+ * \param str the code to parse.
+ * \param out where to store the parsed cheat.
+ *
+ * \return whether str is a valid code.
+ */
+[[nodiscard]] bool Cheat_parse(const char *str, Cheat *out);
+
+/**
+ * \brief Creates an empty set of cheats for the given ROM.
+ *
+ * \param rom borrowed ROM data, which must outlive the cheats.
+ * \param rom_len length of rom.
+ *
+ * \return the created cheats, which must be destroyed via Cheats_destroy.
+ *
+ * \sa Cheats_destroy
+ */
+[[nodiscard]] Cheats *Cheats_new(const u8 *rom, size_t rom_len);
+
+/**
+ * \brief Creates a copy of a set of cheats, with overlays of its own.
+ *
+ * \param src the cheats to copy.
+ *
+ * \return the copy, which must be destroyed via Cheats_destroy.
+ *
+ * \sa Cheats_destroy
+ */
+[[nodiscard]] Cheats *Cheats_clone(const Cheats *src);
+
+/**
+ * \brief Destroys a set of cheats along with its overlays.
+ *
+ * \param self the cheats to destroy, or NULL.
+ *
+ * \sa Cheats_new
+ */
+void Cheats_destroy(Cheats *self);
+
+/**
+ * \brief Adds a cheat.
+ *
+ * ROM patches are copied into the overlays of every bank they apply to right
+ * away, which moves the existing overlays, so any pointer from
+ * Cheats_rom_page must be looked up again.
+ *
+ * \param self the cheats to add to.
+ * \param cheat the cheat to add.
+ */
+void Cheats_add(Cheats *self, const Cheat *cheat);
+
+/**
+ * \brief Checks whether any cheat patches ROM.
+ *
+ * \param self the cheats to query.
+ *
+ * \return whether there are any overlays.
+ */
+[[nodiscard]] bool Cheats_patches_rom(const Cheats *self);
+
+/**
+ * \brief Gets the overlay of a page of ROM.
+ *
+ * \param self the cheats to query.
+ * \param bank the ROM bank mapped at addr.
+ * \param addr an address in 0000-7FFF.
+ *
+ * \return the patched CHEAT_PAGE_LEN bytes of the page holding addr, or NULL
+ * if no cheat patches it.
+ */
+[[nodiscard]] const u8 *Cheats_rom_page(const Cheats *self, size_t bank,
+                                        u16 addr);
+
+/**
+ * \brief Finds the next page of ROM that may be patched.
+ *
+ * \param self the cheats to query.
+ * \param addr an address in 0000-7FFF.
+ *
+ * \return the address of the first page after the one holding addr that has
+ * an overlay in any bank, or $8000 if there is none.
+ */
+[[nodiscard]] u16 Cheats_next_patched(const Cheats *self, u16 addr);
+
+/**
+ * \brief Gets the RAM writes among the cheats.
+ *
+ * \param self the cheats to query.
+ * \param count where to store the number of RAM writes.
+ *
+ * \return the RAM writes, in the order they were added, valid until the next
+ * call to Cheats_add.
+ */
+[[nodiscard]] const Cheat *Cheats_ram_writes(const Cheats *self,
+                                             size_t *count);
+
+#endif
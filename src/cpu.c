@@ -1,4 +1,5 @@
 #include "cpu.h"
+#include "cpu_bus.h"
 #include "macros.h"
 #include "instructions.h"
 #include "num.h"
@@ -15,6 +16,8 @@ Cpu Cpu_new(void)
         .l = 0,
         .a = 0,
         .f = 0,
+        .lazy_flags = {.op = CpuFlagsOp_None},
+        .fetch = nullptr,
         .pc = 0,
         .sp = 0,
         .mode = CpuMode_Running,
@@ -24,214 +27,77 @@ Cpu Cpu_new(void)
     };
 }
 
-bool Cpu_read_cc(const Cpu *const self, const CpuTableCc cc)
+static bool CpuLazyFlags_n(const CpuLazyFlags *const flags)
 {
-    switch (cc) {
-    case CpuTableCc_NZ:
-        return (self->f & CpuFlag_Z) == 0;
-    case CpuTableCc_Z:
-        return (self->f & CpuFlag_Z) != 0;
-    case CpuTableCc_NC:
-        return (self->f & CpuFlag_C) == 0;
-    case CpuTableCc_C:
-        return (self->f & CpuFlag_C) != 0;
+    switch (flags->op) {
+    case CpuFlagsOp_Sub:
+    case CpuFlagsOp_Sbc:
+    case CpuFlagsOp_Dec:
+        return true;
     default:
-        BAIL("invalid cc: %i", cc);
+        return false;
     }
 }
 
-u16 Cpu_read_rp(const Cpu *const self, const CpuTableRp rp)
-{
-    switch (rp) {
-    case CpuTableRp_BC:
-        return concat_u16(self->b, self->c);
-    case CpuTableRp_DE:
-        return concat_u16(self->d, self->e);
-    case CpuTableRp_HL:
-        return concat_u16(self->h, self->l);
-    case CpuTableRp_SP:
-        return self->sp;
+static bool CpuLazyFlags_h(const CpuLazyFlags *const flags)
+{
+    const u8 lhs_lo = flags->lhs & 0xF;
+    const u8 rhs_lo = flags->rhs & 0xF;
+
+    switch (flags->op) {
+    case CpuFlagsOp_Add:
+        return lhs_lo + rhs_lo > 0xF;
+    case CpuFlagsOp_Adc:
+        return lhs_lo + rhs_lo + flags->carry > 0xF;
+    case CpuFlagsOp_Sub:
+        return lhs_lo < rhs_lo;
+    case CpuFlagsOp_Sbc:
+        return lhs_lo < rhs_lo + flags->carry;
+    case CpuFlagsOp_Inc:
+        return (flags->result & 0xF) == 0;
+    case CpuFlagsOp_Dec:
+        return (flags->result & 0xF) == 0xF;
+    case CpuFlagsOp_And:
+    case CpuFlagsOp_Bit:
+        return true;
     default:
-        BAIL("invalid rp: %i", rp);
+        return false;
     }
 }
 
-void Cpu_write_rp(Cpu *const self, const CpuTableRp rp, const u16 value)
+u8 Cpu_read_f(const Cpu *const self)
 {
-    switch (rp) {
-    case CpuTableRp_BC:
-        self->b = value >> 8;
-        self->c = value & 0xFF;
-        break;
-    case CpuTableRp_DE:
-        self->d = value >> 8;
-        self->e = value & 0xFF;
-        break;
-    case CpuTableRp_HL:
-        self->h = value >> 8;
-        self->l = value & 0xFF;
-        break;
-    case CpuTableRp_SP:
-        self->sp = value;
-        break;
-    default:
-        BAIL("invalid rp: %i", rp);
-    }
-}
+    if (self->lazy_flags.op == CpuFlagsOp_None)
+        return self->f;
 
-u16 Cpu_read_rp2(const Cpu *const self, const CpuTableRp rp)
-{
-    switch (rp) {
-    case CpuTableRp2_BC:
-        return concat_u16(self->b, self->c);
-    case CpuTableRp2_DE:
-        return concat_u16(self->d, self->e);
-    case CpuTableRp2_HL:
-        return concat_u16(self->h, self->l);
-    case CpuTableRp2_AF:
-        return concat_u16(self->a, self->f);
-    default:
-        BAIL("invalid rp2: %i", rp);
-    }
-}
+    const CpuLazyFlags *const flags = &self->lazy_flags;
 
-void Cpu_write_rp2(Cpu *const self, const CpuTableRp rp, const u16 value)
-{
-    switch (rp) {
-    case CpuTableRp2_BC:
-        self->b = value >> 8;
-        self->c = value & 0xFF;
-        break;
-    case CpuTableRp2_DE:
-        self->d = value >> 8;
-        self->e = value & 0xFF;
-        break;
-    case CpuTableRp2_HL:
-        self->h = value >> 8;
-        self->l = value & 0xFF;
-        break;
-    case CpuTableRp2_AF:
-        self->a = value >> 8;
-        self->f = value & 0xF0;
-        break;
-    default:
-        BAIL("invalid rp2: %i", rp);
-    }
+    // Z and C are computed by Cpu_read_flag in cpu.h
+    return (Cpu_read_flag(self, CpuFlag_Z) ? CpuFlag_Z : 0) |
+           (CpuLazyFlags_n(flags) ? CpuFlag_N : 0) |
+           (CpuLazyFlags_h(flags) ? CpuFlag_H : 0) |
+           (Cpu_read_flag(self, CpuFlag_C) ? CpuFlag_C : 0);
 }
 
-u8 Cpu_read_mem(Cpu *const self, const Memory *const mem, const u16 addr)
-{
-    self->cycle_count++;
-    return mem->read(mem->ctx, addr);
-}
+extern inline bool Cpu_read_flag(const Cpu *self, CpuFlag flag);
 
-u16 Cpu_read_mem_u16(Cpu *const self, const Memory *const mem, const u16 addr)
-{
-    const u8 lo = Cpu_read_mem(self, mem, addr);
-    const u8 hi = Cpu_read_mem(self, mem, addr + 1);
-    return concat_u16(hi, lo);
-}
+extern inline void Cpu_write_f(Cpu *self, u8 value);
 
-void Cpu_write_mem(Cpu *const self, Memory *const mem, const u16 addr,
-                   const u8 value)
-{
-    self->cycle_count++;
-    mem->write(mem->ctx, addr, value);
-}
+extern inline bool Cpu_read_cc(const Cpu *self, CpuTableCc cc);
 
-void Cpu_write_mem_u16(Cpu *const self, Memory *const mem, const u16 addr,
-                       const u16 value)
-{
-    Cpu_write_mem(self, mem, addr, value & 0xFF);
-    Cpu_write_mem(self, mem, addr + 1, value >> 8);
-}
+extern inline u16 Cpu_read_rp(const Cpu *self, CpuTableRp rp);
 
-u8 Cpu_read_pc(Cpu *const self, const Memory *const mem)
-{
-    const u8 value = Cpu_read_mem(self, mem, self->pc);
-    self->pc++;
-    return value;
-}
+extern inline void Cpu_write_rp(Cpu *self, CpuTableRp rp, u16 value);
 
-u16 Cpu_read_pc_u16(Cpu *const self, const Memory *const mem)
-{
-    const u16 value = Cpu_read_mem_u16(self, mem, self->pc);
-    self->pc += 2;
-    return value;
-}
+extern inline u16 Cpu_read_rp2(const Cpu *self, CpuTableRp2 rp);
 
-void Cpu_stack_push_u16(Cpu *const self, Memory *const mem, const u16 value)
-{
-    self->sp -= 2;
-    Cpu_write_mem_u16(self, mem, self->sp, value);
-    self->cycle_count++;
-}
-
-u16 Cpu_stack_pop_u16(Cpu *const self, const Memory *mem)
-{
-    const u16 value = Cpu_read_mem_u16(self, mem, self->sp);
-    self->sp += 2;
-    return value;
-}
-
-u8 Cpu_read_r(Cpu *const self, const Memory *const mem, const CpuTableR r)
-{
-    switch (r) {
-    case CpuTableR_B:
-        return self->b;
-    case CpuTableR_C:
-        return self->c;
-    case CpuTableR_D:
-        return self->d;
-    case CpuTableR_E:
-        return self->e;
-    case CpuTableR_H:
-        return self->h;
-    case CpuTableR_L:
-        return self->l;
-    case CpuTableR_HL: {
-        const u16 addr = Cpu_read_rp(self, CpuTableRp_HL);
-        return Cpu_read_mem(self, mem, addr);
-    }
-    case CpuTableR_A:
-        return self->a;
-    default:
-        BAIL("invalid cpu r: %i", r);
-    }
-}
+extern inline void Cpu_write_rp2(Cpu *self, CpuTableRp2 rp, u16 value);
 
-void Cpu_write_r(Cpu *const self, Memory *const mem, const CpuTableR r,
-                 const u8 value)
+static void Cpu_enable_queued_ime(Cpu *const self)
 {
-    switch (r) {
-    case CpuTableR_B:
-        self->b = value;
-        break;
-    case CpuTableR_C:
-        self->c = value;
-        break;
-    case CpuTableR_D:
-        self->d = value;
-        break;
-    case CpuTableR_E:
-        self->e = value;
-        break;
-    case CpuTableR_H:
-        self->h = value;
-        break;
-    case CpuTableR_L:
-        self->l = value;
-        break;
-    case CpuTableR_HL: {
-        const u16 addr = Cpu_read_rp(self, CpuTableRp_HL);
-        Cpu_write_mem(self, mem, addr, value);
-        break;
-    }
-    case CpuTableR_A:
-        self->a = value;
-        break;
-    default:
-        BAIL("[GameBoy_write_r] invalid CpuTableR r: %i", r);
+    if (self->queued_ime) {
+        self->ime = true;
+        self->queued_ime = false;
     }
 }
 
@@ -242,15 +108,23 @@ void Cpu_tick(Cpu *const self, Memory *const mem)
         return;
     }
 
-    if (self->queued_ime) {
-        self->ime = true;
-        self->queued_ime = false;
-    }
+    Cpu_enable_queued_ime(self);
 
     const u8 opcode = Cpu_read_pc(self, mem);
     Cpu_execute(self, mem, opcode);
 }
 
+void Cpu_tick_decoded(Cpu *const self, Memory *const mem,
+                      const CpuOpHandler handler, const u8 *const code)
+{
+    Cpu_enable_queued_ime(self);
+
+    self->fetch = code;
+    Cpu_read_pc(self, mem); // The opcode, already decoded into handler
+    handler(self, mem);
+    self->fetch = nullptr;
+}
+
 void Cpu_interrupt(Cpu *const self, Memory *const mem,
                    const u8 handler_location)
 {
@@ -1,6 +1,7 @@
 #ifndef GEMU_CPU_H
 #define GEMU_CPU_H
 
+#include "num.h"
 #include "stdinc.h"
 
 typedef enum : u8 {
@@ -53,6 +54,41 @@ typedef enum : u8 {
     CpuTableAlu_Cp = 7,
 } CpuTableAlu;
 
+/**
+ * The kind of operation that last set the flags, for lazy flag evaluation.
+ */
+typedef enum : u8 {
+    CpuFlagsOp_None, // Flags are stored as-is in Cpu.f
+    CpuFlagsOp_Add,
+    CpuFlagsOp_Adc,
+    CpuFlagsOp_Sub, // Also used for cp
+    CpuFlagsOp_Sbc,
+    CpuFlagsOp_And,
+    CpuFlagsOp_Or, // Also used for xor and swap, which only ever set Z
+    CpuFlagsOp_Inc,
+    CpuFlagsOp_Dec,
+    CpuFlagsOp_Shift, // CB-prefixed rotates and shifts
+    CpuFlagsOp_Bit,
+} CpuFlagsOp;
+
+/**
+ * Enough information about the last flag-setting operation to compute Z/N/H/C
+ * on demand.
+ *
+ * carry holds the carry-in for adc/sbc, the carry-out for shifts, and the
+ * preserved C flag for inc/dec/bit.
+ */
+typedef struct {
+    CpuFlagsOp op;
+    u8 lhs;
+    u8 rhs;
+    u8 carry;
+    u8 result;
+} CpuLazyFlags;
+
+// What the CPU reads and writes through. The functions used for ctx are fixed
+// when the CPU core is compiled (see cpu_bus.h), so read and write are only
+// called with GEMU_DYNAMIC_BUS.
 typedef struct {
     void *ctx;
     u8 (*read)(const void *ctx, u16 addr);
@@ -65,15 +101,52 @@ typedef enum : u8 {
     CpuMode_Stopped,
 } CpuMode;
 
+/**
+ * XORed into a CpuTableR index to find that register in Cpu.r.
+ *
+ * The byte views are laid out so that each register pair lines up with its
+ * u16 in Cpu.rp, which swaps the high and low halves on little-endian hosts.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr u8 CPU_R_SWIZZLE = 0;
+#else
+constexpr u8 CPU_R_SWIZZLE = 1;
+#endif
+
 typedef struct {
-    u8 b;
-    u8 c;
-    u8 d;
-    u8 e;
-    u8 h;
-    u8 l;
-    u8 a;
-    u8 f;
+    union {
+        struct {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            u8 b;
+            u8 c;
+            u8 d;
+            u8 e;
+            u8 h;
+            u8 l;
+            u8 f;
+            u8 a;
+#else
+            u8 c;
+            u8 b;
+            u8 e;
+            u8 d;
+            u8 l;
+            u8 h;
+            u8 a;
+            u8 f;
+#endif
+        };
+        // Indexed by CpuTableR ^ CPU_R_SWIZZLE. The CpuTableR_HL slot aliases
+        // F, so it must never be accessed through here.
+        u8 r[8];
+        // Indexed by CpuTableRp/CpuTableRp2. The last slot holds A and F, not
+        // SP, so only BC/DE/HL may be accessed through here.
+        u16 rp[4];
+    };
+    CpuLazyFlags lazy_flags;
+    // When non-null, the bytes of the current instruction are read from here
+    // instead of through the bus (see Cpu_tick_decoded)
+    const u8 *fetch;
     u16 sp;
     u16 pc;
     CpuMode mode;
@@ -82,40 +155,145 @@ typedef struct {
     int cycle_count;
 } Cpu;
 
-[[nodiscard]] Cpu Cpu_new(void);
-
-[[nodiscard]] bool Cpu_read_cc(const Cpu *self, CpuTableCc cc);
+typedef void (*CpuOpHandler)(Cpu *cpu, Memory *mem);
 
-[[nodiscard]] u16 Cpu_read_rp(const Cpu *self, CpuTableRp rp);
+[[nodiscard]] Cpu Cpu_new(void);
 
-void Cpu_write_rp(Cpu *self, CpuTableRp rp, u16 value);
+/**
+ * \brief Reads the F register, computing any pending lazy flags.
+ *
+ * Cpu.f must not be read directly, since it is stale whenever
+ * Cpu.lazy_flags.op is not CpuFlagsOp_None.
+ *
+ * \param self the CPU to read from.
+ *
+ * \return the current value of F.
+ *
+ * \sa Cpu_write_f
+ */
+[[nodiscard]] u8 Cpu_read_f(const Cpu *self);
 
-[[nodiscard]] u16 Cpu_read_rp2(const Cpu *self, CpuTableRp rp);
+/**
+ * \brief Reads a single flag, computing only what is needed to get it.
+ *
+ * Z and C are computed inline, since conditional jumps read them constantly.
+ *
+ * \param self the CPU to read from.
+ * \param flag the flag to read.
+ *
+ * \return whether flag is set.
+ */
+[[nodiscard]] inline bool Cpu_read_flag(const Cpu *const self,
+                                        const CpuFlag flag)
+{
+    const CpuLazyFlags *const flags = &self->lazy_flags;
 
-void Cpu_write_rp2(Cpu *self, CpuTableRp rp, u16 value);
+    if (flags->op == CpuFlagsOp_None)
+        return (self->f & flag) != 0;
 
-u8 Cpu_read_mem(Cpu *self, const Memory *mem, u16 addr);
+    if (flag == CpuFlag_Z)
+        return flags->result == 0;
 
-u16 Cpu_read_mem_u16(Cpu *self, const Memory *mem, u16 addr);
+    if (flag != CpuFlag_C)
+        return (Cpu_read_f(self) & flag) != 0;
 
-void Cpu_write_mem(Cpu *self, Memory *mem, u16 addr, u8 value);
+    switch (flags->op) {
+    case CpuFlagsOp_Add:
+        return flags->lhs + flags->rhs > 0xFF;
+    case CpuFlagsOp_Adc:
+        return flags->lhs + flags->rhs + flags->carry > 0xFF;
+    case CpuFlagsOp_Sub:
+        return flags->rhs > flags->lhs;
+    case CpuFlagsOp_Sbc:
+        return flags->lhs < flags->rhs + flags->carry;
+    case CpuFlagsOp_And:
+    case CpuFlagsOp_Or:
+        return false;
+    default:
+        return flags->carry != 0;
+    }
+}
 
-void Cpu_write_mem_u16(Cpu *self, Memory *mem, u16 addr, u16 value);
+/**
+ * \brief Overwrites the F register, discarding any pending lazy flags.
+ *
+ * The lower nibble of value is ignored, since it is always zero on hardware.
+ *
+ * \param self the CPU to write to.
+ * \param value the new value of F.
+ *
+ * \sa Cpu_read_f
+ */
+inline void Cpu_write_f(Cpu *const self, const u8 value)
+{
+    self->f = value & 0xF0;
+    self->lazy_flags.op = CpuFlagsOp_None;
+}
 
-u8 Cpu_read_pc(Cpu *self, const Memory *mem);
+[[nodiscard]] inline bool Cpu_read_cc(const Cpu *const self,
+                                      const CpuTableCc cc)
+{
+    // NZ/Z test Z and NC/C test C; the low bit says whether the flag is
+    // expected to be set.
+    const CpuFlag flag = cc < CpuTableCc_NC ? CpuFlag_Z : CpuFlag_C;
+    return Cpu_read_flag(self, flag) == ((cc & 1) != 0);
+}
 
-u16 Cpu_read_pc_u16(Cpu *self, const Memory *mem);
+[[nodiscard]] inline u16 Cpu_read_rp(const Cpu *const self,
+                                     const CpuTableRp rp)
+{
+    return rp == CpuTableRp_SP ? self->sp : self->rp[rp];
+}
 
-u8 Cpu_read_r(Cpu *self, const Memory *mem, CpuTableR r);
+inline void Cpu_write_rp(Cpu *const self, const CpuTableRp rp,
+                         const u16 value)
+{
+    if (rp == CpuTableRp_SP) {
+        self->sp = value;
+    } else {
+        self->rp[rp] = value;
+    }
+}
 
-void Cpu_write_r(Cpu *self, Memory *mem, CpuTableR r, u8 value);
+[[nodiscard]] inline u16 Cpu_read_rp2(const Cpu *const self,
+                                      const CpuTableRp2 rp)
+{
+    if (rp == CpuTableRp2_AF)
+        return concat_u16(self->a, Cpu_read_f(self));
 
-void Cpu_stack_push_u16(Cpu *self, Memory *mem, u16 value);
+    return self->rp[rp];
+}
 
-u16 Cpu_stack_pop_u16(Cpu *self, const Memory *mem);
+inline void Cpu_write_rp2(Cpu *const self, const CpuTableRp2 rp,
+                          const u16 value)
+{
+    if (rp == CpuTableRp2_AF) {
+        self->a = value >> 8;
+        Cpu_write_f(self, value & 0xFF);
+    } else {
+        self->rp[rp] = value;
+    }
+}
 
 void Cpu_tick(Cpu *self, Memory *mem);
 
+/**
+ * \brief Runs one instruction that has already been decoded.
+ *
+ * Behaves like Cpu_tick, except that the opcode and its operands are read
+ * straight from code rather than fetched through mem. The CPU must be in
+ * CpuMode_Running.
+ *
+ * \param self the CPU to run.
+ * \param mem the memory used for everything but instruction fetches.
+ * \param handler the handler for the opcode at code[0].
+ * \param code the bytes of the instruction at Cpu.pc.
+ *
+ * \sa Cpu_tick
+ */
+void Cpu_tick_decoded(Cpu *self, Memory *mem, CpuOpHandler handler,
+                      const u8 *code);
+
 void Cpu_interrupt(Cpu *self, Memory *mem, u8 handler_location);
 
 #endif
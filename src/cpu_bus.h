@@ -0,0 +1,122 @@
+#ifndef GEMU_CPU_BUS_H
+#define GEMU_CPU_BUS_H
+
+// Memory accesses of the CPU core, as used by cpu.c, the opcode handlers in
+// instructions.c and ahead-of-time compiled ROM images.
+//
+// The core is compiled against one concrete bus, named by GEMU_BUS (see
+// gemu_lib in CMakeLists.txt and the CPU tests in tests/CMakeLists.txt). That
+// header defines
+//
+//     static inline u8 Bus_read(const Memory *mem, u16 addr);
+//     static inline void Bus_write(Memory *mem, u16 addr, u8 value);
+//
+// for whatever Memory.ctx points to, so that every access can be inlined into
+// the instruction handlers. With GEMU_DYNAMIC_BUS, accesses go through the
+// Memory function pointers instead, so that one build of the core can run
+// against any bus.
+
+#include "cpu.h"
+#include "num.h"
+#include "stdinc.h"
+
+#if defined(GEMU_DYNAMIC_BUS)
+static inline u8 Bus_read(const Memory *const mem, const u16 addr)
+{
+    return mem->read(mem->ctx, addr);
+}
+
+static inline void Bus_write(Memory *const mem, const u16 addr, const u8 value)
+{
+    mem->write(mem->ctx, addr, value);
+}
+#elif defined(GEMU_BUS)
+#include GEMU_BUS
+#else
+#error "The CPU core needs either GEMU_BUS or GEMU_DYNAMIC_BUS"
+#endif
+
+static inline u8 Cpu_read_mem(Cpu *const self, const Memory *const mem,
+                              const u16 addr)
+{
+    self->cycle_count++;
+    return Bus_read(mem, addr);
+}
+
+static inline u16 Cpu_read_mem_u16(Cpu *const self, const Memory *const mem,
+                                   const u16 addr)
+{
+    const u8 lo = Cpu_read_mem(self, mem, addr);
+    const u8 hi = Cpu_read_mem(self, mem, addr + 1);
+    return concat_u16(hi, lo);
+}
+
+static inline void Cpu_write_mem(Cpu *const self, Memory *const mem,
+                                 const u16 addr, const u8 value)
+{
+    self->cycle_count++;
+    Bus_write(mem, addr, value);
+}
+
+static inline void Cpu_write_mem_u16(Cpu *const self, Memory *const mem,
+                                     const u16 addr, const u16 value)
+{
+    Cpu_write_mem(self, mem, addr, value & 0xFF);
+    Cpu_write_mem(self, mem, addr + 1, value >> 8);
+}
+
+static inline u8 Cpu_read_pc(Cpu *const self, const Memory *const mem)
+{
+    if (self->fetch != nullptr) {
+        self->cycle_count++;
+        self->pc++;
+        return *self->fetch++;
+    }
+
+    const u8 value = Cpu_read_mem(self, mem, self->pc);
+    self->pc++;
+    return value;
+}
+
+static inline u16 Cpu_read_pc_u16(Cpu *const self, const Memory *const mem)
+{
+    const u8 lo = Cpu_read_pc(self, mem);
+    const u8 hi = Cpu_read_pc(self, mem);
+    return concat_u16(hi, lo);
+}
+
+static inline u8 Cpu_read_r(Cpu *const self, const Memory *const mem,
+                            const CpuTableR r)
+{
+    if (r == CpuTableR_HL)
+        return Cpu_read_mem(self, mem, self->rp[CpuTableRp_HL]);
+
+    return self->r[r ^ CPU_R_SWIZZLE];
+}
+
+static inline void Cpu_write_r(Cpu *const self, Memory *const mem,
+                               const CpuTableR r, const u8 value)
+{
+    if (r == CpuTableR_HL) {
+        Cpu_write_mem(self, mem, self->rp[CpuTableRp_HL], value);
+    } else {
+        self->r[r ^ CPU_R_SWIZZLE] = value;
+    }
+}
+
+static inline void Cpu_stack_push_u16(Cpu *const self, Memory *const mem,
+                                      const u16 value)
+{
+    self->sp -= 2;
+    Cpu_write_mem_u16(self, mem, self->sp, value);
+    self->cycle_count++;
+}
+
+static inline u16 Cpu_stack_pop_u16(Cpu *const self, const Memory *const mem)
+{
+    const u16 value = Cpu_read_mem_u16(self, mem, self->sp);
+    self->sp += 2;
+    return value;
+}
+
+#endif
@@ -20,6 +20,27 @@ bool CartridgeType_has_ram(const CartridgeType self)
            self == CartridgeType_Huc1RamBattery;
 }
 
+bool CartridgeType_has_battery(const CartridgeType self)
+{
+    return self == CartridgeType_Mbc1RamBattery ||
+           self == CartridgeType_Mbc2Battery ||
+           self == CartridgeType_RomRamBattery ||
+           self == CartridgeType_Mmm01RamBattery ||
+           self == CartridgeType_Mbc3TimerBattery ||
+           self == CartridgeType_Mbc3TimerRamBattery ||
+           self == CartridgeType_Mbc3RamBattery ||
+           self == CartridgeType_Mbc5RamBattery ||
+           self == CartridgeType_Mbc5RumbleRamBattery ||
+           self == CartridgeType_Mbc7SensorRumbleRamBattery ||
+           self == CartridgeType_Huc1RamBattery;
+}
+
+bool CartridgeType_has_timer(const CartridgeType self)
+{
+    return self == CartridgeType_Mbc3TimerBattery ||
+           self == CartridgeType_Mbc3TimerRamBattery;
+}
+
 size_t rom_banks_from_size_code(const u8 rom_size_code)
 {
     BAIL_IF(rom_size_code > 0x08, "invalid ROM size code: $%02X",
@@ -54,6 +54,10 @@ typedef enum : u8 {
 
 bool CartridgeType_has_ram(CartridgeType self);
 
+bool CartridgeType_has_battery(CartridgeType self);
+
+bool CartridgeType_has_timer(CartridgeType self);
+
 size_t rom_banks_from_size_code(u8 rom_size_code);
 
 size_t ram_banks_from_size_code(u8 ram_size_code);
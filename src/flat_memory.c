@@ -0,0 +1,217 @@
+#define _GNU_SOURCE // memfd_create
+
+#include "flat_memory.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+constexpr size_t FLAT_WINDOW_LEN = 0x10000;
+constexpr size_t FLAT_PAGE_COUNT = FLAT_WINDOW_LEN / FLAT_PAGE_LEN;
+
+// VRAM, WRAM, cartridge RAM, ROM and a save file, with room to spare
+constexpr size_t FLAT_MAX_REGIONS = 8;
+
+// Memory that can be mapped into the window
+typedef struct {
+    const u8 *mem; // NULL if the slot is free
+    size_t len;
+    int fd;     // mem is mapped from the start of this
+    bool owned; // Whether mem and fd came from FlatMemory_alloc
+} FlatRegion;
+
+typedef enum : u8 {
+    FlatPage_Unmapped,
+    FlatPage_Shared,
+    FlatPage_Copy,
+} FlatPageKind;
+
+typedef struct {
+    FlatPageKind kind;
+    int fd;        // For FlatPage_Shared
+    size_t offset; // Into fd
+} FlatPage;
+
+struct FlatMemory {
+    u8 *window;
+    FlatRegion regions[FLAT_MAX_REGIONS];
+    FlatPage pages[FLAT_PAGE_COUNT];
+};
+
+FlatMemory *FlatMemory_new(void)
+{
+    BAIL_IF(sysconf(_SC_PAGESIZE) != FLAT_PAGE_LEN,
+            "Flat memory needs 4 KiB host pages");
+
+    FlatMemory *const self = calloc(1, sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    // Nothing is readable until it is mapped
+    void *const window = mmap(nullptr, FLAT_WINDOW_LEN, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    BAIL_IF(window == MAP_FAILED, "Could not reserve flat memory window");
+
+    self->window = window;
+    return self;
+}
+
+void FlatMemory_destroy(FlatMemory *const self)
+{
+    if (self == nullptr)
+        return;
+
+    for (size_t i = 0; i < FLAT_MAX_REGIONS; ++i) {
+        const FlatRegion *const region = &self->regions[i];
+
+        if (region->mem != nullptr && region->owned) {
+            munmap((void *)region->mem, region->len);
+            close(region->fd);
+        }
+    }
+
+    munmap(self->window, FLAT_WINDOW_LEN);
+    free(self);
+}
+
+const u8 *FlatMemory_window(const FlatMemory *const self)
+{
+    return self->window;
+}
+
+static void FlatMemory_add_region(FlatMemory *const self, const u8 *const mem,
+                                  const size_t len, const int fd,
+                                  const bool owned)
+{
+    for (size_t i = 0; i < FLAT_MAX_REGIONS; ++i) {
+        FlatRegion *const region = &self->regions[i];
+
+        if (region->mem == nullptr) {
+            *region = (FlatRegion){
+                .mem = mem, .len = len, .fd = fd, .owned = owned};
+            return;
+        }
+    }
+
+    BAIL("Too many regions of flat memory");
+}
+
+// The region mem is in, or NULL if there is none
+static FlatRegion *FlatMemory_find_region(FlatMemory *const self,
+                                          const u8 *const mem)
+{
+    for (size_t i = 0; i < FLAT_MAX_REGIONS; ++i) {
+        FlatRegion *const region = &self->regions[i];
+
+        if (region->mem != nullptr && mem >= region->mem &&
+            mem < region->mem + region->len)
+            return region;
+    }
+
+    return nullptr;
+}
+
+// Forgets about the region starting at mem, whose fd may be reused from now on
+static FlatRegion FlatMemory_remove_region(FlatMemory *const self,
+                                           const u8 *const mem)
+{
+    FlatRegion *const region = FlatMemory_find_region(self, mem);
+    BAIL_IF(region == nullptr || region->mem != mem);
+
+    for (size_t i = 0; i < FLAT_PAGE_COUNT; ++i) {
+        FlatPage *const page = &self->pages[i];
+
+        if (page->kind == FlatPage_Shared && page->fd == region->fd)
+            page->kind = FlatPage_Copy;
+    }
+
+    const FlatRegion removed = *region;
+    region->mem = nullptr;
+    return removed;
+}
+
+u8 *FlatMemory_alloc(FlatMemory *const self, const size_t len)
+{
+    const int fd = memfd_create("gemu", MFD_CLOEXEC);
+    BAIL_IF(fd < 0, "Could not create shared memory: %s", strerror(errno));
+    BAIL_IF(ftruncate(fd, len) != 0, "Could not size shared memory: %s",
+            strerror(errno));
+
+    void *const mem =
+        mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    BAIL_IF(mem == MAP_FAILED, "Could not map shared memory: %s",
+            strerror(errno));
+
+    FlatMemory_add_region(self, mem, len, fd, true);
+    return mem;
+}
+
+void FlatMemory_free(FlatMemory *const self, u8 *const mem)
+{
+    if (mem == nullptr)
+        return;
+
+    const FlatRegion region = FlatMemory_remove_region(self, mem);
+    munmap(mem, region.len);
+    close(region.fd);
+}
+
+void FlatMemory_share(FlatMemory *const self, const u8 *const mem,
+                      const size_t len, const int fd)
+{
+    FlatMemory_add_region(self, mem, len, fd, false);
+}
+
+void FlatMemory_unshare(FlatMemory *const self, const u8 *const mem)
+{
+    if (mem != nullptr)
+        FlatMemory_remove_region(self, mem);
+}
+
+bool FlatMemory_map(FlatMemory *const self, const u16 addr, const u8 *const mem)
+{
+    const FlatRegion *const region = FlatMemory_find_region(self, mem);
+
+    if (region == nullptr || mem + FLAT_PAGE_LEN > region->mem + region->len)
+        return false;
+
+    FlatPage *const page = &self->pages[addr / FLAT_PAGE_LEN];
+    const size_t offset = mem - region->mem;
+
+    if (page->kind == FlatPage_Shared && page->fd == region->fd &&
+        page->offset == offset)
+        return true;
+
+    void *const mapped = mmap(&self->window[addr], FLAT_PAGE_LEN, PROT_READ,
+                              MAP_SHARED | MAP_FIXED, region->fd, offset);
+    BAIL_IF(mapped == MAP_FAILED, "Could not map flat memory: %s",
+            strerror(errno));
+
+    *page = (FlatPage){
+        .kind = FlatPage_Shared, .fd = region->fd, .offset = offset};
+    return true;
+}
+
+void FlatMemory_map_copy(FlatMemory *const self, const u16 addr,
+                         const u8 *const data)
+{
+    FlatPage *const page = &self->pages[addr / FLAT_PAGE_LEN];
+    u8 *const dest = &self->window[addr];
+
+    if (page->kind == FlatPage_Copy && memcmp(dest, data, FLAT_PAGE_LEN) == 0)
+        return;
+
+    void *const mapped =
+        mmap(dest, FLAT_PAGE_LEN, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    BAIL_IF(mapped == MAP_FAILED, "Could not map flat memory: %s",
+            strerror(errno));
+
+    memcpy(dest, data, FLAT_PAGE_LEN);
+    BAIL_IF(mprotect(dest, FLAT_PAGE_LEN, PROT_READ) != 0);
+
+    *page = (FlatPage){.kind = FlatPage_Copy, .fd = -1, .offset = 0};
+}
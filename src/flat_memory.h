@@ -0,0 +1,135 @@
+#ifndef GEMU_FLAT_MEMORY_H
+#define GEMU_FLAT_MEMORY_H
+
+// A 64 KiB host window laid out like the address space of a GameBoy, so that
+// reading guest memory takes a single load from window + addr (see
+// GEMU_FLAT_MEMORY in CMakeLists.txt).
+//
+// The window is read-only and made of 4 KiB pages, each mapping either a page
+// of shared memory (a memfd or file the same memory is mapped from elsewhere,
+// so that writes there show up in the window), or a private copy of read-only
+// data. Mirrors such as Echo RAM are the same shared pages mapped twice.
+
+#include "stdinc.h"
+#include <stddef.h>
+
+constexpr size_t FLAT_PAGE_LEN = 0x1000;
+
+typedef struct FlatMemory FlatMemory;
+
+/**
+ * \brief Reserves a window with nothing mapped in it yet.
+ *
+ * Will bail if the host pages are not 4 KiB, since the regions of the GameBoy
+ * address space would not line up with them.
+ *
+ * \return the created FlatMemory, which must be destroyed via
+ * FlatMemory_destroy.
+ *
+ * \sa FlatMemory_destroy
+ */
+[[nodiscard]] FlatMemory *FlatMemory_new(void);
+
+/**
+ * \brief Unmaps the window and frees all memory allocated from it.
+ *
+ * \param self the FlatMemory to destroy, or NULL.
+ *
+ * \sa FlatMemory_new
+ */
+void FlatMemory_destroy(FlatMemory *self);
+
+/**
+ * \brief Gets the window of the given FlatMemory.
+ *
+ * \param self the FlatMemory to query.
+ *
+ * \return the 64 KiB window, which must never be written to.
+ */
+[[nodiscard]] const u8 *FlatMemory_window(const FlatMemory *self);
+
+/**
+ * \brief Allocates zeroed shared memory that can be mapped into the window.
+ *
+ * \param self the FlatMemory to allocate from.
+ * \param len the length to allocate, a multiple of FLAT_PAGE_LEN.
+ *
+ * \return the allocated memory, which must be freed via FlatMemory_free.
+ *
+ * \sa FlatMemory_free
+ */
+[[nodiscard]] u8 *FlatMemory_alloc(FlatMemory *self, size_t len);
+
+/**
+ * \brief Frees shared memory from FlatMemory_alloc.
+ *
+ * Window pages still mapping it keep their contents until they are mapped
+ * again.
+ *
+ * \param self the FlatMemory the memory was allocated from.
+ * \param mem the memory to free, or NULL.
+ *
+ * \sa FlatMemory_alloc
+ */
+void FlatMemory_free(FlatMemory *self, u8 *mem);
+
+/**
+ * \brief Allows memory mapped from the given file to be mapped into the
+ * window.
+ *
+ * \param self the FlatMemory to share the memory with.
+ * \param mem borrowed memory mapped (shared or read-only) from the start of
+ * fd.
+ * \param len the length of mem.
+ * \param fd the file mem is mapped from, which must stay open until
+ * FlatMemory_unshare.
+ *
+ * \sa FlatMemory_unshare
+ */
+void FlatMemory_share(FlatMemory *self, const u8 *mem, size_t len, int fd);
+
+/**
+ * \brief Stops sharing memory from FlatMemory_share.
+ *
+ * As with FlatMemory_free, window pages still mapping it keep their contents
+ * until they are mapped again.
+ *
+ * \param self the FlatMemory the memory was shared with.
+ * \param mem the memory to stop sharing, or NULL.
+ *
+ * \sa FlatMemory_share
+ */
+void FlatMemory_unshare(FlatMemory *self, const u8 *mem);
+
+/**
+ * \brief Maps a page of allocated or shared memory into the window.
+ *
+ * Mapping the same memory as before is free.
+ *
+ * \param self the FlatMemory to map into.
+ * \param addr the address of the page in the window, a multiple of
+ * FLAT_PAGE_LEN.
+ * \param mem the FLAT_PAGE_LEN bytes to map, which must start a page of
+ * memory from FlatMemory_alloc or FlatMemory_share.
+ *
+ * \return whether mem was allocated or shared, and thus mapped.
+ *
+ * \sa FlatMemory_map_copy
+ */
+bool FlatMemory_map(FlatMemory *self, u16 addr, const u8 *mem);
+
+/**
+ * \brief Maps a private copy of the given data into the window.
+ *
+ * Copying the same data as what the page already holds is cheap.
+ *
+ * \param self the FlatMemory to map into.
+ * \param addr the address of the page in the window, a multiple of
+ * FLAT_PAGE_LEN.
+ * \param data the FLAT_PAGE_LEN bytes to copy.
+ *
+ * \sa FlatMemory_map
+ */
+void FlatMemory_map_copy(FlatMemory *self, u16 addr, const u8 *data);
+
+#endif
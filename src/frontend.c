@@ -3,6 +3,7 @@
 #include "game_boy.h"
 #include "log.h"
 #include "macros.h"
+#include "rom_file.h"
 #include "sdl.h"
 #include "stdinc.h"
 #include <SDL3/SDL.h>
@@ -27,9 +28,10 @@ static constexpr double DELTA = 1.0 / FPS;
 static constexpr double MAX_TIME_ACCUMULATOR = 4 * DELTA;
 
 /**
- * Frequency of DIV increments
+ * Duration of a frame on the emulated LCD
  */
-static constexpr int DIV_FREQUENCY_HZ = 16384; // 16779 Hz on SGB
+static constexpr double VFRAME_DURATION =
+    (double)GB_FRAME_CYCLES / GB_CPU_FREQUENCY_HZ;
 
 /**
  * Length of PALETTE_RGB_LEN
@@ -113,6 +115,163 @@ static bool *map_joypad_btn(JoypadState *const joypad, const SDL_Keycode key,
     }
 }
 
+// The path of the save file for the ROM at rom_path, which swaps its extension
+// for .sav. Must be freed.
+static char *save_path_for_rom(const char *const rom_path)
+{
+    static const char SAVE_EXTENSION[] = ".sav";
+
+    const char *const slash = strrchr(rom_path, '/');
+    const char *const name = slash != nullptr ? slash + 1 : rom_path;
+    const char *const extension = strrchr(name, '.');
+
+    // A leading dot starts a hidden file name rather than an extension
+    const size_t stem_len = extension != nullptr && extension != name
+                                ? (size_t)(extension - rom_path)
+                                : strlen(rom_path);
+
+    char *const path = malloc(stem_len + sizeof(SAVE_EXTENSION));
+    BAIL_IF_NULL(path);
+
+    memcpy(path, rom_path, stem_len);
+    memcpy(&path[stem_len], SAVE_EXTENSION, sizeof(SAVE_EXTENSION));
+    return path;
+}
+
+bool load_rom_file(GameBoy *const gb, const char *const path)
+{
+    RomFile *const rom = RomFile_open(path);
+
+    if (rom == nullptr)
+        return false;
+
+    GameBoy_load_rom_file(gb, rom);
+
+    char *const save_path = save_path_for_rom(path);
+    GameBoy_open_save(gb, save_path);
+    free(save_path);
+
+    GameBoy_log_cartridge_info(gb);
+    return true;
+}
+
+bool add_cheats(GameBoy *const gb, const char *const codes)
+{
+    bool valid = true;
+
+    for (const char *code = codes; *code != '\0';) {
+        const size_t len = strcspn(code, ",");
+        char buf[16];
+
+        if (len < sizeof(buf)) {
+            memcpy(buf, code, len);
+            buf[len] = '\0';
+        }
+
+        if (len >= sizeof(buf) || !GameBoy_add_cheat(gb, buf)) {
+            log_error("Invalid cheat code: %.*s", (int)len, code);
+            valid = false;
+        }
+
+        code += len;
+
+        if (*code == ',')
+            ++code;
+    }
+
+    return valid;
+}
+
+// Parses a watchpoint (see add_watchpoints)
+static bool parse_watchpoint(const char *const spec, u16 *const first,
+                             u16 *const last, WatchKind *const kinds)
+{
+    char *end;
+    const unsigned long first_addr = strtoul(spec, &end, 16);
+    unsigned long last_addr = first_addr;
+
+    if (end == spec || first_addr > 0xFFFF)
+        return false;
+
+    if (*end == '-') {
+        const char *const last_spec = end + 1;
+        last_addr = strtoul(last_spec, &end, 16);
+
+        if (end == last_spec || last_addr > 0xFFFF || last_addr < first_addr)
+            return false;
+    }
+
+    *kinds = WatchKind_Read | WatchKind_Write;
+
+    if (*end == ':') {
+        *kinds = 0;
+
+        for (++end; *end != '\0'; ++end) {
+            switch (*end) {
+            case 'r':
+                *kinds |= WatchKind_Read;
+                break;
+            case 'w':
+                *kinds |= WatchKind_Write;
+                break;
+            case 'x':
+                *kinds |= WatchKind_Execute;
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    *first = first_addr;
+    *last = last_addr;
+    return *end == '\0' && *kinds != 0;
+}
+
+bool add_watchpoints(GameBoy *const gb, const char *const specs)
+{
+    bool valid = true;
+
+    for (const char *spec = specs; *spec != '\0';) {
+        const size_t len = strcspn(spec, ",");
+        char buf[32];
+        u16 first;
+        u16 last;
+        WatchKind kinds;
+
+        if (len < sizeof(buf)) {
+            memcpy(buf, spec, len);
+            buf[len] = '\0';
+        }
+
+        if (len < sizeof(buf) && parse_watchpoint(buf, &first, &last, &kinds)) {
+            GameBoy_add_watchpoint(gb, first, last, kinds);
+        } else {
+            log_error("Invalid watchpoint: %.*s", (int)len, spec);
+            valid = false;
+        }
+
+        spec += len;
+
+        if (*spec == ',')
+            ++spec;
+    }
+
+    return valid;
+}
+
+// Logs the watchpoint hit that stopped emulation
+static void log_watch_stop(const WatchHit *const hit)
+{
+    const char *const access = hit->kind == WatchKind_Read    ? "read"
+                               : hit->kind == WatchKind_Write ? "write"
+                                                              : "execute";
+
+    log_info("Watchpoint #%zu hit: %s at $%04X (value = $%02X), press F9 to "
+             "resume",
+             hit->id, access, hit->addr, hit->value);
+}
+
 static void rom_select_callback(void *const data,
                                 const char *const *const files,
                                 [[maybe_unused]] const int filter)
@@ -129,19 +288,55 @@ static void rom_select_callback(void *const data,
     const char *const rom_file = files[0];
 
     log_info("Loading ROM at %s", rom_file);
+    load_rom_file(gb, rom_file);
+}
 
-    size_t rom_len = 0;
-    u8 *const rom = SDL_LoadFile(rom_file, &rom_len);
-
-    if (rom == nullptr) {
-        log_error("Could not load ROM file: %s", SDL_GetError());
-        return;
+// Opens or closes the RAM search, or filters it, for the keys that do so.
+// Returns whether the key was one of them.
+static bool handle_ram_search_key(State *const state, const SDL_Keycode key,
+                                  const SDL_Keymod mod)
+{
+    // <C-f> to open or close the RAM search
+    if (mod == SDL_KMOD_CTRL && key == SDLK_F) {
+        if (state->ram_search == nullptr) {
+            state->ram_search = RamSearch_new(&state->gb);
+        } else {
+            RamSearch_destroy(state->ram_search);
+            state->ram_search = nullptr;
+        }
+        return true;
     }
 
-    GameBoy_load_rom(gb, rom, rom_len);
-    GameBoy_log_cartridge_info(gb);
+    if (state->ram_search == nullptr || (mod & ~SDL_KMOD_SHIFT) != 0)
+        return false;
 
-    SDL_free(rom);
+    // <F1> to start over, <F2>-<F5> to filter bytes, or words with <S-...>
+    RamSearchCmp cmp;
+
+    switch (key) {
+    case SDLK_F1:
+        RamSearch_reset(state->ram_search, &state->gb);
+        return true;
+    case SDLK_F2:
+        cmp = RamSearchCmp_Equal;
+        break;
+    case SDLK_F3:
+        cmp = RamSearchCmp_Changed;
+        break;
+    case SDLK_F4:
+        cmp = RamSearchCmp_Increased;
+        break;
+    case SDLK_F5:
+        cmp = RamSearchCmp_Decreased;
+        break;
+    default:
+        return false;
+    }
+
+    const RamSearchWidth width =
+        (mod & SDL_KMOD_SHIFT) != 0 ? RamSearchWidth_16 : RamSearchWidth_8;
+    RamSearch_filter(state->ram_search, &state->gb, cmp, width, 0);
+    return true;
 }
 
 static inline SDL_Keymod mask_relevant_mod(const SDL_Keymod mod)
@@ -170,6 +365,15 @@ static void handle_event(State *const state, const SDL_Event *const event)
             break;
         }
 
+        if (handle_ram_search_key(state, event->key.key, relevant_mod))
+            break;
+
+        // <F9> to resume after a watchpoint hit
+        if (relevant_mod == SDL_KMOD_NONE && event->key.key == SDLK_F9) {
+            GameBoy_resume(&state->gb);
+            break;
+        }
+
         // <C-o> to select ROM
         if (relevant_mod & SDL_KMOD_CTRL && event->key.key == SDLK_O) {
             SDL_ShowOpenFileDialog(rom_select_callback, &state->gb, nullptr,
@@ -193,197 +397,36 @@ static void handle_event(State *const state, const SDL_Event *const event)
 
 static void update(State *const state, const double delta)
 {
-    Memory memory = (Memory){
-        .ctx = &state->gb,
-        .read = GameBoy_read_mem,
-        .write = GameBoy_write_mem,
-    };
-
-    state->gb.cpu.cycle_count = 0;
-
-    const double total_frame_cycles = GB_CPU_FREQUENCY_HZ * delta;
-
-    static constexpr double VFRAME_DURATION = 1.0 / GB_VBLANK_FREQ;
-    static constexpr int DIV_FREQUENCY_CYCLES =
-        GB_CPU_FREQUENCY_HZ / DIV_FREQUENCY_HZ;
-
-    while (state->cycle_accumulator < total_frame_cycles) {
-        const double actual_vframe_time =
-            state->vframe_time +
-            (state->cycle_accumulator / GB_CPU_FREQUENCY_HZ);
-        double progress = actual_vframe_time / VFRAME_DURATION;
-        while (progress >= 1.0) {
-            progress -= 1.0;
-        }
-
-        const u8 prev_ly = state->gb.ly;
-        state->gb.ly = (u8)(progress * GB_LCD_MAX_LY);
-
-        state->gb.stat |= (state->gb.ly == state->gb.lcy) << 2;
-
-        // Trigger some stuff then ly changes
-        if (prev_ly != state->gb.ly) {
-            // VBlank interrupt
-            if (state->gb.ly == 144) {
-                state->gb.if_ |= InterruptFlag_VBlank;
-            }
-
-            // STAT lcy == ly interrupt
-            if ((state->gb.stat & StatSelect_Lyc) != 0 &&
-                state->gb.ly == state->gb.lcy) {
-                state->gb.if_ |= InterruptFlag_Lcd;
-            }
-        }
-
-        GameBoy_service_interrupts(&state->gb, &memory);
-        Cpu_tick(&state->gb.cpu, &memory);
+    // Nothing runs until resumed after a watchpoint hit, which picks up
+    // right where the update stopped
+    if (GameBoy_watch_stop(&state->gb) != nullptr)
+        return;
 
-        // DIV counter
-        if (state->gb.cpu.mode != CpuMode_Stopped) {
-            state->div_cycle_counter += state->gb.cpu.cycle_count;
+    state->cycle_accumulator += GB_CPU_FREQUENCY_HZ * delta;
+    const int cycles = (int)state->cycle_accumulator;
+    state->cycle_accumulator -= cycles;
 
-            while (state->div_cycle_counter >= DIV_FREQUENCY_CYCLES) {
-                ++state->gb.div;
-                state->div_cycle_counter -= DIV_FREQUENCY_CYCLES;
-            }
-        }
+    GameBoy_run(&state->gb, cycles);
 
-        // TIMA is only incremented if TAC's bit 2 is set
-        if (state->gb.tac & 0b100) {
-            const u8 clock_select = state->gb.tac & 0b11;
-            const int tac_delay_cycles =
-                clock_select == 0 ? 256 : 4 * clock_select;
-
-            // TIMA counter
-            state->tima_cycle_counter += state->gb.cpu.cycle_count;
-            if (state->tima_cycle_counter > tac_delay_cycles) {
-                state->tima_cycle_counter -= tac_delay_cycles;
-                ++state->gb.tima;
-
-                // Trigger timer interrupt when tima overflows
-                if (state->gb.tima == 0) {
-                    state->gb.tima = state->gb.tma;
-                    state->gb.if_ |= InterruptFlag_Timer;
-                }
-            }
-        }
+    const WatchHit *const hit = GameBoy_watch_stop(&state->gb);
 
-        state->cycle_accumulator += state->gb.cpu.cycle_count;
-        state->gb.cpu.cycle_count = 0;
+    if (hit != nullptr) {
+        log_watch_stop(hit);
+        return;
     }
 
-    state->cycle_accumulator -= total_frame_cycles;
-
     state->vframe_time += delta;
-    while (state->vframe_time >= VFRAME_DURATION) {
-        state->vframe_time -= VFRAME_DURATION;
-    }
-}
 
-static void draw_tiles(const State *const state,
-                       const SDL_Surface *const surface,
-                       const SDL_PixelFormatDetails *const pixel_format)
-{
-    static constexpr size_t TILES_HORIZONTAL = 32;
-    static constexpr size_t TILES_VERTICAL = 32;
-
-    u32 *const pixels = surface->pixels;
-
-    const size_t tile_data_start =
-        state->gb.lcdc & LcdControl_BgwTileArea ? 0 : 0x1000;
-    const size_t tile_map_start =
-        state->gb.lcdc & LcdControl_BgTileMap ? 0x1C00 : 0x1800;
-
-    const u8 *const tile_data = &state->gb.vram[tile_data_start];
-    const u8 *const tile_map = &state->gb.vram[tile_map_start];
-
-    for (size_t tile_y = 0; tile_y < TILES_VERTICAL; ++tile_y) {
-        for (size_t tile_x = 0; tile_x < TILES_HORIZONTAL; ++tile_x) {
-            const u8 tile_index =
-                tile_map[(tile_y * TILES_HORIZONTAL) + tile_x];
-            const long tile_index_signed =
-                state->gb.lcdc & LcdControl_BgwTileArea ? tile_index
-                                                        : (i8)tile_index;
-
-            for (size_t tile_row_index = 0; tile_row_index < 8;
-                 ++tile_row_index) {
-                const u8 byte_1 =
-                    tile_data[(tile_index_signed * 16) + (2 * tile_row_index)];
-                const u8 byte_2 = tile_data[(tile_index_signed * 16) +
-                                            (2 * tile_row_index) + 1];
-
-                for (size_t tile_col_index = 0; tile_col_index < 8;
-                     ++tile_col_index) {
-                    const u8 bit_lo = (byte_1 >> tile_col_index) & 1;
-                    const u8 bit_hi = (byte_2 >> tile_col_index) & 1;
-                    const u8 palette_index = bit_lo | (bit_hi << 1);
-
-                    const size_t color =
-                        (state->gb.bgp >> (2 * palette_index)) & 0b11;
-
-                    const size_t pixel_y = (8 * tile_y) + tile_row_index;
-                    const size_t pixel_x = (8 * tile_x) + 7 - tile_col_index;
-
-                    pixels[(pixel_y * surface->w) + pixel_x] =
-                        map_color_index(color, pixel_format);
-                }
-            }
-        }
-    }
-}
+    // Hand whatever the game saved during the frame over to the kernel
+    if (state->vframe_time >= VFRAME_DURATION)
+        GameBoy_flush_save(&state->gb);
 
-static void draw_objects(const State *const state,
-                         const SDL_Surface *const surface,
-                         const SDL_PixelFormatDetails *const pixel_format)
-{
-    u32 *const pixels = surface->pixels;
-
-    for (size_t obj = 0; obj < 40; ++obj) {
-        const u8 *const obj_data = &state->gb.oam[obj * 4];
-
-        const size_t y_pos = obj_data[0] - 16;
-        const size_t x_pos = obj_data[1] - 8;
-        const size_t tile_index = obj_data[2];
-        const u8 attrs = obj_data[3];
-
-        // TODO: implement priority (background over object)
-        // Will probably need two passes: low and normal priority objs
-
-        const bool flip_x = (attrs & ObjAttrs_FlipX) != 0;
-        const bool flip_y = (attrs & ObjAttrs_FlipY) != 0;
-        const u8 obp = (attrs & ObjAttrs_DmgPalette) != 0 ? state->gb.obp1
-                                                          : state->gb.obp0;
-
-        for (size_t sprite_row = 0; sprite_row < 8; ++sprite_row) {
-            // Objects always use the $8000 method
-            const u8 byte_1 =
-                state->gb.vram[(tile_index * 0x10) + (2 * sprite_row)];
-            const u8 byte_2 =
-                state->gb.vram[(tile_index * 0x10) + (2 * sprite_row) + 1];
-
-            for (size_t sprite_col = 0; sprite_col < 8; ++sprite_col) {
-                const u8 bit_lo = (byte_1 >> sprite_col) & 1;
-                const u8 bit_hi = (byte_2 >> sprite_col) & 1;
-                const size_t palette_index = bit_lo | (bit_hi << 1);
-                const size_t color = (obp >> (palette_index * 2)) & 0b11;
-
-                if (color != 0) {
-                    const size_t pixel_y =
-                        y_pos + (flip_y ? 7 - sprite_row : sprite_row);
-                    const size_t pixel_x =
-                        x_pos + (flip_x ? sprite_col : 7 - sprite_col);
-
-                    if (pixel_x < (size_t)surface->w &&
-                        pixel_y < (size_t)surface->h) {
-                        pixels[(pixel_y * surface->w) + pixel_x] =
-                            map_color_index(color, pixel_format);
-                    }
-                }
-            }
-        }
+    while (state->vframe_time >= VFRAME_DURATION) {
+        state->vframe_time -= VFRAME_DURATION;
     }
 }
 
+// Copies the framebuffer of the GameBoy into the screen texture
 static void update_texture(const State *const state)
 {
     SDL_Surface *surface = nullptr;
@@ -397,20 +440,51 @@ static void update_texture(const State *const state)
     BAIL_IF_NULL(pixel_format, "Could not get pixel format: %s",
                  SDL_GetError());
 
-    SDL_FillSurfaceRect(surface, nullptr,
-                        SDL_MapRGB(pixel_format, nullptr, 0, 0, 0));
+    u32 colors[PALETTE_RGB_LEN];
+    for (size_t shade = 0; shade < PALETTE_RGB_LEN; ++shade)
+        colors[shade] = map_color_index(shade, pixel_format);
 
-    if ((state->gb.lcdc & LcdControl_Enable) != 0) {
-        draw_tiles(state, surface, pixel_format);
+    for (int y = 0; y < GB_LCD_HEIGHT; ++y) {
+        u32 *const row =
+            (u32 *)((u8 *)surface->pixels + ((size_t)y * surface->pitch));
 
-        if ((state->gb.lcdc & LcdControl_ObjEnable) != 0) {
-            draw_objects(state, surface, pixel_format);
-        }
+        for (int x = 0; x < GB_LCD_WIDTH; ++x)
+            row[x] = colors[state->gb.framebuffer[y][x]];
     }
 
     SDL_UnlockTexture(state->screen_texture);
 }
 
+// Lists the candidates left in the RAM search over the top left corner
+static void draw_ram_search(const RamSearch *const search,
+                            SDL_Renderer *const renderer)
+{
+    static constexpr size_t SHOWN_CANDIDATES = 16;
+    static constexpr float LINE_HEIGHT = SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2;
+
+    RamSearchCandidate candidates[SHOWN_CANDIDATES];
+    const size_t shown =
+        RamSearch_candidates(search, candidates, SHOWN_CANDIDATES);
+
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    SDL_RenderDebugTextFormat(renderer, 4, 4, "%zu candidates",
+                              RamSearch_count(search));
+
+    for (size_t i = 0; i < shown; ++i) {
+        const RamSearchCandidate *const candidate = &candidates[i];
+        const float y = 4 + (LINE_HEIGHT * (i + 1));
+
+        if (candidate->addr >= 0xA000 && candidate->addr < 0xC000) {
+            SDL_RenderDebugTextFormat(renderer, 4, y, "%02X:%04X %04X",
+                                      candidate->bank, candidate->addr,
+                                      candidate->value);
+        } else {
+            SDL_RenderDebugTextFormat(renderer, 4, y, "   %04X %04X",
+                                      candidate->addr, candidate->value);
+        }
+    }
+}
+
 static void render(const State *const state, SDL_Renderer *const renderer)
 {
     const float ASPECT_RATIO = (float)GB_LCD_WIDTH / GB_LCD_HEIGHT;
@@ -420,20 +494,16 @@ static void render(const State *const state, SDL_Renderer *const renderer)
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
     SDL_RenderClear(renderer);
 
-    // TODO: implement window wrapping
-    const SDL_FRect src_rect = {
-        .x = state->gb.scx,
-        .y = state->gb.scy,
-        .w = GB_LCD_WIDTH,
-        .h = GB_LCD_HEIGHT,
-    };
-
     const SDL_FRect dest_rect =
         fit_rect_to_aspect_ratio(&(SDL_FRect){0, 0, (float)state->window_width,
                                               (float)state->window_height},
                                  ASPECT_RATIO);
 
-    SDL_RenderTexture(renderer, state->screen_texture, &src_rect, &dest_rect);
+    SDL_RenderTexture(renderer, state->screen_texture, nullptr, &dest_rect);
+
+    if (state->ram_search != nullptr)
+        draw_ram_search(state->ram_search, renderer);
+
     SDL_RenderPresent(renderer);
 }
 
@@ -473,3 +543,21 @@ void run_until_quit(State *const state, SDL_Renderer *const renderer)
         }
     }
 }
+
+void run_benchmark(State *const state, const int frames)
+{
+    const u64 start_instructions = state->gb.instruction_count;
+    const double start_time = sdl_get_performance_time();
+
+    for (int i = 0; i < frames; ++i)
+        update(state, DELTA);
+
+    const double elapsed = sdl_get_performance_time() - start_time;
+    const u64 instructions =
+        state->gb.instruction_count - start_instructions;
+
+    log_info("Emulated %d frames in %.3f s (%.1fx real time)", frames, elapsed,
+             (frames * DELTA) / elapsed);
+    log_info("Executed %llu instructions (%.2f MIPS)",
+             (unsigned long long)instructions, instructions / elapsed / 1e6);
+}
@@ -2,20 +2,73 @@
 #define GEMU_FRONTEND_H
 
 #include "game_boy.h"
+#include "ram_search.h"
 #include <SDL3/SDL.h>
 
 typedef struct {
     GameBoy gb;
     int window_width;
     int window_height;
-    double cycle_accumulator;
+    double cycle_accumulator; // Part of a cycle owed to the GameBoy
     double vframe_time;
-    int div_cycle_counter;
-    int tima_cycle_counter;
     bool quit;
     SDL_Texture *screen_texture;
+    RamSearch *ram_search; // Shown over the screen while open, or NULL
 } State;
 
+/**
+ * \brief Loads the ROM file at the given path into a GameBoy, keeping its
+ * battery-backed memory in a .sav file next to it.
+ *
+ * \param gb the GameBoy to load the ROM into.
+ * \param path the path of the ROM file.
+ *
+ * \return whether the ROM file could be read. The reason is logged if not.
+ *
+ * \sa GameBoy_open_save
+ */
+bool load_rom_file(GameBoy *gb, const char *path);
+
+/**
+ * \brief Adds Game Genie and GameShark codes to a GameBoy.
+ *
+ * \param gb the GameBoy to add the codes to, with the ROM they are for loaded.
+ * \param codes comma-separated codes (see Cheat_parse).
+ *
+ * \return whether all codes were valid. Invalid ones are logged and skipped.
+ *
+ * \sa GameBoy_add_cheat
+ */
+bool add_cheats(GameBoy *gb, const char *codes);
+
+/**
+ * \brief Adds watchpoints to a GameBoy, which stop emulation when hit until
+ * F9 is pressed.
+ *
+ * \param gb the GameBoy to add the watchpoints to.
+ * \param specs comma-separated watchpoints, each an address or a range of them
+ * in hex (C000 or C000-C0FF) and optionally the accesses to watch after a
+ * colon, any of r, w and x (C000:w). Reads and writes are watched by default.
+ *
+ * \return whether all watchpoints were valid. Invalid ones are logged and
+ * skipped.
+ *
+ * \sa GameBoy_add_watchpoint
+ */
+bool add_watchpoints(GameBoy *gb, const char *specs);
+
 void run_until_quit(State *state, SDL_Renderer *renderer);
 
+/**
+ * \brief Runs the emulator for a fixed number of frames without rendering, then
+ * logs how fast it went.
+ *
+ * Frames are emulated back-to-back, without waiting for real time to pass, so
+ * the reported figures reflect raw emulation throughput.
+ *
+ * \param state the state to run. Its screen_texture is never touched.
+ * \param frames the number of frames to emulate.
+ */
+void run_benchmark(State *state, int frames);
+
 #endif
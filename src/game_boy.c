@@ -1,15 +1,33 @@
 #include "game_boy.h"
+#include "block_cache.h"
+#include "cheats.h"
 #include "cpu.h"
 #include "data.h"
+#ifdef GEMU_FLAT_MEMORY
+#include "flat_memory.h"
+#endif
 #include "log.h"
 #include "macros.h"
 #include "mapper.h"
 #include "num.h"
+#include "ppu.h"
+#include "rom_file.h"
+#include "save_file.h"
 #include "stdinc.h"
 #include "string.h"
+#include "watchpoints.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+extern inline u8 GameBoy_read_mem(const void *ctx, u16 addr);
+extern inline void GameBoy_write_mem(void *ctx, u16 addr, u8 value);
+extern inline bool GameBoy_oam_dma_running(const GameBoy *self);
+
+static_assert(CHEAT_PAGE_LEN == GB_PAGE_LEN,
+              "Cheat overlays must replace whole pages");
 
 static void GameBoy_write_joyp(GameBoy *const self, const u8 value)
 {
@@ -75,10 +93,142 @@ static void GameBoy_simulate_boot(GameBoy *const self)
     self->boot_rom_enable = false;
 }
 
+static u8 GameBoy_decode_read(const GameBoy *self, u16 addr);
+
+// How long an OAM DMA transfer locks the CPU out, one byte per M-cycle on
+// hardware (see GameBoy_start_lockout_dma)
+static constexpr u64 OAM_DMA_CYCLES = 0xA0;
+
+// The current time for the cartridge, in M-cycles
+static u64 GameBoy_now(const GameBoy *const self)
+{
+    return self->cycles + self->cpu.cycle_count;
+}
+
 static void GameBoy_reset(GameBoy *const self)
 {
     self->cpu.pc = 0;
     self->boot_rom_enable = true;
+    self->dma_end = 0;
+}
+
+// A copy of a page of VRAM or WRAM that forks share until they write to it
+struct SharedPage {
+    size_t refs;
+    u8 data[GB_PAGE_LEN];
+};
+
+static_assert(GB_SHARED_PAGE_COUNT <= 64,
+              "Shared pages must fit in GameBoy.shared_mask");
+
+// A page shared by nothing but its creator yet, holding a copy of data
+static SharedPage *SharedPage_new(const u8 *const data)
+{
+    SharedPage *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    self->refs = 1;
+    memcpy(self->data, data, GB_PAGE_LEN);
+    return self;
+}
+
+static void SharedPage_release(SharedPage *const self)
+{
+    if (--self->refs == 0)
+        free(self);
+}
+
+// A page of cartridge RAM in GameBoy.cart_shared
+typedef struct {
+    SharedPage *page; // NULL once written to since the last fork
+    bool stale;       // Whether the cartridge RAM of the mapper is out of date
+} SharedCartPage;
+
+// The pages of cartridge RAM shared with forks, kept like GameBoy.shared and
+// stale are for VRAM and WRAM but apart from them, since there are many more
+// of them on some cartridges
+struct SharedCartRam {
+    size_t page_count;
+    SharedCartPage pages[];
+};
+
+static SharedCartRam *SharedCartRam_new(const size_t page_count)
+{
+    SharedCartRam *const self =
+        calloc(1, sizeof(*self) + (page_count * sizeof(self->pages[0])));
+    BAIL_IF_NULL(self);
+
+    self->page_count = page_count;
+    return self;
+}
+
+static void SharedCartRam_destroy(SharedCartRam *const self)
+{
+    if (self == nullptr)
+        return;
+
+    for (size_t index = 0; index < self->page_count; ++index) {
+        if (self->pages[index].page != nullptr)
+            SharedPage_release(self->pages[index].page);
+    }
+
+    free(self);
+}
+
+// Index into GameBoy.shared of the page holding addr, in 8000-9FFF or
+// C000-FDFF
+static size_t GameBoy_shared_index(const u16 addr)
+{
+    if (addr <= 0x9FFF)
+        return (addr - 0x8000) / GB_PAGE_LEN;
+
+    // Echo RAM mirrors C000-DDFF
+    return (0x2000 + ((addr - 0xC000) & 0x1FFF)) / GB_PAGE_LEN;
+}
+
+// Where the page at index into GameBoy.shared is kept in vram or ram
+static u8 *GameBoy_own_page(GameBoy *const self, const size_t index)
+{
+    const size_t offset = index * GB_PAGE_LEN;
+    return offset < 0x2000 ? &self->vram[offset] : &self->ram[offset - 0x2000];
+}
+
+// The page of GameBoy.cart_shared mapped at addr, in A000-BFFF, or NULL if
+// none is, such as while cartridge RAM is disabled
+static SharedCartPage *GameBoy_cart_shared_page(const GameBoy *const self,
+                                                const u16 addr)
+{
+    if (self->cart_shared == nullptr)
+        return nullptr;
+
+    const u8 *const bank = Mapper_ram_bank(self->mapper);
+    if (bank == nullptr)
+        return nullptr;
+
+    const size_t offset =
+        (size_t)(bank - Mapper_ram(self->mapper)) + (addr - 0xA000);
+    return &self->cart_shared->pages[offset / GB_PAGE_LEN];
+}
+
+const u8 *GameBoy_cart_ram_page(const GameBoy *const self, const size_t offset)
+{
+    const size_t index = offset / GB_PAGE_LEN;
+
+    if (self->cart_shared != nullptr && self->cart_shared->pages[index].stale)
+        return self->cart_shared->pages[index].page->data;
+
+    return &Mapper_ram(self->mapper)[index * GB_PAGE_LEN];
+}
+
+const u8 *GameBoy_memory_page(const GameBoy *const self, const u16 addr)
+{
+    const size_t index = GameBoy_shared_index(addr);
+    const size_t offset = index * GB_PAGE_LEN;
+
+    if ((self->stale & ((u64)1 << index)) != 0)
+        return self->shared[index]->data;
+
+    return offset < 0x2000 ? &self->vram[offset] : &self->ram[offset - 0x2000];
 }
 
 static void GameBoy_validate_rom(const GameBoy *const self)
@@ -89,50 +239,315 @@ static void GameBoy_validate_rom(const GameBoy *const self)
         self->rom[RomHeader_RomSize], self->rom_len);
 }
 
-GameBoy GameBoy_new(const u8 *const boot_rom)
+#ifdef GEMU_FLAT_MEMORY
+// Mirrors read_pages from first to last into the flat window, 4 KiB at a time.
+// Pages of contiguous shared memory are mapped from it, and read-only pages
+// that are not are copied: the boot ROM over the start of bank 0, or whatever
+// the mapper reads at A000-BFFF without RAM there. Returns false if some page
+// can only be read through read_pages.
+static bool GameBoy_map_flat(GameBoy *const self, const u32 first,
+                             const u32 last)
 {
-    GameBoy gb = {
-        .cpu = Cpu_new(),
-        .rom = nullptr,
-        .rom_len = 0,
-        .boot_rom_exists = boot_rom != nullptr,
-        .boot_rom_enable = true,
-        .lcdc = 0,
-        .stat = 0,
-        .ly = 0,
-        .lcy = 0,
-        .scx = 0,
-        .scy = 0,
-        .wx = 0,
-        .wy = 0,
-        .bgp = 0,
-        .obp0 = 0,
-        .obp1 = 0,
-        .ie = 0,
-        .if_ = 0,
-        .sb = 0,
-        .sc = 0,
-        .div = 0,
-        .tima = 0,
-        .tma = 0,
-        .tac = 0,
-        .joyp = 0x0F,
-    };
+    const size_t sub_pages = FLAT_PAGE_LEN / GB_PAGE_LEN;
+    bool complete = true;
+
+    for (u32 addr = first; addr <= last; addr += FLAT_PAGE_LEN) {
+        const size_t page = addr / GB_PAGE_LEN;
+        const u8 *const mem = self->read_pages[page];
+        bool contiguous = mem != nullptr;
+
+        // FE00-FFFF is never read from the window, so it may differ
+        for (size_t i = 1;
+             contiguous && i < sub_pages && addr + (i * GB_PAGE_LEN) < 0xFE00;
+             ++i)
+            contiguous = self->read_pages[page + i] == &mem[i * GB_PAGE_LEN];
+
+        if (contiguous && FlatMemory_map(self->flat_memory, addr, mem))
+            continue;
+
+        u8 copy[FLAT_PAGE_LEN];
+        bool copyable = true;
+
+        for (size_t i = 0; copyable && i < sub_pages; ++i) {
+            const u16 sub_addr = addr + (i * GB_PAGE_LEN);
+            const u8 *const sub_page = self->read_pages[page + i];
+            u8 *const dest = &copy[i * GB_PAGE_LEN];
+
+            if (self->write_pages[page + i] != nullptr) {
+                copyable = false;
+            } else if (sub_page != nullptr) {
+                memcpy(dest, sub_page, GB_PAGE_LEN);
+            } else if (sub_addr >= 0xA000 && sub_addr <= 0xBFFF) {
+                // The same everywhere until the next mapper write (see
+                // Mapper_ram_bank)
+                memset(dest, GameBoy_decode_read(self, sub_addr),
+                       GB_PAGE_LEN);
+            } else {
+                copyable = false;
+            }
+        }
+
+        if (copyable)
+            FlatMemory_map_copy(self->flat_memory, addr, copy);
+        else
+            complete = false;
+    }
+
+    return complete;
+}
+#endif
+
+// Leaves the pages holding watched addresses out of the page tables, so that
+// accesses to them are checked. Returns whether any page below FE00 is left
+// out of read_pages.
+static bool GameBoy_unmap_watched(GameBoy *const self)
+{
+    if (self->watchpoints == nullptr)
+        return false;
+
+    bool reads = false;
+
+    for (size_t page = 0; page < GB_PAGE_COUNT; ++page) {
+        const WatchKind kinds =
+            Watchpoints_page(self->watchpoints, page * GB_PAGE_LEN);
+
+        if ((kinds & WatchKind_Read) != 0) {
+            self->read_pages[page] = nullptr;
+            reads |= page < 0xFE00 / GB_PAGE_LEN;
+        }
+
+        if ((kinds & WatchKind_Write) != 0)
+            self->write_pages[page] = nullptr;
+    }
+
+    return reads;
+}
+
+// Points the pages of 0000-7FFF and A000-BFFF at whatever the boot ROM and the
+// mapper currently map there
+static void GameBoy_map_cartridge(GameBoy *const self)
+{
+    // Everything is mapped again once OAM DMA is done
+    if (self->dma_end != 0)
+        return;
+
+    const size_t bank_pages = 0x4000 / GB_PAGE_LEN;
+
+    for (size_t page = 0; page < 2 * bank_pages; page += bank_pages) {
+        const u8 *bank_data = nullptr;
+        size_t bank = 0;
+
+        if (self->rom != nullptr) {
+            bank = Mapper_rom_bank(self->mapper, page * GB_PAGE_LEN);
+            if ((bank + 1) * 0x4000 <= self->rom_len)
+                bank_data = &self->rom[bank * 0x4000];
+        }
+
+        for (size_t i = 0; i < bank_pages; ++i) {
+            self->read_pages[page + i] =
+                bank_data == nullptr ? nullptr : &bank_data[i * GB_PAGE_LEN];
+        }
+
+        if (bank_data == nullptr || self->cheats == nullptr)
+            continue;
+
+        // Pages patched by cheats are read from their overlays instead
+        for (size_t i = 0; i < bank_pages; ++i) {
+            const u8 *const overlay = Cheats_rom_page(
+                self->cheats, bank, (page + i) * GB_PAGE_LEN);
+
+            if (overlay != nullptr)
+                self->read_pages[page + i] = overlay;
+        }
+    }
+
+    // 0000-00FF (Boot ROM), which bails on reads if there is none
+    if (self->boot_rom_enable)
+        self->read_pages[0] = self->boot_rom_exists ? self->boot_rom : nullptr;
+
+    // A000-BFFF (cartridge RAM)
+    u8 *const ram = self->mapper == nullptr ? nullptr
+                                            : Mapper_ram_bank(self->mapper);
+
+    for (size_t i = 0; i < 0x2000 / GB_PAGE_LEN; ++i) {
+        u8 *const page = ram == nullptr ? nullptr : &ram[i * GB_PAGE_LEN];
+        self->read_pages[(0xA000 / GB_PAGE_LEN) + i] = page;
+        self->write_pages[(0xA000 / GB_PAGE_LEN) + i] = page;
+    }
+
+    // Pages shared with forks are handled as in GameBoy_map_memory (see
+    // GameBoy_unshare_cart)
+    for (size_t i = 0; ram != nullptr && self->cart_shared != nullptr &&
+                       i < 0x2000 / GB_PAGE_LEN;
+         ++i) {
+        const u16 addr = 0xA000 + (i * GB_PAGE_LEN);
+        const SharedCartPage *const shared =
+            GameBoy_cart_shared_page(self, addr);
+
+        if (shared->page == nullptr)
+            continue;
+
+        if (shared->stale)
+            self->read_pages[addr / GB_PAGE_LEN] = shared->page->data;
+
+        self->write_pages[addr / GB_PAGE_LEN] = nullptr;
+    }
+
+    [[maybe_unused]] const bool watched_reads = GameBoy_unmap_watched(self);
+
+#ifdef GEMU_FLAT_MEMORY
+    // Everything else in the window never changes once a ROM is loaded. Reads
+    // from watched pages must go through GameBoy_read_unpaged though.
+    const bool flat = self->rom != nullptr && !watched_reads &&
+                      GameBoy_map_flat(self, 0x0000, 0x7FFF) &&
+                      GameBoy_map_flat(self, 0xA000, 0xBFFF);
+    self->flat = flat ? FlatMemory_window(self->flat_memory) : nullptr;
+#endif
+}
+
+// Builds read_pages and write_pages from scratch
+static void GameBoy_map_memory(GameBoy *const self)
+{
+    for (size_t page = 0; page < GB_PAGE_COUNT; ++page) {
+        const size_t addr = page * GB_PAGE_LEN;
+        u8 *mapped = nullptr;
+
+        if (addr >= 0x8000 && addr <= 0x9FFF) {
+            // 8000-9FFF (VRAM)
+            mapped = &self->vram[addr - 0x8000];
+        } else if (addr >= 0xC000 && addr <= 0xDFFF) {
+            // C000-DFFF (WRAM)
+            mapped = &self->ram[addr - 0xC000];
+        } else if (addr >= 0xE000 && addr <= 0xFDFF) {
+            // E000-FDFF (Echo RAM, mirror of C000-DDFF)
+            mapped = &self->ram[addr - 0xE000];
+        }
+
+        self->read_pages[page] = mapped;
+        self->write_pages[page] = mapped;
+    }
+
+    // Pages shared with forks are read from their copies where those are
+    // newer, and only written once they stop being shared (see
+    // GameBoy_unshare)
+    for (size_t page = 0x8000 / GB_PAGE_LEN;
+         self->shared_mask != 0 && page < 0xFE00 / GB_PAGE_LEN; ++page) {
+        const u16 addr = page * GB_PAGE_LEN;
+
+        if (self->read_pages[page] == nullptr ||
+            self->shared[GameBoy_shared_index(addr)] == nullptr)
+            continue;
+
+        self->read_pages[page] = GameBoy_memory_page(self, addr);
+        self->write_pages[page] = nullptr;
+    }
+
+#ifdef GEMU_FLAT_MEMORY
+    // VRAM and WRAM, both shared
+    GameBoy_map_flat(self, 0x8000, 0x9FFF);
+    GameBoy_map_flat(self, 0xC000, 0xFFFF);
+#endif
+
+    GameBoy_map_cartridge(self);
+}
+
+// Brings the page tables in line with the memory they map, unless an OAM DMA
+// transfer keeps them empty. They are mapped again once it is done.
+static void GameBoy_remap_memory(GameBoy *const self)
+{
+    if (self->dma_end == 0)
+        GameBoy_map_memory(self);
+}
+
+void GameBoy_init(GameBoy *const self, const u8 *const boot_rom)
+{
+    // Everything else starts out zeroed, so that none of the bulk memory is
+    // touched until it is used
+    self->cpu = Cpu_new();
+    self->boot_rom_exists = boot_rom != nullptr;
+    self->boot_rom_enable = true;
+    self->joyp = 0x0F;
 
     if (boot_rom != nullptr)
-        memcpy(gb.boot_rom, boot_rom, sizeof(gb.boot_rom));
+        memcpy(self->boot_rom, boot_rom, sizeof(self->boot_rom));
+
+#ifdef GEMU_FLAT_MEMORY
+    self->flat_memory = FlatMemory_new();
+    self->ram = FlatMemory_alloc(self->flat_memory, 0x2000);
+    self->vram = FlatMemory_alloc(self->flat_memory, 0x2000);
+#endif
+}
 
+GameBoy GameBoy_new(const u8 *const boot_rom)
+{
+    GameBoy gb = {};
+    GameBoy_init(&gb, boot_rom);
     return gb;
 }
 
+// Writes back and closes the save file of the loaded cartridge, if any
+static void GameBoy_close_save(GameBoy *const self)
+{
+    GameBoy_flush_save(self);
+
+#ifdef GEMU_FLAT_MEMORY
+    if (self->save != nullptr)
+        FlatMemory_unshare(self->flat_memory, SaveFile_data(self->save));
+#endif
+
+    SaveFile_destroy(self->save);
+    self->save = nullptr;
+}
+
 void GameBoy_destroy(GameBoy *const self)
 {
-    free(self->rom);
+    GameBoy_close_save(self);
+
+    RomFile_destroy(self->rom_file);
+    self->rom_file = nullptr;
     self->rom = nullptr;
     self->rom_len = 0;
 
+    SharedCartRam_destroy(self->cart_shared);
+    self->cart_shared = nullptr;
+
     Mapper_destroy(self->mapper);
     self->mapper = nullptr;
+
+    Cheats_destroy(self->cheats);
+    self->cheats = nullptr;
+
+    Watchpoints_destroy(self->watchpoints);
+    self->watchpoints = nullptr;
+    self->hram_watch = 0;
+
+    for (size_t index = 0; index < GB_SHARED_PAGE_COUNT; ++index) {
+        if (self->shared[index] != nullptr)
+            SharedPage_release(self->shared[index]);
+
+        self->shared[index] = nullptr;
+    }
+
+    self->shared_mask = 0;
+    self->stale = 0;
+
+    BlockCache_destroy(self->block_cache);
+    self->block_cache = nullptr;
+
+#ifdef GEMU_JIT
+    Jit_destroy(self->jit);
+    self->jit = nullptr;
+#endif
+
+#ifdef GEMU_FLAT_MEMORY
+    // Along with ram, vram and cart_ram
+    FlatMemory_destroy(self->flat_memory);
+    self->flat_memory = nullptr;
+    self->flat = nullptr;
+    self->ram = nullptr;
+    self->vram = nullptr;
+    self->cart_ram = nullptr;
+#endif
 }
 
 void GameBoy_log_cartridge_info(const GameBoy *const self)
@@ -156,108 +571,442 @@ void GameBoy_load_rom(GameBoy *const self, const u8 *const rom,
     BAIL_IF(rom_len < 0x8000,
             "ROM data cannot be less than 32768 bytes long (was %zu)", rom_len);
 
-    free(self->rom);
+    GameBoy_load_rom_file(self, RomFile_copy(rom, rom_len));
+}
+
+void GameBoy_load_rom_file(GameBoy *const self, RomFile *const rom)
+{
+    BAIL_IF(RomFile_len(rom) < 0x8000,
+            "ROM data cannot be less than 32768 bytes long (was %zu)",
+            RomFile_len(rom));
+
+    GameBoy_close_save(self);
+
+#ifdef GEMU_FLAT_MEMORY
+    // Nothing is read from the window until the new ROM is mapped into it
+    self->flat = nullptr;
+    FlatMemory_unshare(self->flat_memory, self->rom);
+#endif
 
-    self->rom = malloc(rom_len * sizeof(self->rom[0]));
-    BAIL_IF_NULL(self->rom);
+    // Cheats are made for the previous ROM
+    Cheats_destroy(self->cheats);
+    self->cheats = nullptr;
 
-    memcpy(self->rom, rom, rom_len * sizeof(self->rom[0]));
-    self->rom_len = rom_len;
+    RomFile_destroy(self->rom_file);
+    if (self->block_cache != nullptr)
+        BlockCache_clear(self->block_cache);
+
+    self->rom_file = rom;
+    self->rom = RomFile_data(rom);
+    self->rom_len = RomFile_len(rom);
 
     GameBoy_validate_rom(self);
 
+    SharedCartRam_destroy(self->cart_shared);
+    self->cart_shared = nullptr;
+
     Mapper_destroy(self->mapper);
-    self->mapper = Mapper_from_rom(self->rom, self->rom_len);
+    self->mapper =
+        Mapper_from_rom_in(&self->mapper_storage, self->rom, self->rom_len);
+
+#ifdef GEMU_FLAT_MEMORY
+    FlatMemory_share(self->flat_memory, self->rom, self->rom_len,
+                     RomFile_fd(rom));
+
+    // The mapper allocates its RAM from the heap, which cannot be mapped
+    FlatMemory_free(self->flat_memory, self->cart_ram);
+    self->cart_ram = nullptr;
+
+    if (Mapper_ram_len(self->mapper) != 0) {
+        self->cart_ram =
+            FlatMemory_alloc(self->flat_memory, Mapper_ram_len(self->mapper));
+        Mapper_set_ram(self->mapper, self->cart_ram);
+    }
+#endif
+
+    if (self->aot != nullptr &&
+        !AotImage_matches(self->aot, self->rom, self->rom_len))
+        self->aot = nullptr;
 
     GameBoy_reset(self);
 
     if (!self->boot_rom_exists)
         GameBoy_simulate_boot(self);
+
+    GameBoy_map_memory(self);
 }
 
-u8 GameBoy_read_io(const GameBoy *const self, const u16 addr)
+bool GameBoy_open_save(GameBoy *const self, const char *const path)
 {
-    if (addr == 0xFF00) // FF00 (joypad input)
-        return self->joyp;
+    if (self->rom == nullptr)
+        return false;
 
-    // TODO: implement serial transfer
-    if (addr == 0xFF01) // FF01 (serial transfer data)
-        return 0xFF;
+    const CartridgeType type = self->rom[RomHeader_CartridgeType];
 
-    if (addr == 0xFF02) // FF02 (serial transfer control)
-        return self->sc;
+    if (!CartridgeType_has_battery(type))
+        return false;
 
-    if (addr >= 0xFF04 && addr <= 0xFF07) {
-        // FF04-FF07 (timer and divider)
+    // Cartridge RAM, followed by the state of the clock (see Mapper_save_clock)
+    const size_t ram_len = Mapper_ram_len(self->mapper);
+    const bool has_clock = CartridgeType_has_timer(type);
+    const size_t len = ram_len + (has_clock ? MAPPER_CLOCK_SAVE_LEN : 0);
 
-        // clang-format off
-        switch (addr) {
-            case 0xFF04: return self->div;
-            case 0xFF05: return self->tima;
-            case 0xFF06: return self->tma;
-            case 0xFF07: return self->tac;
-            default: BAIL("Unexpected I/O timer and divider read ($%04X)", addr);
-        }
-        // clang-format on
-    }
-
-    if (addr == 0xFF0F) // FF0F (interrupts)
-        return self->if_;
-
-    if (addr >= 0xFF10 && addr <= 0xFF26) // FF10-FF26 (audio)
-        BAIL("I/O audio read ($%04X)", addr);
-
-    if (addr >= 0xFF30 && addr <= 0xFF3F) // FF30-FF3F (wave pattern)
-        BAIL("I/O wave pattern read ($%04X)", addr);
-
-    if (addr >= 0xFF40 && addr <= 0xFF4B) {
-        // FF40-FF4B (LCD)
-        // clang-format off
-        switch (addr) {
-            case 0xFF40: return self->lcdc;
-            case 0xFF44: return self->ly;
-            case 0xFF45: return self->lcy;
-            case 0xFF41: return self->stat;
-            case 0xFF42: return self->scy;
-            case 0xFF43: return self->scx;
-            case 0xFF4A: return self->wy;
-            case 0xFF4B: return self->wx;
-            case 0xFF47: return self->bgp;
-            case 0xFF48: return self->obp0;
-            case 0xFF49: return self->obp1;
-            default: BAIL("Unexpected I/O LCD read (addr = $%04X)", addr);
-        }
-        // clang-format on
+    if (len == 0)
+        return false;
+
+    SaveFile *const save = SaveFile_open(path, len);
+
+    if (save == nullptr)
+        return false;
+
+    u8 *const data = SaveFile_data(save);
+    Mapper_set_ram(self->mapper, data);
+
+    // Forks keep the pages they share, but this one has new contents
+    SharedCartRam_destroy(self->cart_shared);
+    self->cart_shared = nullptr;
+
+    if (has_clock && SaveFile_loaded_len(save) == len) {
+        Mapper_load_clock(self->mapper, GameBoy_now(self), time(nullptr),
+                          &data[ram_len]);
     }
 
-    if (addr == 0xFF4D) // FF4D (CGB registers, CGB-only)
-        return 0xFF;
+#ifdef GEMU_FLAT_MEMORY
+    FlatMemory_share(self->flat_memory, data, len, SaveFile_fd(save));
+    FlatMemory_free(self->flat_memory, self->cart_ram);
+    self->cart_ram = nullptr;
 
-    if (addr == 0xFF4F) // FF4F (VRAM bank select, CGB-only)
-        return 0xFF;
+    if (self->save != nullptr)
+        FlatMemory_unshare(self->flat_memory, SaveFile_data(self->save));
+#endif
 
-    if (addr == 0xFF50) // FF50 (boot ROM disable)
-        return 0xFF;
+    // The mapper no longer uses any previous save file
+    SaveFile_destroy(self->save);
+    self->save = save;
+    GameBoy_map_cartridge(self);
 
-    if (addr >= 0xFF51 && addr <= 0xFF55) // FF51-FF55 (VRAM DMA, CGB-only)
-        return 0xFF;
+    log_info("Saving to %s", path);
+    return true;
+}
 
-    if (addr >= 0xFF68 && addr <= 0xFF6B) // FF68-FF6B (LCD palettes, CGB-only)
-        return 0xFF;
+void GameBoy_flush_save(GameBoy *const self)
+{
+    if (self->save == nullptr)
+        return;
 
-    if (addr == 0xFF70) // FF70 (WRAM bank select, CGB-only)
-        return 0xFF;
+    u8 clock[MAPPER_CLOCK_SAVE_LEN];
+
+    if (CartridgeType_has_timer(self->rom[RomHeader_CartridgeType]) &&
+        Mapper_save_clock(self->mapper, GameBoy_now(self), time(nullptr),
+                          clock)) {
+        // Leave the page alone unless the clock moved
+        const size_t ram_len = Mapper_ram_len(self->mapper);
+        u8 *const saved = &SaveFile_data(self->save)[ram_len];
+
+        if (memcmp(saved, clock, sizeof(clock)) != 0)
+            memcpy(saved, clock, sizeof(clock));
+    }
+
+    SaveFile_flush(self->save);
+}
+
+bool GameBoy_add_cheat(GameBoy *const self, const char *const code)
+{
+    Cheat cheat;
+
+    if (self->rom == nullptr || !Cheat_parse(code, &cheat))
+        return false;
+
+    if (self->cheats == nullptr)
+        self->cheats = Cheats_new(self->rom, self->rom_len);
+
+    Cheats_add(self->cheats, &cheat);
+
+    if (cheat.kind == CheatKind_RomPatch) {
+        // Blocks decoded before may include the patched code
+        if (self->block_cache != nullptr)
+            BlockCache_clear(self->block_cache);
+        GameBoy_map_cartridge(self);
+    }
+
+    return true;
+}
+
+void GameBoy_clear_cheats(GameBoy *const self)
+{
+    Cheats_destroy(self->cheats);
+    self->cheats = nullptr;
+
+    // Decoded blocks only ever stopped short of patched pages, so they are
+    // still good
+    GameBoy_map_cartridge(self);
+}
+
+void GameBoy_apply_cheats(GameBoy *const self)
+{
+    if (self->cheats == nullptr)
+        return;
+
+    size_t count;
+    const Cheat *const writes = Cheats_ram_writes(self->cheats, &count);
+
+    for (size_t i = 0; i < count; ++i)
+        GameBoy_write_mem(self, writes[i].addr, writes[i].value);
+}
+
+// Whether any watchpoint is set, so that each step runs a single instruction
+static bool GameBoy_watching(const GameBoy *const self)
+{
+    return self->watchpoints != nullptr &&
+           Watchpoints_kinds(self->watchpoints) != 0;
+}
+
+// Brings the page tables in line with the watchpoints
+static void GameBoy_update_watched(GameBoy *const self)
+{
+    self->hram_watch = Watchpoints_page(self->watchpoints, 0xFF80);
+    GameBoy_remap_memory(self);
+}
+
+size_t GameBoy_add_watchpoint(GameBoy *const self, const u16 first,
+                              const u16 last, const WatchKind kinds)
+{
+    if (self->watchpoints == nullptr)
+        self->watchpoints = Watchpoints_new();
+
+    const size_t id = Watchpoints_add(self->watchpoints, first, last, kinds);
+    GameBoy_update_watched(self);
+    return id;
+}
+
+bool GameBoy_remove_watchpoint(GameBoy *const self, const size_t id)
+{
+    if (self->watchpoints == nullptr ||
+        !Watchpoints_remove(self->watchpoints, id))
+        return false;
+
+    GameBoy_update_watched(self);
+    return true;
+}
+
+void GameBoy_set_watch_callback(GameBoy *const self,
+                                const WatchCallback callback, void *const data)
+{
+    if (self->watchpoints == nullptr)
+        self->watchpoints = Watchpoints_new();
+
+    Watchpoints_set_callback(self->watchpoints, callback, data);
+}
+
+const WatchHit *GameBoy_watch_stop(const GameBoy *const self)
+{
+    return self->watchpoints == nullptr
+               ? nullptr
+               : Watchpoints_stopped(self->watchpoints);
+}
+
+void GameBoy_resume(GameBoy *const self)
+{
+    if (self->watchpoints != nullptr)
+        Watchpoints_resume(self->watchpoints);
+}
+
+bool GameBoy_set_aot_image(GameBoy *const self, const AotImage *const image)
+{
+    if (self->rom == nullptr ||
+        !AotImage_matches(image, self->rom, self->rom_len)) {
+        log_warn("Compiled image does not match the loaded ROM, ignoring it");
+        self->aot = nullptr;
+        return false;
+    }
+
+    log_info("Using compiled image (%zu blocks)", image->block_count);
+    self->aot = image;
+    return true;
+}
+
+static void GameBoy_write_div(GameBoy *const self,
+                              [[maybe_unused]] const u8 value)
+{
+    self->div = 0;
+}
+
+// Gives the rest of the address space back to the CPU once the running OAM
+// DMA transfer is done
+static void GameBoy_update_dma(GameBoy *const self)
+{
+    if (self->dma_end != 0 && GameBoy_now(self) >= self->dma_end) {
+        self->dma_end = 0;
+        GameBoy_map_memory(self);
+    }
+}
+
+// Starts an OAM DMA transfer from the page given by a write to FF46. It is
+// emulated as a lockout only: OAM is copied all at once, and then the CPU can
+// only reach High RAM and I/O, and the PPU draws no objects, until dma_end.
+// Neither of them can tell that apart from a copy one byte per M-cycle, since
+// the source cannot be written meanwhile and OAM cannot be read.
+static void GameBoy_start_lockout_dma(GameBoy *const self, const u8 value)
+{
+    // A transfer started during another one starts over
+    if (self->dma_end != 0) {
+        self->dma_end = 0;
+        GameBoy_map_memory(self);
+    }
+
+    // Sources past DFFF read WRAM, as through Echo RAM
+    const u16 src = (u16)(value < 0xE0 ? value : value - 0x20) << 8;
+    const u8 *const page = self->read_pages[src / GB_PAGE_LEN];
+
+    if (page != nullptr) {
+        memcpy(self->oam, page, sizeof(self->oam));
+    } else {
+        // Not a CPU read, so watchpoints are not checked
+        for (size_t i = 0; i < sizeof(self->oam); ++i)
+            self->oam[i] = GameBoy_decode_read(self, src + i);
+    }
+
+    self->dma_end = GameBoy_now(self) + OAM_DMA_CYCLES;
+    memset(self->read_pages, 0, sizeof(self->read_pages));
+    memset(self->write_pages, 0, sizeof(self->write_pages));
+#ifdef GEMU_FLAT_MEMORY
+    self->flat = nullptr;
+#endif
+}
+
+static void GameBoy_write_boot_rom_disable(GameBoy *const self, const u8 value)
+{
+    if (value != 0) {
+        self->boot_rom_enable = false;
+        GameBoy_map_cartridge(self);
+    }
+}
 
-    BAIL("Unexpected I/O read (addr = $%04X)", addr);
+typedef struct {
+    size_t offset; // Of the byte in GameBoy backing the register
+    u8 readable;   // Bits read back from that byte, the others read as 1
+    u8 writable;   // Bits writes store into that byte
+    void (*write)(GameBoy *self, u8 value); // Side effects of writes, if any
+} IoRegister;
+
+#define IO_FIELD(field, readable_, writable_)                                  \
+    {.offset = offsetof(GameBoy, field),                                       \
+     .readable = (readable_),                                                  \
+     .writable = (writable_)}
+
+#define IO_AUDIO(addr, readable_, writable_)                                   \
+    [(addr) - 0xFF00] = {.offset = offsetof(GameBoy, audio) + (addr) - 0xFF10, \
+                         .readable = (readable_),                              \
+                         .writable = (writable_)}
+
+// FF00-FF7F (I/O registers). Addresses that are not listed here read as $FF
+// and ignore writes, like unmapped registers do on hardware.
+static const IoRegister IO_REGISTERS[0x80] = {
+    [0x00] = {.offset = offsetof(GameBoy, joyp),
+              .readable = 0x3F,
+              .write = GameBoy_write_joyp}, // FF00 (joypad input)
+
+    // FF01 (serial transfer data), reads back as $FF until serial transfer
+    // gets implemented
+    [0x01] = IO_FIELD(sb, 0x00, 0xFF),
+    [0x02] = IO_FIELD(sc, 0x81, 0x81), // FF02 (serial transfer control)
+
+    // FF04-FF07 (timer and divider)
+    [0x04] = {.offset = offsetof(GameBoy, div),
+              .readable = 0xFF,
+              .write = GameBoy_write_div},
+    [0x05] = IO_FIELD(tima, 0xFF, 0xFF),
+    [0x06] = IO_FIELD(tma, 0xFF, 0xFF),
+    [0x07] = IO_FIELD(tac, 0x07, 0x07),
+
+    [0x0F] = IO_FIELD(if_, 0x1F, 0x1F), // FF0F (interrupts)
+
+    // FF10-FF26 (audio), stored but not played. Write-only bits read as 1.
+    IO_AUDIO(0xFF10, 0x7F, 0xFF), // NR10
+    IO_AUDIO(0xFF11, 0xC0, 0xFF), // NR11
+    IO_AUDIO(0xFF12, 0xFF, 0xFF), // NR12
+    IO_AUDIO(0xFF13, 0x00, 0xFF), // NR13
+    IO_AUDIO(0xFF14, 0x40, 0xFF), // NR14
+    IO_AUDIO(0xFF16, 0xC0, 0xFF), // NR21
+    IO_AUDIO(0xFF17, 0xFF, 0xFF), // NR22
+    IO_AUDIO(0xFF18, 0x00, 0xFF), // NR23
+    IO_AUDIO(0xFF19, 0x40, 0xFF), // NR24
+    IO_AUDIO(0xFF1A, 0x80, 0xFF), // NR30
+    IO_AUDIO(0xFF1B, 0x00, 0xFF), // NR31
+    IO_AUDIO(0xFF1C, 0x60, 0xFF), // NR32
+    IO_AUDIO(0xFF1D, 0x00, 0xFF), // NR33
+    IO_AUDIO(0xFF1E, 0x40, 0xFF), // NR34
+    IO_AUDIO(0xFF20, 0x00, 0xFF), // NR41
+    IO_AUDIO(0xFF21, 0xFF, 0xFF), // NR42
+    IO_AUDIO(0xFF22, 0xFF, 0xFF), // NR43
+    IO_AUDIO(0xFF23, 0x40, 0xFF), // NR44
+    IO_AUDIO(0xFF24, 0xFF, 0xFF), // NR50
+    IO_AUDIO(0xFF25, 0xFF, 0xFF), // NR51
+    IO_AUDIO(0xFF26, 0x8F, 0x80), // NR52
+
+    // FF30-FF3F (wave pattern)
+    IO_AUDIO(0xFF30, 0xFF, 0xFF),
+    IO_AUDIO(0xFF31, 0xFF, 0xFF),
+    IO_AUDIO(0xFF32, 0xFF, 0xFF),
+    IO_AUDIO(0xFF33, 0xFF, 0xFF),
+    IO_AUDIO(0xFF34, 0xFF, 0xFF),
+    IO_AUDIO(0xFF35, 0xFF, 0xFF),
+    IO_AUDIO(0xFF36, 0xFF, 0xFF),
+    IO_AUDIO(0xFF37, 0xFF, 0xFF),
+    IO_AUDIO(0xFF38, 0xFF, 0xFF),
+    IO_AUDIO(0xFF39, 0xFF, 0xFF),
+    IO_AUDIO(0xFF3A, 0xFF, 0xFF),
+    IO_AUDIO(0xFF3B, 0xFF, 0xFF),
+    IO_AUDIO(0xFF3C, 0xFF, 0xFF),
+    IO_AUDIO(0xFF3D, 0xFF, 0xFF),
+    IO_AUDIO(0xFF3E, 0xFF, 0xFF),
+    IO_AUDIO(0xFF3F, 0xFF, 0xFF),
+
+    // FF40-FF4B (LCD)
+    [0x40] = IO_FIELD(lcdc, 0xFF, 0xFF),
+    [0x41] = IO_FIELD(stat, 0x7F, 0x78), // Bits 0-2 are set by the LCD
+    [0x42] = IO_FIELD(scy, 0xFF, 0xFF),
+    [0x43] = IO_FIELD(scx, 0xFF, 0xFF),
+    [0x44] = IO_FIELD(ly, 0xFF, 0x00),
+    [0x45] = IO_FIELD(lcy, 0xFF, 0xFF),
+    [0x46] = {.write = GameBoy_start_lockout_dma}, // FF46 (OAM DMA)
+    [0x47] = IO_FIELD(bgp, 0xFF, 0xFF),
+    [0x48] = IO_FIELD(obp0, 0xFF, 0xFF),
+    [0x49] = IO_FIELD(obp1, 0xFF, 0xFF),
+    [0x4A] = IO_FIELD(wy, 0xFF, 0xFF),
+    [0x4B] = IO_FIELD(wx, 0xFF, 0xFF),
+
+    [0x50] = {.write = GameBoy_write_boot_rom_disable}, // FF50
+
+    // Everything else is either CGB-only or unused
+};
+
+#undef IO_FIELD
+#undef IO_AUDIO
+
+u8 GameBoy_read_io(const GameBoy *const self, const u16 addr)
+{
+    const IoRegister *const reg = &IO_REGISTERS[addr - 0xFF00];
+    const u8 value = ((const u8 *)self)[reg->offset];
+
+    return (value & reg->readable) | (u8)~reg->readable;
 }
 
-u8 GameBoy_read_mem(const void *const ctx, const u16 addr)
+// Reads addr with the full address decoding, without checking watchpoints
+static u8 GameBoy_decode_read(const GameBoy *const self, const u16 addr)
 {
-    const GameBoy *const self = ctx;
+    // FF00-FF7F (I/O registers), by far the most common access that is not
+    // paged, so it comes first
+    if (addr >= 0xFF00 && addr <= 0xFF7F)
+        return GameBoy_read_io(self, addr);
+
+    // Only High RAM and I/O can be reached during OAM DMA
+    if (addr < 0xFF00 && GameBoy_oam_dma_running(self))
+        return 0xFF;
 
     if (addr <= 0x7FFF) {
-        if (self->boot_rom_enable && addr <= 0x100) {
-            // 0000-0100 (Boot ROM)
+        if (self->boot_rom_enable && addr < GB_BOOT_ROM_LEN) {
+            // 0000-00FF (Boot ROM)
             if (!self->boot_rom_exists)
                 BAIL("Tried to read non-existing boot ROM");
 
@@ -267,21 +1016,38 @@ u8 GameBoy_read_mem(const void *const ctx, const u16 addr)
         if (self->rom == nullptr)
             BAIL("Tried to read non-existing ROM");
 
+        if (self->cheats != nullptr) {
+            const u8 *const overlay = Cheats_rom_page(
+                self->cheats, Mapper_rom_bank(self->mapper, addr), addr);
+
+            if (overlay != nullptr)
+                return overlay[addr % GB_PAGE_LEN];
+        }
+
         // 0000-8FFF (from cartridge)
-        return Mapper_read(self->mapper, self->rom, self->rom_len, addr);
+        return Mapper_read(self->mapper, self->rom, self->rom_len, addr,
+                           GameBoy_now(self));
     }
 
     if (addr <= 0x9FFF) // 8000-9FFF (VRAM)
-        return self->vram[addr - 0x8000];
+        return GameBoy_memory_page(self, addr)[addr % GB_PAGE_LEN];
+
+    if (addr <= 0xBFFF) { // A000-BFFF (from cartridge)
+        const SharedCartPage *const shared =
+            GameBoy_cart_shared_page(self, addr);
+
+        if (shared != nullptr && shared->stale)
+            return shared->page->data[addr % GB_PAGE_LEN];
 
-    if (addr <= 0xBFFF) // A000-BFFF (from cartridge)
-        return Mapper_read(self->mapper, self->rom, self->rom_len, addr);
+        return Mapper_read(self->mapper, self->rom, self->rom_len, addr,
+                           GameBoy_now(self));
+    }
 
     if (addr <= 0xDFFF) // C000-DFFF (WRAM)
-        return self->ram[addr - 0xC000];
+        return GameBoy_memory_page(self, addr)[addr % GB_PAGE_LEN];
 
     if (addr <= 0xFDFF) // E000-FDFF (Echo RAM, mirror of C000-DDFF)
-        return self->ram[addr - 0xE000];
+        return GameBoy_memory_page(self, addr)[addr % GB_PAGE_LEN];
 
     if (addr <= 0xFE9F) // FE00-FE9F (OAM)
         return self->oam[addr - 0xFE00];
@@ -289,9 +1055,6 @@ u8 GameBoy_read_mem(const void *const ctx, const u16 addr)
     if (addr <= 0xFEFF) // FEA0-FEFF (Not usable)
         BAIL("Tried to read unusable memory (addr = $%04X)", addr);
 
-    if (addr <= 0xFF7F) // FF00-FF7F (I/O registers)
-        return GameBoy_read_io(self, addr);
-
     if (addr <= 0xFFFE) // FF80-FFFE (High RAM)
         return self->hram[addr - 0xFF80];
 
@@ -299,113 +1062,269 @@ u8 GameBoy_read_mem(const void *const ctx, const u16 addr)
     return self->ie;
 }
 
-u16 GameBoy_read_mem_u16(GameBoy *const self, u16 addr)
+// Reads the opcode at addr for execute watchpoints, as $FF where reading it
+// would bail, so that watching a jump to unusable memory stops on it instead
+static u8 GameBoy_peek_opcode(const GameBoy *const self, const u16 addr)
 {
-    const u8 lo = GameBoy_read_mem(self, addr);
-    const u8 hi = GameBoy_read_mem(self, addr + 1);
-    return concat_u16(hi, lo);
-}
+    if (addr >= 0xFEA0 && addr <= 0xFEFF) // FEA0-FEFF (Not usable)
+        return 0xFF;
 
-void GameBoy_write_io(GameBoy *const self, const u16 addr, const u8 value)
-{
-    if (addr == 0xFF00) {
-        // FF00 (joypad input)
-        GameBoy_write_joyp(self, value);
-    } else if (addr == 0xFF01) {
-        // FF01 (serial transfer data)
-        self->sb = value;
-    } else if (addr == 0xFF02) {
-        // FF02 (serial transfer control)
-        // TODO: implement properly
-        self->sc = value;
-    } else if (addr >= 0xFF04 && addr <= 0xFF07) {
-        // FF04-FF07 (timer and divider)
-        // clang-format off
-        switch (addr) {
-            case 0xFF04: self->div = 0; break;
-            case 0xFF05: self->tima = value; break;
-            case 0xFF06: self->tma = value; break;
-            case 0xFF07: self->tac = value; break;
-            default: BAIL("Unexpected I/O timer and divider write ($%04X, $%02X)", addr, value);
-        }
-        // clang-format on
-    } else if (addr == 0xFF0F) {
-        // FF0F (interrupts)
-        self->if_ = value;
-    } else if (addr >= 0xFF10 && addr <= 0xFF26) {
-        // FF10-FF26 (audio)
-        // TODO: I/O audio write
-    } else if (addr >= 0xFF30 && addr <= 0xFF3F) {
-        // FF30-FF3F (wave pattern)
-        // TODO: I/O wave pattern write
-    } else if (addr == 0xFF46) {
-        // FF46 (OAM DMA source address and start)
-        const u16 src = (u16)value << 8;
-
-        // TODO: implement proper timing
-        for (size_t i = 0; i < 0xA0; ++i) {
-            self->oam[i] = GameBoy_read_mem(self, src + i);
-        }
-    } else if (addr >= 0xFF40 && addr <= 0xFF4B) {
-        // FF40-FF4B (LCD)
-        // clang-format off
-        switch (addr) {
-            case 0xFF40: self->lcdc = value; break;
-            case 0xFF45: self->lcy = value; break;
-            case 0xFF41:
-                // Modifies only bits 3-7
-                self->stat = (self->stat & 0b111) | (value & ~0b111);
-                break;
-            case 0xFF42: self->scy = value; break;
-            case 0xFF43: self->scx = value; break;
-            case 0xFF4A: self->wy = value; break;
-            case 0xFF4B: self->wx = value; break;
-            case 0xFF47: self->bgp = value; break;
-            case 0xFF48: self->obp0 = value; break;
-            case 0xFF49: self->obp1 = value; break;
-            default: log_warn("Unexpected I/O LCD write (addr = $%04X, value = $%02X)", addr, value);
-        }
-        // clang-format on
-    } else if (addr == 0xFF4F) {
-        // FF4F
-        log_warn("I/O VRAM bank select write ($%04X, $%02X)", addr, value);
-    } else if (addr == 0xFF50) {
-        // FF50 (boot ROM disable)
-        if (value != 0)
-            self->boot_rom_enable = false;
-    } else if (addr >= 0xFF51 && addr <= 0xFF55) {
-        // FF51-FF55 (VRAM DMA, CGB-only)
-    } else if (addr >= 0xFF68 && addr <= 0xFF6B) {
-        // FF68-FF6B (LCD color palettes, CGB-only)
-    } else if (addr == 0xFF70) {
-        // FF70 (WRAM bank select, CGB-only)
+    if (addr <= 0x7FFF) {
+        const bool boot_rom = self->boot_rom_enable && addr < GB_BOOT_ROM_LEN;
+
+        if (boot_rom ? !self->boot_rom_exists : self->rom == nullptr)
+            return 0xFF;
+    }
+
+    return GameBoy_decode_read(self, addr);
+}
+
+u8 GameBoy_read_unpaged(const GameBoy *const self, const u16 addr)
+{
+    const u8 value = GameBoy_decode_read(self, addr);
+
+    if (self->watchpoints != nullptr)
+        Watchpoints_check(self->watchpoints, WatchKind_Read, addr, value);
+
+    return value;
+}
+
+u16 GameBoy_read_mem_u16(GameBoy *const self, u16 addr)
+{
+    const u8 lo = GameBoy_read_mem(self, addr);
+    const u8 hi = GameBoy_read_mem(self, addr + 1);
+    return concat_u16(hi, lo);
+}
+
+void GameBoy_write_io(GameBoy *const self, const u16 addr, const u8 value)
+{
+    const IoRegister *const reg = &IO_REGISTERS[addr - 0xFF00];
+
+    if (reg->writable != 0) {
+        u8 *const stored = (u8 *)self + reg->offset;
+        *stored = (*stored & ~reg->writable) | (value & reg->writable);
+    } else if (reg->write == nullptr) {
+        log_debug("Unmapped I/O write (addr = $%04X, value = $%02X)", addr,
+                  value);
+    }
+
+    if (reg->write != nullptr)
+        reg->write(self, value);
+}
+
+// Points the page tables at mem for the page at addr, leaving it out wherever
+// it is watched as GameBoy_unmap_watched does
+static void GameBoy_map_page(GameBoy *const self, const u16 addr, u8 *const mem)
+{
+    const size_t page = addr / GB_PAGE_LEN;
+    const WatchKind kinds = self->watchpoints == nullptr
+                                ? 0
+                                : Watchpoints_page(self->watchpoints, addr);
+
+    self->read_pages[page] = (kinds & WatchKind_Read) != 0 ? nullptr : mem;
+    self->write_pages[page] = (kinds & WatchKind_Write) != 0 ? nullptr : mem;
+}
+
+// Stops sharing the page of VRAM or WRAM holding addr with forks, so that it
+// can be written to
+static void GameBoy_unshare(GameBoy *const self, const u16 addr)
+{
+    const size_t index = GameBoy_shared_index(addr);
+    const u64 bit = (u64)1 << index;
+    SharedPage *const page = self->shared[index];
+
+    if (page == nullptr)
+        return;
+
+    if ((self->stale & bit) != 0) {
+        memcpy(GameBoy_own_page(self, index), page->data, GB_PAGE_LEN);
+        self->stale &= ~bit;
+
+        // Blocks decoded from the copy must not outlive it
+        if (addr >= 0xC000 && self->block_cache != nullptr)
+            BlockCache_flush_ram(self->block_cache);
+    }
+
+    SharedPage_release(page);
+    self->shared[index] = nullptr;
+    self->shared_mask &= ~bit;
+
+    // Only the entries for the page itself change, along with its Echo RAM
+    // mirror
+    if (self->dma_end != 0)
+        return;
+
+    u8 *const own = GameBoy_own_page(self, index);
+    const u16 page_addr = 0x8000 + (index * GB_PAGE_LEN);
+
+    if (page_addr <= 0x9FFF) {
+        GameBoy_map_page(self, page_addr, own);
     } else {
-        log_warn("Unexpected I/O write (addr = $%04X, value = $%02X)", addr,
-                 value);
+        // C000-DFFF (WRAM), and E000-FDFF (Echo RAM) for all but the last
+        // pages
+        const u16 wram_addr = page_addr + 0x2000;
+        GameBoy_map_page(self, wram_addr, own);
+
+        if (wram_addr + 0x2000 < 0xFE00)
+            GameBoy_map_page(self, wram_addr + 0x2000, own);
+    }
+}
+
+// Stops sharing the page of cartridge RAM mapped at addr with forks, if any,
+// like GameBoy_unshare
+static void GameBoy_unshare_cart(GameBoy *const self, const u16 addr)
+{
+    SharedCartPage *const shared = GameBoy_cart_shared_page(self, addr);
+
+    if (shared == nullptr || shared->page == nullptr)
+        return;
+
+    u8 *const own = &Mapper_ram_bank(
+        self->mapper)[(addr - 0xA000) - (addr % GB_PAGE_LEN)];
+
+    if (shared->stale) {
+        memcpy(own, shared->page->data, GB_PAGE_LEN);
+        shared->stale = false;
     }
+
+    SharedPage_release(shared->page);
+    shared->page = nullptr;
+
+    if (self->dma_end == 0)
+        GameBoy_map_page(self, addr, own);
 }
 
-void GameBoy_write_mem(void *const ctx, const u16 addr, const u8 value)
+void GameBoy_fork(GameBoy *const self, GameBoy *const child)
 {
-    GameBoy *const self = ctx;
+#ifdef GEMU_FLAT_MEMORY
+    // The flat window would need mapping pages of other instances
+    BAIL("GameBoy_fork is not supported with GEMU_FLAT_MEMORY");
+#endif
+
+    // Pages written to since the last fork are shared from now on
+    for (size_t index = 0; index < GB_SHARED_PAGE_COUNT; ++index) {
+        if (self->shared[index] != nullptr)
+            continue;
+
+        self->shared[index] = SharedPage_new(GameBoy_own_page(self, index));
+        self->shared_mask |= (u64)1 << index;
+    }
+
+    // Cartridge RAM too, rather than each fork copying all of it
+    const size_t cart_pages = self->mapper == nullptr
+                                  ? 0
+                                  : Mapper_ram_len(self->mapper) / GB_PAGE_LEN;
+
+    if (cart_pages != 0 && self->cart_shared == nullptr)
+        self->cart_shared = SharedCartRam_new(cart_pages);
+
+    for (size_t index = 0; index < cart_pages; ++index) {
+        SharedCartPage *const shared = &self->cart_shared->pages[index];
+
+        if (shared->page == nullptr) {
+            shared->page = SharedPage_new(
+                &Mapper_ram(self->mapper)[index * GB_PAGE_LEN]);
+        }
+    }
 
+    GameBoy_remap_memory(self);
+
+    // Everything but the page tables, vram and ram, which the fork reads from
+    // the shared pages instead, and the framebuffer (as checked next to the
+    // GameBoy struct)
+    memcpy(child, self, offsetof(GameBoy, read_pages));
+    memcpy(&child->oam, &self->oam, sizeof(GameBoy) - offsetof(GameBoy, oam));
+    memset(child->framebuffer, 0, sizeof(child->framebuffer));
+
+    for (size_t index = 0; index < GB_SHARED_PAGE_COUNT; ++index)
+        ++child->shared[index]->refs;
+
+    child->stale = child->shared_mask;
+
+    // Allocated on the first step, as for a new GameBoy, since forks often
+    // never run
+    child->block_cache = nullptr;
+#ifdef GEMU_JIT
+    child->jit = nullptr;
+#endif
+
+    if (self->rom_file != nullptr)
+        child->rom_file = RomFile_ref(self->rom_file);
+
+    if (self->mapper != nullptr)
+        child->mapper = Mapper_clone_in(&child->mapper_storage, self->mapper);
+
+    // Cartridge RAM of the copy is left as it is until each page is written,
+    // and read from the shared pages until then
+    child->cart_shared = nullptr;
+
+    if (cart_pages != 0) {
+        child->cart_shared = SharedCartRam_new(cart_pages);
+
+        for (size_t index = 0; index < cart_pages; ++index) {
+            SharedPage *const page = self->cart_shared->pages[index].page;
+
+            ++page->refs;
+            child->cart_shared->pages[index] =
+                (SharedCartPage){.page = page, .stale = true};
+        }
+    }
+
+    if (self->cheats != nullptr)
+        child->cheats = Cheats_clone(self->cheats);
+
+    child->save = nullptr;
+    child->watchpoints = nullptr;
+    child->hram_watch = 0;
+
+    memset(child->read_pages, 0, sizeof(child->read_pages));
+    memset(child->write_pages, 0, sizeof(child->write_pages));
+    GameBoy_remap_memory(child);
+}
+
+// Writes addr with the full address decoding, without checking watchpoints
+static void GameBoy_decode_write(GameBoy *const self, const u16 addr,
+                                 const u8 value)
+{
     log_trace("write mem (addr = $%04X, value = $%02X)", addr, value);
 
-    if (addr <= 0x7FFF) {
+    if (self->dma_end != 0 && addr < 0xFF00) {
+        GameBoy_update_dma(self);
+
+        // Only High RAM and I/O can be reached during OAM DMA
+        if (self->dma_end != 0)
+            return;
+    }
+
+    if (addr >= 0xFF00 && addr <= 0xFF7F) {
+        // FF00-FF7F (I/O registers), as for GameBoy_read_unpaged
+        GameBoy_write_io(self, addr, value);
+    } else if (addr <= 0x7FFF) {
         // 0000-7FFF (ROM bank)
-        Mapper_write(self->mapper, addr, value);
+        Mapper_write(self->mapper, addr, value, GameBoy_now(self));
+        if (self->block_cache != nullptr)
+            BlockCache_reset_cursor(self->block_cache);
+        GameBoy_map_cartridge(self);
     } else if (addr <= 0x9FFF) {
         // 8000-9FFF (VRAM)
+        GameBoy_unshare(self, addr);
         self->vram[addr - 0x8000] = value;
     } else if (addr <= 0xBFFF) {
         // A000-BFFF (External RAM)
-        Mapper_write(self->mapper, addr, value);
+        GameBoy_unshare_cart(self, addr);
+        Mapper_write(self->mapper, addr, value, GameBoy_now(self));
     } else if (addr <= 0xDFFF) {
         // C000-DFFF (WRAM)
+        GameBoy_unshare(self, addr);
         self->ram[addr - 0xC000] = value;
+        if (self->block_cache != nullptr)
+            BlockCache_write_ram(self->block_cache, addr);
     } else if (addr <= 0xFDFF) {
         // E000-FDFF (Echo RAM, mirror of C000-DDFF)
+        GameBoy_unshare(self, addr);
         self->ram[addr - 0xE000] = value;
+        if (self->block_cache != nullptr)
+            BlockCache_write_ram(self->block_cache, addr - 0x2000);
     } else if (addr <= 0xFE9F) {
         // FE00-FE9F (OAM)
         // TODO: should only be writable during HBlank or VBlank
@@ -414,18 +1333,25 @@ void GameBoy_write_mem(void *const ctx, const u16 addr, const u8 value)
         // FEA0-FEFF (Not usable)
         log_debug("Tried to write into unusable memory (addr = $%04X, $%02X)",
                   addr, value);
-    } else if (addr <= 0xFF7F) {
-        // FF00-FF7F I/O registers
-        GameBoy_write_io(self, addr, value);
     } else if (addr <= 0xFFFE) {
         // FF80-FFFE (High RAM)
         self->hram[addr - 0xFF80] = value;
+        if (self->block_cache != nullptr)
+            BlockCache_write_ram(self->block_cache, addr);
     } else {
         // FFFF (Interrupt Enable Register)
         self->ie = value;
     }
 }
 
+void GameBoy_write_unpaged(GameBoy *const self, const u16 addr, const u8 value)
+{
+    GameBoy_decode_write(self, addr, value);
+
+    if (self->watchpoints != nullptr)
+        Watchpoints_check(self->watchpoints, WatchKind_Write, addr, value);
+}
+
 void GameBoy_service_interrupts(GameBoy *const self, Memory *const mem)
 {
     const u8 int_mask = self->if_ & self->ie;
@@ -446,3 +1372,998 @@ void GameBoy_service_interrupts(GameBoy *const self, Memory *const mem)
         }
     }
 }
+
+static const BlockOp *GameBoy_lookup_block(GameBoy *const self, const u16 pc)
+{
+    BlockCache *const cache = self->block_cache;
+
+    if (pc <= 0x7FFF) {
+        // 0000-7FFF (ROM), unless the boot ROM is mapped over it
+        if ((self->boot_rom_enable && pc < GB_BOOT_ROM_LEN) ||
+            self->rom == nullptr)
+            return nullptr;
+
+        const size_t bank = Mapper_rom_bank(self->mapper, pc);
+        const size_t bank_end = (bank + 1) * 0x4000;
+        const size_t offset = (bank * 0x4000) + (pc & 0x3FFF);
+
+        if (offset >= self->rom_len)
+            return nullptr;
+
+        size_t end = bank_end < self->rom_len ? bank_end : self->rom_len;
+
+        if (self->cheats != nullptr) {
+            // Code in pages patched by cheats runs through the bus, and blocks
+            // stop short of any such page
+            if (Cheats_rom_page(self->cheats, bank, pc) != nullptr)
+                return nullptr;
+
+            const size_t patched =
+                offset + (Cheats_next_patched(self->cheats, pc) - pc);
+            end = patched < end ? patched : end;
+        }
+
+        return BlockCache_lookup(cache, bank, pc, &self->rom[offset],
+                                 end - offset);
+    }
+
+    if (pc >= 0xC000 && pc <= 0xDFFF) {
+        // C000-DFFF (WRAM). Pages only held by the GameBoy this one was forked
+        // from lie elsewhere, so blocks then stop at the end of the page.
+        const u8 *const code =
+            &GameBoy_memory_page(self, pc)[pc % GB_PAGE_LEN];
+        const u32 end =
+            self->stale == 0 ? 0xE000 : pc - (pc % GB_PAGE_LEN) + GB_PAGE_LEN;
+
+        return BlockCache_lookup(cache, BLOCK_BANK_RAM, pc, code, end - pc);
+    }
+
+    if (pc >= 0xFF80 && pc <= 0xFFFE) {
+        // FF80-FFFE (High RAM)
+        return BlockCache_lookup(cache, BLOCK_BANK_RAM, pc,
+                                 &self->hram[pc - 0xFF80], 0xFFFF - pc);
+    }
+
+    return nullptr;
+}
+
+static size_t GameBoy_run_aot(GameBoy *const self, Memory *const mem)
+{
+    Cpu *const cpu = &self->cpu;
+
+    // Compiled code knows nothing about ROM patched by cheats
+    if (self->cheats != nullptr && Cheats_patches_rom(self->cheats))
+        return 0;
+
+    // As with native blocks, the instruction after ei runs on its own
+    if (cpu->pc > 0x7FFF ||
+        (self->boot_rom_enable && cpu->pc < GB_BOOT_ROM_LEN) ||
+        cpu->queued_ime)
+        return 0;
+
+    const AotBlock *const block = AotImage_find(
+        self->aot, Mapper_rom_bank(self->mapper, cpu->pc), cpu->pc);
+    if (block == nullptr)
+        return 0;
+
+    BlockCache_reset_cursor(self->block_cache);
+    block->run(cpu, mem);
+    return block->op_count;
+}
+
+#ifdef GEMU_JIT
+static bool GameBoy_can_run_native(const GameBoy *self, int cycles);
+
+static size_t GameBoy_run_native(GameBoy *const self, Memory *const mem)
+{
+    Block *const block = self->block_cache->block;
+
+    // RAM blocks may be overwritten by their own code, and the instruction
+    // after ei must run on its own so interrupts can be taken right after it
+    if (block->bank == BLOCK_BANK_RAM || self->cpu.queued_ime)
+        return 0;
+
+    if (block->native == nullptr) {
+        if (block->hits < JIT_HOT_THRESHOLD)
+            return 0;
+
+        if (self->jit == nullptr)
+            self->jit = Jit_new();
+
+        size_t op_count = block->op_count;
+        block->native = Jit_compile(self->jit, block->pc, block->ops,
+                                    &op_count, &block->native_cycles);
+        block->native_op_count = op_count;
+
+        if (block->native == nullptr) {
+            // Out of space, so start over
+            Jit_reset(self->jit);
+            BlockCache_clear(self->block_cache);
+            return 0;
+        }
+    }
+
+    if (!GameBoy_can_run_native(self, block->native_cycles))
+        return 0;
+
+    BlockCache_reset_cursor(self->block_cache);
+    block->native(&self->cpu, mem);
+    return block->native_op_count;
+}
+#endif
+
+// Checks the instruction about to run against the execute watchpoints, and
+// returns whether emulation is stopped
+static bool GameBoy_watch_step(GameBoy *const self)
+{
+    Watchpoints *const watchpoints = self->watchpoints;
+    const u16 pc = self->cpu.pc;
+
+    if (Watchpoints_stopped(watchpoints) != nullptr)
+        return true;
+
+    if (self->cpu.mode == CpuMode_Running &&
+        (Watchpoints_page(watchpoints, pc) & WatchKind_Execute) != 0) {
+        Watchpoints_check(watchpoints, WatchKind_Execute, pc,
+                          GameBoy_peek_opcode(self, pc));
+    }
+
+    return Watchpoints_stopped(watchpoints) != nullptr;
+}
+
+size_t GameBoy_step(GameBoy *const self, Memory *const mem)
+{
+    Cpu *const cpu = &self->cpu;
+
+    if (self->dma_end != 0)
+        GameBoy_update_dma(self);
+
+    if (self->watchpoints != nullptr && GameBoy_watch_step(self))
+        return 0;
+
+    if (cpu->mode != CpuMode_Running) {
+        Cpu_tick(cpu, mem);
+        return 0;
+    }
+
+    // Code outside High RAM cannot be fetched during OAM DMA either, so it
+    // runs through the bus without any decoded blocks
+    if (self->dma_end != 0 && cpu->pc < 0xFF80) {
+        Cpu_tick(cpu, mem);
+        return 1;
+    }
+
+    // Allocated only once there is code to run, so that GameBoys which never
+    // run (such as most forks) do without
+    if (self->block_cache == nullptr)
+        self->block_cache = BlockCache_new();
+
+    // Compiled code runs whole blocks, past any watchpoint
+    if (self->aot != nullptr && !GameBoy_watching(self)) {
+        const size_t aot_ops = GameBoy_run_aot(self, mem);
+        if (aot_ops != 0)
+            return aot_ops;
+    }
+
+    const BlockOp *op = BlockCache_next(self->block_cache, cpu->pc);
+    if (op == nullptr) {
+        op = GameBoy_lookup_block(self, cpu->pc);
+
+#ifdef GEMU_JIT
+        if (op != nullptr && !GameBoy_watching(self)) {
+            const size_t native_ops = GameBoy_run_native(self, mem);
+            if (native_ops != 0)
+                return native_ops;
+        }
+#endif
+    }
+
+    if (op == nullptr) {
+        Cpu_tick(cpu, mem);
+    } else {
+        Cpu_tick_decoded(cpu, mem, op->handler, op->code);
+    }
+
+    return 1;
+}
+
+// The decoded block starting at the current PC, if it was the last one looked
+// up and is still what is mapped there
+static const Block *GameBoy_current_block(const GameBoy *const self)
+{
+    const BlockCache *const cache = self->block_cache;
+    if (cache == nullptr)
+        return nullptr;
+
+    const Block *const block = cache->block;
+    const u16 pc = self->cpu.pc;
+
+    // Loops are not skipped while watching, so that each access is checked
+    if (self->cpu.mode != CpuMode_Running || self->cpu.queued_ime ||
+        self->dma_end != 0 || block == nullptr || block->op_count == 0 ||
+        block->pc != pc || GameBoy_watching(self))
+        return nullptr;
+
+    if (block->bank == BLOCK_BANK_RAM)
+        return block->generation == cache->ram_generation ? block : nullptr;
+
+    if (pc > 0x7FFF || (self->boot_rom_enable && pc < GB_BOOT_ROM_LEN))
+        return nullptr;
+
+    return Mapper_rom_bank(self->mapper, pc) == block->bank ? block : nullptr;
+}
+
+const Block *GameBoy_idle_loop(const GameBoy *const self)
+{
+    const Block *const block = GameBoy_current_block(self);
+
+    if (block == nullptr || (block->idle & BlockIdle_Loop) == 0)
+        return nullptr;
+
+    return block;
+}
+
+// Finds the memory behind addr if accessing it has no side effects, along with
+// the range of addresses around it that map to the same host memory in order
+static u8 *GameBoy_plain_memory(GameBoy *const self, const u16 addr,
+                                const bool write, u16 *const first,
+                                u16 *const last)
+{
+    if (addr <= 0x7FFF) {
+        // 0000-7FFF (ROM), unless the boot ROM is mapped over it
+        const bool boot_rom = self->boot_rom_enable && addr < GB_BOOT_ROM_LEN;
+        if (write || boot_rom || self->rom == nullptr)
+            return nullptr;
+
+        const size_t bank = Mapper_rom_bank(self->mapper, addr);
+        const size_t offset = (bank * 0x4000) + (addr & 0x3FFF);
+        if (offset >= self->rom_len)
+            return nullptr;
+
+        const size_t bank_end = (bank + 1) * 0x4000;
+        const size_t end = bank_end < self->rom_len ? bank_end : self->rom_len;
+
+        *first = addr & 0x4000;
+        if (self->boot_rom_enable && *first == 0)
+            *first = GB_BOOT_ROM_LEN;
+
+        *last = addr + (end - offset - 1);
+
+        if (self->cheats != nullptr) {
+            // Pages patched by cheats lie elsewhere, so only the page around
+            // addr is known to be contiguous
+            const u16 page_first = addr - (addr % GB_PAGE_LEN);
+            const u16 page_last = page_first + (GB_PAGE_LEN - 1);
+            *first = *first > page_first ? *first : page_first;
+            *last = *last < page_last ? *last : page_last;
+
+            const u8 *const overlay =
+                Cheats_rom_page(self->cheats, bank, addr);
+
+            if (overlay != nullptr)
+                return (u8 *)&overlay[addr % GB_PAGE_LEN];
+        }
+
+        // ROM is never returned for writes, so this is only ever read from
+        return (u8 *)&self->rom[offset];
+    }
+
+    if (self->shared_mask != 0 && ((addr >= 0x8000 && addr <= 0x9FFF) ||
+                                   (addr >= 0xC000 && addr <= 0xFDFF))) {
+        // Pages shared with forks must stop being shared before they are
+        // written to, and may lie elsewhere, so only the page around addr is
+        // known to be contiguous
+        if (write && self->shared[GameBoy_shared_index(addr)] != nullptr)
+            return nullptr;
+
+        *first = addr - (addr % GB_PAGE_LEN);
+        *last = *first + (GB_PAGE_LEN - 1);
+
+        // Pages only held by shared are never returned for writes
+        return (u8 *)&GameBoy_memory_page(self, addr)[addr % GB_PAGE_LEN];
+    }
+
+    if (addr >= 0x8000 && addr <= 0x9FFF) {
+        // 8000-9FFF (VRAM)
+        *first = 0x8000;
+        *last = 0x9FFF;
+        return &self->vram[addr - 0x8000];
+    }
+
+    if (addr >= 0xC000 && addr <= 0xDFFF) {
+        // C000-DFFF (WRAM)
+        *first = 0xC000;
+        *last = 0xDFFF;
+        return &self->ram[addr - 0xC000];
+    }
+
+    if (addr >= 0xE000 && addr <= 0xFDFF) {
+        // E000-FDFF (Echo RAM, mirror of C000-DDFF)
+        *first = 0xE000;
+        *last = 0xFDFF;
+        return &self->ram[addr - 0xE000];
+    }
+
+    if (addr >= 0xFE00 && addr <= 0xFE9F) {
+        // FE00-FE9F (OAM)
+        *first = 0xFE00;
+        *last = 0xFE9F;
+        return &self->oam[addr - 0xFE00];
+    }
+
+    if (addr >= 0xFF80 && addr <= 0xFFFE) {
+        // FF80-FFFE (High RAM)
+        *first = 0xFF80;
+        *last = 0xFFFE;
+        return &self->hram[addr - 0xFF80];
+    }
+
+    return nullptr;
+}
+
+// How many accesses starting at addr and moving by step each time stay within
+// plain memory (see GameBoy_plain_memory)
+static u32 GameBoy_plain_run(GameBoy *const self, const u16 addr,
+                             const i8 step, const bool write)
+{
+    u16 first;
+    u16 last;
+
+    if (GameBoy_plain_memory(self, addr, write, &first, &last) == nullptr)
+        return 0;
+
+    return step > 0 ? last - addr + 1 : addr - first + 1;
+}
+
+// The host memory of the count bytes accessed starting at addr and moving by
+// step each time, which must all be plain (see GameBoy_plain_run)
+static u8 *GameBoy_plain_span(GameBoy *const self, const u16 addr,
+                              const i8 step, const u32 count, const bool write)
+{
+    u16 first;
+    u16 last;
+    const u16 lowest = step > 0 ? addr : addr - (count - 1);
+
+    return GameBoy_plain_memory(self, lowest, write, &first, &last);
+}
+
+// Where a bulk loop accesses memory in its first iteration
+static u16 GameBoy_bulk_addr(const GameBoy *const self, const u8 pair,
+                             const i8 off)
+{
+    return self->cpu.rp[pair] + off;
+}
+
+// Maps a WRAM or HRAM address to the one the block cache tracks, or returns 0
+// for anything else
+static u16 GameBoy_ram_code_addr(const u16 addr)
+{
+    if ((addr >= 0xC000 && addr <= 0xDFFF) || addr >= 0xFF80)
+        return addr;
+
+    if (addr >= 0xE000 && addr <= 0xFDFF)
+        return addr - 0x2000;
+
+    return 0;
+}
+
+const Block *GameBoy_bulk_loop(GameBoy *const self, u32 *const iterations)
+{
+    const Block *const block = GameBoy_current_block(self);
+    if (block == nullptr || block->bulk.kind == BlockBulk_None)
+        return nullptr;
+
+    const BlockBulk *const bulk = &block->bulk;
+    const Cpu *const cpu = &self->cpu;
+
+    // The last iteration falls through, so it is left to run on its own
+    u32 count = bulk->wide_counter
+                    ? cpu->rp[bulk->counter]
+                    : cpu->r[bulk->counter ^ CPU_R_SWIZZLE];
+    if (count == 0)
+        count = bulk->wide_counter ? 0x10000 : 0x100;
+
+    u32 n = count - 1;
+
+    // Pointers moved through their low byte must not wrap around
+    for (u8 pair = CpuTableRp_BC; pair <= CpuTableRp_HL; ++pair) {
+        if ((bulk->narrow & (1 << pair)) == 0)
+            continue;
+
+        const u8 lo = cpu->rp[pair] & 0xFF;
+        const u32 limit = bulk->step[pair] > 0 ? 0xFF - lo : lo;
+        n = limit < n ? limit : n;
+    }
+
+    const i8 step = bulk->step[bulk->dst];
+    const u16 dst = GameBoy_bulk_addr(self, bulk->dst, bulk->dst_off);
+    const u32 dst_run = GameBoy_plain_run(self, dst, step, true);
+    n = dst_run < n ? dst_run : n;
+
+    if (bulk->kind == BlockBulk_Copy) {
+        const u16 src = GameBoy_bulk_addr(self, bulk->src, bulk->src_off);
+        const u32 src_run = GameBoy_plain_run(self, src, step, false);
+        n = src_run < n ? src_run : n;
+    }
+
+    if (n < 2)
+        return nullptr;
+
+    const u8 *const dst_mem = GameBoy_plain_span(self, dst, step, n, true);
+
+    if (bulk->kind == BlockBulk_Copy) {
+        // Only copies between separate memory come out the same as copying
+        // one byte at a time
+        const u16 src = GameBoy_bulk_addr(self, bulk->src, bulk->src_off);
+        const u8 *const src_mem =
+            GameBoy_plain_span(self, src, step, n, false);
+
+        if ((uintptr_t)src_mem < (uintptr_t)dst_mem + n &&
+            (uintptr_t)dst_mem < (uintptr_t)src_mem + n)
+            return nullptr;
+    }
+
+    if (block->bank == BLOCK_BANK_RAM) {
+        // Nor may a loop in RAM overwrite itself
+        const BlockOp *const last = &block->ops[block->op_count - 1];
+        const u16 code_first = block->pc;
+        const u16 code_last =
+            block->pc + (last->code - block->ops[0].code) + last->length - 1;
+        const u16 dst_lowest = step > 0 ? dst : dst - (n - 1);
+        const u16 dst_first = GameBoy_ram_code_addr(dst_lowest);
+
+        if (dst_first != 0 && dst_first <= code_last &&
+            code_first <= dst_first + (n - 1))
+            return nullptr;
+    }
+
+    *iterations = n;
+    return block;
+}
+
+size_t GameBoy_run_bulk_loop(GameBoy *const self, Memory *const mem,
+                             const Block *const loop, const u32 iterations)
+{
+    const BlockBulk bulk = loop->bulk;
+    const size_t op_count = loop->op_count;
+    Cpu *const cpu = &self->cpu;
+
+    // All but the last iteration are worked out at once...
+    const u32 n = iterations - 1;
+    const i8 step = bulk.step[bulk.dst];
+    const u16 dst = GameBoy_bulk_addr(self, bulk.dst, bulk.dst_off);
+    u8 *const dst_mem = GameBoy_plain_span(self, dst, step, n, true);
+
+    if (bulk.kind == BlockBulk_Copy) {
+        const u16 src = GameBoy_bulk_addr(self, bulk.src, bulk.src_off);
+        memcpy(dst_mem, GameBoy_plain_span(self, src, step, n, false), n);
+    } else {
+        memset(dst_mem, bulk.fill_a ? cpu->a : bulk.fill_value, n);
+    }
+
+    const u16 dst_lowest = step > 0 ? dst : dst - (n - 1);
+    if (GameBoy_ram_code_addr(dst_lowest) != 0) {
+        for (u32 i = 0; i < n; ++i) {
+            BlockCache_write_ram(self->block_cache,
+                                 GameBoy_ram_code_addr(dst_lowest + i));
+        }
+    }
+
+    for (u8 pair = CpuTableRp_BC; pair <= CpuTableRp_HL; ++pair)
+        cpu->rp[pair] += bulk.step[pair] * (i32)n;
+
+    if (bulk.wide_counter) {
+        cpu->rp[bulk.counter] -= n;
+    } else {
+        cpu->r[bulk.counter ^ CPU_R_SWIZZLE] -= n;
+    }
+
+    cpu->cycle_count += bulk.cycles * (int)n;
+
+    // ...and the last one runs as usual, leaving A and the flags as they would
+    // have been
+    BlockCache_reset_cursor(self->block_cache);
+
+    size_t ops = 0;
+    while (ops < op_count)
+        ops += GameBoy_step(self, mem);
+
+    return (size_t)iterations * op_count;
+}
+
+// CPU cycles per DIV increment, which runs at 16384 Hz (16779 Hz on SGB)
+static constexpr int DIV_CYCLES = GB_CPU_FREQUENCY_HZ / 16384;
+
+// The LY the LCD is at the given number of cycles from now
+static u8 GameBoy_lcd_ly(const GameBoy *const self, const int ahead)
+{
+    return (u8)(((self->lcd_cycles + ahead) % GB_FRAME_CYCLES) /
+                GB_LINE_CYCLES);
+}
+
+// The interrupts requested when the LCD moves to the given line
+static u8 GameBoy_ly_interrupts(const GameBoy *const self, const u8 ly)
+{
+    u8 if_ = 0;
+
+    // VBlank interrupt
+    if (ly == 144)
+        if_ |= InterruptFlag_VBlank;
+
+    // STAT lcy == ly interrupt
+    if ((self->stat & StatSelect_Lyc) != 0 && ly == self->lcy)
+        if_ |= InterruptFlag_Lcd;
+
+    return if_;
+}
+
+// Moves the LCD to the given line, as seen at the start of a step
+static void GameBoy_set_ly(GameBoy *const self, const u8 ly)
+{
+    const u8 prev_ly = self->ly;
+    self->ly = ly;
+
+    self->stat |= (self->ly == self->lcy) << 2;
+
+    // Trigger some stuff then ly changes
+    if (prev_ly != self->ly) {
+        self->if_ |= GameBoy_ly_interrupts(self, self->ly);
+
+        // GameShark codes write RAM as VBlank starts
+        if (self->ly == 144)
+            GameBoy_apply_cheats(self);
+    }
+}
+
+// Draws every visible line that the LCD is through mode 3 of the given number
+// of cycles from now, and that was not drawn yet
+static void GameBoy_draw_lines(GameBoy *const self, const int ahead)
+{
+    const int lcd_cycles = (self->lcd_cycles + ahead) % GB_FRAME_CYCLES;
+
+    int drawn = lcd_cycles < PPU_MODE_3_END_CYCLES
+                    ? 0
+                    : ((lcd_cycles - PPU_MODE_3_END_CYCLES) / GB_LINE_CYCLES) +
+                          1;
+    if (drawn > GB_LCD_HEIGHT)
+        drawn = GB_LCD_HEIGHT;
+
+    // The LCD moved on to the next frame
+    if (drawn < self->lcd_drawn)
+        self->lcd_drawn = 0;
+
+    for (; self->lcd_drawn < drawn; ++self->lcd_drawn)
+        Ppu_draw_line(self, self->lcd_drawn);
+}
+
+// How many cycles from now the LCD next moves to another line or gets through
+// mode 3 of a visible one
+static int GameBoy_next_lcd_event(const GameBoy *const self)
+{
+    const int ly = self->lcd_cycles / GB_LINE_CYCLES;
+    const int line_cycles = self->lcd_cycles % GB_LINE_CYCLES;
+
+    if (ly < GB_LCD_HEIGHT && line_cycles < PPU_MODE_3_END_CYCLES)
+        return PPU_MODE_3_END_CYCLES - line_cycles;
+
+    return GB_LINE_CYCLES - line_cycles;
+}
+
+// How many cycles make up one TIMA increment, or 0 if TIMA is stopped
+static int GameBoy_tima_delay_cycles(const GameBoy *const self)
+{
+    // TIMA is only incremented if TAC's bit 2 is set
+    if ((self->tac & 0b100) == 0)
+        return 0;
+
+    const u8 clock_select = self->tac & 0b11;
+    return clock_select == 0 ? 256 : 4 * clock_select;
+}
+
+// Runs the LCD, DIV, TIMA and the cartridge clock for the given number of
+// cycles
+static void GameBoy_advance(GameBoy *const self, const int cycles)
+{
+    self->cycles += cycles;
+    self->cycle_budget -= cycles;
+    self->lcd_cycles = (self->lcd_cycles + cycles) % GB_FRAME_CYCLES;
+
+    // DIV counter
+    if (self->cpu.mode != CpuMode_Stopped) {
+        self->div_cycles += cycles;
+
+        while (self->div_cycles >= DIV_CYCLES) {
+            ++self->div;
+            self->div_cycles -= DIV_CYCLES;
+        }
+    }
+
+    const int tac_delay_cycles = GameBoy_tima_delay_cycles(self);
+    if (tac_delay_cycles == 0)
+        return;
+
+    // TIMA counter. A step may run a whole block, which can span several
+    // increments.
+    self->tima_cycles += cycles;
+    while (self->tima_cycles > tac_delay_cycles) {
+        self->tima_cycles -= tac_delay_cycles;
+        ++self->tima;
+
+        // Trigger timer interrupt when tima overflows
+        if (self->tima == 0) {
+            self->tima = self->tma;
+            self->if_ |= InterruptFlag_Timer;
+        }
+    }
+}
+
+static IdleCheckpoint GameBoy_idle_checkpoint(const GameBoy *const self,
+                                              const Block *const loop)
+{
+    return (IdleCheckpoint){
+        .valid = true,
+        .pc = self->cpu.pc,
+        .bc = self->cpu.rp[CpuTableRp_BC],
+        .de = self->cpu.rp[CpuTableRp_DE],
+        .hl = self->cpu.rp[CpuTableRp_HL],
+        .sp = self->cpu.sp,
+        .a = self->cpu.a,
+        .f = Cpu_read_f(&self->cpu),
+        .ime = self->cpu.ime,
+        .if_ = self->if_,
+        .ie = self->ie,
+        .ly = (loop->idle & BlockIdle_ReadsLcd) ? self->ly : 0,
+        .stat = (loop->idle & BlockIdle_ReadsLcd) ? self->stat : 0,
+        .div = (loop->idle & BlockIdle_ReadsDiv) ? self->div : 0,
+        .tima = (loop->idle & BlockIdle_ReadsTima) ? self->tima : 0,
+        .cycles = self->cycles,
+        .instruction_count = self->instruction_count,
+    };
+}
+
+// Checks whether a loop is at the same point with the same inputs in two
+// checkpoints
+static bool IdleCheckpoint_same_loop_state(const IdleCheckpoint *const a,
+                                           const IdleCheckpoint *const b)
+{
+    return a->pc == b->pc && a->bc == b->bc && a->de == b->de &&
+           a->hl == b->hl && a->sp == b->sp && a->a == b->a && a->f == b->f &&
+           a->ime == b->ime && a->if_ == b->if_ && a->ie == b->ie &&
+           a->ly == b->ly && a->stat == b->stat && a->div == b->div &&
+           a->tima == b->tima;
+}
+
+// Checks whether count iterations of an idle loop taking iteration_cycles each
+// can be skipped over at once, so that every step they are made of would have
+// seen the same inputs and no interrupt would have been requested in between.
+static bool GameBoy_can_skip_idle_loop(const GameBoy *const self,
+                                       const Block *const loop,
+                                       const int iteration_cycles,
+                                       const int count)
+{
+    // Each step takes at least one cycle, so the steps all start (and all but
+    // the last one end) before this
+    const int cycles = iteration_cycles * count;
+    const int last_start = cycles - 1;
+
+    if (last_start >= self->cycle_budget || cycles >= GB_FRAME_CYCLES)
+        return false;
+
+    // LY (and so STAT and the LCD interrupts) must stay the same. Going less
+    // than a frame ahead, it cannot wrap back around to the same line.
+    if (GameBoy_lcd_ly(self, last_start) != self->ly)
+        return false;
+
+    if ((loop->idle & BlockIdle_ReadsDiv) &&
+        self->div_cycles + cycles - 1 >= DIV_CYCLES)
+        return false;
+
+    const int tac_delay_cycles = GameBoy_tima_delay_cycles(self);
+    if (tac_delay_cycles != 0) {
+        // TIMA may change if the loop does not read it, but must not overflow
+        // before the last step
+        const int tima_counter = self->tima_cycles + cycles - 1;
+        const int increments =
+            tima_counter > 0 ? (tima_counter - 1) / tac_delay_cycles : 0;
+        const int max_increments =
+            (loop->idle & BlockIdle_ReadsTima) ? 0 : 0xFF - self->tima;
+
+        if (increments > max_increments)
+            return false;
+    }
+
+    return true;
+}
+
+// Fast-forwards through an idle loop the CPU is at the start of, as far as
+// stepping through it would have gone without anything it reads changing.
+// Returns whether anything was skipped.
+static bool GameBoy_skip_idle_loop(GameBoy *const self)
+{
+    const Block *const loop = GameBoy_idle_loop(self);
+    if (loop == nullptr)
+        return false;
+
+    const IdleCheckpoint now = GameBoy_idle_checkpoint(self, loop);
+    IdleCheckpoint *const prev = &self->idle;
+
+    // The loop has settled if its last iteration ran straight through and
+    // ended up where it started
+    const bool settled =
+        prev->valid && IdleCheckpoint_same_loop_state(prev, &now) &&
+        now.instruction_count - prev->instruction_count == loop->op_count;
+    const int iteration_cycles = (int)(now.cycles - prev->cycles);
+
+    *prev = now;
+
+    if (!settled || iteration_cycles <= 0)
+        return false;
+
+    // Find the most iterations that can be skipped
+    int lo = 0;
+    int hi = (self->cycle_budget / iteration_cycles) + 1;
+
+    while (lo < hi) {
+        const int mid = lo + ((hi - lo + 1) / 2);
+
+        if (GameBoy_can_skip_idle_loop(self, loop, iteration_cycles, mid)) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    if (lo == 0)
+        return false;
+
+    GameBoy_advance(self, iteration_cycles * lo);
+    self->instruction_count += (u64)loop->op_count * lo;
+
+    prev->cycles = self->cycles;
+    prev->instruction_count = self->instruction_count;
+    return true;
+}
+
+// The first line after the current one that would request an enabled
+// interrupt as soon as the LCD reaches it, or GB_LCD_MAX_LY if there is none
+// this frame or interrupts are not acted upon
+static int GameBoy_next_interrupt_ly(const GameBoy *const self,
+                                     const bool interrupts)
+{
+    if (!interrupts)
+        return GB_LCD_MAX_LY;
+
+    u8 if_ = self->if_;
+
+    for (int ly = self->ly + 1; ly < GB_LCD_MAX_LY; ++ly) {
+        if_ |= GameBoy_ly_interrupts(self, ly);
+
+        if ((if_ & self->ie) != 0)
+            return ly;
+    }
+
+    return GB_LCD_MAX_LY;
+}
+
+// Checks whether the steps making up the given number of cycles can all run at
+// once, so that they all start within the budget and, if interrupts are acted
+// upon, no enabled one is requested before the last of them. The last step is
+// assumed to take last_step_cycles.
+static bool GameBoy_can_run_ahead(const GameBoy *const self, const int cycles,
+                                  const int last_step_cycles,
+                                  const bool interrupts, const int interrupt_ly)
+{
+    const int last_start = cycles - last_step_cycles;
+
+    if (last_start >= self->cycle_budget || cycles >= GB_FRAME_CYCLES)
+        return false;
+
+    // LY may move on, but not wrap around to the next frame, nor get to a
+    // line that requests an interrupt
+    const u8 last_ly = GameBoy_lcd_ly(self, last_start);
+    if (last_ly < self->ly || last_ly >= interrupt_ly)
+        return false;
+
+    // Nor may TIMA overflow before the last step if that would request one
+    const int tac_delay_cycles = GameBoy_tima_delay_cycles(self);
+    const bool timer_interrupt =
+        interrupts && (self->ie & InterruptFlag_Timer) != 0;
+
+    if (tac_delay_cycles != 0 && timer_interrupt) {
+        const int tima_counter = self->tima_cycles + last_start;
+        const int increments =
+            tima_counter > 0 ? (tima_counter - 1) / tac_delay_cycles : 0;
+
+        if (increments > 0xFF - self->tima)
+            return false;
+    }
+
+    return true;
+}
+
+#ifdef GEMU_JIT
+// Checks whether a native block that takes up to the given number of cycles
+// can run at once, with the same result as stepping through it: all of its
+// steps start within the budget, and the LCD does not move on nor is any
+// interrupt requested before the last of them. LY and STAT then read the same
+// throughout, and lines are drawn between the same steps.
+static bool GameBoy_can_run_native(const GameBoy *const self, const int cycles)
+{
+    // Anything run before in this step has not been caught up with yet
+    if (self->cpu.cycle_count != 0)
+        return false;
+
+    if (cycles > GameBoy_next_lcd_event(self))
+        return false;
+
+    // Requests matter even with IME clear, to a halt at the end of the block
+    return GameBoy_can_run_ahead(self, cycles, 1, true, GB_LCD_MAX_LY);
+}
+#endif
+
+// Moves the LCD through every line that steps starting up to last_start
+// cycles from now would have started on, in order, and draws those it got
+// through mode 3 of
+static void GameBoy_catch_up_ly(GameBoy *const self, const int last_start)
+{
+    const u8 last_ly = GameBoy_lcd_ly(self, last_start);
+
+    for (int ly = self->ly + 1; ly <= last_ly; ++ly)
+        GameBoy_set_ly(self, ly);
+
+    GameBoy_draw_lines(self, last_start);
+}
+
+// Fast-forwards a halted or stopped CPU to the step that would see an
+// interrupt requested, or to the end of the budget. Returns whether anything
+// was skipped.
+static bool GameBoy_skip_halt(GameBoy *const self)
+{
+    const Cpu *const cpu = &self->cpu;
+    if (cpu->mode == CpuMode_Running)
+        return false;
+
+    // An enabled interrupt wakes the CPU from HALT, and is taken even while
+    // stopped if IME is set
+    const bool interrupts = cpu->mode == CpuMode_Halted || cpu->ime;
+    if (interrupts && (self->if_ & self->ie) != 0)
+        return false;
+
+    const int interrupt_ly = GameBoy_next_interrupt_ly(self, interrupts);
+
+    // Find the most steps that can be skipped. Each takes one cycle.
+    int lo = 0;
+    int hi = self->cycle_budget + 1;
+
+    while (lo < hi) {
+        const int mid = lo + ((hi - lo + 1) / 2);
+
+        if (GameBoy_can_run_ahead(self, mid, 1, interrupts, interrupt_ly)) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    if (lo < 2)
+        return false;
+
+    GameBoy_catch_up_ly(self, lo - 1);
+    GameBoy_advance(self, lo);
+    return true;
+}
+
+// Runs as much of a bulk copy or fill loop the CPU is at the start of as
+// possible at once (see GameBoy_bulk_loop). Returns whether anything was run.
+static bool GameBoy_skip_bulk_loop(GameBoy *const self, Memory *const mem)
+{
+    u32 max_count;
+    const Block *const loop = GameBoy_bulk_loop(self, &max_count);
+    if (loop == nullptr)
+        return false;
+
+    const bool interrupts = self->cpu.ime;
+    const int interrupt_ly = GameBoy_next_interrupt_ly(self, interrupts);
+
+    // Find the most iterations that can run at once
+    u32 lo = 0;
+    u32 hi = max_count;
+
+    while (lo < hi) {
+        const u32 mid = lo + ((hi - lo + 1) / 2);
+
+        if (GameBoy_can_run_ahead(self, loop->bulk.cycles * (int)mid,
+                                  BLOCK_BULK_JUMP_CYCLES, interrupts,
+                                  interrupt_ly)) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    // Lines must be drawn between the same steps as when stepping through the
+    // loop, after the writes before them and before those after them. So it
+    // runs in chunks up to each time the LCD moves on, and an iteration that
+    // straddles one is left to be stepped through.
+    bool ran = false;
+
+    while (lo >= 2) {
+        u32 chunk = (u32)((GameBoy_next_lcd_event(self) +
+                           BLOCK_BULK_JUMP_CYCLES - 1) /
+                          loop->bulk.cycles);
+        if (chunk > lo)
+            chunk = lo;
+        if (chunk < 2)
+            break;
+
+        self->instruction_count +=
+            GameBoy_run_bulk_loop(self, mem, loop, chunk);
+
+        GameBoy_advance(self, self->cpu.cycle_count);
+        self->cpu.cycle_count = 0;
+
+        GameBoy_set_ly(self, GameBoy_lcd_ly(self, 0));
+        GameBoy_draw_lines(self, 0);
+
+        lo -= chunk;
+        ran = true;
+    }
+
+    return ran;
+}
+
+size_t GameBoy_run(GameBoy *const self, const int cycles)
+{
+    // Nothing runs until resumed after a watchpoint hit, which picks up right
+    // where the last run stopped
+    if (GameBoy_watch_stop(self) != nullptr)
+        return 0;
+
+    Memory mem = {
+        .ctx = self,
+        .read = GameBoy_read_mem,
+        .write = GameBoy_write_mem,
+    };
+
+    const u64 start_count = self->instruction_count;
+
+    self->cpu.cycle_count = 0;
+    self->cycle_budget += cycles;
+
+    // Input may have changed since the last run
+    self->idle.valid = false;
+
+    while (self->cycle_budget > 0) {
+        GameBoy_set_ly(self, GameBoy_lcd_ly(self, 0));
+        GameBoy_draw_lines(self, 0);
+
+        GameBoy_service_interrupts(self, &mem);
+
+        // Skipping may draw lines ahead, which would not show OAM DMA ending
+        if (!self->no_skip && self->dma_end == 0) {
+            // A halted CPU only waits for an interrupt, so jump straight to
+            // when one may be requested
+            if (GameBoy_skip_halt(self))
+                continue;
+
+            // Spinning in a loop that waits for one of the above to change
+            // only burns cycles, so jump straight to when it may
+            if (GameBoy_skip_idle_loop(self))
+                continue;
+
+            // Likewise for copying or filling memory one byte at a time
+            if (GameBoy_skip_bulk_loop(self, &mem))
+                continue;
+        }
+
+        self->instruction_count += GameBoy_step(self, &mem);
+
+        GameBoy_advance(self, self->cpu.cycle_count);
+        self->cpu.cycle_count = 0;
+
+        if (GameBoy_watch_stop(self) != nullptr)
+            break;
+    }
+
+    return self->instruction_count - start_count;
+}
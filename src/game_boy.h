@@ -1,18 +1,38 @@
 #ifndef GEMU_GAME_BOY_H
 #define GEMU_GAME_BOY_H
 
+#include "aot.h"
+#include "block_cache.h"
+#include "cheats.h"
 #include "cpu.h"
+#include "log.h"
 #include "mapper.h"
+#include "rom_file.h"
+#include "save_file.h"
+#include "watchpoints.h"
 #include <stddef.h>
 
+#ifdef GEMU_JIT
+#include "jit.h"
+#endif
+
+#ifdef GEMU_FLAT_MEMORY
+#include "flat_memory.h"
+#endif
+
 constexpr int GB_LCD_WIDTH = 160;
 constexpr int GB_LCD_HEIGHT = 144;
 constexpr int GB_BG_WIDTH = 256;
 constexpr int GB_BG_HEIGHT = 256;
 constexpr int GB_LCD_MAX_LY = 154;
 constexpr int GB_CPU_FREQUENCY_HZ = 4194304 / 4;
-constexpr double GB_VBLANK_FREQ = 59.7;
+constexpr int GB_LINE_CYCLES = 114; // M-cycles the LCD spends on each line
+constexpr int GB_FRAME_CYCLES = GB_LINE_CYCLES * GB_LCD_MAX_LY;
 constexpr size_t GB_BOOT_ROM_LEN = 0x100;
+constexpr size_t GB_PAGE_LEN = 0x100;
+constexpr size_t GB_PAGE_COUNT = 0x10000 / GB_PAGE_LEN;
+// Pages of VRAM followed by those of WRAM, which forks share (see GameBoy_fork)
+constexpr size_t GB_SHARED_PAGE_COUNT = 0x4000 / GB_PAGE_LEN;
 
 typedef enum : u8 {
     LcdControl_Enable = 1 << 7,
@@ -69,19 +89,52 @@ typedef struct {
     bool select;
 } JoypadState;
 
+typedef struct SharedPage SharedPage;
+typedef struct SharedCartRam SharedCartRam;
+
+/**
+ * The state of the CPU the last time it was at the start of an idle loop (see
+ * GameBoy_idle_loop), used to tell when the loop has settled.
+ */
+typedef struct {
+    bool valid;
+    u16 pc;
+    u16 bc;
+    u16 de;
+    u16 hl;
+    u16 sp;
+    u8 a;
+    u8 f;
+    bool ime;
+    u8 if_;
+    u8 ie;
+    // Registers that change on their own, only kept if the loop reads them
+    u8 ly;
+    u8 stat;
+    u8 div;
+    u8 tima;
+    u64 cycles;
+    u64 instruction_count;
+} IdleCheckpoint;
+
+// The state of one Game Boy. What nearly every step touches comes first, so
+// that it is packed into the leading cache lines, and bulk memory after it.
 typedef struct {
-    JoypadState joypad;
     Cpu cpu;
-    Mapper *mapper;
-    bool boot_rom_exists;
-    bool boot_rom_enable;
-    u8 ram[0x2000];
-    u8 vram[0x2000];
-    u8 hram[0x7F];
-    u8 oam[0xA0];
-    u8 boot_rom[GB_BOOT_ROM_LEN];
-    u8 *rom;
-    size_t rom_len;
+    // M-cycles emulated before cpu.cycle_count, which GameBoy_run adds up
+    u64 cycles;
+    // When the running OAM DMA transfer ends, or 0 if there is none (see
+    // GameBoy_oam_dma_running). Until then, read_pages and write_pages are
+    // empty so that everything but High RAM and I/O goes through
+    // GameBoy_read_unpaged and GameBoy_write_unpaged.
+    u64 dma_end;
+    // M-cycles left of those given to GameBoy_run, below 0 once the last step
+    // ran past them
+    int cycle_budget;
+    int lcd_cycles;        // M-cycles into the current frame of the LCD
+    int div_cycles;        // M-cycles since DIV was last incremented
+    int tima_cycles;       // Likewise for TIMA
+    u64 instruction_count; // Run so far, including those skipped over
     u8 lcdc;
     u8 stat;
     u8 ly;
@@ -102,8 +155,88 @@ typedef struct {
     u8 tma;
     u8 tac;
     u8 joyp;
+    bool boot_rom_enable;
+    u8 window_line; // Line of the window drawn next (see Ppu_draw_line)
+    u8 lcd_drawn;   // Lines of the current frame drawn so far
+    // Whether GameBoy_run steps through everything it could skip, as a
+    // reference to check skipping against
+    bool no_skip;
+    // Kinds watched in High RAM, whose accesses then skip the fast path too
+    WatchKind hram_watch;
+    JoypadState joypad;
+    IdleCheckpoint idle; // See GameBoy_run
+    Mapper *mapper; // In mapper_storage while a ROM is loaded
+    BlockCache *block_cache; // NULL until the first GameBoy_step
+    const u8 *rom; // Data of rom_file
+    size_t rom_len;
+    const AotImage *aot; // Compiled code for the loaded ROM, if any
+#ifdef GEMU_JIT
+    Jit *jit; // NULL until the first block is compiled
+#endif
+    Cheats *cheats; // NULL until a cheat is added
+    // NULL until a watchpoint or watch callback is set. Watched pages are left
+    // out of read_pages and write_pages.
+    Watchpoints *watchpoints;
+    // Bits of the pages in shared that are set, and of those among them that
+    // are out of date in vram and ram, as in a fork that has not written to
+    // them yet
+    u64 shared_mask;
+    u64 stale;
+    // Likewise for cartridge RAM, or NULL if this GameBoy was never forked
+    // with any (see GameBoy_cart_ram_page)
+    SharedCartRam *cart_shared;
+#ifdef GEMU_FLAT_MEMORY
+    // Window of flat_memory mirroring read_pages below FE00, or NULL while no
+    // ROM is loaded or the cartridge maps something that is not plain memory,
+    // such as disabled RAM or a clock register (see GameBoy_read_mem)
+    const u8 *flat;
+#endif
+    MapperStorage mapper_storage;
+    u8 hram[0x7F];
+    // Copies of the pages of VRAM and WRAM shared with forks, or NULL for those
+    // written to since the last fork. Shared pages are left out of write_pages,
+    // so that the first write to each stops sharing it.
+    SharedPage *shared[GB_SHARED_PAGE_COUNT];
+    // Host memory behind each page of the address space, or NULL where
+    // accesses need more than a plain load or store (see GameBoy_read_mem).
+    // These point into the GameBoy itself, so it must not be moved once a ROM
+    // is loaded.
+    const u8 *read_pages[GB_PAGE_COUNT];
+    u8 *write_pages[GB_PAGE_COUNT];
+#ifdef GEMU_FLAT_MEMORY
+    // Shared memory from flat_memory, so that it can be mapped into flat too
+    u8 *ram;
+    u8 *vram;
+    FlatMemory *flat_memory;
+    u8 *cart_ram; // Allocated from flat_memory while there is no save file
+#else
+    // Out of date in the pages of stale (see GameBoy_memory_page)
+    u8 ram[0x2000];
+    u8 vram[0x2000];
+#endif
+    // Shades (0-3, lightest first) of the LCD, drawn line by line by the
+    // frontend (see Ppu_draw_line)
+    u8 framebuffer[GB_LCD_HEIGHT][GB_LCD_WIDTH];
+    u8 oam[0xA0];
+    u8 audio[0x30]; // FF10-FF3F (audio and wave pattern), not played yet
+    bool boot_rom_exists;
+    u8 boot_rom[GB_BOOT_ROM_LEN];
+    RomFile *rom_file;
+    SaveFile *save; // Battery-backed memory of the cartridge, if any
 } GameBoy;
 
+#ifndef GEMU_FLAT_MEMORY
+// GameBoy_fork copies everything before read_pages and from oam on, so nothing
+// but what it leaves out may be added in between
+static_assert(offsetof(GameBoy, oam) - offsetof(GameBoy, read_pages) ==
+                  sizeof(((GameBoy *)nullptr)->read_pages) +
+                      sizeof(((GameBoy *)nullptr)->write_pages) +
+                      sizeof(((GameBoy *)nullptr)->ram) +
+                      sizeof(((GameBoy *)nullptr)->vram) +
+                      sizeof(((GameBoy *)nullptr)->framebuffer),
+              "GameBoy_fork would leave out fields between read_pages and oam");
+#endif
+
 /**
  * \brief Constructs a GameBoy object with the given boot ROM.
  *
@@ -121,6 +254,19 @@ typedef struct {
  */
 [[nodiscard]] GameBoy GameBoy_new(const u8 *boot_rom);
 
+/**
+ * \brief Constructs a GameBoy in place, like GameBoy_new.
+ *
+ * Only the state that does not start out zeroed is written, so memory from a
+ * fresh mapping is only paged in as the GameBoy uses it (see GameBoyArena).
+ *
+ * \param self where to construct the GameBoy, which **must** be zero-filled.
+ * \param boot_rom the boot ROM to use, as for GameBoy_new.
+ *
+ * \sa GameBoy_destroy
+ */
+void GameBoy_init(GameBoy *self, const u8 *boot_rom);
+
 /**
  * \brief Cleans up a previously-created GameBoy.
  *
@@ -130,6 +276,33 @@ typedef struct {
  */
 void GameBoy_destroy(GameBoy *self);
 
+/**
+ * \brief Constructs an independent copy of a running GameBoy, such as to
+ * branch off a search from its current state.
+ *
+ * The copy shares the ROM and every page of VRAM, WRAM and cartridge RAM
+ * with self until either of them writes to the page, so forking only copies
+ * the pages self wrote to since it was last forked, along with OAM, High RAM
+ * and the rest of the state. The copy never writes to the save file of self.
+ *
+ * The copy starts out without a block cache, which it allocates once it is
+ * first stepped, with a blank framebuffer, and without the watchpoints of
+ * self. Cheats are carried over.
+ *
+ * Forks share their pages without any locking, so they must all be used from
+ * the same thread.
+ *
+ * Forking is not supported when built with GEMU_FLAT_MEMORY, and bails there,
+ * since the flat window of a fork would need to map pages of other instances.
+ *
+ * \param self the GameBoy to fork.
+ * \param child where to construct the copy, which must eventually be destroyed
+ * with GameBoy_destroy.
+ *
+ * \sa GameBoy_memory_page
+ */
+void GameBoy_fork(GameBoy *self, GameBoy *child);
+
 /**
  * \brief Logs information about the currently loaded ROM.
  *
@@ -144,18 +317,458 @@ void GameBoy_log_cartridge_info(const GameBoy *self);
 /**
  * \brief Loads ROM data into a GameBoy.
  *
- * This method copies rom, so it does not take ownership of it.
+ * This method copies rom, so it does not take ownership of it. GameBoy
+ * instances loading the same data share a single copy (see RomFile_copy).
  *
  * \param self the GameBoy to load the ROM to.
  * \param rom the ROM data to load.
  * \param rom_len the length of rom.
+ *
+ * \sa GameBoy_load_rom_file
  */
 void GameBoy_load_rom(GameBoy *self, const u8 *rom, size_t rom_len);
 
-[[nodiscard]] u8 GameBoy_read_mem(const void *ctx, u16 addr);
+/**
+ * \brief Loads a ROM into a GameBoy without copying it.
+ *
+ * The GameBoy and its mapper read straight from rom, which is usually mapped
+ * from the cartridge file (see RomFile_open).
+ *
+ * \param self the GameBoy to load the ROM to.
+ * \param rom the ROM to load, whose reference the GameBoy takes over. Use
+ * RomFile_ref to load it into several instances.
+ *
+ * \sa GameBoy_load_rom
+ */
+void GameBoy_load_rom_file(GameBoy *self, RomFile *rom);
+
+/**
+ * \brief Keeps the battery-backed memory of the loaded cartridge in the given
+ * save file.
+ *
+ * The cartridge RAM is mapped straight from the file, so games write to it
+ * without any further calls. Cartridges with a real-time clock store its state
+ * after the RAM, and the clock catches up with the time that passed since it
+ * was last saved.
+ *
+ * The save file is flushed and closed along with the GameBoy, or when another
+ * ROM is loaded.
+ *
+ * \param self the GameBoy to open the save file for.
+ * \param path the path of the save file, which is created if needed.
+ *
+ * \return whether the loaded cartridge has a battery and the save file could
+ * be opened.
+ *
+ * \sa GameBoy_flush_save
+ */
+bool GameBoy_open_save(GameBoy *self, const char *path);
+
+/**
+ * \brief Starts writing back what changed in the save file of the GameBoy, if
+ * any.
+ *
+ * This does not wait for the writes to finish, so it can be called once per
+ * frame.
+ *
+ * \param self the GameBoy to flush the save file of.
+ *
+ * \sa GameBoy_open_save
+ */
+void GameBoy_flush_save(GameBoy *self);
+
+/**
+ * \brief Adds a Game Genie or GameShark code for the loaded ROM.
+ *
+ * Game Genie codes patch the ROM right away, by mapping patched copies of the
+ * pages they touch, so reads from any other page cost nothing extra. GameShark
+ * codes write RAM whenever GameBoy_apply_cheats is called.
+ *
+ * Cheats are dropped when another ROM is loaded.
+ *
+ * \param self the GameBoy to add the cheat to.
+ * \param code the code to add (see Cheat_parse).
+ *
+ * \return whether a ROM is loaded and code is valid.
+ *
+ * \sa GameBoy_clear_cheats
+ */
+bool GameBoy_add_cheat(GameBoy *self, const char *code);
+
+/**
+ * \brief Removes all cheats, restoring the unpatched ROM.
+ *
+ * \param self the GameBoy to remove the cheats of.
+ *
+ * \sa GameBoy_add_cheat
+ */
+void GameBoy_clear_cheats(GameBoy *self);
+
+/**
+ * \brief Performs the RAM writes of the GameShark codes of a GameBoy, in the
+ * order they were added.
+ *
+ * The frontend calls this at the start of every VBlank, as the real thing
+ * does.
+ *
+ * \param self the GameBoy to apply the cheats of.
+ */
+void GameBoy_apply_cheats(GameBoy *self);
+
+/**
+ * \brief Watches a range of the address space.
+ *
+ * Only the pages holding watched addresses are left out of the page tables,
+ * so accesses to any other page cost nothing extra. Reads and writes are
+ * checked as they happen, by the CPU or otherwise (such as by GameShark
+ * codes), but not those of OAM DMA. Execute watchpoints are checked by
+ * GameBoy_step before running the instruction.
+ *
+ * While there are watchpoints, each step runs a single instruction: compiled
+ * code is not used, and idle and bulk loops are not skipped.
+ *
+ * Without a callback (see GameBoy_set_watch_callback), every hit stops
+ * emulation.
+ *
+ * \param self the GameBoy to watch.
+ * \param first the first address to watch.
+ * \param last the last address to watch, at least first.
+ * \param kinds the accesses to watch, at least one.
+ *
+ * \return the id of the watchpoint, which is the id of the hits on it.
+ *
+ * \sa GameBoy_remove_watchpoint
+ */
+size_t GameBoy_add_watchpoint(GameBoy *self, u16 first, u16 last,
+                              WatchKind kinds);
+
+/**
+ * \brief Stops watching what a watchpoint watched.
+ *
+ * \param self the GameBoy to stop watching.
+ * \param id the id of the watchpoint, as returned by GameBoy_add_watchpoint.
+ *
+ * \return whether there was such a watchpoint.
+ *
+ * \sa GameBoy_add_watchpoint
+ */
+bool GameBoy_remove_watchpoint(GameBoy *self, size_t id);
+
+/**
+ * \brief Sets what to call on each watchpoint hit.
+ *
+ * \param self the GameBoy to set the callback of.
+ * \param callback the callback, which returns whether to stop emulation, or
+ * NULL to stop on every hit.
+ * \param data passed to callback as is.
+ */
+void GameBoy_set_watch_callback(GameBoy *self, WatchCallback callback,
+                                void *data);
+
+/**
+ * \brief Gets the watchpoint hit that stopped emulation, if any.
+ *
+ * A read or write hit stops emulation once the step it happened in is done,
+ * and an execute hit before its instruction runs. GameBoy_step then does
+ * nothing until GameBoy_resume is called.
+ *
+ * \param self the GameBoy to query.
+ *
+ * \return the hit, or NULL if emulation is not stopped.
+ *
+ * \sa GameBoy_resume
+ */
+[[nodiscard]] const WatchHit *GameBoy_watch_stop(const GameBoy *self);
+
+/**
+ * \brief Resumes emulation after a watchpoint hit stopped it.
+ *
+ * \param self the GameBoy to resume.
+ *
+ * \sa GameBoy_watch_stop
+ */
+void GameBoy_resume(GameBoy *self);
+
+/**
+ * \brief Runs the loaded ROM from code compiled ahead of time.
+ *
+ * The image is only used while it matches the loaded ROM, so this must be
+ * called after GameBoy_load_rom. Loading another ROM drops a mismatching
+ * image.
+ *
+ * \param self the GameBoy to use the image with.
+ * \param image borrowed compiled image, as generated by tools/gemu_aot.rb.
+ *
+ * \return whether image matches the loaded ROM and will be used.
+ */
+bool GameBoy_set_aot_image(GameBoy *self, const AotImage *image);
+
+/**
+ * \brief Reads a byte from anywhere in the address space of a GameBoy, with
+ * the full address decoding.
+ *
+ * Prefer GameBoy_read_mem, which only falls back to this for pages that are
+ * not in read_pages.
+ *
+ * \param self the GameBoy to read from.
+ * \param addr the address to read from.
+ *
+ * \return the value at addr.
+ */
+[[nodiscard]] u8 GameBoy_read_unpaged(const GameBoy *self, u16 addr);
+
+/**
+ * \brief Writes a byte to anywhere in the address space of a GameBoy, with
+ * the full address decoding.
+ *
+ * Prefer GameBoy_write_mem, which only falls back to this for pages that are
+ * not in write_pages.
+ *
+ * \param self the GameBoy to write to.
+ * \param addr the address to write to.
+ * \param value the value to write.
+ */
+void GameBoy_write_unpaged(GameBoy *self, u16 addr, u8 value);
+
+/**
+ * \brief Gets the current contents of a page of VRAM or WRAM.
+ *
+ * Pages that a fork has not written to yet are only held by the GameBoy it
+ * was forked from, so vram and ram may be out of date there.
+ *
+ * \param self the GameBoy to query.
+ * \param addr any address in the page, in 8000-9FFF or C000-FDFF.
+ *
+ * \return the GB_PAGE_LEN bytes of the page holding addr.
+ *
+ * \sa GameBoy_fork
+ */
+[[nodiscard]] const u8 *GameBoy_memory_page(const GameBoy *self, u16 addr);
+
+/**
+ * \brief Gets the current contents of a page of cartridge RAM, whether it is
+ * mapped or not.
+ *
+ * As with GameBoy_memory_page, pages that a fork has not written to yet are
+ * only held by the GameBoy it was forked from, so the cartridge RAM of its
+ * mapper may be out of date there.
+ *
+ * \param self the GameBoy to query, which must have cartridge RAM.
+ * \param offset any offset into the page, less than Mapper_ram_len.
+ *
+ * \return the GB_PAGE_LEN bytes of the page holding offset.
+ *
+ * \sa GameBoy_fork
+ */
+[[nodiscard]] const u8 *GameBoy_cart_ram_page(const GameBoy *self,
+                                              size_t offset);
+
+/**
+ * \brief Checks whether an OAM DMA transfer is running.
+ *
+ * OAM is copied as soon as a transfer starts, but until it would have been
+ * done on hardware, the CPU can only reach High RAM and I/O, and the PPU
+ * cannot read OAM to draw objects.
+ *
+ * \param self the GameBoy to check.
+ *
+ * \return whether a transfer is running at the current cycle.
+ */
+[[nodiscard]] inline bool GameBoy_oam_dma_running(const GameBoy *const self)
+{
+    return self->dma_end != 0 &&
+           self->cycles + self->cpu.cycle_count < self->dma_end;
+}
+
+/**
+ * \brief Reads a byte from the address space of a GameBoy.
+ *
+ * Pages of plain memory (ROM, cartridge RAM, VRAM, WRAM and Echo RAM) are read
+ * through read_pages, which is kept up to date whenever the boot ROM gets
+ * unmapped or the mapper is written to. High RAM is read directly as well.
+ * Only the rest goes through GameBoy_read_unpaged.
+ *
+ * With GEMU_FLAT_MEMORY, anything below FE00 is read straight from a flat
+ * window laid out like the address space instead.
+ *
+ * While an OAM DMA transfer runs, only High RAM and I/O can be accessed and
+ * everything else reads as $FF.
+ *
+ * Pages with read watchpoints are not in read_pages, nor is High RAM read
+ * directly while it has any, so reads from them are checked by
+ * GameBoy_read_unpaged.
+ *
+ * \param ctx the GameBoy to read from.
+ * \param addr the address to read from.
+ *
+ * \return the value at addr.
+ *
+ * \sa GameBoy_write_mem
+ */
+[[nodiscard]] inline u8 GameBoy_read_mem(const void *const ctx, const u16 addr)
+{
+    const GameBoy *const self = ctx;
+
+#ifdef GEMU_FLAT_MEMORY
+    if (addr < 0xFE00 && self->flat != nullptr)
+        return self->flat[addr];
+#endif
+
+    const u8 *const page = self->read_pages[addr / GB_PAGE_LEN];
+
+    if (page != nullptr)
+        return page[addr % GB_PAGE_LEN];
+
+    // FF80-FFFE (High RAM)
+    if (addr >= 0xFF80 && addr <= 0xFFFE &&
+        (self->hram_watch & WatchKind_Read) == 0)
+        return self->hram[addr - 0xFF80];
+
+    return GameBoy_read_unpaged(self, addr);
+}
+
+/**
+ * \brief Writes a byte into the address space of a GameBoy.
+ *
+ * As with GameBoy_read_mem, pages of plain memory (cartridge RAM, VRAM, WRAM
+ * and Echo RAM) are written through write_pages, and High RAM directly, unless
+ * they have write watchpoints.
+ *
+ * \param ctx the GameBoy to write to.
+ * \param addr the address to write to.
+ * \param value the value to write.
+ *
+ * \sa GameBoy_read_mem
+ */
+inline void GameBoy_write_mem(void *const ctx, const u16 addr, const u8 value)
+{
+    GameBoy *const self = ctx;
+    u8 *const page = self->write_pages[addr / GB_PAGE_LEN];
+    const bool hram = addr >= 0xFF80 && addr <= 0xFFFE &&
+                      (self->hram_watch & WatchKind_Write) == 0;
+
+    if (page == nullptr && !hram) {
+        GameBoy_write_unpaged(self, addr, value);
+        return;
+    }
+
+    log_trace("write mem (addr = $%04X, value = $%02X)", addr, value);
 
-void GameBoy_write_mem(void *ctx, u16 addr, u8 value);
+    if (hram) {
+        // FF80-FFFE (High RAM)
+        self->hram[addr - 0xFF80] = value;
+        if (self->block_cache != nullptr)
+            BlockCache_write_ram(self->block_cache, addr);
+    } else {
+        page[addr % GB_PAGE_LEN] = value;
+
+        // C000-FDFF (WRAM and Echo RAM, mirror of C000-DDFF)
+        if (addr >= 0xC000 && self->block_cache != nullptr)
+            BlockCache_write_ram(self->block_cache, addr & ~0x2000);
+    }
+}
 
 void GameBoy_service_interrupts(GameBoy *self, Memory *mem);
 
+/**
+ * \brief Runs the CPU for one instruction (or one idle M-cycle, if it is not
+ * running).
+ *
+ * Code in ROM, WRAM and HRAM is run from the block cache, skipping the bus for
+ * instruction fetches. Code anywhere else falls back to Cpu_tick.
+ *
+ * ROM code compiled into the image set with GameBoy_set_aot_image is run one
+ * whole block per step instead.
+ *
+ * With GEMU_JIT, hot ROM blocks are compiled to native code and run as a
+ * whole, so a single step may run several instructions. That is only done
+ * where it cannot make a difference, as GameBoy_run does for skipping: when
+ * the whole block fits within the budget and before the LCD moves on or an
+ * interrupt may be requested.
+ *
+ * Nothing is run while a watchpoint hit has stopped emulation (see
+ * GameBoy_watch_stop).
+ *
+ * \param self the GameBoy to run.
+ * \param mem the memory wired to self, as for Cpu_tick.
+ *
+ * \return the number of instructions run.
+ */
+size_t GameBoy_step(GameBoy *self, Memory *mem);
+
+/**
+ * \brief Runs a GameBoy for a given number of M-cycles, along with its LCD,
+ * timers and interrupts.
+ *
+ * LY moves on and the LCD is drawn line by line as the cycles go by, DIV and
+ * TIMA count up, and requested interrupts are taken between steps.
+ *
+ * Unless no_skip is set, time the CPU spends halted, spinning in an idle loop
+ * (see GameBoy_idle_loop) or copying memory in a bulk loop (see
+ * GameBoy_bulk_loop) is skipped over at once wherever that cannot make a
+ * difference, so that the end result is the same as stepping through it.
+ *
+ * The last step may run past the given cycles, which the next run then makes
+ * up for. A watchpoint hit stops the run early (see GameBoy_watch_stop).
+ *
+ * \param self the GameBoy to run.
+ * \param cycles how many M-cycles to run for.
+ *
+ * \return the number of instructions run, including those skipped over.
+ */
+size_t GameBoy_run(GameBoy *self, int cycles);
+
+/**
+ * \brief Checks whether the CPU is about to enter an idle loop.
+ *
+ * An idle loop is a block that jumps back to its own start without writing
+ * anything (see BlockIdle). Once one of its iterations started and ended in the
+ * same state, every following iteration does the same, for as long as none of
+ * the registers it reads change on their own.
+ *
+ * Only loops that were last run from the block cache are recognised.
+ *
+ * \param self the GameBoy to check.
+ *
+ * \return the decoded loop starting at the current PC, or NULL if there is
+ * none.
+ */
+[[nodiscard]] const Block *GameBoy_idle_loop(const GameBoy *self);
+
+/**
+ * \brief Checks whether the CPU is about to enter a bulk copy or fill loop
+ * (see BlockBulk), and how much of it GameBoy_run_bulk_loop can run.
+ *
+ * Only iterations that access nothing but ROM, VRAM, WRAM, OAM and HRAM, that
+ * do not overwrite the loop itself and that do not copy between overlapping
+ * memory are counted. Neither is the last iteration, which leaves the loop.
+ *
+ * \param self the GameBoy to check.
+ * \param iterations where to store how many iterations can be run. Always at
+ * least 2 when a loop is returned.
+ *
+ * \return the decoded loop starting at the current PC, or NULL if there is
+ * none.
+ *
+ * \sa GameBoy_run_bulk_loop
+ */
+[[nodiscard]] const Block *GameBoy_bulk_loop(GameBoy *self, u32 *iterations);
+
+/**
+ * \brief Runs several iterations of a bulk copy or fill loop at once.
+ *
+ * The end result, including cycles, is the same as stepping through them
+ * without taking any interrupts.
+ *
+ * \param self the GameBoy to run.
+ * \param mem the memory wired to self, as for Cpu_tick.
+ * \param loop the loop returned by GameBoy_bulk_loop.
+ * \param iterations how many iterations to run, from 2 up to the number
+ * returned by GameBoy_bulk_loop.
+ *
+ * \return the number of instructions run.
+ */
+size_t GameBoy_run_bulk_loop(GameBoy *self, Memory *mem, const Block *loop,
+                             u32 iterations);
+
 #endif
@@ -0,0 +1,127 @@
+#include "game_boy_arena.h"
+#include "game_boy.h"
+#include "log.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <SDL3/SDL.h>
+#else
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#endif
+
+// Instances start on their own cache line, so none of them shares one
+static constexpr size_t ARENA_CACHE_LINE_LEN = 64;
+
+// Huge page mappings must be a whole number of them long
+static constexpr size_t ARENA_HUGE_PAGE_LEN = 2 * 1024 * 1024;
+
+struct GameBoyArena {
+    u8 *data;
+    size_t len;    // Of data
+    size_t stride; // sizeof(GameBoy), rounded up to whole cache lines
+    size_t count;
+};
+
+static size_t round_up(const size_t len, const size_t to)
+{
+    return (len + to - 1) / to * to;
+}
+
+// Maps len bytes of zeroed memory, which is only paged in once touched
+static u8 *map_arena(const size_t len, const bool huge_pages)
+{
+#ifdef _WIN32
+    (void)huge_pages;
+
+    u8 *const data = SDL_aligned_alloc(ARENA_CACHE_LINE_LEN, len);
+    BAIL_IF_NULL(data);
+
+    SDL_memset(data, 0, len);
+    return data;
+#else
+#ifdef MAP_HUGETLB
+    if (huge_pages) {
+        void *const data =
+            mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (data != MAP_FAILED)
+            return data;
+
+        log_debug("No huge pages reserved for the arena, using regular ones");
+    }
+#endif
+
+    void *const data = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    BAIL_IF(data == MAP_FAILED, "Could not map arena: %s", strerror(errno));
+
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages, if the kernel has them
+    if (huge_pages)
+        madvise(data, len, MADV_HUGEPAGE);
+#endif
+
+    return data;
+#endif
+}
+
+GameBoyArena *GameBoyArena_new(const size_t count, const u8 *const boot_rom,
+                               const bool huge_pages)
+{
+    BAIL_IF(count == 0, "An arena must hold at least one instance");
+
+    GameBoyArena *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    const size_t stride = round_up(sizeof(GameBoy), ARENA_CACHE_LINE_LEN);
+    const size_t len =
+        huge_pages ? round_up(stride * count, ARENA_HUGE_PAGE_LEN)
+                   : stride * count;
+
+    *self = (GameBoyArena){
+        .data = map_arena(len, huge_pages),
+        .len = len,
+        .stride = stride,
+        .count = count,
+    };
+
+    for (size_t i = 0; i < count; ++i)
+        GameBoy_init(GameBoyArena_get(self, i), boot_rom);
+
+    return self;
+}
+
+void GameBoyArena_destroy(GameBoyArena *const self)
+{
+    if (self == nullptr)
+        return;
+
+    for (size_t i = 0; i < self->count; ++i)
+        GameBoy_destroy(GameBoyArena_get(self, i));
+
+#ifdef _WIN32
+    SDL_aligned_free(self->data);
+#else
+    munmap(self->data, self->len);
+#endif
+
+    free(self);
+}
+
+size_t GameBoyArena_count(const GameBoyArena *const self)
+{
+    return self->count;
+}
+
+GameBoy *GameBoyArena_get(GameBoyArena *const self, const size_t index)
+{
+    BAIL_IF(index >= self->count, "Arena index out of bounds: %zu", index);
+
+    return (GameBoy *)&self->data[index * self->stride];
+}
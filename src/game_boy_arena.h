@@ -0,0 +1,65 @@
+#ifndef GEMU_GAME_BOY_ARENA_H
+#define GEMU_GAME_BOY_ARENA_H
+
+// Many GameBoy instances side by side in a single mapping, for running lots of
+// them at once (such as for automation).
+//
+// Each instance takes whole cache lines, with its hot state (see GameBoy)
+// leading them, and the instances follow one another, so that stepping through
+// them in turn walks memory in order. Backed by huge pages, a few TLB entries
+// cover many instances.
+
+#include "game_boy.h"
+#include "stdinc.h"
+#include <stddef.h>
+
+typedef struct GameBoyArena GameBoyArena;
+
+/**
+ * \brief Creates an arena of GameBoy instances, each constructed as by
+ * GameBoy_init.
+ *
+ * Memory is only paged in as each instance uses it.
+ *
+ * \param count the number of instances, at least 1.
+ * \param boot_rom the boot ROM all instances use, as for GameBoy_new.
+ * \param huge_pages whether to back the arena with huge pages. Reserved ones
+ * are used if there are any, and transparent ones are asked for otherwise.
+ *
+ * \return the created arena, which must be destroyed via
+ * GameBoyArena_destroy.
+ *
+ * \sa GameBoyArena_destroy
+ */
+[[nodiscard]] GameBoyArena *GameBoyArena_new(size_t count, const u8 *boot_rom,
+                                             bool huge_pages);
+
+/**
+ * \brief Destroys an arena along with all of its instances.
+ *
+ * \param self the arena to destroy, or NULL.
+ *
+ * \sa GameBoyArena_new
+ */
+void GameBoyArena_destroy(GameBoyArena *self);
+
+/**
+ * \brief Gets the number of instances in an arena.
+ *
+ * \param self the arena to query.
+ *
+ * \return the number of instances.
+ */
+[[nodiscard]] size_t GameBoyArena_count(const GameBoyArena *self);
+
+/**
+ * \brief Gets an instance of an arena.
+ *
+ * \param self the arena to get the instance of.
+ * \param index the index of the instance, less than GameBoyArena_count.
+ *
+ * \return the instance, which stays in place until the arena is destroyed.
+ */
+[[nodiscard]] GameBoy *GameBoyArena_get(GameBoyArena *self, size_t index);
+
+#endif
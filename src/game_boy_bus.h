@@ -0,0 +1,25 @@
+#ifndef GEMU_GAME_BOY_BUS_H
+#define GEMU_GAME_BOY_BUS_H
+
+// The bus the CPU core of gemu itself is compiled against (see cpu_bus.h), for
+// which Memory.ctx is always a GameBoy.
+//
+// Accesses to plain memory are resolved through the page tables of the GameBoy
+// right in the instruction handlers, which only call out to the GameBoy for
+// I/O and everything else (see GameBoy_read_mem).
+
+#include "cpu.h"
+#include "game_boy.h"
+#include "stdinc.h"
+
+static inline u8 Bus_read(const Memory *const mem, const u16 addr)
+{
+    return GameBoy_read_mem(mem->ctx, addr);
+}
+
+static inline void Bus_write(Memory *const mem, const u16 addr, const u8 value)
+{
+    GameBoy_write_mem(mem->ctx, addr, value);
+}
+
+#endif
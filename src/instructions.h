@@ -6,4 +6,48 @@
 
 void Cpu_execute(Cpu *cpu, Memory *mem, u8 opcode);
 
+/**
+ * \brief Looks up the handler for an unprefixed opcode.
+ *
+ * Calling the returned handler is equivalent to calling Cpu_execute with
+ * opcode.
+ *
+ * \param opcode the opcode to look up.
+ *
+ * \return the handler for opcode.
+ */
+[[nodiscard]] CpuOpHandler Cpu_decode(u8 opcode);
+
+/**
+ * \brief Gets the number of bytes an instruction occupies, including its
+ * opcode and any CB prefix.
+ *
+ * \param opcode the (unprefixed) opcode of the instruction.
+ *
+ * \return the length of the instruction in bytes.
+ */
+[[nodiscard]] u8 Cpu_opcode_length(u8 opcode);
+
+/**
+ * \brief Checks whether an instruction may transfer control anywhere other
+ * than the instruction right after it, or stop the CPU.
+ *
+ * \param opcode the (unprefixed) opcode of the instruction.
+ *
+ * \return whether a straight-line block of code ends at this instruction.
+ */
+[[nodiscard]] bool Cpu_opcode_ends_block(u8 opcode);
+
+/**
+ * \brief Checks whether an instruction only ever changes CPU registers (and
+ * possibly pc), never memory, the stack, interrupts or the CPU mode.
+ *
+ * \param opcode the (unprefixed) opcode of the instruction. The CB prefix
+ * itself is never considered side-effect free, since that depends on the
+ * prefixed opcode.
+ *
+ * \return whether the instruction is free of side effects.
+ */
+[[nodiscard]] bool Cpu_opcode_is_side_effect_free(u8 opcode);
+
 #endif
@@ -0,0 +1,794 @@
+#ifndef GEMU_INSTRUCTIONS_IMPL_H
+#define GEMU_INSTRUCTIONS_IMPL_H
+
+// The semantics of every instruction, as used by the opcode handlers in
+// instructions.c and by ahead-of-time compiled ROM images (see
+// tools/gemu_aot.rb). Each helper expects the opcode (and CB prefix) to have
+// been fetched already, and fetches its own operands with Cpu_read_pc.
+
+#include "cpu.h"
+#include "cpu_bus.h"
+#include "log.h"
+#include "macros.h"
+#include "stdinc.h"
+
+// Traces the instruction being run. Compiled ROM images leave this out, since
+// they run whole blocks rather than single instructions.
+#ifdef GEMU_AOT_NO_TRACE
+#define Cpu_trace(...) ((void)0)
+#else
+#define Cpu_trace(...) log_trace(__VA_ARGS__)
+#endif
+
+/**
+ * \brief Records the operands and result of a flag-setting operation.
+ *
+ * With GEMU_LAZY_FLAGS, the flags themselves are only computed once something
+ * reads them (see Cpu_read_f). Otherwise, they are computed right away.
+ */
+static inline void Cpu_defer_flags(Cpu *const cpu, const CpuFlagsOp op,
+                                   const u8 lhs, const u8 rhs, const u8 carry,
+                                   const u8 result)
+{
+    cpu->lazy_flags = (CpuLazyFlags){
+        .op = op,
+        .lhs = lhs,
+        .rhs = rhs,
+        .carry = carry,
+        .result = result,
+    };
+
+#ifndef GEMU_LAZY_FLAGS
+    Cpu_write_f(cpu, Cpu_read_f(cpu));
+#endif
+}
+
+static inline void Cpu_set_flags(Cpu *const cpu, const bool z, const bool n,
+                                 const bool h, const bool c)
+{
+    Cpu_write_f(cpu, (z ? CpuFlag_Z : 0) | (n ? CpuFlag_N : 0) |
+                         (h ? CpuFlag_H : 0) | (c ? CpuFlag_C : 0));
+}
+
+static inline void Cpu_instr_add_u8(Cpu *const cpu, const u8 rhs)
+{
+    const u8 prev_a = cpu->a;
+    cpu->a += rhs;
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Add, prev_a, rhs, 0, cpu->a);
+}
+
+static inline void Cpu_instr_adc_u8(Cpu *const cpu, const u8 rhs)
+{
+    const u8 prev_a = cpu->a;
+    const u8 carry = Cpu_read_flag(cpu, CpuFlag_C);
+    cpu->a = prev_a + rhs + carry;
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Adc, prev_a, rhs, carry, cpu->a);
+}
+
+static inline void Cpu_instr_sub_u8(Cpu *const cpu, const u8 rhs)
+{
+    const u8 prev_a = cpu->a;
+    cpu->a -= rhs;
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Sub, prev_a, rhs, 0, cpu->a);
+}
+
+static inline void Cpu_instr_sbc_u8(Cpu *const cpu, const u8 rhs)
+{
+    const u8 prev_a = cpu->a;
+    const u8 borrow = Cpu_read_flag(cpu, CpuFlag_C);
+    cpu->a = prev_a - rhs - borrow;
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Sbc, prev_a, rhs, borrow, cpu->a);
+}
+
+static inline void Cpu_instr_and_u8(Cpu *const cpu, const u8 rhs)
+{
+    cpu->a &= rhs;
+    Cpu_defer_flags(cpu, CpuFlagsOp_And, 0, 0, 0, cpu->a);
+}
+
+static inline void Cpu_instr_xor_u8(Cpu *const cpu, const u8 rhs)
+{
+    cpu->a ^= rhs;
+    Cpu_defer_flags(cpu, CpuFlagsOp_Or, 0, 0, 0, cpu->a);
+}
+
+static inline void Cpu_instr_or_u8(Cpu *const cpu, const u8 rhs)
+{
+    cpu->a |= rhs;
+    Cpu_defer_flags(cpu, CpuFlagsOp_Or, 0, 0, 0, cpu->a);
+}
+
+static inline void Cpu_instr_cp_u8(Cpu *const cpu, const u8 rhs)
+{
+    Cpu_defer_flags(cpu, CpuFlagsOp_Sub, cpu->a, rhs, 0, cpu->a - rhs);
+}
+
+static inline void Cpu_instr_alu(Cpu *const cpu, const CpuTableAlu alu,
+                                 const u8 rhs)
+{
+    // clang-format off
+    switch (alu) {
+        case CpuTableAlu_Add: Cpu_instr_add_u8(cpu, rhs); break;
+        case CpuTableAlu_Adc: Cpu_instr_adc_u8(cpu, rhs); break;
+        case CpuTableAlu_Sub: Cpu_instr_sub_u8(cpu, rhs); break;
+        case CpuTableAlu_Sbc: Cpu_instr_sbc_u8(cpu, rhs); break;
+        case CpuTableAlu_And: Cpu_instr_and_u8(cpu, rhs); break;
+        case CpuTableAlu_Xor: Cpu_instr_xor_u8(cpu, rhs); break;
+        case CpuTableAlu_Or: Cpu_instr_or_u8(cpu, rhs); break;
+        case CpuTableAlu_Cp: Cpu_instr_cp_u8(cpu, rhs); break;
+        default: BAIL("invalid alu: %i", alu);
+    }
+    // clang-format on
+}
+
+static inline void Cpu_instr_nop()
+{
+    Cpu_trace("nop");
+}
+
+static inline void Cpu_instr_ld_n16_sp(Cpu *const cpu, Memory *const mem)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("ld [$%04X], SP", addr);
+
+    Cpu_write_mem_u16(cpu, mem, addr, cpu->sp);
+}
+
+static inline void Cpu_instr_stop(Cpu *const cpu)
+{
+    Cpu_trace("stop");
+    cpu->mode = CpuMode_Stopped;
+
+    log_debug("TODO: implement STOP instruction properly");
+}
+
+static inline void Cpu_instr_jr_e8(Cpu *const cpu, const Memory *const mem)
+{
+    const i8 offset = (i8)Cpu_read_pc(cpu, mem);
+    Cpu_trace("jr %i", offset);
+
+    cpu->pc += offset;
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_jr_cc_e8(Cpu *const cpu, const Memory *const mem,
+                                      const CpuTableCc cc)
+{
+    const i8 offset = (i8)Cpu_read_pc(cpu, mem);
+    Cpu_trace("jr cc(%i), %i", cc, offset);
+
+    if (Cpu_read_cc(cpu, cc)) {
+        cpu->pc += offset;
+        cpu->cycle_count++;
+    }
+}
+
+static inline void Cpu_instr_ld_r16_n16(Cpu *const cpu, const Memory *const mem,
+                                        const u8 p)
+{
+    const u16 value = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("ld rp(%d), $%04X", p, value);
+
+    Cpu_write_rp(cpu, p, value);
+}
+
+static inline void Cpu_instr_add_hl_r16(Cpu *const cpu, const u8 p)
+{
+    Cpu_trace("add hl, rp(%d)", p);
+
+    const u16 hl = Cpu_read_rp(cpu, CpuTableRp_HL);
+    const u16 rhs = Cpu_read_rp(cpu, p);
+
+    Cpu_write_rp(cpu, CpuTableRp_HL, hl + rhs);
+
+    Cpu_set_flags(cpu, Cpu_read_flag(cpu, CpuFlag_Z), false,
+                  (hl & 0xFFF) + (rhs & 0xFFF) > 0xFFF, rhs > 0xFFFF - hl);
+
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_ld_bc_a(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("ld [bc], a");
+
+    const u16 bc = Cpu_read_rp(cpu, CpuTableRp_BC);
+    Cpu_write_mem(cpu, mem, bc, cpu->a);
+}
+
+static inline void Cpu_instr_ld_de_a(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("ld [de], a");
+
+    const u16 de = Cpu_read_rp(cpu, CpuTableRp_DE);
+    Cpu_write_mem(cpu, mem, de, cpu->a);
+}
+
+static inline void Cpu_instr_ld_hli_a(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("ld [hl+], a");
+
+    const u16 hl = Cpu_read_rp(cpu, CpuTableRp_HL);
+    Cpu_write_mem(cpu, mem, hl, cpu->a);
+    Cpu_write_rp(cpu, CpuTableRp_HL, hl + 1);
+}
+
+static inline void Cpu_instr_ld_hld_a(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("ld [hl-], a");
+
+    const u16 hl = Cpu_read_rp(cpu, CpuTableRp_HL);
+    Cpu_write_mem(cpu, mem, hl, cpu->a);
+    Cpu_write_rp(cpu, CpuTableRp_HL, hl - 1);
+}
+
+static inline void Cpu_instr_ld_a_bc(Cpu *const cpu, const Memory *const mem)
+{
+    Cpu_trace("ld a, [bc]");
+    const u16 bc = Cpu_read_rp(cpu, CpuTableRp_BC);
+    cpu->a = Cpu_read_mem(cpu, mem, bc);
+}
+
+static inline void Cpu_instr_ld_a_de(Cpu *const cpu, const Memory *const mem)
+{
+    Cpu_trace("ld a, [de]");
+
+    const u16 de = Cpu_read_rp(cpu, CpuTableRp_DE);
+    cpu->a = Cpu_read_mem(cpu, mem, de);
+}
+
+static inline void Cpu_instr_ld_a_hli(Cpu *const cpu, const Memory *const mem)
+{
+    Cpu_trace("ld a, [hl+]");
+
+    const u16 hl = Cpu_read_rp(cpu, CpuTableRp_HL);
+    cpu->a = Cpu_read_mem(cpu, mem, hl);
+    Cpu_write_rp(cpu, CpuTableRp_HL, hl + 1);
+}
+
+static inline void Cpu_instr_ld_a_hld(Cpu *const cpu, const Memory *const mem)
+{
+    Cpu_trace("ld a, [hl-]");
+
+    const u16 hl = Cpu_read_rp(cpu, CpuTableRp_HL);
+    cpu->a = Cpu_read_mem(cpu, mem, hl);
+    Cpu_write_rp(cpu, CpuTableRp_HL, hl - 1);
+}
+
+static inline void Cpu_instr_inc_r16(Cpu *const cpu, const u8 p)
+{
+    Cpu_trace("inc rp(%d)", p);
+
+    const u16 value = Cpu_read_rp(cpu, p);
+    Cpu_write_rp(cpu, p, value + 1);
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_dec_r16(Cpu *const cpu, const u8 p)
+{
+    Cpu_trace("dec rp(%d)", p);
+
+    const u16 value = Cpu_read_rp(cpu, p);
+    Cpu_write_rp(cpu, p, value - 1);
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_inc_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 y)
+{
+    Cpu_trace("inc r(%d)", y);
+
+    const u8 value = Cpu_read_r(cpu, mem, y);
+    const u8 new_value = value + 1;
+    Cpu_write_r(cpu, mem, y, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Inc, 0, 0, Cpu_read_flag(cpu, CpuFlag_C),
+                    new_value);
+}
+
+static inline void Cpu_instr_dec_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 y)
+{
+    Cpu_trace("dec r(%d)", y);
+
+    const u8 value = Cpu_read_r(cpu, mem, y);
+    const u8 new_value = value - 1;
+    Cpu_write_r(cpu, mem, y, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Dec, 0, 0, Cpu_read_flag(cpu, CpuFlag_C),
+                    new_value);
+}
+
+static inline void Cpu_instr_ld_r8_n(Cpu *const cpu, Memory *const mem,
+                                     const u8 y)
+{
+    const u8 value = Cpu_read_pc(cpu, mem);
+    Cpu_trace("ld r(%d), $%02X", y, value);
+
+    Cpu_write_r(cpu, mem, y, value);
+}
+
+static inline void Cpu_instr_rlca(Cpu *const cpu)
+{
+    Cpu_trace("rlca");
+
+    const u8 bit_7 = (cpu->a & 0x80) != 0;
+    cpu->a = (cpu->a << 1) | bit_7;
+
+    Cpu_set_flags(cpu, false, false, false, bit_7);
+}
+
+static inline void Cpu_instr_rrca(Cpu *const cpu)
+{
+    Cpu_trace("rrca");
+
+    const u8 bit_0 = cpu->a & 1;
+    cpu->a = (cpu->a >> 1) | (bit_0 << 7);
+
+    Cpu_set_flags(cpu, false, false, false, bit_0);
+}
+
+static inline void Cpu_instr_rla(Cpu *const cpu)
+{
+    Cpu_trace("rla");
+
+    const u8 prev_carry = Cpu_read_flag(cpu, CpuFlag_C);
+    const u8 new_carry = (cpu->a & 0x80) != 0;
+    cpu->a = (cpu->a << 1) | prev_carry;
+
+    Cpu_set_flags(cpu, false, false, false, new_carry);
+}
+
+static inline void Cpu_instr_rra(Cpu *const cpu)
+{
+    Cpu_trace("rra");
+
+    const u8 prev_carry = Cpu_read_flag(cpu, CpuFlag_C);
+    const u8 new_carry = cpu->a & 1;
+    cpu->a = (cpu->a >> 1) | (prev_carry << 7);
+
+    Cpu_set_flags(cpu, false, false, false, new_carry);
+}
+
+static inline void Cpu_instr_daa(Cpu *const cpu)
+{
+    Cpu_trace("daa");
+
+    const u8 f = Cpu_read_f(cpu);
+    const bool n = (f & CpuFlag_N) != 0;
+    bool c = (f & CpuFlag_C) != 0;
+    u8 adj = 0;
+
+    if (n) {
+        if (f & CpuFlag_H) {
+            adj += 0x06;
+        }
+
+        if (c) {
+            adj += 0x60;
+        }
+
+        cpu->a -= adj;
+    } else {
+        if (f & CpuFlag_H || (cpu->a & 0xF) > 0x9) {
+            adj += 0x06;
+        }
+
+        if (c || cpu->a > 0x99) {
+            adj += 0x60;
+            c = true;
+        }
+
+        cpu->a += adj;
+    }
+
+    Cpu_set_flags(cpu, cpu->a == 0, n, false, c);
+}
+
+static inline void Cpu_instr_cpl(Cpu *const cpu)
+{
+    Cpu_trace("cpl");
+
+    cpu->a = ~cpu->a;
+    Cpu_set_flags(cpu, Cpu_read_flag(cpu, CpuFlag_Z), true, true,
+                  Cpu_read_flag(cpu, CpuFlag_C));
+}
+
+static inline void Cpu_instr_scf(Cpu *const cpu)
+{
+    Cpu_trace("scf");
+
+    Cpu_set_flags(cpu, Cpu_read_flag(cpu, CpuFlag_Z), false, false, true);
+}
+
+static inline void Cpu_instr_ccf(Cpu *const cpu)
+{
+    Cpu_trace("ccf");
+
+    Cpu_set_flags(cpu, Cpu_read_flag(cpu, CpuFlag_Z), false, false,
+                  !Cpu_read_flag(cpu, CpuFlag_C));
+}
+
+static inline void Cpu_instr_halt(Cpu *const cpu)
+{
+    Cpu_trace("halt");
+    cpu->mode = CpuMode_Halted;
+}
+
+static inline void Cpu_instr_ld_r8_r8(Cpu *const cpu, Memory *const mem,
+                                      const u8 y, const u8 z)
+{
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    Cpu_trace("ld r(%d), r(%d)", y, z);
+
+    Cpu_write_r(cpu, mem, y, value);
+}
+
+static inline void Cpu_instr_alu_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 y, const u8 z)
+{
+
+    Cpu_trace("{alu} a, r(%d)", z);
+
+    const u8 rhs = Cpu_read_r(cpu, mem, z);
+    Cpu_instr_alu(cpu, y, rhs);
+}
+
+static inline void Cpu_instr_ldh_n16_a(Cpu *const cpu, Memory *const mem)
+{
+    const u8 offset = Cpu_read_pc(cpu, mem);
+    Cpu_trace("ldh [$%02X], a", offset);
+
+    const u16 addr = 0xFF00 + offset;
+    Cpu_write_mem(cpu, mem, addr, cpu->a);
+}
+
+static inline void Cpu_instr_add_sp_e8(Cpu *const cpu, Memory *const mem)
+{
+    const u8 offset_u8 = (i8)Cpu_read_pc(cpu, mem);
+    const i8 offset = (i8)offset_u8;
+    Cpu_trace("add sp, %d", offset);
+
+    Cpu_set_flags(cpu, false, false,
+                  (cpu->sp & 0xF) + (offset_u8 & 0xF) > 0xF,
+                  (cpu->sp & 0xFF) + offset_u8 > 0xFF);
+
+    cpu->sp += offset;
+    cpu->cycle_count += 2;
+}
+
+static inline void Cpu_instr_ldh_a_n16(Cpu *const cpu, const Memory *const mem)
+{
+    const u8 offset = Cpu_read_pc(cpu, mem);
+    Cpu_trace("ldh a, [$%02X]", offset);
+
+    const u16 addr = 0xFF00 + offset;
+    cpu->a = Cpu_read_mem(cpu, mem, addr);
+}
+
+static inline void Cpu_instr_ld_hl_sp_plus_e8(Cpu *const cpu,
+                                              const Memory *const mem)
+{
+    const u8 offset_u8 = (i8)Cpu_read_pc(cpu, mem);
+    const i8 offset = (i8)offset_u8;
+    Cpu_trace("ld hl, sp%+d", offset);
+
+    Cpu_set_flags(cpu, false, false,
+                  (cpu->sp & 0xF) + (offset_u8 & 0xF) > 0xF,
+                  (cpu->sp & 0xFF) + offset_u8 > 0xFF);
+
+    Cpu_write_rp(cpu, CpuTableRp_HL, cpu->sp + offset);
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_ret_cc(Cpu *const cpu, Memory *const mem,
+                                    const u8 y)
+{
+    Cpu_trace("ret cc(%d)", y);
+
+    cpu->cycle_count++;
+    if (Cpu_read_cc(cpu, y)) {
+        cpu->pc = Cpu_stack_pop_u16(cpu, mem);
+        cpu->cycle_count++;
+    }
+}
+
+static inline void Cpu_instr_pop_r16(Cpu *const cpu, Memory *const mem,
+                                     const CpuTableRp2 p)
+{
+    Cpu_trace("pop rp2(%d)", p);
+
+    const u16 value = Cpu_stack_pop_u16(cpu, mem);
+    Cpu_write_rp2(cpu, p, value);
+}
+
+static inline void Cpu_instr_ret(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("ret");
+
+    cpu->pc = Cpu_stack_pop_u16(cpu, mem);
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_reti(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("reti");
+
+    cpu->ime = true;
+    cpu->pc = Cpu_stack_pop_u16(cpu, mem);
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_jp_hl(Cpu *const cpu)
+{
+    Cpu_trace("jp hl");
+
+    cpu->pc = Cpu_read_rp(cpu, CpuTableRp_HL);
+}
+
+static inline void Cpu_instr_ld_sp_hl(Cpu *const cpu)
+{
+    Cpu_trace("ld sp, hl");
+
+    cpu->sp = Cpu_read_rp(cpu, CpuTableRp_HL);
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_ldh_c_a(Cpu *const cpu, Memory *const mem)
+{
+    Cpu_trace("ldh [c], a");
+
+    const u16 addr = 0xFF00 + cpu->c;
+    Cpu_write_mem(cpu, mem, addr, cpu->a);
+}
+
+static inline void Cpu_instr_ld_a16_a(Cpu *const cpu, Memory *const mem)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("ld [$%04X], a", addr);
+
+    Cpu_write_mem(cpu, mem, addr, cpu->a);
+}
+
+static inline void Cpu_instr_ldh_a_c(Cpu *const cpu, const Memory *const mem)
+{
+    const u16 addr = 0xFF00 + cpu->c;
+    Cpu_trace("ld a, [c]");
+
+    cpu->a = Cpu_read_mem(cpu, mem, addr);
+}
+
+static inline void Cpu_instr_ld_a_a16(Cpu *const cpu, const Memory *const mem)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("ld a, [$%04X]", addr);
+
+    cpu->a = Cpu_read_mem(cpu, mem, addr);
+}
+
+static inline void Cpu_instr_jp_cc_a16(Cpu *const cpu, const Memory *const mem,
+                                       const u8 y)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("jp cc(%d), $%04X", y, addr);
+
+    if (Cpu_read_cc(cpu, y)) {
+        cpu->pc = addr;
+        cpu->cycle_count++;
+    }
+}
+
+static inline void Cpu_instr_jp_a16(Cpu *const cpu, const Memory *const mem)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("jp $%04X", addr);
+
+    cpu->pc = addr;
+    cpu->cycle_count++;
+}
+
+static inline void Cpu_instr_di(Cpu *const cpu)
+{
+    Cpu_trace("di");
+
+    cpu->ime = false;
+    cpu->queued_ime = false;
+}
+
+static inline void Cpu_instr_ei(Cpu *const cpu)
+{
+    Cpu_trace("ei");
+
+    cpu->queued_ime = true;
+}
+
+static inline void Cpu_instr_call_cc_n16(Cpu *const cpu, Memory *const mem,
+                                         const u8 y)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("call cc(%d), $%04X", y, addr);
+
+    if (Cpu_read_cc(cpu, y)) {
+        Cpu_stack_push_u16(cpu, mem, cpu->pc);
+        cpu->pc = addr;
+    }
+}
+
+static inline void Cpu_instr_push_r16(Cpu *const cpu, Memory *const mem,
+                                      const CpuTableRp2 p)
+{
+    Cpu_trace("push rp2(%d)", p);
+
+    const u16 value = Cpu_read_rp2(cpu, p);
+    Cpu_stack_push_u16(cpu, mem, value);
+}
+
+static inline void Cpu_instr_call_n16(Cpu *const cpu, Memory *const mem)
+{
+    const u16 addr = Cpu_read_pc_u16(cpu, mem);
+    Cpu_trace("call $%04X", addr);
+
+    Cpu_stack_push_u16(cpu, mem, cpu->pc);
+    cpu->pc = addr;
+}
+
+static inline void Cpu_instr_alu_a_a8(Cpu *const cpu, Memory *const mem,
+                                      const u8 y)
+{
+    const u8 rhs = Cpu_read_pc(cpu, mem);
+    Cpu_trace("{alu} a, $%02X", rhs);
+
+    Cpu_instr_alu(cpu, y, rhs);
+}
+
+static inline void Cpu_instr_rst_vec(Cpu *const cpu, Memory *const mem,
+                                     const u8 y)
+{
+    Cpu_trace("rst $%02X", y * 8);
+
+    Cpu_stack_push_u16(cpu, mem, cpu->pc);
+    cpu->pc = y * 8;
+}
+
+static inline void Cpu_instr_rlc_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 z)
+{
+    Cpu_trace("rlc r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 bit_7 = (value & 0x80) != 0;
+    const u8 new_value = (value << 1) | bit_7;
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, bit_7, new_value);
+}
+
+static inline void Cpu_instr_rrc_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 z)
+{
+    Cpu_trace("rrc r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 bit_0 = value & 1;
+    const u8 new_value = (value >> 1) | (bit_0 << 7);
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, bit_0, new_value);
+}
+
+static inline void Cpu_instr_rl_r8(Cpu *const cpu, Memory *const mem,
+                                   const u8 z)
+{
+    Cpu_trace("rl r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 prev_carry = Cpu_read_flag(cpu, CpuFlag_C);
+    const u8 new_carry = (value & 0x80) != 0;
+
+    const u8 new_value = (value << 1) | prev_carry;
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, new_carry, new_value);
+}
+
+static inline void Cpu_instr_rr_r8(Cpu *const cpu, Memory *const mem,
+                                   const u8 z)
+{
+    Cpu_trace("rr r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 prev_carry = Cpu_read_flag(cpu, CpuFlag_C);
+    const u8 new_carry = value & 1;
+
+    const u8 new_value = (value >> 1) | (prev_carry << 7);
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, new_carry, new_value);
+}
+
+static inline void Cpu_instr_sla_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 z)
+{
+    Cpu_trace("sla r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 bit_7 = (value & 0x80) != 0;
+    const u8 new_value = value << 1;
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, bit_7, new_value);
+}
+
+static inline void Cpu_instr_sra_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 z)
+{
+    Cpu_trace("sra r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 bit_0 = value & 1;
+    const u8 bit_7 = (value & 0x80) != 0;
+    const u8 new_value = (value >> 1) | (bit_7 << 7);
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, bit_0, new_value);
+}
+
+static inline void Cpu_instr_swap_r8(Cpu *const cpu, Memory *const mem,
+                                     const u8 z)
+{
+    Cpu_trace("swap r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 prev_hi = value >> 4;
+    const u8 prev_lo = value & 0xF;
+    const u8 new_value = (prev_lo << 4) | prev_hi;
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Or, 0, 0, 0, new_value);
+}
+
+static inline void Cpu_instr_srl_r8(Cpu *const cpu, Memory *const mem,
+                                    const u8 z)
+{
+    Cpu_trace("srl r(%d)", z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    const u8 bit_0 = value & 1;
+    const u8 new_value = value >> 1;
+    Cpu_write_r(cpu, mem, z, new_value);
+
+    Cpu_defer_flags(cpu, CpuFlagsOp_Shift, 0, 0, bit_0, new_value);
+}
+
+static inline void Cpu_instr_bit_u3_r8(Cpu *const cpu, Memory *const mem,
+                                       const u8 y, const u8 z)
+{
+    Cpu_trace("bit %d,r(%d)", y, z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    Cpu_defer_flags(cpu, CpuFlagsOp_Bit, 0, 0, Cpu_read_flag(cpu, CpuFlag_C),
+                    value & (1 << y));
+}
+
+static inline void Cpu_instr_res_u3_r8(Cpu *const cpu, Memory *const mem,
+                                       const u8 y, const u8 z)
+{
+    Cpu_trace("res %d,r(%d)", y, z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    Cpu_write_r(cpu, mem, z, value & ~(1 << y));
+}
+
+static inline void Cpu_instr_set_u3_r8(Cpu *const cpu, Memory *const mem,
+                                       const u8 y, const u8 z)
+{
+    Cpu_trace("set %d,r(%d)", y, z);
+
+    const u8 value = Cpu_read_r(cpu, mem, z);
+    Cpu_write_r(cpu, mem, z, value | (1 << y));
+}
+
+#endif
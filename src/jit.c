@@ -0,0 +1,722 @@
+#include "jit.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+constexpr size_t JIT_CODE_LEN = 8 * 1024 * 1024;
+
+// Upper bound on the native code emitted for a single op, including the
+// epilogue
+constexpr size_t JIT_MAX_OP_LEN = 192;
+
+// The code buffer is never writable and executable at once, so that this also
+// works where W^X is enforced: pages are made writable while code is emitted
+// into them, and executable again before it can run.
+struct Jit {
+    u8 *code;
+    size_t len;
+    size_t page_len; // Of the host, which mprotect works in
+};
+
+typedef enum : u8 {
+    HostReg_Rax = 0,
+    HostReg_Rcx = 1,
+    HostReg_Rdx = 2,
+    HostReg_Rbx = 3,
+    HostReg_Rbp = 5,
+    HostReg_Rsi = 6,
+    HostReg_Rdi = 7,
+    HostReg_R8 = 8,
+    HostReg_R9 = 9,
+    HostReg_R10 = 10,
+    HostReg_R11 = 11,
+    HostReg_R12 = 12,
+} HostReg;
+
+// rbx holds the Cpu and r12 the Memory for the whole block. Guest registers
+// live zero-extended in these, indexed by CpuTableR (the (HL) slot is unused).
+static const HostReg GUEST_REGS[8] = {
+    [CpuTableR_B] = HostReg_Rsi, [CpuTableR_C] = HostReg_Rdi,
+    [CpuTableR_D] = HostReg_R8,  [CpuTableR_E] = HostReg_R9,
+    [CpuTableR_H] = HostReg_R10, [CpuTableR_L] = HostReg_R11,
+    [CpuTableR_A] = HostReg_Rbp,
+};
+
+static_assert(sizeof(CpuFlagsOp) == 1);
+static_assert(offsetof(Cpu, cycle_count) < 0x80,
+              "Cpu fields must be reachable with an 8-bit displacement");
+
+typedef enum : u8 {
+    X64Alu_Add = 0,
+    X64Alu_Or = 1,
+    X64Alu_And = 4,
+    X64Alu_Sub = 5,
+    X64Alu_Xor = 6,
+} X64Alu;
+
+typedef struct {
+    u8 *out;
+    u16 pc;         // Address of the op being translated
+    bool pc_synced; // Whether Cpu.pc already holds pc
+    int cycles;     // Cycles of native ops not yet added to Cpu.cycle_count
+    u8 loaded;      // Bitmask of guest registers held in host registers
+    u8 dirty;       // Bitmask of guest registers not yet written back
+} JitEmitter;
+
+static void emit_u8(JitEmitter *const e, const u8 value)
+{
+    *e->out++ = value;
+}
+
+static void emit_u16(JitEmitter *const e, const u16 value)
+{
+    emit_u8(e, value & 0xFF);
+    emit_u8(e, value >> 8);
+}
+
+static void emit_u32(JitEmitter *const e, const u32 value)
+{
+    emit_u16(e, value & 0xFFFF);
+    emit_u16(e, value >> 16);
+}
+
+static void emit_u64(JitEmitter *const e, const u64 value)
+{
+    emit_u32(e, value & 0xFFFFFFFF);
+    emit_u32(e, value >> 32);
+}
+
+static void emit_rex(JitEmitter *const e, const bool w, const HostReg reg,
+                     const HostReg rm, const bool force)
+{
+    const u8 rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+
+    if (rex != 0x40 || force)
+        emit_u8(e, rex);
+}
+
+static void emit_modrm(JitEmitter *const e, const u8 mod, const u8 reg,
+                       const u8 rm)
+{
+    emit_u8(e, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+// movzx reg32, byte [rbx + disp]
+static void emit_load_u8(JitEmitter *const e, const HostReg reg,
+                         const size_t disp)
+{
+    emit_rex(e, false, reg, HostReg_Rbx, false);
+    emit_u8(e, 0x0F);
+    emit_u8(e, 0xB6);
+    emit_modrm(e, 1, reg, HostReg_Rbx);
+    emit_u8(e, disp);
+}
+
+// mov byte [rbx + disp], reg8
+static void emit_store_u8(JitEmitter *const e, const size_t disp,
+                          const HostReg reg)
+{
+    // Without REX, sil/dil/bpl would encode dh/bh/ch instead
+    emit_rex(e, false, reg, HostReg_Rbx, true);
+    emit_u8(e, 0x88);
+    emit_modrm(e, 1, reg, HostReg_Rbx);
+    emit_u8(e, disp);
+}
+
+// mov byte [rbx + disp], imm8
+static void emit_store_imm8(JitEmitter *const e, const size_t disp,
+                            const u8 value)
+{
+    emit_u8(e, 0xC6);
+    emit_modrm(e, 1, 0, HostReg_Rbx);
+    emit_u8(e, disp);
+    emit_u8(e, value);
+}
+
+// mov word [rbx + disp], imm16
+static void emit_store_imm16(JitEmitter *const e, const size_t disp,
+                             const u16 value)
+{
+    emit_u8(e, 0x66);
+    emit_u8(e, 0xC7);
+    emit_modrm(e, 1, 0, HostReg_Rbx);
+    emit_u8(e, disp);
+    emit_u16(e, value);
+}
+
+// add dword [rbx + disp], imm32
+static void emit_add_mem32_imm(JitEmitter *const e, const size_t disp,
+                               const u32 value)
+{
+    emit_u8(e, 0x81);
+    emit_modrm(e, 1, X64Alu_Add, HostReg_Rbx);
+    emit_u8(e, disp);
+    emit_u32(e, value);
+}
+
+// add/sub word [rbx + disp], 1
+static void emit_step_mem16(JitEmitter *const e, const size_t disp,
+                            const X64Alu alu)
+{
+    emit_u8(e, 0x66);
+    emit_u8(e, 0x83);
+    emit_modrm(e, 1, alu, HostReg_Rbx);
+    emit_u8(e, disp);
+    emit_u8(e, 1);
+}
+
+// mov reg32, imm32
+static void emit_mov_imm(JitEmitter *const e, const HostReg reg,
+                         const u32 value)
+{
+    emit_rex(e, false, 0, reg, false);
+    emit_u8(e, 0xB8 + (reg & 7));
+    emit_u32(e, value);
+}
+
+// mov reg64, imm64
+static void emit_mov_imm64(JitEmitter *const e, const HostReg reg,
+                           const u64 value)
+{
+    emit_rex(e, true, 0, reg, false);
+    emit_u8(e, 0xB8 + (reg & 7));
+    emit_u64(e, value);
+}
+
+// mov dst32, src32 (or dst64, src64 if wide)
+static void emit_mov(JitEmitter *const e, const HostReg dst, const HostReg src,
+                     const bool wide)
+{
+    emit_rex(e, wide, src, dst, false);
+    emit_u8(e, 0x89);
+    emit_modrm(e, 3, src, dst);
+}
+
+// {alu} dst32, src32
+static void emit_alu(JitEmitter *const e, const X64Alu alu, const HostReg dst,
+                     const HostReg src)
+{
+    emit_rex(e, false, src, dst, false);
+    emit_u8(e, (alu << 3) | 0x01);
+    emit_modrm(e, 3, src, dst);
+}
+
+// {alu} dst32, imm32
+static void emit_alu_imm(JitEmitter *const e, const X64Alu alu,
+                         const HostReg dst, const u32 value)
+{
+    emit_rex(e, false, 0, dst, false);
+    emit_u8(e, 0x81);
+    emit_modrm(e, 3, alu, dst);
+    emit_u32(e, value);
+}
+
+// shl/shr dst32, imm8
+static void emit_shift(JitEmitter *const e, const bool left, const HostReg dst,
+                       const u8 amount)
+{
+    emit_rex(e, false, 0, dst, false);
+    emit_u8(e, 0xC1);
+    emit_modrm(e, 3, left ? 4 : 5, dst);
+    emit_u8(e, amount);
+}
+
+static size_t guest_reg_disp(const CpuTableR r)
+{
+    return offsetof(Cpu, r) + (r ^ CPU_R_SWIZZLE);
+}
+
+static HostReg use_reg(JitEmitter *const e, const CpuTableR r)
+{
+    if ((e->loaded & (1 << r)) == 0) {
+        emit_load_u8(e, GUEST_REGS[r], guest_reg_disp(r));
+        e->loaded |= 1 << r;
+    }
+
+    return GUEST_REGS[r];
+}
+
+static HostReg def_reg(JitEmitter *const e, const CpuTableR r)
+{
+    e->loaded |= 1 << r;
+    e->dirty |= 1 << r;
+    return GUEST_REGS[r];
+}
+
+static void sync_state(JitEmitter *const e)
+{
+    for (u8 r = 0; r < 8; ++r) {
+        if ((e->dirty & (1 << r)) != 0)
+            emit_store_u8(e, guest_reg_disp(r), GUEST_REGS[r]);
+    }
+    e->dirty = 0;
+
+    if (e->cycles != 0) {
+        emit_add_mem32_imm(e, offsetof(Cpu, cycle_count), e->cycles);
+        e->cycles = 0;
+    }
+
+    if (!e->pc_synced) {
+        emit_store_imm16(e, offsetof(Cpu, pc), e->pc);
+        e->pc_synced = true;
+    }
+}
+
+static void emit_prologue(JitEmitter *const e)
+{
+    emit_u8(e, 0x53); // push rbx
+    emit_u8(e, 0x55); // push rbp
+    emit_u8(e, 0x41); // push r12
+    emit_u8(e, 0x54);
+
+    emit_mov(e, HostReg_Rbx, HostReg_Rdi, true);
+    emit_mov(e, HostReg_R12, HostReg_Rsi, true);
+}
+
+static void emit_epilogue(JitEmitter *const e)
+{
+    sync_state(e);
+
+    emit_u8(e, 0x41); // pop r12
+    emit_u8(e, 0x5C);
+    emit_u8(e, 0x5D); // pop rbp
+    emit_u8(e, 0x5B); // pop rbx
+    emit_u8(e, 0xC3); // ret
+}
+
+// Runs op through Cpu_tick_decoded, with all state written back beforehand
+static void emit_callout(JitEmitter *const e, const BlockOp *const op)
+{
+    sync_state(e);
+
+    emit_mov(e, HostReg_Rdi, HostReg_Rbx, true);
+    emit_mov(e, HostReg_Rsi, HostReg_R12, true);
+    emit_mov_imm64(e, HostReg_Rdx, (uintptr_t)op->handler);
+    emit_mov_imm64(e, HostReg_Rcx, (uintptr_t)op->code);
+    emit_mov_imm64(e, HostReg_Rax, (uintptr_t)Cpu_tick_decoded);
+    emit_u8(e, 0xFF); // call rax
+    emit_u8(e, 0xD0);
+
+    // The handler may have changed any register, and has moved Cpu.pc past
+    // the op (unless it jumped, which ends the block anyway)
+    e->loaded = 0;
+}
+
+static void emit_store_lazy_flags(JitEmitter *const e, const CpuFlagsOp op,
+                                  const HostReg lhs, const HostReg rhs,
+                                  const HostReg result)
+{
+    const size_t base = offsetof(Cpu, lazy_flags);
+
+    emit_store_imm8(e, base + offsetof(CpuLazyFlags, op), op);
+
+    if (op == CpuFlagsOp_And || op == CpuFlagsOp_Or) {
+        emit_store_imm8(e, base + offsetof(CpuLazyFlags, lhs), 0);
+        emit_store_imm8(e, base + offsetof(CpuLazyFlags, rhs), 0);
+    } else {
+        emit_store_u8(e, base + offsetof(CpuLazyFlags, lhs), lhs);
+        emit_store_u8(e, base + offsetof(CpuLazyFlags, rhs), rhs);
+    }
+
+    emit_store_imm8(e, base + offsetof(CpuLazyFlags, carry), 0);
+    emit_store_u8(e, base + offsetof(CpuLazyFlags, result), result);
+}
+
+// {alu} a, rhs for every ALU op but adc/sbc, which need the carry flag
+static bool emit_alu_a(JitEmitter *const e, const CpuTableAlu alu,
+                       const bool imm, const u8 rhs)
+{
+    static const X64Alu X64_ALU[8] = {
+        [CpuTableAlu_Add] = X64Alu_Add, [CpuTableAlu_Sub] = X64Alu_Sub,
+        [CpuTableAlu_And] = X64Alu_And, [CpuTableAlu_Xor] = X64Alu_Xor,
+        [CpuTableAlu_Or] = X64Alu_Or,   [CpuTableAlu_Cp] = X64Alu_Sub,
+    };
+    static const CpuFlagsOp FLAGS_OPS[8] = {
+        [CpuTableAlu_Add] = CpuFlagsOp_Add, [CpuTableAlu_Sub] = CpuFlagsOp_Sub,
+        [CpuTableAlu_And] = CpuFlagsOp_And, [CpuTableAlu_Xor] = CpuFlagsOp_Or,
+        [CpuTableAlu_Or] = CpuFlagsOp_Or,   [CpuTableAlu_Cp] = CpuFlagsOp_Sub,
+    };
+
+    if (alu == CpuTableAlu_Adc || alu == CpuTableAlu_Sbc)
+        return false;
+
+    const HostReg a = use_reg(e, CpuTableR_A);
+
+    if (imm) {
+        emit_mov_imm(e, HostReg_Rcx, rhs);
+    } else {
+        emit_mov(e, HostReg_Rcx, use_reg(e, rhs), false);
+    }
+
+    emit_mov(e, HostReg_Rdx, a, false);
+    emit_alu(e, X64_ALU[alu], HostReg_Rdx, HostReg_Rcx);
+    emit_alu_imm(e, X64Alu_And, HostReg_Rdx, 0xFF);
+
+    emit_store_lazy_flags(e, FLAGS_OPS[alu], a, HostReg_Rcx, HostReg_Rdx);
+
+    if (alu != CpuTableAlu_Cp)
+        emit_mov(e, def_reg(e, CpuTableR_A), HostReg_Rdx, false);
+
+    return true;
+}
+
+// inc/dec rr, for BC/DE/HL
+static void emit_step_rp(JitEmitter *const e, const CpuTableRp rp,
+                         const X64Alu alu)
+{
+    const CpuTableR hi_r = rp * 2;
+    const CpuTableR lo_r = (rp * 2) + 1;
+
+    emit_mov(e, HostReg_Rax, use_reg(e, hi_r), false);
+    emit_shift(e, true, HostReg_Rax, 8);
+    emit_alu(e, X64Alu_Or, HostReg_Rax, use_reg(e, lo_r));
+    emit_alu_imm(e, alu, HostReg_Rax, 1);
+
+    const HostReg lo = def_reg(e, lo_r);
+    emit_mov(e, lo, HostReg_Rax, false);
+    emit_alu_imm(e, X64Alu_And, lo, 0xFF);
+
+    const HostReg hi = def_reg(e, hi_r);
+    emit_mov(e, hi, HostReg_Rax, false);
+    emit_shift(e, false, hi, 8);
+    emit_alu_imm(e, X64Alu_And, hi, 0xFF);
+}
+
+/**
+ * \brief Translates op into native code, if it is simple enough.
+ *
+ * \return the number of M-cycles op takes, or 0 if it was not translated.
+ */
+static int emit_native_op(JitEmitter *const e, const BlockOp *const op)
+{
+    const u8 *const code = op->code;
+    const u8 opcode = code[0];
+
+    const u8 x = opcode >> 6;
+    const u8 y = (opcode >> 3) & 0b111;
+    const u8 z = opcode & 0b111;
+    const u8 p = y >> 1;
+    const u8 q = y & 1;
+
+    if (opcode == 0x00) // nop
+        return 1;
+
+    if (x == 1 && y != CpuTableR_HL && z != CpuTableR_HL) {
+        // ld r, r
+        const HostReg src = use_reg(e, z);
+        emit_mov(e, def_reg(e, y), src, false);
+        return 1;
+    }
+
+    if (x == 0 && z == 6 && y != CpuTableR_HL) {
+        // ld r, n8
+        emit_mov_imm(e, def_reg(e, y), code[1]);
+        return 2;
+    }
+
+    if (x == 0 && z == 1 && q == 0) {
+        // ld rr, n16
+        if (p == CpuTableRp_SP) {
+            emit_store_imm16(e, offsetof(Cpu, sp), concat_u16(code[2], code[1]));
+        } else {
+            emit_mov_imm(e, def_reg(e, p * 2), code[2]);
+            emit_mov_imm(e, def_reg(e, (p * 2) + 1), code[1]);
+        }
+        return 3;
+    }
+
+    if (x == 0 && z == 3) {
+        // inc/dec rr
+        const X64Alu alu = q == 0 ? X64Alu_Add : X64Alu_Sub;
+
+        if (p == CpuTableRp_SP) {
+            emit_step_mem16(e, offsetof(Cpu, sp), alu);
+        } else {
+            emit_step_rp(e, p, alu);
+        }
+        return 2;
+    }
+
+    if (x == 2 && z != CpuTableR_HL) {
+        // {alu} a, r
+        return emit_alu_a(e, y, false, z) ? 1 : 0;
+    }
+
+    if (x == 3 && z == 6) {
+        // {alu} a, n8
+        return emit_alu_a(e, y, true, code[1]) ? 2 : 0;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Translates an unconditional jump to a constant address.
+ *
+ * \return the number of M-cycles op takes, or 0 if it is not such a jump.
+ */
+static int emit_jump(JitEmitter *const e, const BlockOp *const op)
+{
+    const u8 *const code = op->code;
+
+    if (code[0] == 0x18) { // jr e8
+        e->pc = e->pc + 2 + (i8)code[1];
+        e->pc_synced = false;
+        return 3;
+    }
+
+    if (code[0] == 0xC3) { // jp a16
+        e->pc = concat_u16(code[2], code[1]);
+        e->pc_synced = false;
+        return 4;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief Checks whether op may write to 0000-7FFF, and so switch the bank the
+ * rest of the block is in, or to FF00-FFFF, which may start OAM DMA or request
+ * an interrupt.
+ *
+ * As in tools/gemu_aot.rb, only stores to a constant address in 8000-FEFF are
+ * known to do neither, since registers and SP may point anywhere.
+ */
+static bool may_write_mapper_or_io(const BlockOp *const op)
+{
+    const u8 *const code = op->code;
+
+    switch (code[0]) {
+    case 0x08: { // ld [a16], sp
+        const u16 addr = concat_u16(code[2], code[1]);
+        return addr < 0x8000 || addr >= 0xFEFF;
+    }
+    case 0xEA: { // ld [a16], a
+        const u16 addr = concat_u16(code[2], code[1]);
+        return addr < 0x8000 || addr >= 0xFF00;
+    }
+    case 0xCB: // Rotates, shifts, res and set on [hl], but not bit
+        return (code[1] & 0b111) == CpuTableR_HL && (code[1] >> 6) != 1;
+    case 0x02: // ld [bc], a
+    case 0x12: // ld [de], a
+    case 0x22: // ld [hl+], a
+    case 0x32: // ld [hl-], a
+    case 0x34: // inc [hl]
+    case 0x35: // dec [hl]
+    case 0x36: // ld [hl], n8
+    case 0xC5: // push bc
+    case 0xD5: // push de
+    case 0xE5: // push hl
+    case 0xF5: // push af
+    case 0xE0: // ldh [a8], a
+    case 0xE2: // ld [c], a
+        return true;
+    default: // ld [hl], r
+        return (code[0] & 0xF8) == 0x70 && code[0] != 0x76;
+    }
+}
+
+/**
+ * \brief Checks whether op reads or writes FF00-FFFF at a constant address.
+ *
+ * Such an op only runs first in a block, once the caller has brought the
+ * timers up to date with the ops before it.
+ */
+static bool accesses_io(const BlockOp *const op)
+{
+    const u8 *const code = op->code;
+
+    switch (code[0]) {
+    case 0xE0: // ldh [a8], a
+    case 0xE2: // ld [c], a
+    case 0xF0: // ldh a, [a8]
+    case 0xF2: // ld a, [c]
+        return true;
+    case 0x08: // ld [a16], sp
+        return concat_u16(code[2], code[1]) >= 0xFEFF;
+    case 0xEA: // ld [a16], a
+    case 0xFA: // ld a, [a16]
+        return concat_u16(code[2], code[1]) >= 0xFF00;
+    default:
+        return false;
+    }
+}
+
+// The most M-cycles op may take, with any branch taken
+static int max_cycles(const BlockOp *const op)
+{
+    const u8 *const code = op->code;
+    const u8 opcode = code[0];
+
+    const u8 x = opcode >> 6;
+    const u8 y = (opcode >> 3) & 0b111;
+    const u8 z = opcode & 0b111;
+    const u8 p = y >> 1;
+    const u8 q = y & 1;
+
+    switch (x) {
+    case 0:
+        switch (z) {
+        case 0: // nop, ld [a16], sp, stop, jr
+            return y == 1 ? 5 : y < 3 ? 1 : 3;
+        case 1: // ld rr, n16 or add hl, rr
+            return q == 0 ? 3 : 2;
+        case 4: // inc r
+        case 5: // dec r
+            return y == CpuTableR_HL ? 3 : 1;
+        case 6: // ld r, n8
+            return y == CpuTableR_HL ? 3 : 2;
+        case 7: // Rotates on A, daa, cpl, scf, ccf
+            return 1;
+        default: // Loads through rr, inc/dec rr
+            return 2;
+        }
+    case 1: // ld r, r or halt
+        if (opcode == 0x76)
+            return 1;
+        return y == CpuTableR_HL || z == CpuTableR_HL ? 2 : 1;
+    case 2: // {alu} a, r
+        return z == CpuTableR_HL ? 2 : 1;
+    default:
+        break;
+    }
+
+    switch (z) {
+    case 0: // ret cc, ldh [a8], a, add sp, e8, ldh a, [a8], ld hl, sp + e8
+        return y < 4 ? 5 : y == 5 ? 4 : 3;
+    case 1: // pop, ret, reti, jp hl, ld sp, hl
+        return q == 0 ? 3 : p < 2 ? 4 : p == 2 ? 1 : 2;
+    case 2: // jp cc, ld [c], a, ld [a16], a, ld a, [c], ld a, [a16]
+        return y < 4 || (y & 1) != 0 ? 4 : 2;
+    case 3: // jp, prefix, di, ei
+        if (y == 0)
+            return 4;
+        if (y != 1)
+            return 1;
+        if ((code[1] & 0b111) != CpuTableR_HL)
+            return 2;
+        return (code[1] >> 6) == 1 ? 3 : 4;
+    case 4: // call cc
+        return 6;
+    case 5: // push, call
+        return q == 0 ? 4 : 6;
+    case 6: // {alu} a, n8
+        return 2;
+    default: // rst
+        return 4;
+    }
+}
+
+Jit *Jit_new(void)
+{
+    Jit *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    void *const code = mmap(nullptr, JIT_CODE_LEN, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    BAIL_IF(code == MAP_FAILED, "Could not allocate JIT code buffer");
+
+    const long page_len = sysconf(_SC_PAGESIZE);
+    BAIL_IF(page_len <= 0, "Could not get the page size");
+
+    *self = (Jit){.code = code, .len = 0, .page_len = (size_t)page_len};
+    return self;
+}
+
+void Jit_destroy(Jit *const self)
+{
+    if (self != nullptr) {
+        munmap(self->code, JIT_CODE_LEN);
+        free(self);
+    }
+}
+
+void Jit_reset(Jit *const self)
+{
+    self->len = 0;
+}
+
+CpuOpHandler Jit_compile(Jit *const self, const u16 pc,
+                         const BlockOp *const ops, size_t *const op_count,
+                         u8 *const cycles_bound)
+{
+    const size_t max_end = self->len + ((*op_count + 1) * JIT_MAX_OP_LEN);
+    if (max_end > JIT_CODE_LEN)
+        return nullptr;
+
+    u8 *const start = &self->code[self->len];
+
+    // The pages that the code may be emitted into, the first of which may
+    // already hold code compiled before
+    const size_t first = self->len / self->page_len * self->page_len;
+    const size_t protect_len =
+        ((max_end + self->page_len - 1) / self->page_len * self->page_len) -
+        first;
+
+    BAIL_IF(mprotect(&self->code[first], protect_len, PROT_READ | PROT_WRITE) !=
+                0,
+            "Could not make JIT code writable");
+
+    JitEmitter e = {
+        .out = start,
+        .pc = pc,
+        .pc_synced = true,
+        .cycles = 0,
+        .loaded = 0,
+        .dirty = 0,
+    };
+
+    emit_prologue(&e);
+
+    size_t i = 0;
+    int bound = 0;
+    while (i < *op_count) {
+        const BlockOp *const op = &ops[i];
+        if (i != 0 && accesses_io(op))
+            break;
+
+        ++i;
+        bound += max_cycles(op);
+
+        int cycles = emit_jump(&e, op);
+        if (cycles != 0) {
+            e.cycles += cycles;
+            break;
+        }
+
+        cycles = emit_native_op(&e, op);
+        if (cycles != 0) {
+            e.cycles += cycles;
+            e.pc += op->length;
+            e.pc_synced = false;
+        } else {
+            emit_callout(&e, op);
+            e.pc += op->length;
+        }
+
+        // Let the caller run the instruction after ei, and take interrupts.
+        // After a store that may have switched banks, the rest of the block
+        // may not be there anymore, and after one to I/O, code may have been
+        // locked out of ROM by OAM DMA.
+        if (op->code[0] == 0xFB || may_write_mapper_or_io(op))
+            break;
+    }
+
+    emit_epilogue(&e);
+
+    BAIL_IF(mprotect(&self->code[first], protect_len, PROT_READ | PROT_EXEC) !=
+                0,
+            "Could not make JIT code executable");
+
+    self->len += e.out - start;
+    *op_count = i;
+    *cycles_bound = bound;
+
+    return (CpuOpHandler)(uintptr_t)start;
+}
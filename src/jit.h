@@ -0,0 +1,83 @@
+#ifndef GEMU_JIT_H
+#define GEMU_JIT_H
+
+#include "block_cache.h"
+#include "cpu.h"
+#include "stdinc.h"
+#include <stddef.h>
+
+/**
+ * An x86-64 (System V) translator for blocks of SM83 code.
+ *
+ * Only available when built with GEMU_JIT. Guest registers are kept in host
+ * registers while the native code runs. Simple register/immediate
+ * instructions are translated to native code, while everything else (memory
+ * accesses, conditional control flow, ...) calls into the instruction handlers
+ * with the guest registers written back, which keeps the two in lockstep.
+ */
+typedef struct Jit Jit;
+
+/**
+ * How many times a block has to be entered before it gets compiled.
+ */
+constexpr u8 JIT_HOT_THRESHOLD = 8;
+
+/**
+ * \brief Allocates a JIT along with its executable code buffer.
+ *
+ * The created JIT must eventually be destroyed with Jit_destroy.
+ *
+ * \return the created JIT.
+ *
+ * \sa Jit_destroy
+ */
+[[nodiscard]] Jit *Jit_new(void);
+
+/**
+ * \brief Frees a JIT and all the code it has compiled.
+ *
+ * \param self the JIT to free. May be NULL.
+ *
+ * \sa Jit_new
+ */
+void Jit_destroy(Jit *self);
+
+/**
+ * \brief Discards all compiled code, making room for more.
+ *
+ * Every function previously returned by Jit_compile becomes invalid.
+ *
+ * \param self the JIT to reset.
+ */
+void Jit_reset(Jit *self);
+
+/**
+ * \brief Compiles a decoded block into native code.
+ *
+ * The returned function runs the block from its first op, as if Cpu_tick was
+ * called once per op, and leaves Cpu.pc at wherever the block ended up.
+ * Compilation stops after an ei, so that the instruction following it (and
+ * any interrupt that it lets through) is handled by the caller. It also stops
+ * after any store that may reach 0000-7FFF or FF00-FFFF (the same ones that
+ * end blocks in tools/gemu_aot.rb, along with stores to I/O), and before any
+ * access to I/O at a constant address other than the first op, so that the
+ * caller can keep the bank, OAM DMA and timers up to date around them.
+ *
+ * The block's ops must stay valid and unchanged for as long as the returned
+ * code is used, since their bytes are read at run time.
+ *
+ * \param self the JIT to compile with.
+ * \param pc the address of the first op.
+ * \param ops the ops of the block.
+ * \param op_count the number of ops, which must not be zero. Set to the number
+ * of ops actually compiled on return.
+ * \param cycles_bound set to the most M-cycles the compiled ops may take.
+ *
+ * \return the compiled block, or NULL if the code buffer is full.
+ *
+ * \sa Jit_reset
+ */
+[[nodiscard]] CpuOpHandler Jit_compile(Jit *self, u16 pc, const BlockOp *ops,
+                                       size_t *op_count, u8 *cycles_bound);
+
+#endif
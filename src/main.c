@@ -1,6 +1,7 @@
 #include "frontend.h"
 #include "game_boy.h"
 #include "log.h"
+#include "macros.h"
 #include "sdl.h"
 #include "stdinc.h"
 #include "string.h"
@@ -27,6 +28,7 @@ static void cleanup(void)
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_DestroyTexture(state.screen_texture);
+    RamSearch_destroy(state.ram_search);
 
     GameBoy_destroy(&state.gb);
 }
@@ -37,6 +39,9 @@ int main(int argc, const char *argv[])
 
     const char *boot_rom_path = nullptr;
     const char *log_level_str = nullptr;
+    const char *cheats = nullptr;
+    const char *watchpoints = nullptr;
+    int benchmark_frames = 0;
 
     struct argparse_option options[] = {
         OPT_HELP(),
@@ -45,6 +50,16 @@ int main(int argc, const char *argv[])
         OPT_STRING('l', "log-level", (void *)&log_level_str,
                    "log level (one of trace, debug, info, warn, error)",
                    nullptr, 0, 0),
+        OPT_STRING('c', "cheats", (void *)&cheats,
+                   "comma-separated Game Genie or GameShark codes", nullptr, 0,
+                   0),
+        OPT_STRING('w', "watch", (void *)&watchpoints,
+                   "comma-separated watchpoints (addr[-addr][:rwx])", nullptr,
+                   0, 0),
+        OPT_INTEGER(0, "benchmark", &benchmark_frames,
+                    "emulate this many frames without a window, then report "
+                    "emulation speed",
+                    nullptr, 0, 0),
         OPT_END(),
     };
 
@@ -69,24 +84,6 @@ int main(int argc, const char *argv[])
 
     logger_init(log_level);
 
-    size_t rom_len = 0;
-    u8 *const rom = SDL_LoadFile(argv[0], &rom_len);
-    SDL_CHECKED(rom != nullptr, "Could not read ROM file");
-
-    SDL_CHECKED(SDL_Init(SDL_INIT_VIDEO), "Could not initialize video");
-
-    SDL_CHECKED(SDL_CreateWindowAndRenderer("gemu", WINDOW_WIDTH_INITIAL,
-                                            WINDOW_HEIGHT_INITIAL, 0, &window,
-                                            &renderer),
-                "Could not create window or renderer");
-
-    SDL_Texture *const texture = SDL_CreateTexture(
-        renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
-        GB_BG_WIDTH, GB_BG_HEIGHT);
-    SDL_CHECKED(texture != nullptr, "Could not create texture");
-
-    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
-
     u8 *boot_rom = nullptr;
 
     if (boot_rom_path != nullptr) {
@@ -108,23 +105,46 @@ int main(int argc, const char *argv[])
         .window_height = WINDOW_HEIGHT_INITIAL,
         .cycle_accumulator = 0.0,
         .vframe_time = 0.0,
-        .div_cycle_counter = 0,
-        .tima_cycle_counter = 0,
         .quit = false,
-        .screen_texture = texture,
+        .screen_texture = nullptr,
+        .ram_search = nullptr,
     };
 
-    GameBoy_load_rom(&state.gb, rom, rom_len);
+    BAIL_IF(!load_rom_file(&state.gb, argv[0]), "Could not read ROM file");
+    BAIL_IF(cheats != nullptr && !add_cheats(&state.gb, cheats),
+            "Could not add cheats");
+    BAIL_IF(watchpoints != nullptr && !add_watchpoints(&state.gb, watchpoints),
+            "Could not add watchpoints");
+#ifdef GEMU_AOT
+    GameBoy_set_aot_image(&state.gb, &AOT_IMAGE);
+#endif
 
     SDL_free(boot_rom);
-    SDL_free(rom);
 
-    GameBoy_log_cartridge_info(&state.gb);
+    atexit(cleanup);
+
+    if (benchmark_frames > 0) {
+        run_benchmark(&state, benchmark_frames);
+        return 0;
+    }
+
+    SDL_CHECKED(SDL_Init(SDL_INIT_VIDEO), "Could not initialize video");
+
+    SDL_CHECKED(SDL_CreateWindowAndRenderer("gemu", WINDOW_WIDTH_INITIAL,
+                                            WINDOW_HEIGHT_INITIAL, 0, &window,
+                                            &renderer),
+                "Could not create window or renderer");
+
+    state.screen_texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+        GB_LCD_WIDTH, GB_LCD_HEIGHT);
+    SDL_CHECKED(state.screen_texture != nullptr, "Could not create texture");
+
+    SDL_SetTextureScaleMode(state.screen_texture, SDL_SCALEMODE_NEAREST);
 
     SDL_RenderPresent(renderer);
     SDL_SetWindowResizable(window, true);
 
-    atexit(cleanup);
     run_until_quit(&state, renderer);
 
     return 0;
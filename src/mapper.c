@@ -1,19 +1,40 @@
 #include "mapper.h"
 #include "data.h"
-#include "log.h"
 #include "macros.h"
 #include "stdinc.h"
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+
+constexpr size_t ROM_BANK_LEN = 0x4000;
+constexpr size_t RAM_BANK_LEN = 0x2000;
+constexpr u64 RTC_CYCLES_PER_SECOND = 4194304 / 4;
+constexpr u64 RTC_SECONDS_PER_DAY = 24 * 60 * 60;
 
 typedef struct {
-    u8 (*read)(const Mapper *mapper, const u8 *rom, size_t rom_len, u16 addr);
-    void (*write)(Mapper *mapper, u16 addr, u8 value);
+    size_t size; // Of the whole mapper, for Mapper_clone_in
+    // 0000-7FFF (mapper registers), which must update the cached banks
+    void (*write_register)(Mapper *mapper, u16 addr, u8 value, u64 cycles);
+    // A000-BFFF while no RAM bank is mapped there
+    u8 (*read_unbanked)(const Mapper *mapper, u16 addr, u64 cycles);
+    void (*write_unbanked)(Mapper *mapper, u16 addr, u8 value, u64 cycles);
+    // See Mapper_save_clock and Mapper_load_clock
+    bool (*save_clock)(const Mapper *mapper, u64 cycles, i64 host_time,
+                       u8 *out);
+    bool (*load_clock)(Mapper *mapper, u64 cycles, i64 host_time,
+                       const u8 *in);
     void (*destroy)(Mapper *mapper);
 } MapperInterface;
 
 struct Mapper {
     const MapperInterface *const vtable;
+    size_t rom_bank_mask; // Number of ROM banks - 1
+    size_t ram_bank_mask; // Number of RAM banks - 1, if there are any
+    u8 *ram;              // Cartridge RAM, or NULL if there is none
+    bool owns_ram;        // Whether ram is freed along with the mapper
+    bool boxed;           // Whether the mapper itself is on the heap
+    size_t rom_bank[2];   // Banks mapped at 0000-3FFF and 4000-7FFF
+    u8 *ram_bank;         // Mapped at A000-BFFF, or NULL
 };
 
 typedef struct {
@@ -22,24 +43,91 @@ typedef struct {
 
 typedef struct {
     Mapper base;
-    size_t rom_banks;
-    size_t rom_bank_num;
+    bool ram_enable;
+    u8 bank1; // 5 bits, lower bits of the ROM bank
+    u8 bank2; // 2 bits, upper bits of the ROM bank or the RAM bank
     u8 banking_mode_sel;
 } Mbc1Mapper;
 
-static u8 NoMbcMapper_read([[maybe_unused]] const Mapper *const base,
-                           const u8 *const rom, const size_t rom_len,
-                           const u16 addr)
-{
-    if (addr < rom_len)
-        return rom[addr];
+typedef enum : u8 {
+    Mbc3Rtc_Seconds,
+    Mbc3Rtc_Minutes,
+    Mbc3Rtc_Hours,
+    Mbc3Rtc_DayLow,
+    Mbc3Rtc_DayHigh,
+    Mbc3Rtc_Count,
+} Mbc3Rtc;
+
+// The real-time clock is never ticked. Its registers are only worked out from
+// how many cycles passed since rtc_since when they are latched or written.
+typedef struct {
+    Mapper base;
+    bool has_rtc;
+    bool ram_enable;
+    u8 rom_bank_num;
+    u8 ram_bank_sel;  // 00-07 for a RAM bank, 08-0C for an RTC register
+    u8 latch;         // Last value written to 6000-7FFF
+    bool rtc_halted;  // Bit 6 of the upper day counter register
+    u64 rtc_seconds;  // Clock value at rtc_since, with the day carry as day 512
+    u64 rtc_since;    // In emulated M-cycles
+    u8 rtc_latched[Mbc3Rtc_Count];
+} Mbc3Mapper;
+
+typedef struct {
+    Mapper base;
+    bool ram_enable;
+    u16 rom_bank_num; // 9 bits
+    u8 ram_bank_num;
+} Mbc5Mapper;
 
+// A000-BFFF with RAM disabled or missing, which reads as open bus
+static u8 Mapper_read_open_bus([[maybe_unused]] const Mapper *const self,
+                               [[maybe_unused]] const u16 addr,
+                               [[maybe_unused]] const u64 cycles)
+{
     return 0xFF;
 }
 
-static void NoMbcMapper_write([[maybe_unused]] Mapper *const base,
-                              [[maybe_unused]] const u16 addr,
-                              [[maybe_unused]] const u8 value)
+static void Mapper_write_nothing([[maybe_unused]] Mapper *const self,
+                                 [[maybe_unused]] const u16 addr,
+                                 [[maybe_unused]] const u8 value,
+                                 [[maybe_unused]] const u64 cycles)
+{
+}
+
+// For mappers without a real-time clock
+static bool Mapper_save_no_clock([[maybe_unused]] const Mapper *const self,
+                                 [[maybe_unused]] const u64 cycles,
+                                 [[maybe_unused]] const i64 host_time,
+                                 [[maybe_unused]] u8 *const out)
+{
+    return false;
+}
+
+static bool Mapper_load_no_clock([[maybe_unused]] Mapper *const self,
+                                 [[maybe_unused]] const u64 cycles,
+                                 [[maybe_unused]] const i64 host_time,
+                                 [[maybe_unused]] const u8 *const in)
+{
+    return false;
+}
+
+// Points ram_bank at the given bank, if there is RAM and it is enabled
+static void Mapper_map_ram(Mapper *const self, const bool enable,
+                           const size_t bank)
+{
+    self->ram_bank = nullptr;
+
+    if (enable && self->ram != nullptr) {
+        const size_t offset = (bank & self->ram_bank_mask) * RAM_BANK_LEN;
+        self->ram_bank = &self->ram[offset];
+    }
+}
+
+static void NoMbcMapper_write_register([[maybe_unused]] Mapper *const base,
+                                       [[maybe_unused]] const u16 addr,
+                                       [[maybe_unused]] const u8 value,
+                                       [[maybe_unused]] const u64 cycles)
 {
 }
 
@@ -50,83 +138,404 @@ static void NoMbcMapper_destroy([[maybe_unused]] Mapper *const base)
 static NoMbcMapper NoMbcMapper_new()
 {
     static const MapperInterface vtable = {
-        .read = NoMbcMapper_read,
-        .write = NoMbcMapper_write,
+        .size = sizeof(NoMbcMapper),
+        .write_register = NoMbcMapper_write_register,
+        .read_unbanked = Mapper_read_open_bus,
+        .write_unbanked = Mapper_write_nothing,
+        .save_clock = Mapper_save_no_clock,
+        .load_clock = Mapper_load_no_clock,
         .destroy = NoMbcMapper_destroy,
     };
 
-    return (NoMbcMapper){.base = {.vtable = &vtable}};
+    return (NoMbcMapper){
+        .base = {.vtable = &vtable, .rom_bank = {0, 1}},
+    };
 }
 
-static u8 Mbc1Mapper_read(const Mapper *const base, const u8 *const rom,
-                          const size_t rom_len, const u16 addr)
+static void Mbc1Mapper_map(Mbc1Mapper *const self)
 {
-    const Mbc1Mapper *const self = (const void *)base;
-
-    if (self->banking_mode_sel == 1)
-        log_error("read from $%04X, mode = %i", addr, self->banking_mode_sel);
+    Mapper *const base = &self->base;
+    const size_t upper = (size_t)self->bank2 << 5;
 
-    if (addr < 0x4000) // 0000-3FFF (ROM bank X0)
-        return rom[addr];
+    base->rom_bank[0] = self->banking_mode_sel == 1 ? upper : 0;
+    base->rom_bank[1] = upper | self->bank1;
 
-    if (addr < 0x8000) // 4000-7FFF (ROM bank 01-7F)
-        return rom[(0x4000 * self->rom_bank_num) + addr - 0x4000];
+    for (size_t i = 0; i < 2; ++i)
+        base->rom_bank[i] &= base->rom_bank_mask;
 
-    return 0xFF;
+    Mapper_map_ram(base, self->ram_enable,
+                   self->banking_mode_sel == 1 ? self->bank2 : 0);
 }
 
-static void Mbc1Mapper_write(Mapper *const base, const u16 addr, const u8 value)
+static void Mbc1Mapper_write_register(Mapper *const base, const u16 addr,
+                                      const u8 value,
+                                      [[maybe_unused]] const u64 cycles)
 {
     Mbc1Mapper *const self = (void *)base;
 
-    if (addr >= 0x2000 && addr < 0x4000) {
+    if (addr < 0x2000) {
+        // 0000-1FFF (RAM enable)
+        self->ram_enable = (value & 0x0F) == 0x0A;
+    } else if (addr < 0x4000) {
         // 2000-3FFF (ROM bank number)
-        self->rom_bank_num = (value & 0x11111) % self->rom_banks;
+        self->bank1 = value & 0x1F;
 
-        if (self->rom_bank_num == 0)
-            self->rom_bank_num = 1;
+        if (self->bank1 == 0)
+            self->bank1 = 1;
     } else if (addr < 0x6000) {
-        // 4000-5FFF (upper bits of ROM bank number)
-    } else if (addr < 0x8000) {
+        // 4000-5FFF (RAM bank number, or upper bits of ROM bank number)
+        self->bank2 = value & 0b11;
+    } else {
         // 6000-7FFF (banking mode select)
-        if (self->rom_banks >= 64)
-            self->banking_mode_sel = value & 1;
+        self->banking_mode_sel = value & 1;
     }
+
+    Mbc1Mapper_map(self);
 }
 
 static void Mbc1Mapper_destroy([[maybe_unused]] Mapper *const base)
 {
 }
 
-static Mbc1Mapper Mbc1Mapper_new(const u8 rom_size_code, const u8 ram_size_code)
+static Mbc1Mapper Mbc1Mapper_new()
 {
     static const MapperInterface vtable = {
-        .read = Mbc1Mapper_read,
-        .write = Mbc1Mapper_write,
+        .size = sizeof(Mbc1Mapper),
+        .write_register = Mbc1Mapper_write_register,
+        .read_unbanked = Mapper_read_open_bus,
+        .write_unbanked = Mapper_write_nothing,
+        .save_clock = Mapper_save_no_clock,
+        .load_clock = Mapper_load_no_clock,
         .destroy = Mbc1Mapper_destroy,
     };
 
-    BAIL_IF(ram_size_code != 0);
-
     return (Mbc1Mapper){
-        .base = {.vtable = &vtable},
-        .rom_banks = rom_banks_from_size_code(rom_size_code),
+        .base = {.vtable = &vtable, .rom_bank = {0, 1}},
+        .ram_enable = false,
+        .bank1 = 1,
+        .bank2 = 0,
         .banking_mode_sel = 0,
-        .rom_bank_num = 0,
     };
 }
 
-#define RETURN_BOX(data)                                \
-    do {                                                \
-        typeof(data) *const ptr = malloc(sizeof(*ptr)); \
-        BAIL_IF_NULL(ptr);                              \
-                                                        \
-        const typeof(data) data_value = data;           \
-        memcpy(ptr, &data_value, sizeof(*ptr));         \
-        return &ptr->base;                              \
+static void Mbc3Mapper_map(Mbc3Mapper *const self)
+{
+    Mapper *const base = &self->base;
+
+    base->rom_bank[1] = self->rom_bank_num & base->rom_bank_mask;
+
+    // RTC registers are accessed through read_unbanked and write_unbanked
+    Mapper_map_ram(base, self->ram_enable && self->ram_bank_sel <= 0x07,
+                   self->ram_bank_sel);
+}
+
+// Bits of each RTC register that exist
+static const u8 RTC_MASKS[Mbc3Rtc_Count] = {0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+
+// The RTC register selected at A000-BFFF, if any
+static bool Mbc3Mapper_rtc_register(const Mbc3Mapper *const self,
+                                    Mbc3Rtc *const reg)
+{
+    if (!self->has_rtc || !self->ram_enable || self->ram_bank_sel < 0x08 ||
+        self->ram_bank_sel > 0x0C)
+        return false;
+
+    *reg = self->ram_bank_sel - 0x08;
+    return true;
+}
+
+// The value of the clock at the given cycle
+static u64 Mbc3Mapper_rtc_now(const Mbc3Mapper *const self, const u64 cycles)
+{
+    if (self->rtc_halted)
+        return self->rtc_seconds;
+
+    return self->rtc_seconds +
+           ((cycles - self->rtc_since) / RTC_CYCLES_PER_SECOND);
+}
+
+static void split_rtc(const u64 seconds, const bool halted,
+                      u8 regs[Mbc3Rtc_Count])
+{
+    const u64 days = seconds / RTC_SECONDS_PER_DAY;
+
+    regs[Mbc3Rtc_Seconds] = seconds % 60;
+    regs[Mbc3Rtc_Minutes] = (seconds / 60) % 60;
+    regs[Mbc3Rtc_Hours] = (seconds / (60 * 60)) % 24;
+    regs[Mbc3Rtc_DayLow] = days & 0xFF;
+    regs[Mbc3Rtc_DayHigh] = ((days >> 8) & 1) | (halted ? 0x40 : 0) |
+                            (days >= 512 ? 0x80 : 0);
+}
+
+static u64 join_rtc(const u8 regs[Mbc3Rtc_Count])
+{
+    const u8 day_high = regs[Mbc3Rtc_DayHigh];
+    const u64 days = regs[Mbc3Rtc_DayLow] | ((u64)(day_high & 1) << 8) |
+                     ((day_high & 0x80) ? 512 : 0);
+
+    return (days * RTC_SECONDS_PER_DAY) + (regs[Mbc3Rtc_Hours] * 60 * 60) +
+           (regs[Mbc3Rtc_Minutes] * 60) + regs[Mbc3Rtc_Seconds];
+}
+
+// Restarts the clock from the given registers at the given cycle
+static void Mbc3Mapper_set_rtc(Mbc3Mapper *const self,
+                               const u8 regs[Mbc3Rtc_Count], const u64 cycles)
+{
+    self->rtc_seconds = join_rtc(regs);
+    self->rtc_since = cycles;
+    self->rtc_halted = (regs[Mbc3Rtc_DayHigh] & 0x40) != 0;
+}
+
+static void Mbc3Mapper_write_register(Mapper *const base, const u16 addr,
+                                      const u8 value, const u64 cycles)
+{
+    Mbc3Mapper *const self = (void *)base;
+
+    if (addr < 0x2000) {
+        // 0000-1FFF (RAM and RTC enable)
+        self->ram_enable = (value & 0x0F) == 0x0A;
+    } else if (addr < 0x4000) {
+        // 2000-3FFF (ROM bank number)
+        self->rom_bank_num = value & 0x7F;
+
+        if (self->rom_bank_num == 0)
+            self->rom_bank_num = 1;
+    } else if (addr < 0x6000) {
+        // 4000-5FFF (RAM bank number or RTC register select)
+        self->ram_bank_sel = value;
+    } else {
+        // 6000-7FFF (latch clock data)
+        if (self->latch == 0x00 && value == 0x01) {
+            split_rtc(Mbc3Mapper_rtc_now(self, cycles), self->rtc_halted,
+                      self->rtc_latched);
+        }
+
+        self->latch = value;
+    }
+
+    Mbc3Mapper_map(self);
+}
+
+static u8 Mbc3Mapper_read_unbanked(const Mapper *const base,
+                                   [[maybe_unused]] const u16 addr,
+                                   [[maybe_unused]] const u64 cycles)
+{
+    const Mbc3Mapper *const self = (const void *)base;
+    Mbc3Rtc reg;
+
+    if (!Mbc3Mapper_rtc_register(self, &reg))
+        return 0xFF;
+
+    return self->rtc_latched[reg];
+}
+
+static void Mbc3Mapper_write_unbanked(Mapper *const base,
+                                      [[maybe_unused]] const u16 addr,
+                                      const u8 value, const u64 cycles)
+{
+    Mbc3Mapper *const self = (void *)base;
+    Mbc3Rtc reg;
+
+    if (!Mbc3Mapper_rtc_register(self, &reg))
+        return;
+
+    u8 regs[Mbc3Rtc_Count];
+    split_rtc(Mbc3Mapper_rtc_now(self, cycles), self->rtc_halted, regs);
+    regs[reg] = value & RTC_MASKS[reg];
+
+    // Only writing the seconds restarts the current second
+    const u64 subsecond = self->rtc_halted || reg == Mbc3Rtc_Seconds
+                              ? 0
+                              : (cycles - self->rtc_since) %
+                                    RTC_CYCLES_PER_SECOND;
+
+    Mbc3Mapper_set_rtc(self, regs, cycles - subsecond);
+}
+
+static void write_le(u8 *const out, const u64 value, const size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static u64 read_le(const u8 *const in, const size_t len)
+{
+    u64 value = 0;
+    for (size_t i = 0; i < len; ++i)
+        value |= (u64)in[i] << (8 * i);
+
+    return value;
+}
+
+static bool Mbc3Mapper_save_clock(const Mapper *const base, const u64 cycles,
+                                  const i64 host_time, u8 *const out)
+{
+    const Mbc3Mapper *const self = (const void *)base;
+
+    if (!self->has_rtc)
+        return false;
+
+    u8 regs[Mbc3Rtc_Count];
+    split_rtc(Mbc3Mapper_rtc_now(self, cycles), self->rtc_halted, regs);
+
+    for (size_t i = 0; i < Mbc3Rtc_Count; ++i) {
+        write_le(&out[4 * i], regs[i], 4);
+        write_le(&out[4 * (Mbc3Rtc_Count + i)], self->rtc_latched[i], 4);
+    }
+
+    write_le(&out[8 * Mbc3Rtc_Count], (u64)host_time, 8);
+    return true;
+}
+
+static bool Mbc3Mapper_load_clock(Mapper *const base, const u64 cycles,
+                                  const i64 host_time, const u8 *const in)
+{
+    Mbc3Mapper *const self = (void *)base;
+
+    if (!self->has_rtc)
+        return false;
+
+    u8 regs[Mbc3Rtc_Count];
+    for (size_t i = 0; i < Mbc3Rtc_Count; ++i) {
+        regs[i] = in[4 * i] & RTC_MASKS[i];
+        self->rtc_latched[i] = in[4 * (Mbc3Rtc_Count + i)] & RTC_MASKS[i];
+    }
+
+    Mbc3Mapper_set_rtc(self, regs, cycles);
+
+    // The clock kept running while nothing was emulated
+    const i64 saved_time = (i64)read_le(&in[8 * Mbc3Rtc_Count], 8);
+    if (!self->rtc_halted && host_time > saved_time)
+        self->rtc_seconds += host_time - saved_time;
+
+    return true;
+}
+
+static void Mbc3Mapper_destroy([[maybe_unused]] Mapper *const base)
+{
+}
+
+static Mbc3Mapper Mbc3Mapper_new(const bool has_rtc)
+{
+    static const MapperInterface vtable = {
+        .size = sizeof(Mbc3Mapper),
+        .write_register = Mbc3Mapper_write_register,
+        .read_unbanked = Mbc3Mapper_read_unbanked,
+        .write_unbanked = Mbc3Mapper_write_unbanked,
+        .save_clock = Mbc3Mapper_save_clock,
+        .load_clock = Mbc3Mapper_load_clock,
+        .destroy = Mbc3Mapper_destroy,
+    };
+
+    return (Mbc3Mapper){
+        .base = {.vtable = &vtable, .rom_bank = {0, 1}},
+        .has_rtc = has_rtc,
+        .ram_enable = false,
+        .rom_bank_num = 1,
+        .ram_bank_sel = 0,
+        .latch = 0xFF,
+        .rtc_halted = false,
+        .rtc_seconds = 0,
+        .rtc_since = 0,
+        .rtc_latched = {},
+    };
+}
+
+static void Mbc5Mapper_map(Mbc5Mapper *const self)
+{
+    Mapper *const base = &self->base;
+
+    base->rom_bank[1] = self->rom_bank_num & base->rom_bank_mask;
+    Mapper_map_ram(base, self->ram_enable, self->ram_bank_num);
+}
+
+static void Mbc5Mapper_write_register(Mapper *const base, const u16 addr,
+                                      const u8 value,
+                                      [[maybe_unused]] const u64 cycles)
+{
+    Mbc5Mapper *const self = (void *)base;
+
+    if (addr < 0x2000) {
+        // 0000-1FFF (RAM enable)
+        self->ram_enable = (value & 0x0F) == 0x0A;
+    } else if (addr < 0x3000) {
+        // 2000-2FFF (lower 8 bits of ROM bank number)
+        self->rom_bank_num = (self->rom_bank_num & 0x100) | value;
+    } else if (addr < 0x4000) {
+        // 3000-3FFF (bit 8 of ROM bank number)
+        self->rom_bank_num = (self->rom_bank_num & 0xFF) | ((value & 1) << 8);
+    } else if (addr < 0x6000) {
+        // 4000-5FFF (RAM bank number)
+        self->ram_bank_num = value & 0x0F;
+    }
+
+    Mbc5Mapper_map(self);
+}
+
+static void Mbc5Mapper_destroy([[maybe_unused]] Mapper *const base)
+{
+}
+
+static Mbc5Mapper Mbc5Mapper_new()
+{
+    static const MapperInterface vtable = {
+        .size = sizeof(Mbc5Mapper),
+        .write_register = Mbc5Mapper_write_register,
+        .read_unbanked = Mapper_read_open_bus,
+        .write_unbanked = Mapper_write_nothing,
+        .save_clock = Mapper_save_no_clock,
+        .load_clock = Mapper_load_no_clock,
+        .destroy = Mbc5Mapper_destroy,
+    };
+
+    return (Mbc5Mapper){
+        .base = {.vtable = &vtable, .rom_bank = {0, 1}},
+        .ram_enable = false,
+        .rom_bank_num = 1,
+        .ram_bank_num = 0,
+    };
+}
+
+// Boxes data in storage, or on the heap if storage is NULL
+#define RETURN_BOX(storage, data, rom_banks, ram_banks)                      \
+    do {                                                                     \
+        static_assert(sizeof(data) <= sizeof(MapperStorage),                 \
+                      "MapperStorage must fit every mapper");                \
+                                                                             \
+        typeof(data) *const ptr =                                            \
+            (storage) != nullptr ? (void *)(storage) : malloc(sizeof(*ptr)); \
+        BAIL_IF_NULL(ptr);                                                   \
+                                                                             \
+        const typeof(data) data_value = data;                                \
+        memcpy(ptr, &data_value, sizeof(*ptr));                              \
+        Mapper_init_banks(&ptr->base, rom_banks, ram_banks);                 \
+        ptr->base.boxed = (storage) == nullptr;                              \
+        return &ptr->base;                                                   \
     } while (0)
 
-Mapper *Mapper_from_rom(const u8 *rom, const size_t rom_len)
+// Sets up the bank masks and cartridge RAM of a freshly created mapper
+static void Mapper_init_banks(Mapper *const self, const size_t rom_banks,
+                              const size_t ram_banks)
+{
+    self->rom_bank_mask = rom_banks - 1;
+    self->ram_bank_mask = ram_banks == 0 ? 0 : ram_banks - 1;
+    self->ram = nullptr;
+    self->owns_ram = ram_banks != 0;
+    self->ram_bank = nullptr;
+
+    if (ram_banks != 0) {
+        self->ram = calloc(ram_banks, RAM_BANK_LEN);
+        BAIL_IF_NULL(self->ram);
+    }
+}
+
+Mapper *Mapper_from_rom(const u8 *const rom, const size_t rom_len)
+{
+    return Mapper_from_rom_in(nullptr, rom, rom_len);
+}
+
+Mapper *Mapper_from_rom_in(MapperStorage *const storage, const u8 *const rom,
+                           const size_t rom_len)
 {
     BAIL_IF(rom_len < 0x8000);
 
@@ -136,34 +545,150 @@ Mapper *Mapper_from_rom(const u8 *rom, const size_t rom_len)
 
     BAIL_IF(ram_size_code == 1, "invalid RAM size");
 
+    const size_t rom_banks = rom_banks_from_size_code(rom_size_code);
+    const size_t ram_banks =
+        CartridgeType_has_ram(ctype) ? ram_banks_from_size_code(ram_size_code)
+                                     : 0;
+
     switch (ctype) {
     case CartridgeType_RomOnly:
-        RETURN_BOX(NoMbcMapper_new());
+        RETURN_BOX(storage, NoMbcMapper_new(), rom_banks, 0);
     case CartridgeType_Mbc1:
-        RETURN_BOX(Mbc1Mapper_new(rom_size_code, ram_size_code));
+    case CartridgeType_Mbc1Ram:
+    case CartridgeType_Mbc1RamBattery:
+        RETURN_BOX(storage, Mbc1Mapper_new(), rom_banks, ram_banks);
+    case CartridgeType_Mbc3TimerBattery:
+    case CartridgeType_Mbc3TimerRamBattery:
+        RETURN_BOX(storage, Mbc3Mapper_new(true), rom_banks, ram_banks);
+    case CartridgeType_Mbc3:
+    case CartridgeType_Mbc3Ram:
+    case CartridgeType_Mbc3RamBattery:
+        RETURN_BOX(storage, Mbc3Mapper_new(false), rom_banks, ram_banks);
+    case CartridgeType_Mbc5:
+    case CartridgeType_Mbc5Ram:
+    case CartridgeType_Mbc5RamBattery:
+    case CartridgeType_Mbc5Rumble:
+    case CartridgeType_Mbc5RumbleRam:
+    case CartridgeType_Mbc5RumbleRamBattery:
+        RETURN_BOX(storage, Mbc5Mapper_new(), rom_banks, ram_banks);
     default:
         BAIL("unimplemented mapper: $%02X", ctype);
     }
 }
 
+Mapper *Mapper_clone_in(MapperStorage *const storage, const Mapper *const src)
+{
+    memcpy(storage, src, src->vtable->size);
+
+    Mapper *const self = (Mapper *)storage;
+    self->boxed = false;
+
+    if (src->ram != nullptr) {
+        self->ram = malloc(Mapper_ram_len(src));
+        BAIL_IF_NULL(self->ram);
+
+        self->owns_ram = true;
+
+        if (src->ram_bank != nullptr)
+            self->ram_bank = &self->ram[src->ram_bank - src->ram];
+    }
+
+    return self;
+}
+
 u8 Mapper_read(const Mapper *const self, const u8 *rom, const size_t rom_len,
-               u16 addr)
+               u16 addr, const u64 cycles)
 {
     BAIL_IF(addr >= 0x8000 && (addr < 0xA000 || addr >= 0xC000),
             "unexpected mapper read (addr = $%04X)", addr);
 
-    return self->vtable->read(self, rom, rom_len, addr);
+    if (addr < 0x8000) {
+        // 0000-7FFF (ROM)
+        const size_t offset =
+            (self->rom_bank[addr / ROM_BANK_LEN] * ROM_BANK_LEN) +
+            (addr % ROM_BANK_LEN);
+
+        return offset < rom_len ? rom[offset] : 0xFF;
+    }
+
+    // A000-BFFF (cartridge RAM)
+    if (self->ram_bank != nullptr)
+        return self->ram_bank[addr - 0xA000];
+
+    return self->vtable->read_unbanked(self, addr, cycles);
 }
 
-void Mapper_write(Mapper *const self, const u16 addr, const u8 value)
+size_t Mapper_rom_bank(const Mapper *const self, const u16 addr)
 {
-    self->vtable->write(self, addr, value);
+    return self->rom_bank[addr / ROM_BANK_LEN];
+}
+
+u8 *Mapper_ram_bank(const Mapper *const self)
+{
+    return self->ram_bank;
+}
+
+u8 *Mapper_ram(const Mapper *const self)
+{
+    return self->ram;
+}
+
+size_t Mapper_ram_len(const Mapper *const self)
+{
+    return self->ram == nullptr ? 0 : (self->ram_bank_mask + 1) * RAM_BANK_LEN;
+}
+
+void Mapper_set_ram(Mapper *const self, u8 *const ram)
+{
+    if (self->ram == nullptr)
+        return;
+
+    if (self->ram_bank != nullptr)
+        self->ram_bank = &ram[self->ram_bank - self->ram];
+
+    if (self->owns_ram)
+        free(self->ram);
+
+    self->ram = ram;
+    self->owns_ram = false;
+}
+
+void Mapper_write(Mapper *const self, const u16 addr, const u8 value,
+                  const u64 cycles)
+{
+    if (addr < 0x8000) {
+        // 0000-7FFF (mapper registers)
+        self->vtable->write_register(self, addr, value, cycles);
+    } else if (self->ram_bank != nullptr) {
+        // A000-BFFF (cartridge RAM)
+        self->ram_bank[addr - 0xA000] = value;
+    } else {
+        self->vtable->write_unbanked(self, addr, value, cycles);
+    }
+}
+
+bool Mapper_save_clock(const Mapper *const self, const u64 cycles,
+                       const i64 host_time, u8 out[MAPPER_CLOCK_SAVE_LEN])
+{
+    return self->vtable->save_clock(self, cycles, host_time, out);
+}
+
+bool Mapper_load_clock(Mapper *const self, const u64 cycles,
+                       const i64 host_time,
+                       const u8 in[MAPPER_CLOCK_SAVE_LEN])
+{
+    return self->vtable->load_clock(self, cycles, host_time, in);
 }
 
 void Mapper_destroy(Mapper *const self)
 {
     if (self != nullptr) {
         self->vtable->destroy(self);
-        free(self);
+
+        if (self->owns_ram)
+            free(self->ram);
+
+        if (self->boxed)
+            free(self);
     }
 }
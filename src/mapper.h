@@ -6,13 +6,24 @@
 
 typedef struct Mapper Mapper;
 
+// Length of the real-time clock state at the end of a save file
+constexpr size_t MAPPER_CLOCK_SAVE_LEN = 48;
+
+// Room for any mapper, so that it can live inside whatever owns it (see
+// Mapper_from_rom_in)
+typedef struct {
+    alignas(max_align_t) u8 bytes[128];
+} MapperStorage;
+
 /**
  * \brief Creates a mapper corresponding to the header information in the given
  * ROM data.
  *
  * This mapper must eventually be destroyed via Mapper_destroy.
  *
- * Will bail if rom is less than 0x8000 bytes long.
+ * Supports MBC1, MBC3 and MBC5 besides cartridges without a mapper, and
+ * allocates the cartridge RAM if the header asks for any. Will bail if rom is
+ * less than 0x8000 bytes long or uses any other mapper.
  *
  * \param rom borrowed ROM data to create the mapper according to.
  * \param rom_len length of rom.
@@ -24,30 +35,183 @@ typedef struct Mapper Mapper;
  */
 Mapper *Mapper_from_rom(const u8 *rom, size_t rom_len);
 
+/**
+ * \brief Creates a mapper like Mapper_from_rom, but in the given storage rather
+ * than on the heap.
+ *
+ * The mapper must still be destroyed via Mapper_destroy, which leaves storage
+ * alone.
+ *
+ * \param storage where to create the mapper, which must outlive it.
+ * \param rom borrowed ROM data to create the mapper according to.
+ * \param rom_len length of rom.
+ *
+ * \return a pointer to the created Mapper, inside storage.
+ *
+ * \sa Mapper_from_rom
+ */
+Mapper *Mapper_from_rom_in(MapperStorage *storage, const u8 *rom,
+                           size_t rom_len);
+
+/**
+ * \brief Creates a copy of a mapper in the given storage.
+ *
+ * The copy gets cartridge RAM of its own, so it never writes to a save file.
+ * Its contents are left uninitialized for the caller to fill in, such as only
+ * as each page is written (see GameBoy_fork).
+ *
+ * \param storage where to create the copy, which must outlive it.
+ * \param src the mapper to copy.
+ *
+ * \return a pointer to the copy, inside storage, which must be destroyed via
+ * Mapper_destroy.
+ *
+ * \sa Mapper_from_rom_in
+ */
+Mapper *Mapper_clone_in(MapperStorage *storage, const Mapper *src);
+
 /**
  * \brief Reads a byte from the given mapper.
  *
+ * ROM and cartridge RAM are read from the banks cached at the last write to
+ * the mapper registers, so only the registers of MBC3 real-time clocks take a
+ * virtual call.
+ *
  * \param self the mapper to read from.
  * \param rom borrowed ROM data wired to the mapper.
  * \param rom_len length of rom.
  * \param addr the address to read from.
+ * \param cycles M-cycles emulated so far, which the real-time clock of MBC3
+ * follows. This must never go backwards.
  *
  * \return the value at addr from the mapper.
  *
  * \sa Mapper_write
  */
-u8 Mapper_read(const Mapper *self, const u8 *rom, size_t rom_len, u16 addr);
+u8 Mapper_read(const Mapper *self, const u8 *rom, size_t rom_len, u16 addr,
+               u64 cycles);
+
+/**
+ * \brief Gets the ROM bank currently mapped at the given address.
+ *
+ * Together with the address, this identifies which ROM byte a read from addr
+ * returns: rom[(bank * 0x4000) + (addr & 0x3FFF)].
+ *
+ * \param self the mapper to query.
+ * \param addr an address in 0000-7FFF.
+ *
+ * \return the index of the 16 KiB ROM bank mapped at addr.
+ *
+ * \sa Mapper_read
+ */
+[[nodiscard]] size_t Mapper_rom_bank(const Mapper *self, u16 addr);
+
+/**
+ * \brief Gets the cartridge RAM currently mapped at A000-BFFF.
+ *
+ * This only changes on writes to 0000-7FFF. While it is NULL, every address in
+ * A000-BFFF reads the same value, which only changes then as well.
+ *
+ * \param self the mapper to query.
+ *
+ * \return the 8 KiB RAM bank mapped at A000, or NULL if the cartridge has no
+ * RAM, it is disabled or something else is mapped there instead.
+ *
+ * \sa Mapper_read
+ */
+[[nodiscard]] u8 *Mapper_ram_bank(const Mapper *self);
+
+/**
+ * \brief Gets the length of the cartridge RAM of the given mapper.
+ *
+ * \param self the mapper to query.
+ *
+ * \return the length of the cartridge RAM in bytes, or 0 if there is none.
+ *
+ * \sa Mapper_set_ram
+ */
+[[nodiscard]] size_t Mapper_ram_len(const Mapper *self);
+
+/**
+ * \brief Gets the cartridge RAM of the given mapper, including the banks that
+ * are not mapped.
+ *
+ * \param self the mapper to query.
+ *
+ * \return the Mapper_ram_len bytes of cartridge RAM, one bank after the other,
+ * or NULL if there is none.
+ *
+ * \sa Mapper_ram_bank
+ */
+[[nodiscard]] u8 *Mapper_ram(const Mapper *self);
+
+/**
+ * \brief Moves the cartridge RAM of the given mapper to other memory.
+ *
+ * The mapper then reads and writes ram in place of its own cartridge RAM,
+ * whose contents are dropped. This is a no-op if the cartridge has no RAM.
+ * Since this changes what Mapper_ram_bank returns, the caller must look it up
+ * again.
+ *
+ * \param self the mapper to move the RAM of.
+ * \param ram borrowed memory of Mapper_ram_len bytes, which must outlive the
+ * mapper.
+ *
+ * \sa Mapper_ram_len
+ */
+void Mapper_set_ram(Mapper *self, u8 *ram);
 
 /**
  * \brief Writes a byte to the given mapper.
  *
+ * Writes to 0000-7FFF set the mapper registers, which may change what
+ * Mapper_rom_bank and Mapper_ram_bank return.
+ *
  * \param self the mapper to write to.
  * \param addr the address to write to.
  * \param value the value to write.
+ * \param cycles M-cycles emulated so far, as for Mapper_read.
  *
  * \sa Mapper_read
  */
-void Mapper_write(Mapper *self, u16 addr, u8 value);
+void Mapper_write(Mapper *self, u16 addr, u8 value, u64 cycles);
+
+/**
+ * \brief Saves the state of the real-time clock of the given mapper, if any.
+ *
+ * This uses the layout that BGB and VBA-M append to the cartridge RAM in save
+ * files: the current and the latched clock registers as 32-bit little-endian
+ * words, followed by the host time as a 64-bit little-endian UNIX timestamp.
+ *
+ * \param self the mapper to save the clock of.
+ * \param cycles M-cycles emulated so far, as for Mapper_read.
+ * \param host_time the current UNIX time of the host, in seconds.
+ * \param out where to store the MAPPER_CLOCK_SAVE_LEN bytes of state.
+ *
+ * \return whether the mapper has a clock and out was written.
+ *
+ * \sa Mapper_load_clock
+ */
+bool Mapper_save_clock(const Mapper *self, u64 cycles, i64 host_time,
+                       u8 out[MAPPER_CLOCK_SAVE_LEN]);
+
+/**
+ * \brief Restores the real-time clock of the given mapper, if any.
+ *
+ * Unless it was halted, the clock is moved forward by the host time that
+ * passed since the state was saved.
+ *
+ * \param self the mapper to restore the clock of.
+ * \param cycles M-cycles emulated so far, as for Mapper_read.
+ * \param host_time the current UNIX time of the host, in seconds.
+ * \param in MAPPER_CLOCK_SAVE_LEN bytes of state from Mapper_save_clock.
+ *
+ * \return whether the mapper has a clock and it was restored.
+ *
+ * \sa Mapper_save_clock
+ */
+bool Mapper_load_clock(Mapper *self, u64 cycles, i64 host_time,
+                       const u8 in[MAPPER_CLOCK_SAVE_LEN]);
 
 /**
  * \brief Cleans up any memory used by a mapper.
@@ -1,16 +1,10 @@
 #include "num.h"
 #include "stdinc.h"
 
-u16 concat_u16(const u8 hi, const u8 lo)
-{
-    return ((u16)hi << 8) | (u16)lo;
-}
+// Inline functions in headers only have inline definitions there, which the
+// compiler may or may not use. Declaring each one extern in exactly one
+// translation unit (here for num.h, and in cpu.c, block_cache.c and game_boy.c
+// for their headers) emits the external definition that calls fall back on.
+extern inline u16 concat_u16(u8 hi, u8 lo);
 
-void set_bits(u8 *const dest, const u8 mask, const bool value)
-{
-    if (value) {
-        *dest |= mask;
-    } else {
-        *dest &= ~mask;
-    }
-}
+extern inline void set_bits(u8 *dest, u8 mask, bool value);
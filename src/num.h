@@ -3,8 +3,18 @@
 
 #include "stdinc.h"
 
-[[nodiscard]] u16 concat_u16(u8 hi, u8 lo);
+[[nodiscard]] inline u16 concat_u16(const u8 hi, const u8 lo)
+{
+    return ((u16)hi << 8) | (u16)lo;
+}
 
-void set_bits(u8 *dest, u8 mask, bool value);
+inline void set_bits(u8 *const dest, const u8 mask, const bool value)
+{
+    if (value) {
+        *dest |= mask;
+    } else {
+        *dest &= ~mask;
+    }
+}
 
 #endif
@@ -0,0 +1,199 @@
+#include "ppu.h"
+#include "game_boy.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <string.h>
+
+constexpr size_t PPU_VRAM_PAGE_COUNT = 0x2000 / GB_PAGE_LEN;
+constexpr size_t PPU_TILE_LEN = 16;
+constexpr size_t PPU_TILE_MAP_WIDTH = 32;
+constexpr size_t PPU_OBJ_COUNT = 40;
+constexpr size_t PPU_LINE_OBJ_COUNT = 10;
+
+// The pages of VRAM as the GameBoy sees them (see GameBoy_memory_page)
+typedef struct {
+    const u8 *pages[PPU_VRAM_PAGE_COUNT];
+} PpuVram;
+
+static u8 PpuVram_read(const PpuVram *const self, const u16 offset)
+{
+    return self->pages[offset / GB_PAGE_LEN][offset % GB_PAGE_LEN];
+}
+
+// The color index of pixel x (0 being the leftmost) of a row of a tile, given
+// the two bytes of the row
+static u8 tile_color(const u8 lo, const u8 hi, const u8 x)
+{
+    const u8 bit = 7 - x;
+    return ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+}
+
+// The offset into VRAM of the row of the background or window tile that pixel
+// (x, y) of the given tile map falls on
+static u16 Ppu_tile_row(const GameBoy *const gb, const PpuVram *const vram,
+                        const u16 map, const u8 x, const u8 y)
+{
+    const u8 index =
+        PpuVram_read(vram, map + ((y / 8) * PPU_TILE_MAP_WIDTH) + (x / 8));
+
+    // Tiles 0-127 come from 9000-97FF rather than 8000-87FF unless LCDC says
+    // otherwise
+    const int tile = (gb->lcdc & LcdControl_BgwTileArea) != 0
+                         ? index * (int)PPU_TILE_LEN
+                         : 0x1000 + ((i8)index * (int)PPU_TILE_LEN);
+
+    return (u16)(tile + ((y % 8) * 2));
+}
+
+// Draws pixels first to last - 1 of a line of the background or window into
+// colors, from row y of the given tile map, starting at column x
+static void Ppu_draw_tiles(const GameBoy *const gb, const PpuVram *const vram,
+                           const u16 map, u8 x, const u8 y, const int first,
+                           const int last, u8 *const colors)
+{
+    u8 lo = 0;
+    u8 hi = 0;
+
+    // x wraps around to the left edge of the tile map on its own
+    for (int pixel = first; pixel < last; ++pixel, ++x) {
+        if (pixel == first || x % 8 == 0) {
+            const u16 row = Ppu_tile_row(gb, vram, map, x, y);
+            lo = PpuVram_read(vram, row);
+            hi = PpuVram_read(vram, row + 1);
+        }
+
+        colors[pixel] = tile_color(lo, hi, x % 8);
+    }
+}
+
+// Draws the background and window of a line into colors, as color indices
+static void Ppu_draw_bgw(GameBoy *const gb, const PpuVram *const vram,
+                         const u8 ly, u8 colors[GB_LCD_WIDTH])
+{
+    if ((gb->lcdc & LcdControl_ObjBgwEnable) == 0) {
+        memset(colors, 0, GB_LCD_WIDTH);
+        return;
+    }
+
+    // Where the window starts on this line, which may be left of the screen
+    int window_x = GB_LCD_WIDTH;
+
+    if ((gb->lcdc & LcdControl_WinEnable) != 0 && ly >= gb->wy &&
+        gb->wx < GB_LCD_WIDTH + 7)
+        window_x = gb->wx - 7;
+
+    const u16 bg_map = (gb->lcdc & LcdControl_BgTileMap) != 0 ? 0x1C00 : 0x1800;
+    const int bg_last = window_x > 0 ? window_x : 0;
+    Ppu_draw_tiles(gb, vram, bg_map, gb->scx, (u8)(gb->scy + ly), 0, bg_last,
+                   colors);
+
+    if (window_x < GB_LCD_WIDTH) {
+        const u16 win_map =
+            (gb->lcdc & LcdControl_WinTileMap) != 0 ? 0x1C00 : 0x1800;
+        Ppu_draw_tiles(gb, vram, win_map, (u8)(bg_last - window_x),
+                       gb->window_line, bg_last, GB_LCD_WIDTH, colors);
+
+        ++gb->window_line;
+    }
+}
+
+// Draws the objects on a line over it, given the color indices of the
+// background and window under them
+static void Ppu_draw_objects(const GameBoy *const gb, const PpuVram *const vram,
+                             const u8 ly, const u8 bgw[GB_LCD_WIDTH],
+                             u8 line[GB_LCD_WIDTH])
+{
+    const int height = (gb->lcdc & LcdControl_ObjSize) != 0 ? 16 : 8;
+
+    // The first objects in OAM on the line, sorted by X. Among those at the
+    // same X, the first in OAM stays first.
+    u8 objs[PPU_LINE_OBJ_COUNT];
+    size_t obj_count = 0;
+
+    for (size_t obj = 0; obj < PPU_OBJ_COUNT && obj_count < PPU_LINE_OBJ_COUNT;
+         ++obj) {
+        const int top = gb->oam[obj * 4] - 16;
+        if (ly < top || ly >= top + height)
+            continue;
+
+        const u8 x = gb->oam[(obj * 4) + 1];
+        size_t i = obj_count++;
+
+        for (; i > 0 && gb->oam[(objs[i - 1] * 4) + 1] > x; --i)
+            objs[i] = objs[i - 1];
+
+        objs[i] = (u8)obj;
+    }
+
+    // Pixels taken by an object drawn before, which hides the objects after
+    // it even when it is itself behind the background
+    bool taken[GB_LCD_WIDTH] = {};
+
+    for (size_t i = 0; i < obj_count; ++i) {
+        const u8 *const obj_data = &gb->oam[objs[i] * 4];
+        const int left = obj_data[1] - 8;
+        const u8 attrs = obj_data[3];
+
+        int row = ly - (obj_data[0] - 16);
+        if ((attrs & ObjAttrs_FlipY) != 0)
+            row = height - 1 - row;
+
+        // 8x16 objects take two tiles, the first one even
+        const u8 tile = height == 16 ? (obj_data[2] & 0xFE) : obj_data[2];
+
+        // Objects always use the $8000 method
+        const u16 addr = (u16)((tile * PPU_TILE_LEN) + (row * 2));
+        const u8 lo = PpuVram_read(vram, addr);
+        const u8 hi = PpuVram_read(vram, addr + 1);
+
+        const u8 obp =
+            (attrs & ObjAttrs_DmgPalette) != 0 ? gb->obp1 : gb->obp0;
+        const bool behind = (attrs & ObjAttrs_Priority) != 0;
+
+        for (int col = 0; col < 8; ++col) {
+            const int x = left + col;
+            if (x < 0 || x >= GB_LCD_WIDTH || taken[x])
+                continue;
+
+            const u8 color = tile_color(
+                lo, hi, (attrs & ObjAttrs_FlipX) != 0 ? 7 - col : col);
+
+            // Color 0 is transparent, so objects after this one may show there
+            if (color == 0)
+                continue;
+
+            taken[x] = true;
+
+            if (!behind || bgw[x] == 0)
+                line[x] = (obp >> (2 * color)) & 0b11;
+        }
+    }
+}
+
+void Ppu_draw_line(GameBoy *const gb, const u8 ly)
+{
+    u8 *const line = gb->framebuffer[ly];
+
+    if (ly == 0)
+        gb->window_line = 0;
+
+    if ((gb->lcdc & LcdControl_Enable) == 0) {
+        memset(line, 0, GB_LCD_WIDTH);
+        return;
+    }
+
+    PpuVram vram;
+    for (size_t page = 0; page < PPU_VRAM_PAGE_COUNT; ++page)
+        vram.pages[page] =
+            GameBoy_memory_page(gb, (u16)(0x8000 + (page * GB_PAGE_LEN)));
+
+    u8 bgw[GB_LCD_WIDTH];
+    Ppu_draw_bgw(gb, &vram, ly, bgw);
+
+    for (int x = 0; x < GB_LCD_WIDTH; ++x)
+        line[x] = (gb->bgp >> (2 * bgw[x])) & 0b11;
+
+    // OAM cannot be read while OAM DMA writes it
+    if ((gb->lcdc & LcdControl_ObjEnable) != 0 && !GameBoy_oam_dma_running(gb))
+        Ppu_draw_objects(gb, &vram, ly, bgw, line);
+}
@@ -0,0 +1,35 @@
+#ifndef GEMU_PPU_H
+#define GEMU_PPU_H
+
+// The pixel pipeline of a GameBoy, which draws the LCD one line at a time into
+// its framebuffer.
+//
+// Each line is drawn as a whole once mode 3 is over for it, from the registers,
+// VRAM and OAM as they are then, so that changes to them between lines (such
+// as to scroll part of the screen) show up where they would on hardware.
+
+#include "game_boy.h"
+#include "stdinc.h"
+
+// M-cycles into each line at which mode 3 is over, out of GB_LINE_CYCLES. On
+// hardware, mode 3 runs a little longer with objects on the line.
+constexpr int PPU_MODE_3_END_CYCLES = 63;
+
+/**
+ * \brief Draws a line of the LCD into the framebuffer of a GameBoy.
+ *
+ * This draws the background and window, scrolling around the edges of the
+ * tile maps, and the first 10 objects in OAM on the line, with those further
+ * left over the others. Objects with their priority bit set only show over
+ * background and window color 0. No objects are drawn while OAM DMA runs, and
+ * the whole line is color 0 while the LCD is off.
+ *
+ * Lines must be drawn in order from the top of each frame, since the window
+ * only moves down on lines it is shown on.
+ *
+ * \param gb the GameBoy to draw the line of.
+ * \param ly the line to draw, less than GB_LCD_HEIGHT.
+ */
+void Ppu_draw_line(GameBoy *gb, u8 ly);
+
+#endif
@@ -0,0 +1,493 @@
+#include "ram_search.h"
+#include "game_boy.h"
+#include "macros.h"
+#include "mapper.h"
+#include "num.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define RAM_SEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+// Where each kind of RAM is in a snapshot. HRAM is padded to a whole chunk, so
+// that it is never compared against the start of cartridge RAM.
+static constexpr size_t WRAM_AT = 0;
+static constexpr size_t WRAM_LEN = 0x2000;
+static constexpr size_t HRAM_AT = 0x2000;
+static constexpr size_t HRAM_LEN = 0x7F;
+static constexpr size_t CART_RAM_AT = 0x2080;
+static constexpr size_t CART_RAM_BANK_LEN = 0x2000;
+
+// Bytes filtered at once, one word of candidates
+static constexpr size_t CHUNK_LEN = 64;
+
+struct RamSearch {
+    size_t len; // Of each snapshot, a multiple of CHUNK_LEN
+    size_t cart_ram_len;
+    // As of the last filter. Both snapshots are followed by a chunk of zeroes,
+    // so that 16-bit values can be loaded past the end.
+    u8 *snapshot;
+    u8 *next; // Taken by the next filter, then swapped with snapshot
+    u64 *candidates; // One bit per byte of the snapshots
+    size_t count;
+    RamSearchWidth width; // Of the last filter
+};
+
+// Lanes of bytes, each either 0xFF or 0x00 once compared. Without any vector
+// instructions, there is just the one.
+#if defined(__AVX2__)
+typedef __m256i Lanes;
+static constexpr size_t LANE_COUNT = 32;
+
+static inline Lanes lanes_load(const u8 *const p)
+{
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline Lanes lanes_splat(const u8 value)
+{
+    return _mm256_set1_epi8((char)value);
+}
+
+static inline Lanes lanes_eq(const Lanes a, const Lanes b)
+{
+    return _mm256_cmpeq_epi8(a, b);
+}
+
+static inline Lanes lanes_max(const Lanes a, const Lanes b)
+{
+    return _mm256_max_epu8(a, b);
+}
+
+static inline Lanes lanes_add(const Lanes a, const Lanes b)
+{
+    return _mm256_add_epi8(a, b);
+}
+
+static inline Lanes lanes_sub(const Lanes a, const Lanes b)
+{
+    return _mm256_sub_epi8(a, b);
+}
+
+static inline Lanes lanes_and(const Lanes a, const Lanes b)
+{
+    return _mm256_and_si256(a, b);
+}
+
+static inline Lanes lanes_or(const Lanes a, const Lanes b)
+{
+    return _mm256_or_si256(a, b);
+}
+
+static inline Lanes lanes_not(const Lanes a)
+{
+    return _mm256_xor_si256(a, _mm256_set1_epi8(-1));
+}
+
+// One bit per lane, from its top bit
+static inline u64 lanes_mask(const Lanes a)
+{
+    return (u32)_mm256_movemask_epi8(a);
+}
+#elif defined(RAM_SEARCH_SSE2)
+typedef __m128i Lanes;
+static constexpr size_t LANE_COUNT = 16;
+
+static inline Lanes lanes_load(const u8 *const p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline Lanes lanes_splat(const u8 value)
+{
+    return _mm_set1_epi8((char)value);
+}
+
+static inline Lanes lanes_eq(const Lanes a, const Lanes b)
+{
+    return _mm_cmpeq_epi8(a, b);
+}
+
+static inline Lanes lanes_max(const Lanes a, const Lanes b)
+{
+    return _mm_max_epu8(a, b);
+}
+
+static inline Lanes lanes_add(const Lanes a, const Lanes b)
+{
+    return _mm_add_epi8(a, b);
+}
+
+static inline Lanes lanes_sub(const Lanes a, const Lanes b)
+{
+    return _mm_sub_epi8(a, b);
+}
+
+static inline Lanes lanes_and(const Lanes a, const Lanes b)
+{
+    return _mm_and_si128(a, b);
+}
+
+static inline Lanes lanes_or(const Lanes a, const Lanes b)
+{
+    return _mm_or_si128(a, b);
+}
+
+static inline Lanes lanes_not(const Lanes a)
+{
+    return _mm_xor_si128(a, _mm_set1_epi8(-1));
+}
+
+// One bit per lane, from its top bit
+static inline u64 lanes_mask(const Lanes a)
+{
+    return (u32)_mm_movemask_epi8(a);
+}
+#else
+typedef u8 Lanes;
+static constexpr size_t LANE_COUNT = 1;
+
+static inline Lanes lanes_load(const u8 *const p)
+{
+    return *p;
+}
+
+static inline Lanes lanes_splat(const u8 value)
+{
+    return value;
+}
+
+static inline Lanes lanes_eq(const Lanes a, const Lanes b)
+{
+    return a == b ? 0xFF : 0x00;
+}
+
+static inline Lanes lanes_max(const Lanes a, const Lanes b)
+{
+    return a > b ? a : b;
+}
+
+static inline Lanes lanes_add(const Lanes a, const Lanes b)
+{
+    return (u8)(a + b);
+}
+
+static inline Lanes lanes_sub(const Lanes a, const Lanes b)
+{
+    return (u8)(a - b);
+}
+
+static inline Lanes lanes_and(const Lanes a, const Lanes b)
+{
+    return a & b;
+}
+
+static inline Lanes lanes_or(const Lanes a, const Lanes b)
+{
+    return a | b;
+}
+
+static inline Lanes lanes_not(const Lanes a)
+{
+    return (u8)~a;
+}
+
+// One bit per lane, from its top bit
+static inline u64 lanes_mask(const Lanes a)
+{
+    return a >> 7;
+}
+#endif
+
+static_assert(CHUNK_LEN % LANE_COUNT == 0,
+              "Chunks must be made of whole lanes");
+
+// Unsigned a > b, since only equality and the maximum are unsigned in SSE2
+static inline Lanes lanes_gt(const Lanes a, const Lanes b)
+{
+    return lanes_not(lanes_eq(lanes_max(a, b), b));
+}
+
+typedef struct {
+    RamSearchCmp cmp;
+    RamSearchWidth width;
+    Lanes lo; // Bytes of the value to compare against
+    Lanes hi;
+} Query;
+
+// Compares the LANE_COUNT values starting at cur against those at prev
+static inline Lanes match(const Query *const query, const u8 *const cur,
+                          const u8 *const prev)
+{
+    const Lanes cur_lo = lanes_load(cur);
+    const Lanes prev_lo = lanes_load(prev);
+
+    if (query->width == RamSearchWidth_8) {
+        switch (query->cmp) {
+        case RamSearchCmp_Equal:
+            return lanes_eq(cur_lo, prev_lo);
+        case RamSearchCmp_Changed:
+            return lanes_not(lanes_eq(cur_lo, prev_lo));
+        case RamSearchCmp_Increased:
+            return lanes_gt(cur_lo, prev_lo);
+        case RamSearchCmp_Decreased:
+            return lanes_gt(prev_lo, cur_lo);
+        case RamSearchCmp_Delta:
+            return lanes_eq(lanes_sub(cur_lo, prev_lo), query->lo);
+        case RamSearchCmp_Value:
+            return lanes_eq(cur_lo, query->lo);
+        }
+    }
+
+    // Each 16-bit value is made of the byte in a lane and the next one
+    const Lanes cur_hi = lanes_load(cur + 1);
+    const Lanes prev_hi = lanes_load(prev + 1);
+    const Lanes eq_lo = lanes_eq(cur_lo, prev_lo);
+    const Lanes eq_hi = lanes_eq(cur_hi, prev_hi);
+
+    switch (query->cmp) {
+    case RamSearchCmp_Equal:
+        return lanes_and(eq_lo, eq_hi);
+    case RamSearchCmp_Changed:
+        return lanes_not(lanes_and(eq_lo, eq_hi));
+    case RamSearchCmp_Increased:
+        return lanes_or(lanes_gt(cur_hi, prev_hi),
+                        lanes_and(eq_hi, lanes_gt(cur_lo, prev_lo)));
+    case RamSearchCmp_Decreased:
+        return lanes_or(lanes_gt(prev_hi, cur_hi),
+                        lanes_and(eq_hi, lanes_gt(prev_lo, cur_lo)));
+    case RamSearchCmp_Delta: {
+        // Borrowing from the high byte adds 0xFF to it
+        const Lanes borrow = lanes_gt(prev_lo, cur_lo);
+        const Lanes delta_hi =
+            lanes_add(lanes_sub(cur_hi, prev_hi), borrow);
+
+        return lanes_and(lanes_eq(lanes_sub(cur_lo, prev_lo), query->lo),
+                         lanes_eq(delta_hi, query->hi));
+    }
+    case RamSearchCmp_Value:
+        return lanes_and(lanes_eq(cur_lo, query->lo),
+                         lanes_eq(cur_hi, query->hi));
+    }
+
+    BAIL("Unknown RAM search comparison %d", query->cmp);
+}
+
+static size_t count_ones(u64 bits)
+{
+#if defined(__GNUC__)
+    return (size_t)__builtin_popcountll(bits);
+#else
+    size_t count = 0;
+
+    for (; bits != 0; bits &= bits - 1)
+        ++count;
+
+    return count;
+#endif
+}
+
+static void set_candidates(u64 *const candidates, const size_t at,
+                           const size_t len)
+{
+    for (size_t i = at; i < at + len; ++i)
+        candidates[i / 64] |= (u64)1 << (i % 64);
+}
+
+static void clear_candidate(u64 *const candidates, const size_t at)
+{
+    candidates[at / 64] &= ~((u64)1 << (at % 64));
+}
+
+// Copies the RAM of gb into a snapshot, leaving its padding alone
+static void RamSearch_capture(const RamSearch *const self,
+                              const GameBoy *const gb, u8 *const snapshot)
+{
+    // Page by page, as forks may still share some (see GameBoy_memory_page)
+    for (size_t at = 0; at < WRAM_LEN; at += GB_PAGE_LEN) {
+        memcpy(&snapshot[WRAM_AT + at], GameBoy_memory_page(gb, 0xC000 + at),
+               GB_PAGE_LEN);
+    }
+
+    memcpy(&snapshot[HRAM_AT], gb->hram, HRAM_LEN);
+
+    size_t cart_ram_len =
+        gb->mapper != nullptr ? Mapper_ram_len(gb->mapper) : 0;
+
+    // Another ROM may have been loaded since the search started
+    if (cart_ram_len > self->cart_ram_len)
+        cart_ram_len = self->cart_ram_len;
+
+    // Cartridge RAM is a whole number of pages, shared like WRAM
+    for (size_t at = 0; at < cart_ram_len; at += GB_PAGE_LEN) {
+        memcpy(&snapshot[CART_RAM_AT + at], GameBoy_cart_ram_page(gb, at),
+               GB_PAGE_LEN);
+    }
+
+    memset(&snapshot[CART_RAM_AT + cart_ram_len], 0,
+           self->cart_ram_len - cart_ram_len);
+}
+
+RamSearch *RamSearch_new(const GameBoy *const gb)
+{
+    RamSearch *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    const size_t cart_ram_len =
+        gb->mapper != nullptr ? Mapper_ram_len(gb->mapper) : 0;
+    const size_t len = (CART_RAM_AT + cart_ram_len + CHUNK_LEN - 1) /
+                       CHUNK_LEN * CHUNK_LEN;
+
+    *self = (RamSearch){
+        .len = len,
+        .cart_ram_len = cart_ram_len,
+        .snapshot = calloc(len + CHUNK_LEN, 1),
+        .next = calloc(len + CHUNK_LEN, 1),
+        .candidates = malloc(len / CHUNK_LEN * sizeof(u64)),
+    };
+    BAIL_IF_NULL(self->snapshot);
+    BAIL_IF_NULL(self->next);
+    BAIL_IF_NULL(self->candidates);
+
+    RamSearch_reset(self, gb);
+    return self;
+}
+
+void RamSearch_destroy(RamSearch *const self)
+{
+    if (self == nullptr)
+        return;
+
+    free(self->snapshot);
+    free(self->next);
+    free(self->candidates);
+    free(self);
+}
+
+void RamSearch_reset(RamSearch *const self, const GameBoy *const gb)
+{
+    RamSearch_capture(self, gb, self->snapshot);
+
+    memset(self->candidates, 0, self->len / CHUNK_LEN * sizeof(u64));
+    set_candidates(self->candidates, WRAM_AT, WRAM_LEN);
+    set_candidates(self->candidates, HRAM_AT, HRAM_LEN);
+    set_candidates(self->candidates, CART_RAM_AT, self->cart_ram_len);
+
+    self->count = WRAM_LEN + HRAM_LEN + self->cart_ram_len;
+    self->width = RamSearchWidth_8;
+}
+
+size_t RamSearch_filter(RamSearch *const self, const GameBoy *const gb,
+                        const RamSearchCmp cmp, const RamSearchWidth width,
+                        const u16 value)
+{
+    RamSearch_capture(self, gb, self->next);
+
+    // The byte after the end of each region is not part of the same value
+    if (width == RamSearchWidth_16) {
+        clear_candidate(self->candidates, WRAM_AT + WRAM_LEN - 1);
+        clear_candidate(self->candidates, HRAM_AT + HRAM_LEN - 1);
+
+        for (size_t bank_at = 0; bank_at < self->cart_ram_len;
+             bank_at += CART_RAM_BANK_LEN) {
+            const size_t bank_end = bank_at + CART_RAM_BANK_LEN;
+            clear_candidate(self->candidates,
+                            CART_RAM_AT - 1 +
+                                (bank_end < self->cart_ram_len
+                                     ? bank_end
+                                     : self->cart_ram_len));
+        }
+    }
+
+    const Query query = {
+        .cmp = cmp,
+        .width = width,
+        .lo = lanes_splat(value & 0xFF),
+        .hi = lanes_splat(value >> 8),
+    };
+
+    size_t count = 0;
+
+    for (size_t chunk = 0; chunk < self->len / CHUNK_LEN; ++chunk) {
+        u64 bits = self->candidates[chunk];
+
+        // Most chunks run out of candidates after a few filters
+        if (bits == 0)
+            continue;
+
+        const size_t at = chunk * CHUNK_LEN;
+        u64 matches = 0;
+
+        for (size_t i = 0; i < CHUNK_LEN; i += LANE_COUNT) {
+            matches |= lanes_mask(match(&query, &self->next[at + i],
+                                        &self->snapshot[at + i]))
+                       << i;
+        }
+
+        bits &= matches;
+        self->candidates[chunk] = bits;
+        count += count_ones(bits);
+    }
+
+    u8 *const snapshot = self->next;
+    self->next = self->snapshot;
+    self->snapshot = snapshot;
+    self->count = count;
+    self->width = width;
+    return count;
+}
+
+size_t RamSearch_count(const RamSearch *const self)
+{
+    return self->count;
+}
+
+// The candidate at the given place in the snapshots
+static RamSearchCandidate RamSearch_candidate(const RamSearch *const self,
+                                              const size_t at)
+{
+    const u16 value = self->width == RamSearchWidth_16
+                          ? concat_u16(self->snapshot[at + 1],
+                                       self->snapshot[at])
+                          : self->snapshot[at];
+
+    if (at < HRAM_AT)
+        return (RamSearchCandidate){
+            .addr = 0xC000 + (at - WRAM_AT), .bank = 0, .value = value};
+
+    if (at < CART_RAM_AT)
+        return (RamSearchCandidate){
+            .addr = 0xFF80 + (at - HRAM_AT), .bank = 0, .value = value};
+
+    const size_t offset = at - CART_RAM_AT;
+    return (RamSearchCandidate){
+        .addr = 0xA000 + (offset % CART_RAM_BANK_LEN),
+        .bank = offset / CART_RAM_BANK_LEN,
+        .value = value,
+    };
+}
+
+size_t RamSearch_candidates(const RamSearch *const self,
+                            RamSearchCandidate *const out, const size_t max)
+{
+    size_t stored = 0;
+
+    for (size_t chunk = 0; chunk < self->len / CHUNK_LEN && stored < max;
+         ++chunk) {
+        const u64 bits = self->candidates[chunk];
+
+        for (size_t i = 0; i < CHUNK_LEN && bits >> i != 0 && stored < max;
+             ++i) {
+            if ((bits >> i) & 1)
+                out[stored++] = RamSearch_candidate(self, chunk * CHUNK_LEN + i);
+        }
+    }
+
+    return stored;
+}
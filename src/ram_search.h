@@ -0,0 +1,113 @@
+#ifndef GEMU_RAM_SEARCH_H
+#define GEMU_RAM_SEARCH_H
+
+// Narrows down where a game keeps some variable, such as a score or a
+// position, by comparing all of its RAM against how it was the last time.
+//
+// WRAM, HRAM and cartridge RAM are copied into one snapshot per filter, and
+// every byte of it that may still be the variable is a candidate, kept as one
+// bit. Each filter compares the new snapshot against the previous one with
+// vector instructions where the compiler targets them (AVX2 or SSE2), so that
+// filtering every frame is cheap.
+
+#include "game_boy.h"
+#include "stdinc.h"
+#include <stddef.h>
+
+typedef enum : u8 {
+    RamSearchCmp_Equal,     // Unchanged since the last filter
+    RamSearchCmp_Changed,   // Changed since the last filter
+    RamSearchCmp_Increased, // Greater than at the last filter (unsigned)
+    RamSearchCmp_Decreased, // Less than at the last filter (unsigned)
+    RamSearchCmp_Delta,     // Exactly value more than at the last filter
+    RamSearchCmp_Value,     // Exactly value
+} RamSearchCmp;
+
+// Size of the variable searched for. Wider ones are little-endian.
+typedef enum : u8 {
+    RamSearchWidth_8 = 1,
+    RamSearchWidth_16 = 2,
+} RamSearchWidth;
+
+typedef struct {
+    u16 addr; // In C000-DFFF, FF80-FFFE or A000-BFFF
+    u8 bank;  // Cartridge RAM bank mapped at A000 for addr to hold the value
+    u16 value; // As of the last filter, with the width it used
+} RamSearchCandidate;
+
+typedef struct RamSearch RamSearch;
+
+/**
+ * \brief Starts a search over the RAM of a GameBoy, with every byte of it as a
+ * candidate.
+ *
+ * The cartridge RAM searched is that of the ROM loaded now. The search should
+ * be reset after loading another one.
+ *
+ * \param gb the GameBoy to take the first snapshot of.
+ *
+ * \return the created search, which must be destroyed via RamSearch_destroy.
+ *
+ * \sa RamSearch_destroy
+ */
+[[nodiscard]] RamSearch *RamSearch_new(const GameBoy *gb);
+
+/**
+ * \brief Destroys a search.
+ *
+ * \param self the search to destroy, or NULL.
+ *
+ * \sa RamSearch_new
+ */
+void RamSearch_destroy(RamSearch *self);
+
+/**
+ * \brief Starts a search over again, with every byte as a candidate.
+ *
+ * \param self the search to reset.
+ * \param gb the GameBoy to take the first snapshot of.
+ */
+void RamSearch_reset(RamSearch *self, const GameBoy *gb);
+
+/**
+ * \brief Keeps the candidates whose value compares as given against the last
+ * snapshot, then takes a new one.
+ *
+ * A 16-bit candidate is made of its byte and the next one, so filtering them
+ * drops the last byte of WRAM, HRAM and each cartridge RAM bank for good.
+ *
+ * \param self the search to filter.
+ * \param gb the GameBoy to take the new snapshot of.
+ * \param cmp how the new values must compare against the last ones.
+ * \param width the size of the values to compare.
+ * \param value the operand of RamSearchCmp_Delta and RamSearchCmp_Value,
+ * truncated to width. Ignored by the other comparisons.
+ *
+ * \return the number of candidates left.
+ */
+size_t RamSearch_filter(RamSearch *self, const GameBoy *gb, RamSearchCmp cmp,
+                        RamSearchWidth width, u16 value);
+
+/**
+ * \brief Gets the number of candidates left.
+ *
+ * \param self the search to query.
+ *
+ * \return the number of candidates left.
+ */
+[[nodiscard]] size_t RamSearch_count(const RamSearch *self);
+
+/**
+ * \brief Lists the candidates left, in order of their place in the snapshot:
+ * WRAM, then HRAM, then cartridge RAM.
+ *
+ * \param self the search to query.
+ * \param out where to store the candidates.
+ * \param max the most candidates to store in out.
+ *
+ * \return the number of candidates stored in out, at most max.
+ */
+size_t RamSearch_candidates(const RamSearch *self, RamSearchCandidate *out,
+                            size_t max);
+
+#endif
@@ -0,0 +1,302 @@
+#define _GNU_SOURCE // memfd_create
+
+#include "rom_file.h"
+#include "log.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <SDL3/SDL.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct RomFile {
+    const u8 *data;
+    size_t len;
+    bool mapped; // Whether data is mapped from a file rather than allocated
+    // Identifies the ROM among the loaded ones: the device and inode of a
+    // mapped file, or a hash of the contents of a copy. Hashing a mapped file
+    // would page all of it in.
+    u64 id[2];
+    // Only dropped to 0 with loaded_roms_lock held, so that RomFile_find
+    // never takes a reference to a ROM that is being destroyed
+    SDL_AtomicInt refs;
+    RomFile *next; // Guarded by loaded_roms_lock
+#ifdef GEMU_FLAT_MEMORY
+    // What data is mapped from, or -1 until RomFile_fd is called. Guarded by
+    // loaded_roms_lock.
+    int fd;
+#endif
+};
+
+// Every ROM that is still referenced, so that loading the same one again
+// shares it
+static RomFile *loaded_roms = nullptr;
+static SDL_SpinLock loaded_roms_lock = 0;
+
+static u64 hash_contents(const u8 *const data, const size_t len)
+{
+    u64 hash = 0xCBF29CE484222325;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+// A new reference to the loaded ROM with the given identity, or NULL if there
+// is none. Copies are also compared byte for byte, since hashes may collide.
+static RomFile *RomFile_find_locked(const bool mapped, const u64 id0,
+                                    const u64 id1, const u8 *const data,
+                                    const size_t len)
+{
+    for (RomFile *rom = loaded_roms; rom != nullptr; rom = rom->next) {
+        if (rom->mapped != mapped || rom->len != len || rom->id[0] != id0 ||
+            rom->id[1] != id1)
+            continue;
+
+        if (!mapped && memcmp(rom->data, data, len) != 0)
+            continue;
+
+        return RomFile_ref(rom);
+    }
+
+    return nullptr;
+}
+
+static RomFile *RomFile_find(const bool mapped, const u64 id0, const u64 id1,
+                             const u8 *const data, const size_t len)
+{
+    SDL_LockSpinlock(&loaded_roms_lock);
+    RomFile *const rom = RomFile_find_locked(mapped, id0, id1, data, len);
+    SDL_UnlockSpinlock(&loaded_roms_lock);
+
+    return rom;
+}
+
+// Adds a ROM that was just loaded, unless another thread loaded the same one
+// in the meantime. Then that one is returned instead and the caller must free
+// what it loaded.
+static RomFile *RomFile_add(const u8 *const data, const size_t len,
+                            const bool mapped, const u64 id0, const u64 id1,
+                            [[maybe_unused]] const int fd)
+{
+    RomFile *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    *self = (RomFile){
+        .data = data,
+        .len = len,
+        .mapped = mapped,
+        .id = {id0, id1},
+#ifdef GEMU_FLAT_MEMORY
+        .fd = fd,
+#endif
+    };
+    SDL_SetAtomicInt(&self->refs, 1);
+
+    SDL_LockSpinlock(&loaded_roms_lock);
+
+    RomFile *const loaded = RomFile_find_locked(mapped, id0, id1, data, len);
+
+    if (loaded == nullptr) {
+        self->next = loaded_roms;
+        loaded_roms = self;
+    }
+
+    SDL_UnlockSpinlock(&loaded_roms_lock);
+
+    if (loaded != nullptr) {
+        free(self);
+        return loaded;
+    }
+
+    return self;
+}
+
+RomFile *RomFile_open(const char *const path)
+{
+#ifdef _WIN32
+    size_t len = 0;
+    u8 *const data = SDL_LoadFile(path, &len);
+
+    if (data == nullptr) {
+        log_error("Could not read %s: %s", path, SDL_GetError());
+        return nullptr;
+    }
+
+    RomFile *const self = RomFile_copy(data, len);
+    SDL_free(data);
+    return self;
+#else
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        log_error("Could not open %s: %s", path, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        log_error("Could not read %s: not a non-empty file", path);
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t len = st.st_size;
+    RomFile *const loaded =
+        RomFile_find(true, st.st_dev, st.st_ino, nullptr, len);
+
+    if (loaded != nullptr) {
+        close(fd);
+        return loaded;
+    }
+
+    void *const data = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED) {
+        log_error("Could not map %s: %s", path, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+#ifdef GEMU_FLAT_MEMORY
+    // Kept open to map the banks into flat memory
+    RomFile *const self =
+        RomFile_add(data, len, true, st.st_dev, st.st_ino, fd);
+#else
+    // The mapping keeps the file open
+    close(fd);
+    RomFile *const self =
+        RomFile_add(data, len, true, st.st_dev, st.st_ino, -1);
+#endif
+
+    if (self->data != data) {
+#ifdef GEMU_FLAT_MEMORY
+        close(fd);
+#endif
+        munmap(data, len);
+    }
+
+    return self;
+#endif
+}
+
+RomFile *RomFile_copy(const u8 *const data, const size_t len)
+{
+    const u64 hash = hash_contents(data, len);
+    RomFile *const loaded = RomFile_find(false, hash, 0, data, len);
+
+    if (loaded != nullptr)
+        return loaded;
+
+    u8 *const copy = malloc(len);
+    BAIL_IF_NULL(copy);
+    memcpy(copy, data, len);
+
+    RomFile *const self = RomFile_add(copy, len, false, hash, 0, -1);
+
+    if (self->data != copy)
+        free(copy);
+
+    return self;
+}
+
+RomFile *RomFile_ref(RomFile *const self)
+{
+    SDL_AddAtomicInt(&self->refs, 1);
+    return self;
+}
+
+#ifdef GEMU_FLAT_MEMORY
+int RomFile_fd(RomFile *const self)
+{
+    SDL_LockSpinlock(&loaded_roms_lock);
+    const int loaded_fd = self->fd;
+    SDL_UnlockSpinlock(&loaded_roms_lock);
+
+    if (loaded_fd >= 0)
+        return loaded_fd;
+
+    // Copies are only put in a file once they need to be mapped
+    const int fd = memfd_create("gemu-rom", MFD_CLOEXEC);
+    BAIL_IF(fd < 0, "Could not create ROM file: %s", strerror(errno));
+
+    for (size_t done = 0; done < self->len;) {
+        const ssize_t written = write(fd, &self->data[done], self->len - done);
+        BAIL_IF(written < 0, "Could not write ROM file: %s", strerror(errno));
+        done += written;
+    }
+
+    // Another thread may have got there first
+    SDL_LockSpinlock(&loaded_roms_lock);
+    if (self->fd < 0)
+        self->fd = fd;
+    const int shared_fd = self->fd;
+    SDL_UnlockSpinlock(&loaded_roms_lock);
+
+    if (shared_fd != fd)
+        close(fd);
+
+    return shared_fd;
+}
+#endif
+
+const u8 *RomFile_data(const RomFile *const self)
+{
+    return self->data;
+}
+
+size_t RomFile_len(const RomFile *const self)
+{
+    return self->len;
+}
+
+void RomFile_destroy(RomFile *const self)
+{
+    if (self == nullptr)
+        return;
+
+    SDL_LockSpinlock(&loaded_roms_lock);
+
+    if (SDL_AddAtomicInt(&self->refs, -1) > 1) {
+        SDL_UnlockSpinlock(&loaded_roms_lock);
+        return;
+    }
+
+    for (RomFile **link = &loaded_roms; *link != nullptr;
+         link = &(*link)->next) {
+        if (*link == self) {
+            *link = self->next;
+            break;
+        }
+    }
+
+    SDL_UnlockSpinlock(&loaded_roms_lock);
+
+#ifdef GEMU_FLAT_MEMORY
+    if (self->fd >= 0)
+        close(self->fd);
+#endif
+
+#ifdef _WIN32
+    free((void *)self->data);
+#else
+    if (self->mapped)
+        munmap((void *)self->data, self->len);
+    else
+        free((void *)self->data);
+#endif
+
+    free(self);
+}
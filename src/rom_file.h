@@ -0,0 +1,107 @@
+#ifndef GEMU_ROM_FILE_H
+#define GEMU_ROM_FILE_H
+
+#include "stdinc.h"
+#include <stddef.h>
+
+// Read-only ROM data, either mapped straight from the cartridge file or copied
+// from memory.
+//
+// ROMs are reference counted and shared: opening the same file or copying the
+// same data while it is still loaded returns another reference to the same
+// RomFile instead of a new one, so any number of GameBoy instances running
+// the same game only keep it in memory once. ROMs may be opened, referenced
+// and destroyed from any thread.
+typedef struct RomFile RomFile;
+
+/**
+ * \brief Maps the ROM file at the given path into memory.
+ *
+ * The file is mapped read-only where the host supports it, so only the banks
+ * that are accessed are ever paged in, and processes running the same ROM
+ * share its pages. Elsewhere, it is read into memory instead.
+ *
+ * If the same file is already loaded, it is shared instead.
+ *
+ * \param path the path of the ROM file.
+ *
+ * \return a reference to the mapped ROM, which must be dropped via
+ * RomFile_destroy, or NULL if the file could not be read. The reason is
+ * logged.
+ *
+ * \sa RomFile_destroy
+ */
+[[nodiscard]] RomFile *RomFile_open(const char *path);
+
+/**
+ * \brief Copies the given ROM data.
+ *
+ * If a copy of the same data is already loaded, it is shared instead.
+ *
+ * \param data the ROM data to copy.
+ * \param len the length of data.
+ *
+ * \return a reference to the copied ROM, which must be dropped via
+ * RomFile_destroy.
+ *
+ * \sa RomFile_destroy
+ */
+[[nodiscard]] RomFile *RomFile_copy(const u8 *data, size_t len);
+
+/**
+ * \brief Takes another reference to a ROM.
+ *
+ * \param self the ROM to reference.
+ *
+ * \return self, which must be dropped via RomFile_destroy once more.
+ *
+ * \sa RomFile_destroy
+ */
+RomFile *RomFile_ref(RomFile *self);
+
+#ifdef GEMU_FLAT_MEMORY
+/**
+ * \brief Gets a file holding the data of a ROM, for mapping it elsewhere.
+ *
+ * This is the file a ROM was mapped from, while copies are written to a memfd
+ * the first time this is called for them.
+ *
+ * \param self the ROM to get the file of.
+ *
+ * \return a file descriptor that stays open until the ROM is destroyed. Its
+ * contents start with RomFile_data.
+ */
+[[nodiscard]] int RomFile_fd(RomFile *self);
+#endif
+
+/**
+ * \brief Gets the data of a ROM.
+ *
+ * \param self the ROM to get the data of.
+ *
+ * \return the RomFile_len bytes of the ROM, valid until it is destroyed.
+ */
+[[nodiscard]] const u8 *RomFile_data(const RomFile *self);
+
+/**
+ * \brief Gets the length of a ROM.
+ *
+ * \param self the ROM to get the length of.
+ *
+ * \return the length of the ROM in bytes.
+ */
+[[nodiscard]] size_t RomFile_len(const RomFile *self);
+
+/**
+ * \brief Drops a reference to a ROM, which is unmapped or freed along with
+ * the last one.
+ *
+ * \param self the ROM to drop a reference to, or NULL.
+ *
+ * \sa RomFile_open
+ * \sa RomFile_copy
+ * \sa RomFile_ref
+ */
+void RomFile_destroy(RomFile *self);
+
+#endif
@@ -0,0 +1,183 @@
+#include "save_file.h"
+#include "log.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <SDL3/SDL.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct SaveFile {
+    u8 *data;
+    size_t len;
+    size_t loaded_len;
+#ifdef _WIN32
+    // Without a mapping, the whole file is written back on destruction
+    char *path;
+    size_t file_len;
+#endif
+#ifdef GEMU_FLAT_MEMORY
+    int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+SaveFile *SaveFile_open(const char *const path, const size_t len)
+{
+    size_t file_len = 0;
+    u8 *const contents = SDL_LoadFile(path, &file_len);
+
+    if (contents == nullptr)
+        file_len = 0;
+
+    const size_t loaded_len = file_len < len ? file_len : len;
+
+    if (file_len < len)
+        file_len = len;
+
+    SaveFile *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    u8 *const data = calloc(file_len, 1);
+    BAIL_IF_NULL(data);
+
+    if (contents != nullptr) {
+        memcpy(data, contents, loaded_len);
+        SDL_free(contents);
+    }
+
+    char *const path_copy = SDL_strdup(path);
+    BAIL_IF_NULL(path_copy);
+
+    *self = (SaveFile){
+        .data = data,
+        .len = len,
+        .loaded_len = loaded_len,
+        .path = path_copy,
+        .file_len = file_len,
+    };
+    return self;
+}
+
+void SaveFile_flush([[maybe_unused]] SaveFile *const self)
+{
+}
+
+void SaveFile_destroy(SaveFile *const self)
+{
+    if (self == nullptr)
+        return;
+
+    if (!SDL_SaveFile(self->path, self->data, self->file_len))
+        log_error("Could not write %s: %s", self->path, SDL_GetError());
+
+    SDL_free(self->path);
+    free(self->data);
+    free(self);
+}
+
+#else
+
+SaveFile *SaveFile_open(const char *const path, const size_t len)
+{
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        log_error("Could not open %s: %s", path, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        log_error("Could not open %s: not a file", path);
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t file_len = st.st_size;
+
+    if (file_len < len && ftruncate(fd, len) != 0) {
+        log_error("Could not extend %s: %s", path, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    void *const data =
+        mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (data == MAP_FAILED) {
+        log_error("Could not map %s: %s", path, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+#ifndef GEMU_FLAT_MEMORY
+    // The mapping keeps the file open
+    close(fd);
+#endif
+
+    SaveFile *const self = malloc(sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    *self = (SaveFile){
+        .data = data,
+        .len = len,
+        .loaded_len = file_len < len ? file_len : len,
+#ifdef GEMU_FLAT_MEMORY
+        // Kept open to map the RAM banks into flat memory
+        .fd = fd,
+#endif
+    };
+    return self;
+}
+
+void SaveFile_flush(SaveFile *const self)
+{
+    // The kernel keeps track of which pages are dirty, so this only schedules
+    // writing those
+    if (msync(self->data, self->len, MS_ASYNC) != 0)
+        log_error("Could not flush save file: %s", strerror(errno));
+}
+
+void SaveFile_destroy(SaveFile *const self)
+{
+    if (self == nullptr)
+        return;
+
+    SaveFile_flush(self);
+    munmap(self->data, self->len);
+#ifdef GEMU_FLAT_MEMORY
+    close(self->fd);
+#endif
+    free(self);
+}
+
+#ifdef GEMU_FLAT_MEMORY
+int SaveFile_fd(const SaveFile *const self)
+{
+    return self->fd;
+}
+#endif
+
+#endif
+
+u8 *SaveFile_data(const SaveFile *const self)
+{
+    return self->data;
+}
+
+size_t SaveFile_loaded_len(const SaveFile *const self)
+{
+    return self->loaded_len;
+}
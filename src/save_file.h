@@ -0,0 +1,86 @@
+#ifndef GEMU_SAVE_FILE_H
+#define GEMU_SAVE_FILE_H
+
+#include "stdinc.h"
+#include <stddef.h>
+
+// Battery-backed cartridge memory kept in a file, such as a .sav next to the
+// ROM
+typedef struct SaveFile SaveFile;
+
+/**
+ * \brief Opens the save file at the given path, creating it if needed.
+ *
+ * The file is mapped into memory where the host supports it, so writes to
+ * SaveFile_data end up in the file without any further calls, even if the
+ * emulator crashes. Elsewhere, it is read into memory and only written back
+ * when the save file is destroyed.
+ *
+ * A shorter file is extended with zeroes up to len, while anything past len
+ * is left alone.
+ *
+ * \param path the path of the save file.
+ * \param len how many bytes of the file to access.
+ *
+ * \return the opened save file, which must be destroyed via SaveFile_destroy,
+ * or NULL if it could not be opened. The reason is logged.
+ *
+ * \sa SaveFile_destroy
+ */
+[[nodiscard]] SaveFile *SaveFile_open(const char *path, size_t len);
+
+/**
+ * \brief Gets the memory of a save file.
+ *
+ * \param self the save file to get the memory of.
+ *
+ * \return the len bytes passed to SaveFile_open, valid until the save file is
+ * destroyed.
+ */
+[[nodiscard]] u8 *SaveFile_data(const SaveFile *self);
+
+/**
+ * \brief Gets how many bytes of a save file were already there when it was
+ * opened.
+ *
+ * \param self the save file to query.
+ *
+ * \return the number of bytes at the start of SaveFile_data that came from
+ * the file rather than being zero-filled, at most the len passed to
+ * SaveFile_open.
+ */
+[[nodiscard]] size_t SaveFile_loaded_len(const SaveFile *self);
+
+#ifdef GEMU_FLAT_MEMORY
+/**
+ * \brief Gets the file a save file is mapped from, for mapping it elsewhere.
+ *
+ * \param self the save file to query.
+ *
+ * \return a file descriptor that stays open until the save file is destroyed.
+ * Its contents start with SaveFile_data.
+ */
+[[nodiscard]] int SaveFile_fd(const SaveFile *self);
+#endif
+
+/**
+ * \brief Starts writing the changed parts of a save file back, without
+ * waiting for it.
+ *
+ * Only the pages that were written to since the last flush are written back.
+ * This is cheap enough to call once per frame.
+ *
+ * \param self the save file to flush.
+ */
+void SaveFile_flush(SaveFile *self);
+
+/**
+ * \brief Flushes and closes a save file.
+ *
+ * \param self the save file to destroy, or NULL.
+ *
+ * \sa SaveFile_open
+ */
+void SaveFile_destroy(SaveFile *self);
+
+#endif
@@ -0,0 +1,175 @@
+#include "watchpoints.h"
+#include "macros.h"
+#include "stdinc.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+constexpr size_t WATCH_PAGE_COUNT = 0x10000 / WATCH_PAGE_LEN;
+
+typedef struct {
+    u16 first;
+    u16 last;
+    WatchKind kinds; // 0 once removed, so that the slot can be reused
+} Watchpoint;
+
+struct Watchpoints {
+    Watchpoint *entries; // Indexed by id
+    size_t entry_count;
+    WatchKind kinds;                   // See Watchpoints_kinds
+    WatchKind pages[WATCH_PAGE_COUNT]; // See Watchpoints_page
+    WatchCallback callback;
+    void *data;
+    bool stopped;
+    WatchHit hit; // The one that stopped
+    // Whether the execute hit that stopped is to be skipped once resumed
+    bool skip_execute;
+};
+
+Watchpoints *Watchpoints_new(void)
+{
+    Watchpoints *const self = calloc(1, sizeof(*self));
+    BAIL_IF_NULL(self);
+
+    return self;
+}
+
+void Watchpoints_destroy(Watchpoints *const self)
+{
+    if (self == nullptr)
+        return;
+
+    free(self->entries);
+    free(self);
+}
+
+// Works out kinds and pages again from the watchpoints left
+static void Watchpoints_update_pages(Watchpoints *const self)
+{
+    self->kinds = 0;
+    memset(self->pages, 0, sizeof(self->pages));
+
+    for (size_t id = 0; id < self->entry_count; ++id) {
+        const Watchpoint *const entry = &self->entries[id];
+        self->kinds |= entry->kinds;
+
+        for (size_t page = entry->first / WATCH_PAGE_LEN;
+             page <= entry->last / WATCH_PAGE_LEN; ++page)
+            self->pages[page] |= entry->kinds;
+    }
+}
+
+size_t Watchpoints_add(Watchpoints *const self, const u16 first,
+                       const u16 last, const WatchKind kinds)
+{
+    BAIL_IF(first > last || kinds == 0,
+            "Invalid watchpoint (first = $%04X, last = $%04X, kinds = %d)",
+            first, last, kinds);
+
+    size_t id = 0;
+
+    while (id < self->entry_count && self->entries[id].kinds != 0)
+        ++id;
+
+    if (id == self->entry_count) {
+        Watchpoint *const entries =
+            realloc(self->entries,
+                    (self->entry_count + 1) * sizeof(*self->entries));
+        BAIL_IF_NULL(entries);
+
+        self->entries = entries;
+        ++self->entry_count;
+    }
+
+    self->entries[id] = (Watchpoint){
+        .first = first,
+        .last = last,
+        .kinds = kinds,
+    };
+
+    Watchpoints_update_pages(self);
+    return id;
+}
+
+bool Watchpoints_remove(Watchpoints *const self, const size_t id)
+{
+    if (id >= self->entry_count || self->entries[id].kinds == 0)
+        return false;
+
+    self->entries[id].kinds = 0;
+    Watchpoints_update_pages(self);
+    return true;
+}
+
+void Watchpoints_set_callback(Watchpoints *const self,
+                              const WatchCallback callback, void *const data)
+{
+    self->callback = callback;
+    self->data = data;
+}
+
+WatchKind Watchpoints_kinds(const Watchpoints *const self)
+{
+    return self->kinds;
+}
+
+WatchKind Watchpoints_page(const Watchpoints *const self, const u16 addr)
+{
+    return self->pages[addr / WATCH_PAGE_LEN];
+}
+
+bool Watchpoints_check(Watchpoints *const self, const WatchKind kind,
+                       const u16 addr, const u8 value)
+{
+    if ((self->pages[addr / WATCH_PAGE_LEN] & kind) == 0)
+        return false;
+
+    // The instruction that stopped runs once without stopping again
+    if (kind == WatchKind_Execute && self->skip_execute) {
+        self->skip_execute = false;
+
+        if (addr == self->hit.addr)
+            return false;
+    }
+
+    for (size_t id = 0; id < self->entry_count; ++id) {
+        const Watchpoint *const entry = &self->entries[id];
+
+        if ((entry->kinds & kind) == 0 || addr < entry->first ||
+            addr > entry->last)
+            continue;
+
+        const WatchHit hit = {
+            .kind = kind,
+            .addr = addr,
+            .value = value,
+            .id = id,
+        };
+
+        const bool stop = self->callback == nullptr ||
+                          self->callback(self->data, &hit);
+
+        if (stop && !self->stopped) {
+            self->stopped = true;
+            self->hit = hit;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+const WatchHit *Watchpoints_stopped(const Watchpoints *const self)
+{
+    return self->stopped ? &self->hit : nullptr;
+}
+
+void Watchpoints_resume(Watchpoints *const self)
+{
+    if (!self->stopped)
+        return;
+
+    self->stopped = false;
+    self->skip_execute = self->hit.kind == WatchKind_Execute;
+}
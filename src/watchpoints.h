@@ -0,0 +1,146 @@
+#ifndef GEMU_WATCHPOINTS_H
+#define GEMU_WATCHPOINTS_H
+
+// Watchpoints on ranges of the address space of a GameBoy.
+//
+// The GameBoy leaves every page holding a watched address out of its page
+// tables, so that only accesses to those pages take the unpaged paths, which
+// check them against the watchpoints (see GameBoy_add_watchpoint). Accesses to
+// any other page cost nothing extra.
+
+#include "stdinc.h"
+#include <stddef.h>
+
+// Granularity of watched pages, the same as that of the GameBoy page tables
+constexpr size_t WATCH_PAGE_LEN = 0x100;
+
+typedef enum : u8 {
+    WatchKind_Read = 1 << 0,
+    WatchKind_Write = 1 << 1,
+    WatchKind_Execute = 1 << 2, // Of the instruction starting at the address
+} WatchKind;
+
+typedef struct {
+    WatchKind kind; // The one access that hit
+    u16 addr;
+    u8 value; // Read or written, or the opcode about to be executed
+    size_t id; // Of the watchpoint hit
+} WatchHit;
+
+/**
+ * Called with each access that hits a watchpoint, which returns whether to
+ * stop emulation.
+ */
+typedef bool (*WatchCallback)(void *data, const WatchHit *hit);
+
+typedef struct Watchpoints Watchpoints;
+
+/**
+ * \brief Creates an empty set of watchpoints, which stops on every hit.
+ *
+ * \return the created watchpoints, which must be destroyed via
+ * Watchpoints_destroy.
+ *
+ * \sa Watchpoints_destroy
+ */
+[[nodiscard]] Watchpoints *Watchpoints_new(void);
+
+/**
+ * \brief Destroys a set of watchpoints.
+ *
+ * \param self the watchpoints to destroy, or NULL.
+ *
+ * \sa Watchpoints_new
+ */
+void Watchpoints_destroy(Watchpoints *self);
+
+/**
+ * \brief Watches a range of addresses.
+ *
+ * \param self the watchpoints to add to.
+ * \param first the first address to watch.
+ * \param last the last address to watch, at least first.
+ * \param kinds the accesses to watch, at least one.
+ *
+ * \return the id of the watchpoint, for Watchpoints_remove.
+ */
+size_t Watchpoints_add(Watchpoints *self, u16 first, u16 last,
+                       WatchKind kinds);
+
+/**
+ * \brief Stops watching what a watchpoint watched. Its id may be given to
+ * another watchpoint afterwards.
+ *
+ * \param self the watchpoints to remove from.
+ * \param id the id of the watchpoint, as returned by Watchpoints_add.
+ *
+ * \return whether there was such a watchpoint.
+ */
+bool Watchpoints_remove(Watchpoints *self, size_t id);
+
+/**
+ * \brief Sets what to call on each hit.
+ *
+ * \param self the watchpoints to set the callback of.
+ * \param callback the callback, or NULL to stop on every hit.
+ * \param data passed to callback as is.
+ */
+void Watchpoints_set_callback(Watchpoints *self, WatchCallback callback,
+                              void *data);
+
+/**
+ * \brief Gets the kinds of accesses watched anywhere.
+ *
+ * \param self the watchpoints to query.
+ *
+ * \return the kinds watched by any watchpoint.
+ */
+[[nodiscard]] WatchKind Watchpoints_kinds(const Watchpoints *self);
+
+/**
+ * \brief Gets the kinds of accesses watched within a page.
+ *
+ * \param self the watchpoints to query.
+ * \param addr any address in the page.
+ *
+ * \return the kinds watched by any watchpoint on the WATCH_PAGE_LEN bytes of
+ * the page holding addr.
+ */
+[[nodiscard]] WatchKind Watchpoints_page(const Watchpoints *self, u16 addr);
+
+/**
+ * \brief Checks an access against the watchpoints, calling the callback and
+ * stopping if it hits one.
+ *
+ * Once stopped, further hits are still reported to the callback, but the one
+ * that stopped is kept.
+ *
+ * \param self the watchpoints to check against.
+ * \param kind the access, a single kind.
+ * \param addr the address accessed.
+ * \param value the value read or written, or the opcode about to be executed.
+ *
+ * \return whether the access hit a watchpoint.
+ */
+bool Watchpoints_check(Watchpoints *self, WatchKind kind, u16 addr, u8 value);
+
+/**
+ * \brief Gets the hit that stopped emulation.
+ *
+ * \param self the watchpoints to query.
+ *
+ * \return the hit, or NULL if not stopped.
+ */
+[[nodiscard]] const WatchHit *Watchpoints_stopped(const Watchpoints *self);
+
+/**
+ * \brief Goes on after a stop.
+ *
+ * If an execute watchpoint stopped emulation before its instruction ran, that
+ * instruction does not hit it again when it runs next.
+ *
+ * \param self the watchpoints to resume.
+ */
+void Watchpoints_resume(Watchpoints *self);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef GEMU_TESTS_DUMB_RAM_H
+#define GEMU_TESTS_DUMB_RAM_H
+
+// Flat 64 KiB memory for the CPU tests, which fails the running test on any
+// access to an address that was not marked active.
+//
+// The CPU tests run on a CPU core compiled against it (see tests/CMakeLists.txt
+// and src/cpu_bus.h), so Memory.ctx must always be a DumbRam there. Use
+// DumbRam_memory to also work with GEMU_DYNAMIC_BUS.
+
+#include "cpu.h"
+#include "stdinc.h"
+#include <unity.h>
+
+typedef struct {
+    bool active[0x10000];
+    u8 data[0x10000];
+} DumbRam;
+
+static inline u8 DumbRam_read(const void *const ctx, const u16 addr)
+{
+    const DumbRam *const ram = ctx;
+    TEST_ASSERT_TRUE_MESSAGE(ram->active[addr],
+                             "tried to read from inactive memory");
+    return ram->data[addr];
+}
+
+static inline void DumbRam_write(void *const ctx, const u16 addr,
+                                 const u8 value)
+{
+    DumbRam *const ram = ctx;
+    TEST_ASSERT_TRUE_MESSAGE(ram->active[addr],
+                             "tried to write into inactive memory");
+    ram->data[addr] = value;
+}
+
+static inline Memory DumbRam_memory(DumbRam *const ram)
+{
+    return (Memory){
+        .ctx = ram,
+        .read = DumbRam_read,
+        .write = DumbRam_write,
+    };
+}
+
+#ifndef GEMU_DYNAMIC_BUS
+static inline u8 Bus_read(const Memory *const mem, const u16 addr)
+{
+    return DumbRam_read(mem->ctx, addr);
+}
+
+static inline void Bus_write(Memory *const mem, const u16 addr, const u8 value)
+{
+    DumbRam_write(mem->ctx, addr, value);
+}
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Writes the ROM that test_aot compiles ahead of time and runs (see
+# tests/CMakeLists.txt): 4 banks of MBC1 ROM, whose code in bank 1 switches to
+# bank 2 through (hl) in the middle of what would otherwise be a single block.
+#
+# Usage: make_aot_rom.rb <output-file>
+
+BANK_LEN = 0x4000
+
+abort "usage: #{$PROGRAM_NAME} <output-file>" if ARGV.length != 1
+
+rom = ("\x00".b * (4 * BANK_LEN))
+
+def place(rom, offset, bytes)
+  rom[offset, bytes.length] = bytes.pack('C*')
+end
+
+place(rom, 0x0147, [0x01, 0x01]) # MBC1, 64 KiB
+place(rom, 0x0100, [0xC3, 0x50, 0x01]) # jp $0150
+place(rom, 0x0150, [0xC3, 0x00, 0x40]) # jp $4000
+
+# Bank 1
+place(rom, BANK_LEN + 0x0000, [0x21, 0x00, 0x20]) # ld hl, $2000
+place(rom, BANK_LEN + 0x0003, [0x3E, 0x02]) # ld a, 2
+place(rom, BANK_LEN + 0x0005, [0x77]) # ld (hl), a
+place(rom, BANK_LEN + 0x0006, [0x06, 0x11]) # ld b, $11
+place(rom, BANK_LEN + 0x0008, [0x18, 0xFE]) # jr @
+
+# Bank 2, which the code above runs into
+place(rom, (2 * BANK_LEN) + 0x0006, [0x06, 0x22]) # ld b, $22
+place(rom, (2 * BANK_LEN) + 0x0008, [0x18, 0xFE]) # jr @
+
+# Header checksum, which gemu checks when there is no boot ROM
+place(rom, 0x014D, [(0x0134..0x014C).reduce(0) { |sum, offset| (sum - rom.getbyte(offset) - 1) & 0xFF }])
+
+File.binwrite(ARGV[0], rom)
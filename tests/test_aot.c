@@ -0,0 +1,113 @@
+#include "aot.h"
+#include "cpu.h"
+#include "game_boy.h"
+#include "stdinc.h"
+#include <stdio.h>
+#include <unity.h>
+
+// Written by make_aot_rom.rb, which AOT_IMAGE is compiled from (see
+// tests/CMakeLists.txt)
+static const char *const ROM_PATH = "data/aot_test.gb";
+
+static u8 rom[0x10000];
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void run_nothing([[maybe_unused]] Cpu *const cpu,
+                        [[maybe_unused]] Memory *const mem)
+{
+}
+
+static const AotBlock BLOCKS[] = {
+    {.bank = 0, .pc = 0x0000, .op_count = 1, .run = run_nothing},
+    {.bank = 0, .pc = 0x0150, .op_count = 2, .run = run_nothing},
+    {.bank = 1, .pc = 0x4000, .op_count = 3, .run = run_nothing},
+    {.bank = 2, .pc = 0x4000, .op_count = 4, .run = run_nothing},
+};
+
+void test_aot_finds_blocks_by_bank_and_pc(void)
+{
+    const AotImage image = {
+        .rom_len = 0x8000,
+        .rom_hash = 0,
+        .block_count = sizeof(BLOCKS) / sizeof(BLOCKS[0]),
+        .blocks = BLOCKS,
+    };
+
+    for (size_t i = 0; i < image.block_count; ++i) {
+        TEST_ASSERT_EQUAL_PTR(
+            &BLOCKS[i], AotImage_find(&image, BLOCKS[i].bank, BLOCKS[i].pc));
+    }
+
+    TEST_ASSERT_NULL(AotImage_find(&image, 0, 0x0151));
+    TEST_ASSERT_NULL(AotImage_find(&image, 3, 0x4000));
+    TEST_ASSERT_NULL(AotImage_find(&image, 1, 0x0150));
+}
+
+void test_aot_matches_only_the_compiled_rom(void)
+{
+    static u8 rom[0x8000] = {};
+    rom[0x0150] = 0x18;
+
+    const AotImage image = {
+        .rom_len = sizeof(rom),
+        .rom_hash = AotImage_hash(rom, sizeof(rom)),
+        .block_count = 0,
+        .blocks = nullptr,
+    };
+
+    TEST_ASSERT_TRUE(AotImage_matches(&image, rom, sizeof(rom)));
+    TEST_ASSERT_FALSE(AotImage_matches(&image, rom, sizeof(rom) - 1));
+
+    rom[0x0151] = 0xFE;
+    TEST_ASSERT_FALSE(AotImage_matches(&image, rom, sizeof(rom)));
+}
+
+// Runs the test ROM until it settles in its final loop
+static void run_rom(GameBoy *const gb, const bool aot)
+{
+    FILE *const file = fopen(ROM_PATH, "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_size_t(sizeof(rom), fread(rom, 1, sizeof(rom), file));
+    fclose(file);
+
+    *gb = GameBoy_new(nullptr);
+    GameBoy_load_rom(gb, rom, sizeof(rom));
+
+    if (aot)
+        TEST_ASSERT_TRUE(GameBoy_set_aot_image(gb, &AOT_IMAGE));
+
+    Memory mem = {
+        .ctx = gb,
+        .read = GameBoy_read_mem,
+        .write = GameBoy_write_mem,
+    };
+
+    for (size_t i = 0; i < 32; ++i)
+        GameBoy_step(gb, &mem);
+}
+
+void test_aot_image_runs_like_the_interpreter(void)
+{
+    static GameBoy interpreted;
+    static GameBoy compiled;
+
+    run_rom(&interpreted, false);
+    run_rom(&compiled, true);
+
+    // The bank switch through (hl) ends the block, so the code after it runs
+    // from bank 2 rather than from the compiled bank 1
+    const AotBlock *const block = AotImage_find(&AOT_IMAGE, 1, 0x4000);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL_UINT8(3, block->op_count);
+
+    TEST_ASSERT_EQUAL_HEX8(0x22, compiled.cpu.b);
+    TEST_ASSERT_EQUAL_HEX8(interpreted.cpu.b, compiled.cpu.b);
+    TEST_ASSERT_EQUAL_HEX16(interpreted.cpu.pc, compiled.cpu.pc);
+    TEST_ASSERT_EQUAL_HEX8(interpreted.cpu.a, compiled.cpu.a);
+
+    GameBoy_destroy(&interpreted);
+    GameBoy_destroy(&compiled);
+}
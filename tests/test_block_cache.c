@@ -0,0 +1,184 @@
+#include "block_cache.h"
+#include "stdinc.h"
+#include <unity.h>
+
+static BlockCache *cache;
+
+void setUp(void)
+{
+    cache = BlockCache_new();
+}
+
+void tearDown(void)
+{
+    BlockCache_destroy(cache);
+}
+
+void test_block_cache_decodes_until_jump(void)
+{
+    static const u8 code[] = {
+        0x3E, 0x12,       // ld a, $12
+        0xCB, 0x37,       // swap a
+        0x21, 0x00, 0xC0, // ld hl, $C000
+        0x18, 0xF7,       // jr -9
+        0x00,             // nop
+    };
+
+    const BlockOp *op = BlockCache_lookup(cache, 1, 0x4000, code, sizeof(code));
+    TEST_ASSERT_NOT_NULL(op);
+    TEST_ASSERT_EQUAL_PTR(&code[0], op->code);
+
+    // Jumping into the middle of the block starts a new one
+    TEST_ASSERT_NULL(BlockCache_next(cache, 0x4003));
+
+    op = BlockCache_lookup(cache, 1, 0x4000, code, sizeof(code));
+    const u16 expected_pcs[] = {0x4002, 0x4004, 0x4007};
+
+    for (size_t i = 0; i < 3; ++i) {
+        op = BlockCache_next(cache, expected_pcs[i]);
+        TEST_ASSERT_NOT_NULL(op);
+        TEST_ASSERT_EQUAL_PTR(&code[expected_pcs[i] - 0x4000], op->code);
+    }
+
+    // The block ends at the jr
+    TEST_ASSERT_NULL(BlockCache_next(cache, 0x4009));
+}
+
+void test_block_cache_stops_at_end_of_code(void)
+{
+    static const u8 code[] = {0x00, 0x01, 0x34}; // nop; ld bc, $??34
+
+    TEST_ASSERT_NOT_NULL(BlockCache_lookup(cache, 0, 0x3FFD, code, 3));
+    TEST_ASSERT_NULL(BlockCache_next(cache, 0x3FFE));
+    TEST_ASSERT_NULL(BlockCache_lookup(cache, 0, 0x3FFE, &code[1], 2));
+}
+
+void test_block_cache_drops_overwritten_ram_blocks(void)
+{
+    u8 hram[] = {0x3E, 0x28, 0xC9}; // ld a, $28; ret
+
+    const BlockOp *op = BlockCache_lookup(cache, BLOCK_BANK_RAM, 0xFF80, hram,
+                                          sizeof(hram));
+    TEST_ASSERT_NOT_NULL(op);
+
+    // Writing next to the block keeps it
+    BlockCache_write_ram(cache, 0xFF83);
+    TEST_ASSERT_NOT_NULL(BlockCache_next(cache, 0xFF82));
+
+    const u32 generation = cache->ram_generation;
+    BlockCache_write_ram(cache, 0xFF81);
+    TEST_ASSERT_NOT_EQUAL(generation, cache->ram_generation);
+
+    hram[1] = 0x29;
+    hram[2] = 0x00;
+    op = BlockCache_lookup(cache, BLOCK_BANK_RAM, 0xFF80, hram, sizeof(hram));
+    TEST_ASSERT_NOT_NULL(op);
+    TEST_ASSERT_NOT_NULL(BlockCache_next(cache, 0xFF82));
+    TEST_ASSERT_NULL(BlockCache_next(cache, 0xFF83));
+}
+
+void test_block_cache_finds_idle_loops(void)
+{
+    static const u8 poll_ly[] = {
+        0xF0, 0x44, // ldh a, [$FF44]
+        0xFE, 0x90, // cp $90
+        0x20, 0xFA, // jr nz, -6
+    };
+
+    TEST_ASSERT_NOT_NULL(
+        BlockCache_lookup(cache, 0, 0x0200, poll_ly, sizeof(poll_ly)));
+    TEST_ASSERT_EQUAL_HEX8(BlockIdle_Loop | BlockIdle_ReadsLcd,
+                           cache->block->idle);
+
+    // Reads through a register may see anything
+    static const u8 poll_hl[] = {
+        0x7E,       // ld a, [hl]
+        0xA7,       // and a
+        0x28, 0xFC, // jr z, -4
+    };
+
+    TEST_ASSERT_NOT_NULL(
+        BlockCache_lookup(cache, 0, 0x0300, poll_hl, sizeof(poll_hl)));
+    TEST_ASSERT_EQUAL_HEX8(BlockIdle_Loop | BlockIdle_ReadsLcd |
+                               BlockIdle_ReadsDiv | BlockIdle_ReadsTima,
+                           cache->block->idle);
+
+    // Writing to memory is a side effect
+    static const u8 fill[] = {
+        0x22,       // ld [hl+], a
+        0x0D,       // dec c
+        0x20, 0xFC, // jr nz, -4
+    };
+
+    TEST_ASSERT_NOT_NULL(
+        BlockCache_lookup(cache, 0, 0x0400, fill, sizeof(fill)));
+    TEST_ASSERT_EQUAL_HEX8(0, cache->block->idle);
+
+    // Jumping somewhere else is not a loop
+    static const u8 poll_elsewhere[] = {
+        0xF0, 0x85, // ldh a, [$FF85]
+        0xA7,       // and a
+        0x28, 0xFA, // jr z, -6
+    };
+
+    TEST_ASSERT_NOT_NULL(BlockCache_lookup(cache, 0, 0x0500, poll_elsewhere,
+                                           sizeof(poll_elsewhere)));
+    TEST_ASSERT_EQUAL_HEX8(0, cache->block->idle);
+}
+
+void test_block_cache_finds_bulk_loops(void)
+{
+    static const u8 copy[] = {
+        0x2A,       // ld a, [hl+]
+        0x12,       // ld [de], a
+        0x13,       // inc de
+        0x0B,       // dec bc
+        0x78,       // ld a, b
+        0xB1,       // or c
+        0x20, 0xF8, // jr nz, -8
+    };
+
+    TEST_ASSERT_NOT_NULL(
+        BlockCache_lookup(cache, 0, 0x0200, copy, sizeof(copy)));
+    const BlockBulk *bulk = &cache->block->bulk;
+    TEST_ASSERT_EQUAL(BlockBulk_Copy, bulk->kind);
+    TEST_ASSERT_EQUAL(13, bulk->cycles);
+    TEST_ASSERT_TRUE(bulk->wide_counter);
+    TEST_ASSERT_EQUAL(CpuTableRp_BC, bulk->counter);
+    TEST_ASSERT_EQUAL(CpuTableRp_HL, bulk->src);
+    TEST_ASSERT_EQUAL(0, bulk->src_off);
+    TEST_ASSERT_EQUAL(CpuTableRp_DE, bulk->dst);
+    TEST_ASSERT_EQUAL(0, bulk->dst_off);
+    TEST_ASSERT_EQUAL(1, bulk->step[CpuTableRp_DE]);
+    TEST_ASSERT_EQUAL(1, bulk->step[CpuTableRp_HL]);
+
+    static const u8 fill[] = {
+        0x32,       // ld [hl-], a
+        0x0D,       // dec c
+        0x20, 0xFC, // jr nz, -4
+    };
+
+    TEST_ASSERT_NOT_NULL(
+        BlockCache_lookup(cache, 0, 0x0300, fill, sizeof(fill)));
+    bulk = &cache->block->bulk;
+    TEST_ASSERT_EQUAL(BlockBulk_Fill, bulk->kind);
+    TEST_ASSERT_EQUAL(6, bulk->cycles);
+    TEST_ASSERT_FALSE(bulk->wide_counter);
+    TEST_ASSERT_EQUAL(CpuTableR_C, bulk->counter);
+    TEST_ASSERT_EQUAL(CpuTableRp_HL, bulk->dst);
+    TEST_ASSERT_EQUAL(-1, bulk->step[CpuTableRp_HL]);
+    TEST_ASSERT_TRUE(bulk->fill_a);
+
+    // Testing a register the loop does not count down never ends the loop
+    static const u8 endless[] = {
+        0x22,       // ld [hl+], a
+        0x0B,       // dec bc
+        0x7A,       // ld a, d
+        0xB3,       // or e
+        0x20, 0xFA, // jr nz, -6
+    };
+
+    TEST_ASSERT_NOT_NULL(
+        BlockCache_lookup(cache, 0, 0x0400, endless, sizeof(endless)));
+    TEST_ASSERT_EQUAL(BlockBulk_None, cache->block->bulk.kind);
+}
@@ -0,0 +1,130 @@
+#include "cheats.h"
+#include "stdinc.h"
+#include <string.h>
+#include <unity.h>
+
+// 4 banks of ROM, each filled with its number
+static u8 rom[0x10000];
+static Cheats *cheats;
+
+void setUp(void)
+{
+    for (size_t i = 0; i < sizeof(rom); ++i)
+        rom[i] = i / 0x4000;
+
+    cheats = Cheats_new(rom, sizeof(rom));
+}
+
+void tearDown(void)
+{
+    Cheats_destroy(cheats);
+}
+
+void test_cheats_parses_game_genie_codes(void)
+{
+    Cheat cheat;
+
+    TEST_ASSERT_TRUE(Cheat_parse("3EA-05B-E6E", &cheat));
+    TEST_ASSERT_EQUAL_INT(CheatKind_RomPatch, cheat.kind);
+    TEST_ASSERT_EQUAL_HEX16(0x4A05, cheat.addr);
+    TEST_ASSERT_EQUAL_HEX8(0x3E, cheat.value);
+    TEST_ASSERT_TRUE(cheat.has_compare);
+    TEST_ASSERT_EQUAL_HEX8(0x01, cheat.compare);
+
+    TEST_ASSERT_TRUE(Cheat_parse("00a17b", &cheat));
+    TEST_ASSERT_EQUAL_INT(CheatKind_RomPatch, cheat.kind);
+    TEST_ASSERT_EQUAL_HEX16(0x4A17, cheat.addr);
+    TEST_ASSERT_EQUAL_HEX8(0x00, cheat.value);
+    TEST_ASSERT_FALSE(cheat.has_compare);
+}
+
+void test_cheats_parses_gameshark_codes(void)
+{
+    Cheat cheat;
+
+    TEST_ASSERT_TRUE(Cheat_parse("010138CD", &cheat));
+    TEST_ASSERT_EQUAL_INT(CheatKind_RamWrite, cheat.kind);
+    TEST_ASSERT_EQUAL_HEX16(0xCD38, cheat.addr);
+    TEST_ASSERT_EQUAL_HEX8(0x01, cheat.value);
+}
+
+void test_cheats_rejects_invalid_codes(void)
+{
+    static const char *const codes[] = {
+        "",            // Empty
+        "3EA-05B-E6",  // Wrong length
+        "3EA-05B-E6EE",
+        "3EG-05B-E6E", // Not hex
+        "3EA-057",     // Game Genie code for 8000-FFFF
+        "01013870",    // GameShark code for 0000-7FFF
+    };
+
+    for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); ++i) {
+        Cheat cheat;
+        TEST_ASSERT_FALSE_MESSAGE(Cheat_parse(codes[i], &cheat), codes[i]);
+    }
+}
+
+void test_cheats_overlays_banks_holding_compare_value(void)
+{
+    const Cheat cheat = {
+        .kind = CheatKind_RomPatch,
+        .addr = 0x4A05,
+        .value = 0x3E,
+        .has_compare = true,
+        .compare = 0x02,
+    };
+    Cheats_add(cheats, &cheat);
+
+    TEST_ASSERT_TRUE(Cheats_patches_rom(cheats));
+    TEST_ASSERT_NULL(Cheats_rom_page(cheats, 1, 0x4A05));
+    TEST_ASSERT_NULL(Cheats_rom_page(cheats, 2, 0x4B05));
+
+    const u8 *const page = Cheats_rom_page(cheats, 2, 0x4A05);
+    TEST_ASSERT_NOT_NULL(page);
+    TEST_ASSERT_EQUAL_HEX8(0x02, page[0x04]);
+    TEST_ASSERT_EQUAL_HEX8(0x3E, page[0x05]);
+    TEST_ASSERT_EQUAL_HEX8(0x02, page[0xFF]);
+
+    // The ROM itself is left alone
+    TEST_ASSERT_EQUAL_HEX8(0x02, rom[0x8A05]);
+
+    TEST_ASSERT_EQUAL_HEX16(0x4A00, Cheats_next_patched(cheats, 0x0000));
+    TEST_ASSERT_EQUAL_HEX16(0x4A00, Cheats_next_patched(cheats, 0x49FF));
+    TEST_ASSERT_EQUAL_HEX16(0x8000, Cheats_next_patched(cheats, 0x4A00));
+}
+
+void test_cheats_overlays_every_bank_without_compare_value(void)
+{
+    const Cheat first = {
+        .kind = CheatKind_RomPatch, .addr = 0x4A05, .value = 0x3E};
+    const Cheat second = {
+        .kind = CheatKind_RomPatch, .addr = 0x4A06, .value = 0x3F};
+    Cheats_add(cheats, &first);
+    Cheats_add(cheats, &second);
+
+    for (size_t bank = 0; bank < 4; ++bank) {
+        const u8 *const page = Cheats_rom_page(cheats, bank, 0x4A00);
+        TEST_ASSERT_NOT_NULL(page);
+        TEST_ASSERT_EQUAL_HEX8(0x3E, page[0x05]);
+        TEST_ASSERT_EQUAL_HEX8(0x3F, page[0x06]);
+    }
+}
+
+void test_cheats_keeps_ram_writes_in_order(void)
+{
+    const Cheat first = {
+        .kind = CheatKind_RamWrite, .addr = 0xC000, .value = 0x12};
+    const Cheat second = {
+        .kind = CheatKind_RamWrite, .addr = 0xC000, .value = 0x34};
+    Cheats_add(cheats, &first);
+    Cheats_add(cheats, &second);
+
+    size_t count;
+    const Cheat *const writes = Cheats_ram_writes(cheats, &count);
+
+    TEST_ASSERT_FALSE(Cheats_patches_rom(cheats));
+    TEST_ASSERT_EQUAL_size_t(2, count);
+    TEST_ASSERT_EQUAL_HEX8(0x12, writes[0].value);
+    TEST_ASSERT_EQUAL_HEX8(0x34, writes[1].value);
+}
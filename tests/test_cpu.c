@@ -1,4 +1,6 @@
 #include "cpu.h"
+#include "cpu_bus.h"
+#include "dumb_ram.h"
 #include <cjson/cJSON.h>
 #include <dirent.h>
 #include <stddef.h>
@@ -23,3 +25,60 @@ void test_cpu_new(void)
     TEST_ASSERT_EQUAL(cpu.ime, true);
     TEST_ASSERT_EQUAL(cpu.cycle_count, 0);
 }
+
+void test_cpu_flags_survive_partial_updates(void)
+{
+    static DumbRam ram = {};
+    Memory mem = DumbRam_memory(&ram);
+
+    ram.data[0x0000] = 0x80; // add a, b
+    ram.data[0x0001] = 0x3C; // inc a
+    ram.data[0x0002] = 0xF5; // push af
+
+    for (u16 addr = 0x0000; addr <= 0x0002; ++addr)
+        ram.active[addr] = true;
+    ram.active[0xFFFC] = true;
+    ram.active[0xFFFD] = true;
+
+    Cpu cpu = Cpu_new();
+    cpu.sp = 0xFFFE;
+    cpu.a = 0xFF;
+    cpu.b = 0x01;
+
+    for (int i = 0; i < 3; ++i)
+        Cpu_tick(&cpu, &mem);
+
+    // add sets Z, H and C. inc then recomputes Z and H, but must keep C.
+    TEST_ASSERT_EQUAL_HEX8(0x01, cpu.a);
+    TEST_ASSERT_EQUAL_HEX8(CpuFlag_C, Cpu_read_f(&cpu));
+    TEST_ASSERT_EQUAL_HEX8(CpuFlag_C, ram.data[0xFFFC]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, ram.data[0xFFFD]);
+}
+
+void test_cpu_register_pairs_alias_bytes(void)
+{
+    Cpu cpu = Cpu_new();
+
+    Cpu_write_rp(&cpu, CpuTableRp_BC, 0x1234);
+    Cpu_write_rp(&cpu, CpuTableRp_DE, 0x5678);
+    Cpu_write_rp(&cpu, CpuTableRp_HL, 0x9ABC);
+    Cpu_write_rp2(&cpu, CpuTableRp2_AF, 0xDEF0);
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, cpu.b);
+    TEST_ASSERT_EQUAL_HEX8(0x34, cpu.c);
+    TEST_ASSERT_EQUAL_HEX8(0x56, cpu.d);
+    TEST_ASSERT_EQUAL_HEX8(0x78, cpu.e);
+    TEST_ASSERT_EQUAL_HEX8(0x9A, cpu.h);
+    TEST_ASSERT_EQUAL_HEX8(0xBC, cpu.l);
+    TEST_ASSERT_EQUAL_HEX8(0xDE, cpu.a);
+    TEST_ASSERT_EQUAL_HEX8(0xF0, Cpu_read_f(&cpu));
+
+    cpu.h = 0xC0;
+    Cpu_write_r(&cpu, nullptr, CpuTableR_L, 0xDE);
+    Cpu_write_r(&cpu, nullptr, CpuTableR_A, 0x42);
+
+    TEST_ASSERT_EQUAL_HEX16(0xC0DE, Cpu_read_rp(&cpu, CpuTableRp_HL));
+    TEST_ASSERT_EQUAL_HEX8(0x42, Cpu_read_r(&cpu, nullptr, CpuTableR_A));
+    TEST_ASSERT_EQUAL_HEX8(0x12, Cpu_read_r(&cpu, nullptr, CpuTableR_B));
+    TEST_ASSERT_EQUAL_HEX16(0x42F0, Cpu_read_rp2(&cpu, CpuTableRp2_AF));
+}
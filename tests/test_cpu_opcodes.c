@@ -1,16 +1,17 @@
 #include "cpu.h"
+#include "dumb_ram.h"
 #include "stdinc.h"
+#ifdef GEMU_JIT
+#include "block_cache.h"
+#include "instructions.h"
+#include "jit.h"
+#endif
 #include <cjson/cJSON.h>
 #include <dirent.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unity.h>
 
-typedef struct {
-    bool active[0x10000];
-    u8 data[0x10000];
-} DumbRam;
-
 typedef struct {
     u16 address;
     u8 value;
@@ -32,22 +33,6 @@ typedef struct {
     int ram_len;
 } CpuState;
 
-static u8 read_mock_ram(const void *ctx, const u16 addr)
-{
-    const DumbRam *const ram = ctx;
-    TEST_ASSERT_TRUE_MESSAGE(ram->active[addr],
-                             "tried to read from inactive memory");
-    return ram->data[addr];
-}
-
-static void write_mock_ram(void *ctx, const u16 addr, const u8 value)
-{
-    DumbRam *const ram = ctx;
-    TEST_ASSERT_TRUE_MESSAGE(ram->active[addr],
-                             "tried to write into inactive memory");
-    ram->data[addr] = value;
-}
-
 static CpuState CpuState_from_cjson(const cJSON *const src)
 {
     const cJSON *const pc = cJSON_GetObjectItemCaseSensitive(src, "pc");
@@ -103,19 +88,50 @@ static void CpuState_destroy(CpuState *const state)
     state->ram_len = 0;
 }
 
+#ifdef GEMU_JIT
+static BlockCache *block_cache = nullptr;
+static Jit *jit = nullptr;
+
+// Runs the instruction at pc as a single-op native block. Returns false when
+// the instruction wraps around the address space, which blocks never do.
+static bool run_native(Cpu *const cpu, Memory *const mem,
+                       const DumbRam *const ram)
+{
+    const u16 pc = cpu->pc;
+    const u8 len = Cpu_opcode_length(ram->data[pc]);
+    if (pc + len > 0x10000)
+        return false;
+
+    BlockCache_clear(block_cache);
+    const BlockOp *const op =
+        BlockCache_lookup(block_cache, 0, pc, &ram->data[pc], len);
+    TEST_ASSERT_NOT_NULL(op);
+
+    size_t op_count = 1;
+    u8 cycles_bound;
+    CpuOpHandler native = Jit_compile(jit, pc, op, &op_count, &cycles_bound);
+    if (native == nullptr) {
+        Jit_reset(jit);
+        native = Jit_compile(jit, pc, op, &op_count, &cycles_bound);
+    }
+    TEST_ASSERT_NOT_NULL(native);
+
+    native(cpu, mem);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(cycles_bound, cpu->cycle_count);
+    return true;
+}
+#endif
+
 static void run_cpu_tick_test(const CpuState *const initial_state,
                               const CpuState *const final_state,
-                              const char *const test_name)
+                              const char *const test_name,
+                              [[maybe_unused]] const bool native)
 {
     Cpu cpu = Cpu_new();
 
     DumbRam dumb_ram = {};
 
-    Memory mock_memory = (Memory){
-        .ctx = &dumb_ram,
-        .read = read_mock_ram,
-        .write = write_mock_ram,
-    };
+    Memory mock_memory = DumbRam_memory(&dumb_ram);
 
     cpu.pc = initial_state->pc;
     cpu.sp = initial_state->sp;
@@ -124,7 +140,7 @@ static void run_cpu_tick_test(const CpuState *const initial_state,
     cpu.c = initial_state->c;
     cpu.d = initial_state->d;
     cpu.e = initial_state->e;
-    cpu.f = initial_state->f;
+    Cpu_write_f(&cpu, initial_state->f);
     cpu.h = initial_state->h;
     cpu.l = initial_state->l;
     cpu.ime = initial_state->ime;
@@ -136,7 +152,16 @@ static void run_cpu_tick_test(const CpuState *const initial_state,
         dumb_ram.active[entry->address] = true;
     }
 
+#ifdef GEMU_JIT
+    if (native) {
+        if (!run_native(&cpu, &mock_memory, &dumb_ram))
+            return;
+    } else {
+        Cpu_tick(&cpu, &mock_memory);
+    }
+#else
     Cpu_tick(&cpu, &mock_memory);
+#endif
 
     char msg_buffer[32];
 
@@ -155,7 +180,8 @@ static void run_cpu_tick_test(const CpuState *const initial_state,
     snprintf(msg_buffer, sizeof(msg_buffer), "(%s, e)", test_name);
     TEST_ASSERT_EQUAL_HEX8_MESSAGE(final_state->e, cpu.e, msg_buffer);
     snprintf(msg_buffer, sizeof(msg_buffer), "(%s, f)", test_name);
-    TEST_ASSERT_EQUAL_HEX8_MESSAGE(final_state->f, cpu.f, msg_buffer);
+    TEST_ASSERT_EQUAL_HEX8_MESSAGE(final_state->f, Cpu_read_f(&cpu),
+                                   msg_buffer);
     snprintf(msg_buffer, sizeof(msg_buffer), "(%s, h)", test_name);
     TEST_ASSERT_EQUAL_HEX8_MESSAGE(final_state->h, cpu.h, msg_buffer);
     snprintf(msg_buffer, sizeof(msg_buffer), "(%s, l)", test_name);
@@ -206,7 +232,12 @@ static void run_opcode_test_file(const char *const filepath)
         CpuState final_state = CpuState_from_cjson(final);
         TEST_ASSERT_EQUAL(initial_state.ram_len, final_state.ram_len);
 
-        run_cpu_tick_test(&initial_state, &final_state, name->valuestring);
+        run_cpu_tick_test(&initial_state, &final_state, name->valuestring,
+                          false);
+#ifdef GEMU_JIT
+        run_cpu_tick_test(&initial_state, &final_state, name->valuestring,
+                          true);
+#endif
 
         CpuState_destroy(&initial_state);
         CpuState_destroy(&final_state);
@@ -224,6 +255,11 @@ static int dirent_filter(const struct dirent *const entry)
 
 void test_cpu_opcodes(void)
 {
+#ifdef GEMU_JIT
+    block_cache = BlockCache_new();
+    jit = Jit_new();
+#endif
+
     struct dirent **entries = nullptr;
     const int entries_len =
         scandir("data/core/cpu_opcodes", &entries, dirent_filter, alphasort);
@@ -242,4 +278,9 @@ void test_cpu_opcodes(void)
     }
 
     free((void *)entries);
+
+#ifdef GEMU_JIT
+    Jit_destroy(jit);
+    BlockCache_destroy(block_cache);
+#endif
 }
@@ -0,0 +1,777 @@
+#include "data.h"
+#include "game_boy.h"
+#include "stdinc.h"
+#include <stdio.h>
+#include <unity.h>
+
+static const char *const SAVE_PATH = "test_game_boy.sav";
+
+// 32 banks of MBC1 ROM, each filled with its number, and 4 banks of RAM
+static u8 rom[0x80000];
+static u8 boot_rom[GB_BOOT_ROM_LEN];
+static GameBoy gb;
+
+void setUp(void)
+{
+    for (size_t i = 0; i < sizeof(rom); ++i)
+        rom[i] = i / 0x4000;
+
+    rom[0x0000] = 0x31;
+    rom[RomHeader_CartridgeType] = CartridgeType_Mbc1RamBattery;
+    rom[RomHeader_RomSize] = 4;
+    rom[RomHeader_RamSize] = 3;
+
+    memset(boot_rom, 0xB0, sizeof(boot_rom));
+
+    gb = GameBoy_new(boot_rom);
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+}
+
+void tearDown(void)
+{
+    GameBoy_destroy(&gb);
+    remove(SAVE_PATH);
+}
+
+void test_game_boy_maps_boot_rom_until_disabled(void)
+{
+    TEST_ASSERT_EQUAL_HEX8(0xB0, GameBoy_read_mem(&gb, 0x0000));
+    TEST_ASSERT_EQUAL_HEX8(0xB0, GameBoy_read_mem(&gb, 0x00FF));
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0x0100));
+
+    GameBoy_write_mem(&gb, 0xFF50, 0x01);
+
+    TEST_ASSERT_EQUAL_HEX8(0x31, GameBoy_read_mem(&gb, 0x0000));
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0x00FF));
+}
+
+void test_game_boy_reads_cartridge_past_boot_rom(void)
+{
+    Memory mem = {
+        .ctx = &gb,
+        .read = GameBoy_read_mem,
+        .write = GameBoy_write_mem,
+    };
+
+    rom[0x0100] = 0x3C;
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+
+    TEST_ASSERT_EQUAL_HEX8(0xB0, GameBoy_read_unpaged(&gb, 0x00FF));
+    TEST_ASSERT_EQUAL_HEX8(0x3C, GameBoy_read_unpaged(&gb, 0x0100));
+
+    gb.cpu.pc = 0x0100;
+    GameBoy_add_watchpoint(&gb, 0x0100, 0x0100, WatchKind_Execute);
+
+    TEST_ASSERT_EQUAL_size_t(0, GameBoy_step(&gb, &mem));
+    TEST_ASSERT_EQUAL_HEX8(0x3C, GameBoy_watch_stop(&gb)->value);
+}
+
+void test_game_boy_follows_rom_bank_switches(void)
+{
+    GameBoy_write_mem(&gb, 0x2000, 0x10);
+
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0x3FFF));
+    TEST_ASSERT_EQUAL_HEX8(0x10, GameBoy_read_mem(&gb, 0x4000));
+    TEST_ASSERT_EQUAL_HEX8(0x10, GameBoy_read_mem(&gb, 0x7FFF));
+
+    GameBoy_write_mem(&gb, 0x2000, 0x01);
+
+    TEST_ASSERT_EQUAL_HEX8(0x01, GameBoy_read_mem(&gb, 0x5123));
+}
+
+void test_game_boy_follows_ram_bank_switches(void)
+{
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0xA000));
+
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    GameBoy_write_mem(&gb, 0xA000, 0x12);
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&gb, 0xA000));
+
+    GameBoy_write_mem(&gb, 0x6000, 0x01);
+    GameBoy_write_mem(&gb, 0x4000, 0x03);
+    GameBoy_write_mem(&gb, 0xBFFF, 0x34);
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0xA000));
+
+    GameBoy_write_mem(&gb, 0x4000, 0x00);
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&gb, 0xA000));
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0xBFFF));
+
+    GameBoy_write_mem(&gb, 0x0000, 0x00);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0xA000));
+}
+
+void test_game_boy_mirrors_wram_in_echo_ram(void)
+{
+    GameBoy_write_mem(&gb, 0xC123, 0x42);
+    TEST_ASSERT_EQUAL_HEX8(0x42, GameBoy_read_mem(&gb, 0xE123));
+
+    GameBoy_write_mem(&gb, 0xFDFF, 0x24);
+    TEST_ASSERT_EQUAL_HEX8(0x24, GameBoy_read_mem(&gb, 0xDDFF));
+    TEST_ASSERT_EQUAL_HEX8(0x24, gb.ram[0x1DFF]);
+}
+
+void test_game_boy_reads_back_plain_memory(void)
+{
+    static const u16 addrs[] = {0x8000, 0x9FFF, 0xC000, 0xDFFF,
+                                0xFE00, 0xFF80, 0xFFFE, 0xFFFF};
+
+    for (size_t i = 0; i < sizeof(addrs) / sizeof(addrs[0]); ++i)
+        GameBoy_write_mem(&gb, addrs[i], i + 1);
+
+    for (size_t i = 0; i < sizeof(addrs) / sizeof(addrs[0]); ++i)
+        TEST_ASSERT_EQUAL_HEX8(i + 1, GameBoy_read_mem(&gb, addrs[i]));
+
+    TEST_ASSERT_EQUAL_HEX8(8, gb.ie);
+}
+
+void test_game_boy_masks_io_registers(void)
+{
+    GameBoy_write_mem(&gb, 0xFF0F, 0xFF);
+    TEST_ASSERT_EQUAL_HEX8(0x1F, gb.if_);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0xFF0F));
+
+    // Only bits 3-6 of STAT are writable
+    gb.stat = 0x02;
+    GameBoy_write_mem(&gb, 0xFF41, 0xFD);
+    TEST_ASSERT_EQUAL_HEX8(0x7A, gb.stat);
+    TEST_ASSERT_EQUAL_HEX8(0xFA, GameBoy_read_mem(&gb, 0xFF41));
+
+    gb.ly = 0x90;
+    GameBoy_write_mem(&gb, 0xFF44, 0x12);
+    TEST_ASSERT_EQUAL_HEX8(0x90, GameBoy_read_mem(&gb, 0xFF44));
+
+    gb.div = 0xAB;
+    GameBoy_write_mem(&gb, 0xFF04, 0x12);
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0xFF04));
+}
+
+void test_game_boy_reads_unmapped_io_as_open_bus(void)
+{
+    // NR14 only reads back its length enable bit
+    GameBoy_write_mem(&gb, 0xFF14, 0x87);
+    TEST_ASSERT_EQUAL_HEX8(0xBF, GameBoy_read_mem(&gb, 0xFF14));
+
+    GameBoy_write_mem(&gb, 0xFF30, 0x5A);
+    TEST_ASSERT_EQUAL_HEX8(0x5A, GameBoy_read_mem(&gb, 0xFF30));
+
+    static const u16 unmapped[] = {0xFF03, 0xFF15, 0xFF27, 0xFF4D, 0xFF7F};
+
+    for (size_t i = 0; i < sizeof(unmapped) / sizeof(unmapped[0]); ++i) {
+        GameBoy_write_mem(&gb, unmapped[i], 0x00);
+        TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, unmapped[i]));
+    }
+}
+
+void test_game_boy_keeps_cartridge_ram_in_save_file(void)
+{
+    TEST_ASSERT_TRUE(GameBoy_open_save(&gb, SAVE_PATH));
+
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    GameBoy_write_mem(&gb, 0xA000, 0x12);
+    GameBoy_write_mem(&gb, 0x6000, 0x01);
+    GameBoy_write_mem(&gb, 0x4000, 0x03);
+    GameBoy_write_mem(&gb, 0xBFFF, 0x34);
+
+    // Loading a ROM closes the save file of the previous one
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+
+    static u8 saved[0x8000 + 1];
+    FILE *const file = fopen(SAVE_PATH, "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_size_t(0x8000, fread(saved, 1, sizeof(saved), file));
+    fclose(file);
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, saved[0x0000]);
+    TEST_ASSERT_EQUAL_HEX8(0x34, saved[0x7FFF]);
+
+    TEST_ASSERT_TRUE(GameBoy_open_save(&gb, SAVE_PATH));
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&gb, 0xA000));
+}
+
+void test_game_boy_only_saves_with_battery(void)
+{
+    rom[RomHeader_CartridgeType] = CartridgeType_Mbc1Ram;
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+
+    TEST_ASSERT_FALSE(GameBoy_open_save(&gb, SAVE_PATH));
+    TEST_ASSERT_NULL(fopen(SAVE_PATH, "rb"));
+}
+
+void test_game_boy_saves_clock_after_ram(void)
+{
+    rom[RomHeader_CartridgeType] = CartridgeType_Mbc3TimerRamBattery;
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+    TEST_ASSERT_TRUE(GameBoy_open_save(&gb, SAVE_PATH));
+
+    gb.cycles = 5 * GB_CPU_FREQUENCY_HZ;
+    GameBoy_flush_save(&gb);
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+
+    static u8 saved[0x8000 + MAPPER_CLOCK_SAVE_LEN + 1];
+    FILE *const file = fopen(SAVE_PATH, "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_size_t(0x8000 + MAPPER_CLOCK_SAVE_LEN,
+                             fread(saved, 1, sizeof(saved), file));
+    fclose(file);
+
+    TEST_ASSERT_EQUAL_HEX8(5, saved[0x8000]);
+
+    // The clock picks up where it left off, give or take the host time that
+    // passed in between
+    TEST_ASSERT_TRUE(GameBoy_open_save(&gb, SAVE_PATH));
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    GameBoy_write_mem(&gb, 0x4000, 0x08);
+    GameBoy_write_mem(&gb, 0x6000, 0x00);
+    GameBoy_write_mem(&gb, 0x6000, 0x01);
+    const u8 seconds = GameBoy_read_mem(&gb, 0xA000);
+    TEST_ASSERT_TRUE(seconds >= 5 && seconds <= 6);
+}
+
+void test_game_boy_shares_rom_between_instances(void)
+{
+    GameBoy other = GameBoy_new(boot_rom);
+    GameBoy_load_rom(&other, rom, sizeof(rom));
+
+    TEST_ASSERT_EQUAL_PTR(gb.rom, other.rom);
+
+    // Each instance still banks on its own
+    GameBoy_write_mem(&other, 0x2000, 0x05);
+    TEST_ASSERT_EQUAL_HEX8(0x05, GameBoy_read_mem(&other, 0x4000));
+    TEST_ASSERT_EQUAL_HEX8(0x01, GameBoy_read_mem(&gb, 0x4000));
+
+    GameBoy_destroy(&other);
+    TEST_ASSERT_EQUAL_HEX8(0x01, GameBoy_read_mem(&gb, 0x4000));
+}
+
+void test_game_boy_forks_share_pages_until_written(void)
+{
+#ifdef GEMU_FLAT_MEMORY
+    TEST_IGNORE_MESSAGE("GameBoy_fork is not supported with GEMU_FLAT_MEMORY");
+#endif
+
+    static GameBoy first;
+    static GameBoy second;
+
+    GameBoy_write_mem(&gb, 0x8010, 0x12);
+    GameBoy_write_mem(&gb, 0xC020, 0x34);
+    GameBoy_fork(&gb, &first);
+    GameBoy_fork(&gb, &second);
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&first, 0x8010));
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&second, 0xE020));
+    TEST_ASSERT_EQUAL_PTR(GameBoy_memory_page(&first, 0xC000),
+                          GameBoy_memory_page(&second, 0xC000));
+
+    // Each write lands in a page of its own
+    GameBoy_write_mem(&first, 0xE020, 0x56);
+    GameBoy_write_mem(&gb, 0x8010, 0x78);
+
+    TEST_ASSERT_EQUAL_HEX8(0x56, GameBoy_read_mem(&first, 0xC020));
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&second, 0xC020));
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&gb, 0xC020));
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&first, 0x8010));
+    TEST_ASSERT_EQUAL_HEX8(0x78, gb.vram[0x0010]);
+
+    // The rest of the page was copied along
+    GameBoy_write_mem(&second, 0xC021, 0x9A);
+    TEST_ASSERT_EQUAL_HEX8(0x34, second.ram[0x0020]);
+
+    GameBoy_destroy(&first);
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&second, 0x8010));
+    GameBoy_destroy(&second);
+}
+
+void test_game_boy_forks_keep_watched_pages_unmapped_once_written(void)
+{
+#ifdef GEMU_FLAT_MEMORY
+    TEST_IGNORE_MESSAGE("GameBoy_fork is not supported with GEMU_FLAT_MEMORY");
+#endif
+
+    static GameBoy fork;
+
+    GameBoy_add_watchpoint(&gb, 0xC020, 0xC020, WatchKind_Read);
+    GameBoy_fork(&gb, &fork);
+
+    GameBoy_write_mem(&gb, 0xC021, 0x12);
+
+    TEST_ASSERT_NULL(gb.read_pages[0xC0]);
+    TEST_ASSERT_EQUAL_PTR(&gb.ram[0x0000], gb.write_pages[0xC0]);
+    TEST_ASSERT_EQUAL_PTR(&gb.ram[0x0000], gb.read_pages[0xE0]);
+    TEST_ASSERT_NULL(gb.write_pages[0xC1]);
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&gb, 0xE021));
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&fork, 0xC021));
+
+    GameBoy_destroy(&fork);
+}
+
+void test_game_boy_forks_keep_cartridge_state_apart(void)
+{
+#ifdef GEMU_FLAT_MEMORY
+    TEST_IGNORE_MESSAGE("GameBoy_fork is not supported with GEMU_FLAT_MEMORY");
+#endif
+
+    static GameBoy fork;
+
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    GameBoy_write_mem(&gb, 0xA000, 0x12);
+    GameBoy_write_mem(&gb, 0x2000, 0x05);
+    GameBoy_fork(&gb, &fork);
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&fork, 0xA000));
+    TEST_ASSERT_EQUAL_HEX8(0x05, GameBoy_read_mem(&fork, 0x4000));
+
+    GameBoy_write_mem(&fork, 0xA000, 0x34);
+    GameBoy_write_mem(&fork, 0x2000, 0x06);
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&gb, 0xA000));
+    TEST_ASSERT_EQUAL_HEX8(0x05, GameBoy_read_mem(&gb, 0x4000));
+    TEST_ASSERT_EQUAL_HEX8(0x06, GameBoy_read_mem(&fork, 0x4000));
+
+    GameBoy_destroy(&fork);
+}
+
+void test_game_boy_forks_share_cartridge_ram_pages_until_written(void)
+{
+#ifdef GEMU_FLAT_MEMORY
+    TEST_IGNORE_MESSAGE("GameBoy_fork is not supported with GEMU_FLAT_MEMORY");
+#endif
+
+    static GameBoy first;
+    static GameBoy second;
+
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    GameBoy_write_mem(&gb, 0x6000, 0x01);
+    GameBoy_write_mem(&gb, 0xA010, 0x12);
+    GameBoy_write_mem(&gb, 0x4000, 0x02);
+    GameBoy_write_mem(&gb, 0xB020, 0x34);
+    GameBoy_fork(&gb, &first);
+    GameBoy_fork(&gb, &second);
+
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&first, 0xB020));
+    TEST_ASSERT_EQUAL_PTR(first.read_pages[0xB0], second.read_pages[0xB0]);
+    TEST_ASSERT_NULL(first.write_pages[0xB0]);
+
+    // Each write lands in a page of its own, the rest of which is copied along
+    GameBoy_write_mem(&first, 0xB021, 0x56);
+    GameBoy_write_mem(&gb, 0xB020, 0x78);
+
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&first, 0xB020));
+    TEST_ASSERT_EQUAL_HEX8(0x56, GameBoy_read_mem(&first, 0xB021));
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&second, 0xB020));
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&second, 0xB021));
+    TEST_ASSERT_EQUAL_HEX8(0x78, GameBoy_read_mem(&gb, 0xB020));
+
+    // Banks that are not mapped are shared all the same
+    GameBoy_write_mem(&second, 0x4000, 0x00);
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_unpaged(&second, 0xA010));
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_cart_ram_page(&second, 0x0010)[0x10]);
+
+    // Shared pages outlive the GameBoy they were forked from
+    GameBoy_destroy(&gb);
+    gb = GameBoy_new(boot_rom);
+    GameBoy_write_mem(&second, 0x4000, 0x02);
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&second, 0xB020));
+
+    GameBoy_destroy(&first);
+    GameBoy_destroy(&second);
+}
+
+void test_game_boy_restricts_cpu_to_hram_during_oam_dma(void)
+{
+    GameBoy_write_mem(&gb, 0xFF50, 0x01);
+    GameBoy_write_mem(&gb, 0xC012, 0x34);
+    GameBoy_write_mem(&gb, 0xFF80, 0x56);
+
+    // Sources past DFFF read WRAM
+    GameBoy_write_mem(&gb, 0xFF46, 0xE0);
+
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0xC012));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0x4000));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0xFE12));
+    TEST_ASSERT_EQUAL_HEX8(0x56, GameBoy_read_mem(&gb, 0xFF80));
+    TEST_ASSERT_EQUAL_HEX8(0xE0, GameBoy_read_mem(&gb, 0xFF0F));
+
+    GameBoy_write_mem(&gb, 0xC012, 0x78);
+    GameBoy_write_mem(&gb, 0x2000, 0x05);
+
+    gb.cpu.cycle_count += 0x9F;
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_read_mem(&gb, 0xC012));
+
+    gb.cpu.cycle_count += 1;
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&gb, 0xC012));
+    TEST_ASSERT_EQUAL_HEX8(0x34, gb.oam[0x12]);
+
+    // Writes outside High RAM and I/O were dropped
+    GameBoy_write_mem(&gb, 0xC000, 0x00);
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&gb, 0xC012));
+    TEST_ASSERT_EQUAL_HEX8(0x01, GameBoy_read_mem(&gb, 0x4000));
+}
+
+void test_game_boy_patches_rom_with_cheats(void)
+{
+    // $3E at 4A05 in banks holding $03 there
+    TEST_ASSERT_TRUE(GameBoy_add_cheat(&gb, "3EA-05B-EE6"));
+    TEST_ASSERT_EQUAL_HEX8(0x01, GameBoy_read_mem(&gb, 0x4A05));
+
+    GameBoy_write_mem(&gb, 0x2000, 0x03);
+    TEST_ASSERT_EQUAL_HEX8(0x3E, GameBoy_read_mem(&gb, 0x4A05));
+    TEST_ASSERT_EQUAL_HEX8(0x03, GameBoy_read_mem(&gb, 0x4A04));
+    TEST_ASSERT_EQUAL_HEX8(0x03, rom[0xCA05]);
+
+    GameBoy_clear_cheats(&gb);
+    TEST_ASSERT_EQUAL_HEX8(0x03, GameBoy_read_mem(&gb, 0x4A05));
+}
+
+void test_game_boy_writes_ram_cheats_when_applied(void)
+{
+    TEST_ASSERT_FALSE(GameBoy_add_cheat(&gb, "not a code"));
+    TEST_ASSERT_TRUE(GameBoy_add_cheat(&gb, "014216D0"));
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0xD016));
+
+    GameBoy_apply_cheats(&gb);
+    TEST_ASSERT_EQUAL_HEX8(0x42, GameBoy_read_mem(&gb, 0xD016));
+
+    // Loading a ROM drops its cheats
+    GameBoy_write_mem(&gb, 0xD016, 0x00);
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+    GameBoy_apply_cheats(&gb);
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0xD016));
+}
+
+void test_game_boy_only_checks_accesses_to_watched_pages(void)
+{
+    GameBoy_write_mem(&gb, 0xC012, 0x34);
+    const size_t id =
+        GameBoy_add_watchpoint(&gb, 0xC010, 0xC01F, WatchKind_Write);
+
+    TEST_ASSERT_NULL(gb.write_pages[0xC0]);
+    TEST_ASSERT_NOT_NULL(gb.read_pages[0xC0]);
+    TEST_ASSERT_NOT_NULL(gb.write_pages[0xC1]);
+
+    GameBoy_write_mem(&gb, 0xC000, 0x12);
+    TEST_ASSERT_EQUAL_HEX8(0x34, GameBoy_read_mem(&gb, 0xC012));
+    TEST_ASSERT_NULL(GameBoy_watch_stop(&gb));
+
+    GameBoy_write_mem(&gb, 0xC012, 0x56);
+    TEST_ASSERT_EQUAL_HEX8(0x56, GameBoy_read_mem(&gb, 0xC012));
+
+    const WatchHit *const hit = GameBoy_watch_stop(&gb);
+    TEST_ASSERT_NOT_NULL(hit);
+    TEST_ASSERT_EQUAL_INT(WatchKind_Write, hit->kind);
+    TEST_ASSERT_EQUAL_HEX16(0xC012, hit->addr);
+    TEST_ASSERT_EQUAL_HEX8(0x56, hit->value);
+
+    GameBoy_resume(&gb);
+    TEST_ASSERT_NULL(GameBoy_watch_stop(&gb));
+
+    TEST_ASSERT_TRUE(GameBoy_remove_watchpoint(&gb, id));
+    TEST_ASSERT_NOT_NULL(gb.write_pages[0xC0]);
+}
+
+void test_game_boy_watches_hram_reads(void)
+{
+    GameBoy_write_mem(&gb, 0xFF90, 0x12);
+    GameBoy_add_watchpoint(&gb, 0xFF90, 0xFF90, WatchKind_Read);
+
+    TEST_ASSERT_EQUAL_HEX8(0x00, GameBoy_read_mem(&gb, 0xFF91));
+    TEST_ASSERT_NULL(GameBoy_watch_stop(&gb));
+
+    TEST_ASSERT_EQUAL_HEX8(0x12, GameBoy_read_mem(&gb, 0xFF90));
+    TEST_ASSERT_NOT_NULL(GameBoy_watch_stop(&gb));
+}
+
+void test_game_boy_stops_before_watched_instructions(void)
+{
+    Memory mem = {
+        .ctx = &gb,
+        .read = GameBoy_read_mem,
+        .write = GameBoy_write_mem,
+    };
+
+    GameBoy_write_mem(&gb, 0xFF50, 0x01);
+    GameBoy_write_mem(&gb, 0xC000, 0x00); // nop
+    GameBoy_write_mem(&gb, 0xC001, 0x00); // nop
+    gb.cpu.pc = 0xC000;
+
+    GameBoy_add_watchpoint(&gb, 0xC001, 0xC001, WatchKind_Execute);
+
+    TEST_ASSERT_EQUAL_size_t(1, GameBoy_step(&gb, &mem));
+    TEST_ASSERT_EQUAL_size_t(0, GameBoy_step(&gb, &mem));
+    TEST_ASSERT_EQUAL_HEX16(0xC001, gb.cpu.pc);
+    TEST_ASSERT_EQUAL_INT(WatchKind_Execute, GameBoy_watch_stop(&gb)->kind);
+
+    GameBoy_resume(&gb);
+    TEST_ASSERT_EQUAL_size_t(1, GameBoy_step(&gb, &mem));
+    TEST_ASSERT_EQUAL_HEX16(0xC002, gb.cpu.pc);
+}
+
+void test_game_boy_watches_execution_of_unusable_memory(void)
+{
+    Memory mem = {
+        .ctx = &gb,
+        .read = GameBoy_read_mem,
+        .write = GameBoy_write_mem,
+    };
+
+    GameBoy_write_mem(&gb, 0xFF50, 0x01);
+    gb.cpu.pc = 0xFEA0;
+
+    GameBoy_add_watchpoint(&gb, 0xFEA0, 0xFEA0, WatchKind_Execute);
+
+    TEST_ASSERT_EQUAL_size_t(0, GameBoy_step(&gb, &mem));
+    TEST_ASSERT_EQUAL_HEX16(0xFEA0, GameBoy_watch_stop(&gb)->addr);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, GameBoy_watch_stop(&gb)->value);
+}
+
+// Runs a GameBoy from a ROM that copies tiles to VRAM and fills a tile map in
+// bulk loops, then halts until each VBlank and spins on LY before scrolling and
+// copying the tile shown everywhere anew while the LCD draws
+static void run_frames(GameBoy *const self, const bool no_skip)
+{
+    static u8 frame_rom[0x8000];
+
+    static const u8 vblank[] = {
+        0xC3, 0x00, 0x02, // jp $0200
+    };
+    static const u8 entry[] = {
+        0xC3, 0x50, 0x01, // jp $0150
+    };
+    static const u8 main[] = {
+        0xAF,             // xor a
+        0xE0, 0x40,       // ldh [$40], a
+        0x21, 0x00, 0x10, // ld hl, $1000
+        0x11, 0x00, 0x80, // ld de, $8000
+        0x01, 0x00, 0x08, // ld bc, $0800
+        0x2A,             // ld a, [hl+]
+        0x12,             // ld [de], a
+        0x13,             // inc de
+        0x0B,             // dec bc
+        0x78,             // ld a, b
+        0xB1,             // or c
+        0x20, 0xF8,       // jr nz, $015C
+        0x21, 0x00, 0x98, // ld hl, $9800
+        0x01, 0x00, 0x04, // ld bc, $0400
+        0x3E, 0x10,       // ld a, $10
+        0x22,             // ld [hl+], a
+        0x0B,             // dec bc
+        0x78,             // ld a, b
+        0xB1,             // or c
+        0x20, 0xF8,       // jr nz, $016A
+        0x3E, 0xE4,       // ld a, $E4
+        0xE0, 0x47,       // ldh [$47], a
+        0x3E, 0x91,       // ld a, $91
+        0xE0, 0x40,       // ldh [$40], a
+        0x3E, 0x01,       // ld a, 1
+        0xE0, 0xFF,       // ldh [$FF], a
+        0x3E, 0x05,       // ld a, 5
+        0xE0, 0x07,       // ldh [$07], a
+        0xAF,             // xor a
+        0xE0, 0x0F,       // ldh [$0F], a
+        0xFB,             // ei
+        0x76,             // halt
+        0xF0, 0x44,       // ldh a, [$44]
+        0xFE, 0x10,       // cp $10
+        0x20, 0xFA,       // jr nz, $0187
+        0x21, 0x00, 0xC0, // ld hl, $C000
+        0x34,             // inc [hl]
+        0x7E,             // ld a, [hl]
+        0xE0, 0x43,       // ldh [$43], a
+        0xFA, 0x00, 0xC0, // ld a, [$C000]
+        0xE6, 0x07,       // and 7
+        0xC6, 0x10,       // add a, $10
+        0x67,             // ld h, a
+        0x2E, 0x00,       // ld l, 0
+        0x11, 0x00, 0x81, // ld de, $8100
+        0x01, 0x00, 0x01, // ld bc, $0100
+        0x2A,             // ld a, [hl+]
+        0x12,             // ld [de], a
+        0x13,             // inc de
+        0x0B,             // dec bc
+        0x78,             // ld a, b
+        0xB1,             // or c
+        0x20, 0xF8,       // jr nz, $01A4
+        0x18, 0xD8,       // jr $0186
+    };
+    static const u8 handler[] = {
+        0xF5,             // push af
+        0xFA, 0x01, 0xC0, // ld a, [$C001]
+        0x3C,             // inc a
+        0xEA, 0x01, 0xC0, // ld [$C001], a
+        0xF1,             // pop af
+        0xD9,             // reti
+    };
+
+    memcpy(&frame_rom[0x0040], vblank, sizeof(vblank));
+    memcpy(&frame_rom[0x0100], entry, sizeof(entry));
+    memcpy(&frame_rom[0x0150], main, sizeof(main));
+    memcpy(&frame_rom[0x0200], handler, sizeof(handler));
+
+    // Tiles to copy, different in each block of 16
+    for (size_t i = 0; i < 0x800; ++i)
+        frame_rom[0x1000 + i] = (u8)((i * 7) + ((i >> 8) * 0x35));
+
+    *self = GameBoy_new(boot_rom);
+    GameBoy_load_rom(self, frame_rom, sizeof(frame_rom));
+    GameBoy_write_mem(self, 0xFF50, 0x01);
+    self->cpu.pc = 0x0100;
+    self->cpu.sp = 0xFFFE;
+    self->no_skip = no_skip;
+
+    // Uneven runs, so that skipping has to stop short at their ends too
+    for (int cycles = 0; cycles < 10 * GB_FRAME_CYCLES; cycles += 1001)
+        GameBoy_run(self, 1001);
+}
+
+void test_game_boy_skips_to_the_same_state_as_stepping(void)
+{
+    static GameBoy skipped;
+    static GameBoy stepped;
+
+    run_frames(&skipped, false);
+    run_frames(&stepped, true);
+
+    TEST_ASSERT_EQUAL_MEMORY(stepped.cpu.rp, skipped.cpu.rp,
+                             sizeof(stepped.cpu.rp));
+    TEST_ASSERT_EQUAL_HEX8(stepped.cpu.a, skipped.cpu.a);
+    TEST_ASSERT_EQUAL_HEX8(Cpu_read_f(&stepped.cpu), Cpu_read_f(&skipped.cpu));
+    TEST_ASSERT_EQUAL_HEX16(stepped.cpu.sp, skipped.cpu.sp);
+    TEST_ASSERT_EQUAL_HEX16(stepped.cpu.pc, skipped.cpu.pc);
+    TEST_ASSERT_EQUAL(stepped.cpu.ime, skipped.cpu.ime);
+    TEST_ASSERT_EQUAL(stepped.cpu.mode, skipped.cpu.mode);
+
+    TEST_ASSERT_EQUAL_HEX8(stepped.if_, skipped.if_);
+    TEST_ASSERT_EQUAL_HEX8(stepped.div, skipped.div);
+    TEST_ASSERT_EQUAL_HEX8(stepped.tima, skipped.tima);
+    TEST_ASSERT_EQUAL_HEX8(stepped.ly, skipped.ly);
+    TEST_ASSERT_EQUAL_UINT64(stepped.cycles, skipped.cycles);
+    TEST_ASSERT_EQUAL_UINT64(stepped.instruction_count,
+                             skipped.instruction_count);
+
+    TEST_ASSERT_EQUAL_MEMORY(stepped.ram, skipped.ram, sizeof(stepped.ram));
+    TEST_ASSERT_EQUAL_MEMORY(stepped.vram, skipped.vram, sizeof(stepped.vram));
+    TEST_ASSERT_EQUAL_MEMORY(stepped.hram, skipped.hram, sizeof(stepped.hram));
+    TEST_ASSERT_EQUAL_MEMORY(stepped.oam, skipped.oam, sizeof(stepped.oam));
+    TEST_ASSERT_EQUAL_MEMORY(stepped.framebuffer, skipped.framebuffer,
+                             sizeof(stepped.framebuffer));
+
+    // The ROM got as far as handling VBlank
+    TEST_ASSERT_TRUE(skipped.ram[0x0001] > 0);
+
+    GameBoy_destroy(&skipped);
+    GameBoy_destroy(&stepped);
+}
+
+// Starts a GameBoy on a ROM that loops through reading DIV and LY after a few
+// other instructions, and calling into bank 1 code that switches to bank 2 in
+// the middle of what would otherwise be a single block, while counting
+// VBlanks. Watching anything keeps it from running native code with GEMU_JIT.
+static void start_banked_loop(GameBoy *const self, const bool watched)
+{
+    static u8 banked_rom[0x10000];
+
+    static const u8 vblank[] = {
+        0xF5,             // push af
+        0xFA, 0x00, 0xC0, // ld a, [$C000]
+        0x3C,             // inc a
+        0xEA, 0x00, 0xC0, // ld [$C000], a
+        0xF1,             // pop af
+        0xD9,             // reti
+    };
+    static const u8 entry[] = {
+        0xC3, 0x50, 0x01, // jp $0150
+    };
+    static const u8 main[] = {
+        0x31, 0xFE, 0xFF, // ld sp, $FFFE
+        0x3E, 0x91,       // ld a, $91
+        0xE0, 0x40,       // ldh [$40], a
+        0x3E, 0x01,       // ld a, 1
+        0xE0, 0xFF,       // ldh [$FF], a
+        0xAF,             // xor a
+        0xE0, 0x0F,       // ldh [$0F], a
+        0x21, 0x00, 0xC1, // ld hl, $C100
+        0xFB,             // ei
+        0x14,             // inc d
+        0x7A,             // ld a, d
+        0xC6, 0x11,       // add a, $11
+        0x5F,             // ld e, a
+        0xF0, 0x04,       // ldh a, [$04]
+        0x22,             // ld [hl+], a
+        0x7B,             // ld a, e
+        0x87,             // add a, a
+        0x5F,             // ld e, a
+        0xF0, 0x44,       // ldh a, [$44]
+        0x22,             // ld [hl+], a
+        0x7C,             // ld a, h
+        0xFE, 0xC8,       // cp $C8
+        0x20, 0x02,       // jr nz, $0177
+        0x26, 0xC1,       // ld h, $C1
+        0xCD, 0x00, 0x40, // call $4000
+        0x18, 0xE6,       // jr $0162
+    };
+    static const u8 banked[] = {
+        0x3E, 0x02,       // ld a, 2
+        0xEA, 0x00, 0x20, // ld [$2000], a
+        0x04,             // inc b (inc c in bank 2)
+        0x3E, 0x01,       // ld a, 1
+        0xEA, 0x00, 0x20, // ld [$2000], a
+        0xC9,             // ret
+    };
+
+    memcpy(&banked_rom[0x0040], vblank, sizeof(vblank));
+    memcpy(&banked_rom[0x0100], entry, sizeof(entry));
+    memcpy(&banked_rom[0x0150], main, sizeof(main));
+    memcpy(&banked_rom[0x4000], banked, sizeof(banked));
+    memcpy(&banked_rom[0x8000], banked, sizeof(banked));
+    banked_rom[0x8005] = 0x0C;
+
+    banked_rom[RomHeader_CartridgeType] = CartridgeType_Mbc1;
+    banked_rom[RomHeader_RomSize] = 1;
+
+    *self = GameBoy_new(boot_rom);
+    GameBoy_load_rom(self, banked_rom, sizeof(banked_rom));
+    GameBoy_write_mem(self, 0xFF50, 0x01);
+    self->cpu.pc = 0x0100;
+    self->no_skip = true;
+
+    if (watched)
+        GameBoy_add_watchpoint(self, 0x7FFF, 0x7FFF, WatchKind_Execute);
+}
+
+void test_game_boy_runs_native_code_like_the_interpreter(void)
+{
+    static GameBoy interpreted;
+    static GameBoy native;
+
+    start_banked_loop(&interpreted, true);
+    start_banked_loop(&native, false);
+
+    // Uneven runs, so that blocks have to stop short at their ends too
+    for (int cycles = 0; cycles < 10 * GB_FRAME_CYCLES; cycles += 1001) {
+        GameBoy_run(&interpreted, 1001);
+        GameBoy_run(&native, 1001);
+
+        TEST_ASSERT_EQUAL_MEMORY(interpreted.cpu.rp, native.cpu.rp,
+                                 sizeof(interpreted.cpu.rp));
+        TEST_ASSERT_EQUAL_HEX8(interpreted.cpu.a, native.cpu.a);
+        TEST_ASSERT_EQUAL_HEX16(interpreted.cpu.sp, native.cpu.sp);
+        TEST_ASSERT_EQUAL_HEX16(interpreted.cpu.pc, native.cpu.pc);
+        TEST_ASSERT_EQUAL_UINT64(interpreted.cycles, native.cycles);
+        TEST_ASSERT_EQUAL_UINT64(interpreted.instruction_count,
+                                 native.instruction_count);
+        TEST_ASSERT_EQUAL_MEMORY(interpreted.ram, native.ram,
+                                 sizeof(interpreted.ram));
+    }
+
+    // The code after the bank switch ran from bank 2, and VBlank was handled
+    TEST_ASSERT_EQUAL_HEX8(0x00, native.cpu.b);
+    TEST_ASSERT_TRUE(native.ram[0x0000] > 0);
+
+#ifdef GEMU_JIT
+    TEST_ASSERT_NOT_NULL(native.jit);
+#endif
+
+    GameBoy_destroy(&interpreted);
+    GameBoy_destroy(&native);
+}
@@ -0,0 +1,149 @@
+#include "data.h"
+#include "game_boy.h"
+#include "game_boy_arena.h"
+#include "stdinc.h"
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+// 2 banks of MBC1 ROM with 1 bank of RAM
+static u8 rom[0x8000];
+static u8 boot_rom[GB_BOOT_ROM_LEN];
+static GameBoyArena *arena;
+
+void setUp(void)
+{
+    rom[RomHeader_CartridgeType] = CartridgeType_Mbc1Ram;
+    rom[RomHeader_RomSize] = 0;
+    rom[RomHeader_RamSize] = 2;
+
+    arena = GameBoyArena_new(3, boot_rom, false);
+}
+
+void tearDown(void)
+{
+    GameBoyArena_destroy(arena);
+}
+
+void test_game_boy_arena_lays_instances_out_on_cache_lines(void)
+{
+    TEST_ASSERT_EQUAL_size_t(3, GameBoyArena_count(arena));
+
+    for (size_t i = 0; i < 3; ++i) {
+        const GameBoy *const gb = GameBoyArena_get(arena, i);
+
+        TEST_ASSERT_EQUAL_size_t(0, (uintptr_t)gb % 64);
+        TEST_ASSERT_TRUE(gb->boot_rom_enable);
+        TEST_ASSERT_EQUAL_HEX8(0x0F, gb->joyp);
+    }
+
+    TEST_ASSERT_TRUE((u8 *)GameBoyArena_get(arena, 1) -
+                         (u8 *)GameBoyArena_get(arena, 0) >=
+                     (ptrdiff_t)sizeof(GameBoy));
+}
+
+void test_game_boy_arena_keeps_instances_apart(void)
+{
+    for (size_t i = 0; i < 3; ++i) {
+        GameBoy *const gb = GameBoyArena_get(arena, i);
+
+        GameBoy_load_rom(gb, rom, sizeof(rom));
+        GameBoy_write_mem(gb, 0x0000, 0x0A);
+        GameBoy_write_mem(gb, 0xA000, 0x10 + i);
+        GameBoy_write_mem(gb, 0xC000, 0x20 + i);
+        GameBoy_write_mem(gb, 0xFF80, 0x30 + i);
+    }
+
+    for (size_t i = 0; i < 3; ++i) {
+        GameBoy *const gb = GameBoyArena_get(arena, i);
+
+        TEST_ASSERT_EQUAL_HEX8(0x10 + i, GameBoy_read_mem(gb, 0xA000));
+        TEST_ASSERT_EQUAL_HEX8(0x20 + i, GameBoy_read_mem(gb, 0xC000));
+        TEST_ASSERT_EQUAL_HEX8(0x30 + i, GameBoy_read_mem(gb, 0xFF80));
+    }
+}
+
+void test_game_boy_arena_keeps_mappers_inside_instances(void)
+{
+    GameBoy *const gb = GameBoyArena_get(arena, 0);
+    GameBoy_load_rom(gb, rom, sizeof(rom));
+
+    TEST_ASSERT_EQUAL_PTR(&gb->mapper_storage, gb->mapper);
+
+    // Loading again replaces it in place
+    GameBoy_load_rom(gb, rom, sizeof(rom));
+    TEST_ASSERT_EQUAL_PTR(&gb->mapper_storage, gb->mapper);
+}
+
+// Starts the ROM running code that counts VBlanks in C000 and spins
+// incrementing C001 in between
+static void start_counting(GameBoy *const gb)
+{
+    static const u8 vblank[] = {
+        0xE5,             // push hl
+        0x21, 0x00, 0xC0, // ld hl, $C000
+        0x34,             // inc [hl]
+        0xE1,             // pop hl
+        0xD9,             // reti
+    };
+    static const u8 main[] = {
+        0x3E, 0x91,       // ld a, $91
+        0xE0, 0x40,       // ldh [$40], a
+        0x3E, 0x01,       // ld a, 1
+        0xE0, 0xFF,       // ldh [$FF], a
+        0xAF,             // xor a
+        0xE0, 0x0F,       // ldh [$0F], a
+        0xFB,             // ei
+        0x21, 0x01, 0xC0, // ld hl, $C001
+        0x34,             // inc [hl]
+        0x18, 0xFA,       // jr $015C
+    };
+
+    memcpy(&rom[0x0040], vblank, sizeof(vblank));
+    memcpy(&rom[0x0150], main, sizeof(main));
+
+    GameBoy_load_rom(gb, rom, sizeof(rom));
+    GameBoy_write_mem(gb, 0xFF50, 0x01);
+    gb->cpu.pc = 0x0150;
+    gb->cpu.sp = 0xFFFE;
+}
+
+void test_game_boy_arena_runs_instances_and_forks_through_frames(void)
+{
+#ifdef GEMU_FLAT_MEMORY
+    TEST_IGNORE_MESSAGE("GameBoy_fork is not supported with GEMU_FLAT_MEMORY");
+#endif
+
+    GameBoy *const parent = GameBoyArena_get(arena, 0);
+    GameBoy *const child = GameBoyArena_get(arena, 1);
+    GameBoy *const alone = GameBoyArena_get(arena, 2);
+
+    start_counting(parent);
+    start_counting(alone);
+
+    GameBoy_run(parent, GB_FRAME_CYCLES);
+    TEST_ASSERT_EQUAL_HEX8(1, GameBoy_read_mem(parent, 0xC000));
+
+    GameBoy_destroy(child);
+    GameBoy_fork(parent, child);
+
+    GameBoy_run(parent, GB_FRAME_CYCLES);
+    GameBoy_run(child, GB_FRAME_CYCLES);
+    GameBoy_run(alone, 2 * GB_FRAME_CYCLES);
+
+    // Running on from a fork ends up where running straight through does
+    for (size_t i = 0; i < 2; ++i) {
+        GameBoy *const gb = i == 0 ? parent : child;
+
+        TEST_ASSERT_EQUAL_UINT64(alone->cycles + alone->cpu.cycle_count,
+                                 gb->cycles + gb->cpu.cycle_count);
+        TEST_ASSERT_EQUAL_HEX8(2, GameBoy_read_mem(gb, 0xC000));
+        TEST_ASSERT_EQUAL_HEX8(GameBoy_read_mem(alone, 0xC001),
+                               GameBoy_read_mem(gb, 0xC001));
+        TEST_ASSERT_EQUAL_MEMORY(alone->framebuffer, gb->framebuffer,
+                                 sizeof(gb->framebuffer));
+    }
+
+    TEST_ASSERT_NOT_EQUAL(GameBoy_memory_page(parent, 0xC000),
+                          GameBoy_memory_page(child, 0xC000));
+}
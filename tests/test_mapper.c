@@ -0,0 +1,251 @@
+#include "data.h"
+#include "mapper.h"
+#include "stdinc.h"
+#include <unity.h>
+
+// M-cycles per second of the MBC3 real-time clock
+constexpr u64 SECOND = 1 << 20;
+
+// Only the header is looked at, so this can claim any size
+static u8 rom[0x8000];
+static Mapper *mapper;
+
+void setUp(void)
+{
+    memset(rom, 0, sizeof(rom));
+    mapper = nullptr;
+}
+
+void tearDown(void)
+{
+    Mapper_destroy(mapper);
+}
+
+static Mapper *create_mapper(const CartridgeType type, const u8 rom_size_code,
+                             const u8 ram_size_code)
+{
+    rom[RomHeader_CartridgeType] = type;
+    rom[RomHeader_RomSize] = rom_size_code;
+    rom[RomHeader_RamSize] = ram_size_code;
+
+    return Mapper_from_rom(rom, sizeof(rom));
+}
+
+static u8 read(const u16 addr)
+{
+    return Mapper_read(mapper, rom, sizeof(rom), addr, 0);
+}
+
+// Latches the RTC at the given cycle and reads back the given register
+static u8 read_rtc(const u8 reg, const u64 cycles)
+{
+    Mapper_write(mapper, 0x6000, 0x00, cycles);
+    Mapper_write(mapper, 0x6000, 0x01, cycles);
+    Mapper_write(mapper, 0x4000, reg, cycles);
+    return Mapper_read(mapper, rom, sizeof(rom), 0xA000, cycles);
+}
+
+void test_mapper_mbc1_switches_rom_banks(void)
+{
+    mapper = create_mapper(CartridgeType_Mbc1, 0x05, 0x00); // 64 banks
+
+    TEST_ASSERT_EQUAL_size_t(0, Mapper_rom_bank(mapper, 0x0000));
+    TEST_ASSERT_EQUAL_size_t(1, Mapper_rom_bank(mapper, 0x4000));
+
+    // Bank 0 is mapped as bank 1
+    Mapper_write(mapper, 0x2000, 0x00, 0);
+    TEST_ASSERT_EQUAL_size_t(1, Mapper_rom_bank(mapper, 0x7FFF));
+
+    Mapper_write(mapper, 0x2000, 0xE3, 0);
+    Mapper_write(mapper, 0x4000, 0x01, 0);
+    TEST_ASSERT_EQUAL_size_t(0x23, Mapper_rom_bank(mapper, 0x4000));
+    TEST_ASSERT_EQUAL_size_t(0, Mapper_rom_bank(mapper, 0x0000));
+
+    // Mode 1 applies the upper bits to 0000-3FFF as well
+    Mapper_write(mapper, 0x6000, 0x01, 0);
+    TEST_ASSERT_EQUAL_size_t(0x20, Mapper_rom_bank(mapper, 0x3FFF));
+
+    // Bank numbers wrap around at the size of the ROM
+    Mapper_write(mapper, 0x4000, 0x02, 0);
+    TEST_ASSERT_EQUAL_size_t(0x03, Mapper_rom_bank(mapper, 0x4000));
+}
+
+void test_mapper_mbc1_switches_ram_banks_in_mode_1(void)
+{
+    mapper = create_mapper(CartridgeType_Mbc1RamBattery, 0x00, 0x03);
+
+    TEST_ASSERT_NULL(Mapper_ram_bank(mapper));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, read(0xA000));
+
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+    Mapper_write(mapper, 0xA000, 0x12, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x12, read(0xA000));
+
+    Mapper_write(mapper, 0x4000, 0x02, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x12, read(0xA000));
+
+    Mapper_write(mapper, 0x6000, 0x01, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x00, read(0xA000));
+
+    Mapper_write(mapper, 0xBFFF, 0x34, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x34, Mapper_ram_bank(mapper)[0x1FFF]);
+
+    Mapper_write(mapper, 0x0000, 0x00, 0);
+    TEST_ASSERT_NULL(Mapper_ram_bank(mapper));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, read(0xBFFF));
+}
+
+void test_mapper_moves_ram_elsewhere(void)
+{
+    static u8 ram[0x8000];
+
+    mapper = create_mapper(CartridgeType_Mbc1RamBattery, 0x00, 0x03);
+    TEST_ASSERT_EQUAL_size_t(sizeof(ram), Mapper_ram_len(mapper));
+
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+    Mapper_write(mapper, 0x6000, 0x01, 0);
+    Mapper_write(mapper, 0x4000, 0x02, 0);
+    Mapper_set_ram(mapper, ram);
+    TEST_ASSERT_EQUAL_PTR(&ram[0x4000], Mapper_ram_bank(mapper));
+
+    Mapper_write(mapper, 0xA001, 0x56, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x56, ram[0x4001]);
+
+    Mapper_write(mapper, 0x4000, 0x03, 0);
+    TEST_ASSERT_EQUAL_PTR(&ram[0x6000], Mapper_ram_bank(mapper));
+}
+
+void test_mapper_mbc3_latches_rtc_registers(void)
+{
+    mapper = create_mapper(CartridgeType_Mbc3TimerRamBattery, 0x06, 0x03);
+
+    Mapper_write(mapper, 0x2000, 0x7F, 0);
+    TEST_ASSERT_EQUAL_size_t(0x7F, Mapper_rom_bank(mapper, 0x4000));
+
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+    Mapper_write(mapper, 0x4000, 0x03, 0);
+    TEST_ASSERT_NOT_NULL(Mapper_ram_bank(mapper));
+
+    // Selecting an RTC register unmaps the RAM
+    Mapper_write(mapper, 0x4000, 0x0C, 0);
+    TEST_ASSERT_NULL(Mapper_ram_bank(mapper));
+    Mapper_write(mapper, 0xA000, 0xFF, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x00, read(0xA000));
+
+    Mapper_write(mapper, 0x6000, 0x00, 0);
+    Mapper_write(mapper, 0x6000, 0x01, 0);
+    TEST_ASSERT_EQUAL_HEX8(0xC1, read(0xA000));
+}
+
+void test_mapper_mbc3_rtc_follows_emulated_cycles(void)
+{
+    mapper = create_mapper(CartridgeType_Mbc3TimerRamBattery, 0x06, 0x03);
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+
+    TEST_ASSERT_EQUAL_HEX8(0, read_rtc(0x08, SECOND - 1));
+    TEST_ASSERT_EQUAL_HEX8(1, read_rtc(0x08, SECOND));
+
+    // 1 day, 2 hours, 3 minutes and 4 seconds
+    const u64 seconds = ((((24 + 2) * 60) + 3) * 60) + 4;
+    const u64 cycles = (seconds * SECOND) + 5;
+    TEST_ASSERT_EQUAL_HEX8(4, read_rtc(0x08, cycles));
+    TEST_ASSERT_EQUAL_HEX8(3, read_rtc(0x09, cycles));
+    TEST_ASSERT_EQUAL_HEX8(2, read_rtc(0x0A, cycles));
+    TEST_ASSERT_EQUAL_HEX8(1, read_rtc(0x0B, cycles));
+    TEST_ASSERT_EQUAL_HEX8(0, read_rtc(0x0C, cycles));
+
+    // Latched registers do not move until the next latch
+    Mapper_write(mapper, 0x4000, 0x08, cycles);
+    TEST_ASSERT_EQUAL_HEX8(
+        4, Mapper_read(mapper, rom, sizeof(rom), 0xA000, cycles + 10 * SECOND));
+
+    // Writing the seconds restarts the current second
+    Mapper_write(mapper, 0xA000, 30, cycles);
+    TEST_ASSERT_EQUAL_HEX8(30, read_rtc(0x08, cycles + SECOND - 1));
+    TEST_ASSERT_EQUAL_HEX8(31, read_rtc(0x08, cycles + SECOND));
+}
+
+void test_mapper_mbc3_rtc_stops_while_halted(void)
+{
+    mapper = create_mapper(CartridgeType_Mbc3TimerRamBattery, 0x06, 0x03);
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+
+    // Day 511 rolls over into the carry bit
+    Mapper_write(mapper, 0x4000, 0x0B, 0);
+    Mapper_write(mapper, 0xA000, 0xFF, 0);
+    Mapper_write(mapper, 0x4000, 0x0C, 0);
+    Mapper_write(mapper, 0xA000, 0x41, 0);
+    Mapper_write(mapper, 0x4000, 0x0A, 0);
+    Mapper_write(mapper, 0xA000, 23, 0);
+    Mapper_write(mapper, 0x4000, 0x09, 0);
+    Mapper_write(mapper, 0xA000, 59, 0);
+    Mapper_write(mapper, 0x4000, 0x08, 0);
+    Mapper_write(mapper, 0xA000, 59, 0);
+
+    TEST_ASSERT_EQUAL_HEX8(59, read_rtc(0x08, 100 * SECOND));
+
+    Mapper_write(mapper, 0x4000, 0x0C, 100 * SECOND);
+    Mapper_write(mapper, 0xA000, 0x01, 100 * SECOND);
+
+    TEST_ASSERT_EQUAL_HEX8(0x01, read_rtc(0x0C, 101 * SECOND - 1));
+    TEST_ASSERT_EQUAL_HEX8(0x80, read_rtc(0x0C, 101 * SECOND));
+    TEST_ASSERT_EQUAL_HEX8(0x00, read_rtc(0x0B, 101 * SECOND));
+    TEST_ASSERT_EQUAL_HEX8(0x00, read_rtc(0x08, 101 * SECOND));
+}
+
+void test_mapper_mbc3_rtc_catches_up_with_host_time(void)
+{
+    u8 state[MAPPER_CLOCK_SAVE_LEN];
+
+    mapper = create_mapper(CartridgeType_Mbc3TimerRamBattery, 0x06, 0x03);
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+    TEST_ASSERT_EQUAL_HEX8(5, read_rtc(0x08, 5 * SECOND));
+    TEST_ASSERT_TRUE(Mapper_save_clock(mapper, 7 * SECOND, 1000, state));
+
+    TEST_ASSERT_EQUAL_HEX8(7, state[0]);
+    TEST_ASSERT_EQUAL_HEX8(5, state[20]);
+    TEST_ASSERT_EQUAL_HEX8(0xE8, state[40]);
+    TEST_ASSERT_EQUAL_HEX8(0x03, state[41]);
+    Mapper_destroy(mapper);
+
+    // Restored into a fresh mapper 2 minutes later
+    mapper = create_mapper(CartridgeType_Mbc3TimerRamBattery, 0x06, 0x03);
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+    Mapper_write(mapper, 0x4000, 0x08, 0);
+    TEST_ASSERT_TRUE(Mapper_load_clock(mapper, 0, 1120, state));
+
+    TEST_ASSERT_EQUAL_HEX8(5, read(0xA000));
+    TEST_ASSERT_EQUAL_HEX8(7, read_rtc(0x08, 0));
+    TEST_ASSERT_EQUAL_HEX8(2, read_rtc(0x09, 0));
+    TEST_ASSERT_EQUAL_HEX8(8, read_rtc(0x08, SECOND));
+}
+
+void test_mapper_saves_no_clock_without_rtc(void)
+{
+    u8 state[MAPPER_CLOCK_SAVE_LEN];
+
+    mapper = create_mapper(CartridgeType_Mbc3RamBattery, 0x06, 0x03);
+    TEST_ASSERT_FALSE(Mapper_save_clock(mapper, 0, 0, state));
+    TEST_ASSERT_FALSE(Mapper_load_clock(mapper, 0, 0, state));
+}
+
+void test_mapper_mbc5_switches_rom_and_ram_banks(void)
+{
+    mapper = create_mapper(CartridgeType_Mbc5RamBattery, 0x08, 0x04);
+
+    Mapper_write(mapper, 0x2000, 0x00, 0);
+    TEST_ASSERT_EQUAL_size_t(0, Mapper_rom_bank(mapper, 0x4000));
+
+    Mapper_write(mapper, 0x3000, 0x01, 0);
+    Mapper_write(mapper, 0x2000, 0x23, 0);
+    TEST_ASSERT_EQUAL_size_t(0x123, Mapper_rom_bank(mapper, 0x4000));
+    TEST_ASSERT_EQUAL_size_t(0, Mapper_rom_bank(mapper, 0x0000));
+
+    Mapper_write(mapper, 0x0000, 0x0A, 0);
+    Mapper_write(mapper, 0x4000, 0x0F, 0);
+    Mapper_write(mapper, 0xA000, 0x56, 0);
+    Mapper_write(mapper, 0x4000, 0x00, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x00, read(0xA000));
+    Mapper_write(mapper, 0x4000, 0x0F, 0);
+    TEST_ASSERT_EQUAL_HEX8(0x56, read(0xA000));
+}
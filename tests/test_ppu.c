@@ -0,0 +1,174 @@
+#include "game_boy.h"
+#include "ppu.h"
+#include "stdinc.h"
+#include <string.h>
+#include <unity.h>
+
+static GameBoy gb;
+
+// Fills every row of a tile with the given pair of bytes
+static void fill_tile(const size_t tile, const u8 lo, const u8 hi)
+{
+    for (size_t row = 0; row < 8; ++row) {
+        gb.vram[(tile * 16) + (row * 2)] = lo;
+        gb.vram[(tile * 16) + (row * 2) + 1] = hi;
+    }
+}
+
+static void set_obj(const size_t obj, const u8 y, const u8 x, const u8 tile,
+                    const u8 attrs)
+{
+    gb.oam[obj * 4] = y;
+    gb.oam[(obj * 4) + 1] = x;
+    gb.oam[(obj * 4) + 2] = tile;
+    gb.oam[(obj * 4) + 3] = attrs;
+}
+
+void setUp(void)
+{
+    gb = GameBoy_new(nullptr);
+    gb.bgp = 0xE4;
+    gb.obp0 = 0xE4;
+}
+
+void tearDown(void)
+{
+    GameBoy_destroy(&gb);
+}
+
+void test_ppu_scrolls_background_around_edges(void)
+{
+    gb.lcdc = LcdControl_Enable | LcdControl_BgwTileArea |
+              LcdControl_ObjBgwEnable;
+    fill_tile(1, 0xFF, 0xFF);
+    gb.vram[0x1800 + (31 * 32) + 31] = 1;
+    gb.scx = 0xFC;
+    gb.scy = 0xF8;
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(3, gb.framebuffer[0][0]);
+    TEST_ASSERT_EQUAL_UINT8(3, gb.framebuffer[0][3]);
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][4]);
+
+    // Signed tile numbers count from 9000 instead
+    gb.lcdc &= ~LcdControl_BgwTileArea;
+    fill_tile(0x100 + 1, 0xFF, 0x00);
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(1, gb.framebuffer[0][0]);
+}
+
+void test_ppu_moves_window_down_only_where_shown(void)
+{
+    gb.lcdc = LcdControl_Enable | LcdControl_WinTileMap |
+              LcdControl_WinEnable | LcdControl_BgwTileArea |
+              LcdControl_ObjBgwEnable;
+    memset(&gb.vram[0x1C00], 1, 0x400);
+    gb.vram[16] = 0xFF; // Only the top row of tile 1
+    gb.wy = 2;
+    gb.wx = 7 + 80;
+
+    for (u8 ly = 0; ly < 3; ++ly)
+        Ppu_draw_line(&gb, ly);
+
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[1][80]);
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[2][79]);
+    TEST_ASSERT_EQUAL_UINT8(1, gb.framebuffer[2][80]);
+
+    // Hiding the window for a line picks it up where it left off
+    gb.lcdc &= ~LcdControl_WinEnable;
+    Ppu_draw_line(&gb, 3);
+    gb.lcdc |= LcdControl_WinEnable;
+    Ppu_draw_line(&gb, 4);
+
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[4][80]);
+    TEST_ASSERT_EQUAL_UINT8(2, gb.window_line);
+}
+
+void test_ppu_draws_leftmost_objects_on_top(void)
+{
+    gb.lcdc = LcdControl_Enable | LcdControl_ObjEnable | LcdControl_BgwTileArea |
+              LcdControl_ObjBgwEnable;
+    fill_tile(2, 0xFF, 0x00);
+    fill_tile(3, 0x00, 0xF0); // Color 2 on the left half, clear on the right
+
+    set_obj(0, 16, 8 + 4, 2, 0);
+    set_obj(1, 16, 8, 3, 0);
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(2, gb.framebuffer[0][3]);
+    TEST_ASSERT_EQUAL_UINT8(1, gb.framebuffer[0][4]);
+    TEST_ASSERT_EQUAL_UINT8(1, gb.framebuffer[0][11]);
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][12]);
+
+    // Flipped, the clear half of object 1 is on the left instead
+    set_obj(1, 16, 8, 3, ObjAttrs_FlipX);
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][3]);
+    TEST_ASSERT_EQUAL_UINT8(2, gb.framebuffer[0][4]);
+}
+
+void test_ppu_hides_objects_behind_background_if_asked(void)
+{
+    gb.lcdc = LcdControl_Enable | LcdControl_ObjEnable | LcdControl_BgwTileArea |
+              LcdControl_ObjBgwEnable;
+    fill_tile(0, 0xF0, 0x00); // Background color 1 on the left half
+    fill_tile(2, 0xFF, 0xFF);
+
+    set_obj(0, 16, 8, 2, ObjAttrs_Priority);
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(1, gb.framebuffer[0][0]);
+    TEST_ASSERT_EQUAL_UINT8(3, gb.framebuffer[0][4]);
+}
+
+void test_ppu_draws_ten_objects_per_line_at_most(void)
+{
+    gb.lcdc = LcdControl_Enable | LcdControl_ObjEnable | LcdControl_BgwTileArea |
+              LcdControl_ObjBgwEnable;
+    fill_tile(2, 0xFF, 0xFF);
+
+    for (size_t obj = 0; obj < 11; ++obj)
+        set_obj(obj, 16, (u8)(8 + (obj * 8)), 2, 0);
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(3, gb.framebuffer[0][79]);
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][80]);
+}
+
+void test_ppu_blanks_lines_while_lcd_is_off(void)
+{
+    gb.lcdc = LcdControl_BgwTileArea | LcdControl_ObjBgwEnable;
+    fill_tile(0, 0xFF, 0xFF);
+    memset(gb.framebuffer[0], 3, GB_LCD_WIDTH);
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][0]);
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][GB_LCD_WIDTH - 1]);
+}
+
+void test_ppu_hides_objects_during_oam_dma(void)
+{
+    gb.lcdc = LcdControl_Enable | LcdControl_ObjEnable | LcdControl_BgwTileArea |
+              LcdControl_ObjBgwEnable;
+    fill_tile(2, 0xFF, 0xFF);
+    set_obj(0, 16, 8, 2, 0);
+    gb.dma_end = 0xA0;
+
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(0, gb.framebuffer[0][0]);
+
+    gb.cycles = 0xA0;
+    Ppu_draw_line(&gb, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(3, gb.framebuffer[0][0]);
+}
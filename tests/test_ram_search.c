@@ -0,0 +1,202 @@
+#include "data.h"
+#include "game_boy.h"
+#include "ram_search.h"
+#include "stdinc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+static constexpr size_t RAM_LEN = 0x2000 + 0x7F + 0x8000;
+
+// MBC1 with 4 banks of RAM, enabled and switchable
+static u8 rom[0x8000];
+static u8 boot_rom[GB_BOOT_ROM_LEN];
+static GameBoy gb;
+static RamSearch *search;
+static RamSearchCandidate candidates[RAM_LEN];
+
+void setUp(void)
+{
+    rom[RomHeader_CartridgeType] = CartridgeType_Mbc1Ram;
+    rom[RomHeader_RamSize] = 3;
+
+    gb = GameBoy_new(boot_rom);
+    GameBoy_load_rom(&gb, rom, sizeof(rom));
+    GameBoy_write_mem(&gb, 0x0000, 0x0A);
+    GameBoy_write_mem(&gb, 0x6000, 0x01);
+
+    search = RamSearch_new(&gb);
+}
+
+void tearDown(void)
+{
+    RamSearch_destroy(search);
+    GameBoy_destroy(&gb);
+}
+
+void test_ram_search_starts_with_every_byte(void)
+{
+    TEST_ASSERT_EQUAL_size_t(RAM_LEN, RamSearch_count(search));
+    TEST_ASSERT_EQUAL_size_t(RAM_LEN,
+                             RamSearch_candidates(search, candidates, RAM_LEN));
+    TEST_ASSERT_EQUAL_HEX16(0xC000, candidates[0].addr);
+    TEST_ASSERT_EQUAL_HEX16(0xFF80, candidates[0x2000].addr);
+    TEST_ASSERT_EQUAL_HEX16(0xA000, candidates[0x207F].addr);
+    TEST_ASSERT_EQUAL_HEX16(0xBFFF, candidates[RAM_LEN - 1].addr);
+    TEST_ASSERT_EQUAL_UINT8(3, candidates[RAM_LEN - 1].bank);
+}
+
+void test_ram_search_compares_bytes_against_last_filter(void)
+{
+    GameBoy_write_mem(&gb, 0xC000, 10);
+    GameBoy_write_mem(&gb, 0xFF90, 200);
+    RamSearch_reset(search, &gb);
+
+    GameBoy_write_mem(&gb, 0xC000, 13);
+    GameBoy_write_mem(&gb, 0xFF90, 100);
+
+    TEST_ASSERT_EQUAL_size_t(
+        2, RamSearch_filter(search, &gb, RamSearchCmp_Changed,
+                            RamSearchWidth_8, 0));
+    TEST_ASSERT_EQUAL_size_t(
+        2, RamSearch_filter(search, &gb, RamSearchCmp_Equal, RamSearchWidth_8,
+                            0));
+
+    GameBoy_write_mem(&gb, 0xC000, 16);
+    GameBoy_write_mem(&gb, 0xFF90, 90);
+
+    TEST_ASSERT_EQUAL_size_t(
+        1, RamSearch_filter(search, &gb, RamSearchCmp_Delta, RamSearchWidth_8,
+                            3));
+    TEST_ASSERT_EQUAL_size_t(1,
+                             RamSearch_candidates(search, candidates, RAM_LEN));
+    TEST_ASSERT_EQUAL_HEX16(0xC000, candidates[0].addr);
+    TEST_ASSERT_EQUAL_UINT16(16, candidates[0].value);
+}
+
+void test_ram_search_compares_little_endian_words(void)
+{
+    GameBoy_write_mem(&gb, 0xD000, 0xFF);
+    GameBoy_write_mem(&gb, 0xD001, 0x01);
+    RamSearch_reset(search, &gb);
+
+    // The low byte borrows from the high one
+    GameBoy_write_mem(&gb, 0xD000, 0x01);
+    GameBoy_write_mem(&gb, 0xD001, 0x03);
+
+    TEST_ASSERT_EQUAL_size_t(
+        1, RamSearch_filter(search, &gb, RamSearchCmp_Delta,
+                            RamSearchWidth_16, 0x0102));
+    TEST_ASSERT_EQUAL_size_t(1,
+                             RamSearch_candidates(search, candidates, RAM_LEN));
+    TEST_ASSERT_EQUAL_HEX16(0xD000, candidates[0].addr);
+    TEST_ASSERT_EQUAL_HEX16(0x0301, candidates[0].value);
+}
+
+void test_ram_search_keeps_words_within_regions(void)
+{
+    GameBoy_write_mem(&gb, 0xDFFF, 0x34);
+    GameBoy_write_mem(&gb, 0xFF80, 0x12);
+    GameBoy_write_mem(&gb, 0x4000, 0x01);
+    GameBoy_write_mem(&gb, 0xBFFF, 0x34);
+    GameBoy_write_mem(&gb, 0x4000, 0x02);
+    GameBoy_write_mem(&gb, 0xA000, 0x12);
+
+    TEST_ASSERT_EQUAL_size_t(
+        0, RamSearch_filter(search, &gb, RamSearchCmp_Value,
+                            RamSearchWidth_16, 0x1234));
+}
+
+void test_ram_search_finds_values_in_cartridge_ram_banks(void)
+{
+    GameBoy_write_mem(&gb, 0x4000, 0x02);
+    GameBoy_write_mem(&gb, 0xA010, 7);
+    RamSearch_reset(search, &gb);
+
+    GameBoy_write_mem(&gb, 0xA010, 8);
+
+    TEST_ASSERT_EQUAL_size_t(
+        1, RamSearch_filter(search, &gb, RamSearchCmp_Increased,
+                            RamSearchWidth_8, 0));
+    TEST_ASSERT_EQUAL_size_t(1,
+                             RamSearch_candidates(search, candidates, RAM_LEN));
+    TEST_ASSERT_EQUAL_HEX16(0xA010, candidates[0].addr);
+    TEST_ASSERT_EQUAL_UINT8(2, candidates[0].bank);
+}
+
+// Whether a value compares as given, one byte at a time
+static bool matches(const RamSearchCmp cmp, const u16 prev, const u16 cur,
+                    const u16 value, const u16 mask)
+{
+    switch (cmp) {
+    case RamSearchCmp_Equal:
+        return cur == prev;
+    case RamSearchCmp_Changed:
+        return cur != prev;
+    case RamSearchCmp_Increased:
+        return cur > prev;
+    case RamSearchCmp_Decreased:
+        return cur < prev;
+    case RamSearchCmp_Delta:
+        return ((cur - prev) & mask) == (value & mask);
+    case RamSearchCmp_Value:
+        return cur == (value & mask);
+    }
+
+    return false;
+}
+
+void test_ram_search_filters_like_plain_comparisons(void)
+{
+    static u8 prev[0x2000];
+    srand(1);
+
+    for (RamSearchCmp cmp = RamSearchCmp_Equal; cmp <= RamSearchCmp_Value;
+         ++cmp) {
+        for (RamSearchWidth width = RamSearchWidth_8;
+             width <= RamSearchWidth_16; ++width) {
+            // Few enough distinct values that each comparison keeps some
+            for (size_t i = 0; i < sizeof(prev); ++i)
+                gb.ram[i] = rand() % 4;
+
+            memcpy(prev, gb.ram, sizeof(prev));
+            RamSearch_reset(search, &gb);
+
+            for (size_t i = 0; i < sizeof(prev); ++i)
+                gb.ram[i] += rand() % 3;
+
+            const u16 mask = width == RamSearchWidth_16 ? 0xFFFF : 0xFF;
+            const u16 value = width == RamSearchWidth_16 ? 0x0101 : 1;
+            RamSearch_filter(search, &gb, cmp, width, value);
+
+            const size_t count =
+                RamSearch_candidates(search, candidates, RAM_LEN);
+            size_t expected = 0;
+
+            for (size_t i = 0; i + width <= sizeof(prev); ++i) {
+                const u16 p = width == RamSearchWidth_16
+                                  ? prev[i] | (prev[i + 1] << 8)
+                                  : prev[i];
+                const u16 c = width == RamSearchWidth_16
+                                  ? gb.ram[i] | (gb.ram[i + 1] << 8)
+                                  : gb.ram[i];
+
+                if (!matches(cmp, p, c, value, mask))
+                    continue;
+
+                TEST_ASSERT_LESS_THAN_size_t(count, expected);
+                TEST_ASSERT_EQUAL_HEX16(0xC000 + i,
+                                        candidates[expected].addr);
+                TEST_ASSERT_EQUAL_HEX16(c, candidates[expected].value);
+                ++expected;
+            }
+
+            // Only unchanged values are left outside of WRAM
+            for (; expected < count; ++expected) {
+                TEST_ASSERT_EQUAL_INT(RamSearchCmp_Equal, cmp);
+                TEST_ASSERT_FALSE(candidates[expected].addr >= 0xC000 &&
+                                  candidates[expected].addr < 0xE000);
+            }
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#include "rom_file.h"
+#include "stdinc.h"
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+static const char *const ROM_PATH = "test_rom_file.gb";
+
+static u8 data[0x8000];
+static RomFile *rom;
+
+void setUp(void)
+{
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = i * 7;
+
+    rom = nullptr;
+}
+
+void tearDown(void)
+{
+    RomFile_destroy(rom);
+    remove(ROM_PATH);
+}
+
+void test_rom_file_maps_file_contents(void)
+{
+    FILE *const file = fopen(ROM_PATH, "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_size_t(sizeof(data), fwrite(data, 1, sizeof(data), file));
+    TEST_ASSERT_EQUAL_INT(0, fclose(file));
+
+    rom = RomFile_open(ROM_PATH);
+
+    TEST_ASSERT_NOT_NULL(rom);
+    TEST_ASSERT_EQUAL_size_t(sizeof(data), RomFile_len(rom));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, RomFile_data(rom), sizeof(data));
+}
+
+void test_rom_file_shares_mapped_file(void)
+{
+    FILE *const file = fopen(ROM_PATH, "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_size_t(sizeof(data), fwrite(data, 1, sizeof(data), file));
+    TEST_ASSERT_EQUAL_INT(0, fclose(file));
+
+    rom = RomFile_open(ROM_PATH);
+    RomFile *const other = RomFile_open(ROM_PATH);
+    TEST_ASSERT_EQUAL_PTR(rom, other);
+    TEST_ASSERT_EQUAL_PTR(rom, RomFile_ref(rom));
+    RomFile_destroy(rom);
+
+    // Either reference keeps the ROM loaded
+    RomFile_destroy(other);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, RomFile_data(rom), sizeof(data));
+}
+
+void test_rom_file_fails_on_missing_or_empty_file(void)
+{
+    TEST_ASSERT_NULL(RomFile_open("does_not_exist.gb"));
+
+    FILE *const file = fopen(ROM_PATH, "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_INT(0, fclose(file));
+
+    TEST_ASSERT_NULL(RomFile_open(ROM_PATH));
+}
+
+void test_rom_file_copies_data(void)
+{
+    rom = RomFile_copy(data, sizeof(data));
+    memset(data, 0, sizeof(data));
+
+    TEST_ASSERT_EQUAL_size_t(sizeof(data), RomFile_len(rom));
+    TEST_ASSERT_EQUAL_HEX8(7, RomFile_data(rom)[1]);
+    TEST_ASSERT_EQUAL_HEX8(0xF9, RomFile_data(rom)[0x7FFF]);
+}
+
+void test_rom_file_shares_copies_of_same_data(void)
+{
+    rom = RomFile_copy(data, sizeof(data));
+    RomFile *const same = RomFile_copy(data, sizeof(data));
+    RomFile *const shorter = RomFile_copy(data, sizeof(data) - 1);
+
+    data[0x1234] ^= 1;
+    RomFile *const different = RomFile_copy(data, sizeof(data));
+
+    TEST_ASSERT_EQUAL_PTR(rom, same);
+    TEST_ASSERT_NOT_EQUAL(rom, shorter);
+    TEST_ASSERT_NOT_EQUAL(rom, different);
+    TEST_ASSERT_EQUAL_HEX8(data[0x1234] ^ 1, RomFile_data(rom)[0x1234]);
+
+    RomFile_destroy(same);
+    RomFile_destroy(shorter);
+    RomFile_destroy(different);
+}
+
+// Copies data and drops the copy over and over, returning how many copies did
+// not hold it
+static int copy_repeatedly(void *const arg)
+{
+    (void)arg;
+    int mismatches = 0;
+
+    for (int i = 0; i < 200; ++i) {
+        RomFile *const copy = RomFile_copy(data, sizeof(data));
+
+        if (memcmp(RomFile_data(copy), data, sizeof(data)) != 0)
+            ++mismatches;
+
+        RomFile_destroy(copy);
+    }
+
+    return mismatches;
+}
+
+void test_rom_file_shares_copies_across_threads(void)
+{
+    SDL_Thread *threads[4];
+
+    for (size_t i = 0; i < 4; ++i) {
+        threads[i] = SDL_CreateThread(copy_repeatedly, "RomFile", nullptr);
+        TEST_ASSERT_NOT_NULL(threads[i]);
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+        int mismatches = -1;
+        SDL_WaitThread(threads[i], &mismatches);
+        TEST_ASSERT_EQUAL_INT(0, mismatches);
+    }
+
+    // Every copy was dropped along with its last reference
+    rom = RomFile_copy(data, sizeof(data));
+    RomFile *const same = RomFile_copy(data, sizeof(data));
+    TEST_ASSERT_EQUAL_PTR(rom, same);
+    RomFile_destroy(same);
+}
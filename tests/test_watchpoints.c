@@ -0,0 +1,96 @@
+#include "stdinc.h"
+#include "watchpoints.h"
+#include <unity.h>
+
+static Watchpoints *watchpoints;
+
+void setUp(void)
+{
+    watchpoints = Watchpoints_new();
+}
+
+void tearDown(void)
+{
+    Watchpoints_destroy(watchpoints);
+}
+
+void test_watchpoints_mark_pages_they_touch(void)
+{
+    Watchpoints_add(watchpoints, 0xC0F0, 0xC110, WatchKind_Write);
+    Watchpoints_add(watchpoints, 0xC105, 0xC105, WatchKind_Read);
+
+    TEST_ASSERT_EQUAL_INT(0, Watchpoints_page(watchpoints, 0xBFFF));
+    TEST_ASSERT_EQUAL_INT(WatchKind_Write,
+                          Watchpoints_page(watchpoints, 0xC000));
+    TEST_ASSERT_EQUAL_INT(WatchKind_Write | WatchKind_Read,
+                          Watchpoints_page(watchpoints, 0xC1FF));
+    TEST_ASSERT_EQUAL_INT(0, Watchpoints_page(watchpoints, 0xC200));
+    TEST_ASSERT_EQUAL_INT(WatchKind_Write | WatchKind_Read,
+                          Watchpoints_kinds(watchpoints));
+}
+
+void test_watchpoints_stop_on_first_hit(void)
+{
+    const size_t id =
+        Watchpoints_add(watchpoints, 0xC010, 0xC01F, WatchKind_Write);
+
+    TEST_ASSERT_FALSE(
+        Watchpoints_check(watchpoints, WatchKind_Write, 0xC00F, 0x12));
+    TEST_ASSERT_FALSE(
+        Watchpoints_check(watchpoints, WatchKind_Read, 0xC010, 0x12));
+    TEST_ASSERT_NULL(Watchpoints_stopped(watchpoints));
+
+    TEST_ASSERT_TRUE(
+        Watchpoints_check(watchpoints, WatchKind_Write, 0xC01F, 0x34));
+    TEST_ASSERT_TRUE(
+        Watchpoints_check(watchpoints, WatchKind_Write, 0xC010, 0x56));
+
+    const WatchHit *const hit = Watchpoints_stopped(watchpoints);
+    TEST_ASSERT_NOT_NULL(hit);
+    TEST_ASSERT_EQUAL_size_t(id, hit->id);
+    TEST_ASSERT_EQUAL_HEX16(0xC01F, hit->addr);
+    TEST_ASSERT_EQUAL_HEX8(0x34, hit->value);
+
+    Watchpoints_resume(watchpoints);
+    TEST_ASSERT_NULL(Watchpoints_stopped(watchpoints));
+
+    TEST_ASSERT_TRUE(Watchpoints_remove(watchpoints, id));
+    TEST_ASSERT_FALSE(Watchpoints_remove(watchpoints, id));
+    TEST_ASSERT_EQUAL_INT(0, Watchpoints_kinds(watchpoints));
+}
+
+static size_t hits;
+
+static bool count_hit([[maybe_unused]] void *const data,
+                      [[maybe_unused]] const WatchHit *const hit)
+{
+    ++hits;
+    return false;
+}
+
+void test_watchpoints_stop_only_if_callback_says_so(void)
+{
+    Watchpoints_add(watchpoints, 0xFF80, 0xFFFE, WatchKind_Read);
+    Watchpoints_set_callback(watchpoints, count_hit, nullptr);
+    hits = 0;
+
+    Watchpoints_check(watchpoints, WatchKind_Read, 0xFF80, 0x00);
+    Watchpoints_check(watchpoints, WatchKind_Read, 0xFFFF, 0x00);
+
+    TEST_ASSERT_EQUAL_size_t(1, hits);
+    TEST_ASSERT_NULL(Watchpoints_stopped(watchpoints));
+}
+
+void test_watchpoints_skip_execute_hit_once_resumed(void)
+{
+    Watchpoints_add(watchpoints, 0x0150, 0x0150, WatchKind_Execute);
+
+    TEST_ASSERT_TRUE(
+        Watchpoints_check(watchpoints, WatchKind_Execute, 0x0150, 0x00));
+    Watchpoints_resume(watchpoints);
+
+    TEST_ASSERT_FALSE(
+        Watchpoints_check(watchpoints, WatchKind_Execute, 0x0150, 0x00));
+    TEST_ASSERT_TRUE(
+        Watchpoints_check(watchpoints, WatchKind_Execute, 0x0150, 0x00));
+}
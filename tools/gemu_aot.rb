@@ -0,0 +1,201 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Compiles the code of a ROM ahead of time into C, for ROM-specific builds of
+# gemu (see gemu_add_aot_executable in CMakeLists.txt).
+#
+# Code is discovered by following control flow from the entry point at $0100
+# and from the RST and interrupt vectors. Each basic block found becomes one C
+# function that calls the Cpu_instr_* helpers from src/instructions_impl.h
+# directly, so the compiler can inline and constant-fold every instruction.
+# The resulting AOT_IMAGE is looked up by (bank, pc) at run time, and anything
+# that was not discovered here (jp hl targets, code in RAM, other banks, ...)
+# runs through the interpreter as usual.
+#
+# Code in 4000-7FFF reached from bank 0 is assumed to be in bank 1. That is
+# only ever wrong for banks that are not mapped at the time, whose blocks then
+# simply never get looked up.
+#
+# Usage: gemu_aot.rb <rom-file> <output-file>
+
+require_relative 'sm83'
+
+BANK_LEN = 0x4000
+
+# Interrupts are only taken between blocks, so keep them reasonably short
+MAX_BLOCK_OPS = 64
+
+ENTRY_POINTS = [0x100, *(0x00..0x38).step(8), *(0x40..0x60).step(8)].freeze
+
+EI = 0xFB
+LD_A16_A = 0xEA
+LD_A16_SP = 0x08
+PREFIX = 0xCB
+
+# Stores to an address held in registers: through (bc), (de) and (hl), and
+# pushes, since SP may point anywhere too
+INDIRECT_STORES = [0x02, 0x12, 0x22, 0x32, 0x34, 0x35, 0x36, *(0x70..0x75), 0x77, 0xC5, 0xD5, 0xE5, 0xF5].freeze
+
+def fnv1a(bytes)
+  bytes.each_byte.reduce(0x811C9DC5) { |hash, byte| ((hash ^ byte) * 0x01000193) & 0xFFFFFFFF }
+end
+
+def u16_at(rom, offset)
+  rom.getbyte(offset) | (rom.getbyte(offset + 1) << 8)
+end
+
+# Addresses control may continue at after the instruction at pc, besides the
+# next one, and whether the next one is reachable too.
+def branch_targets(rom, offset, pc, opcode)
+  next_pc = pc + length(opcode)
+
+  case opcode
+  when 0x18 then [[next_pc + rom.getbyte(offset + 1) - ((rom.getbyte(offset + 1) & 0x80) << 1)], false]
+  when 0x20, 0x28, 0x30, 0x38
+    [[next_pc + rom.getbyte(offset + 1) - ((rom.getbyte(offset + 1) & 0x80) << 1)], true]
+  when 0xC3 then [[u16_at(rom, offset + 1)], false]
+  when 0xC2, 0xCA, 0xD2, 0xDA, 0xC4, 0xCC, 0xD4, 0xDC, 0xCD then [[u16_at(rom, offset + 1)], true]
+  when 0xC7, 0xCF, 0xD7, 0xDF, 0xE7, 0xEF, 0xF7, 0xFF then [[opcode & 0x38], true]
+  when 0xC0, 0xC8, 0xD0, 0xD8, 0x76, 0x10 then [[], true]
+  else [[], !ends_block?(opcode)]
+  end
+end
+
+# Bank a target address is in, as seen from code in the given bank
+def target_bank(bank, addr)
+  return 0 if addr < BANK_LEN
+
+  bank.zero? ? 1 : bank
+end
+
+# Whether the instruction may write to 0000-7FFF, and so switch the bank the
+# rest of the block is in. Only stores to FF00-FFFF or to a constant address
+# above 7FFF are known not to.
+def may_write_mapper?(rom, offset, opcode)
+  case opcode
+  when LD_A16_A then u16_at(rom, offset + 1) < 0x8000
+  when LD_A16_SP then u16_at(rom, offset + 1) < 0x8000 || u16_at(rom, offset + 1) == 0xFFFF
+  when PREFIX
+    # Rotates, shifts, res and set on (hl), but not bit
+    cb = rom.getbyte(offset + 1)
+    (cb & 0b111) == 6 && (cb >> 6) != 1
+  else INDIRECT_STORES.include?(opcode)
+  end
+end
+
+Block = Struct.new(:bank, :pc, :ops)
+
+def decode_block(rom, bank, pc)
+  ops = []
+  successors = []
+  region_end = [(bank + 1) * BANK_LEN, rom.bytesize].min
+  addr = pc
+
+  loop do
+    offset = (bank * BANK_LEN) + (addr & 0x3FFF)
+    opcode = rom.getbyte(offset)
+    len = length(opcode)
+    break if offset + len > region_end || decode(opcode).start_with?('BAIL')
+
+    ops << [addr, rom.byteslice(offset, len)]
+    targets, falls_through = branch_targets(rom, offset, addr, opcode)
+    successors.concat(targets.map { |target| target & 0xFFFF })
+    addr += len
+
+    # Stop after ei, so that interrupts are checked right after the next
+    # instruction, and after possible mapper writes, which may switch the bank
+    # the rest of the block is in
+    ends = ends_block?(opcode) || opcode == EI || ops.length == MAX_BLOCK_OPS ||
+           may_write_mapper?(rom, offset, opcode)
+    next unless ends
+
+    successors << addr if falls_through
+    break
+  end
+
+  [Block.new(bank, pc, ops), successors]
+end
+
+def discover_blocks(rom)
+  blocks = {}
+  pending = ENTRY_POINTS.map { |pc| [0, pc] }
+
+  until pending.empty?
+    bank, pc = pending.pop
+    next if blocks.key?([bank, pc]) || pc > 0x7FFF || (bank * BANK_LEN) >= rom.bytesize
+
+    block, successors = decode_block(rom, bank, pc)
+    next if block.ops.empty?
+
+    blocks[[bank, pc]] = block
+    successors.each { |target| pending << [target_bank(bank, target), target] if target <= 0x7FFF }
+  end
+
+  blocks.values.sort_by { |block| [block.bank, block.pc] }
+end
+
+def block_name(block)
+  format('Aot_block_%02X_%04X', block.bank, block.pc)
+end
+
+def code_name(block)
+  format('AOT_CODE_%02X_%04X', block.bank, block.pc)
+end
+
+def emit_op(out, addr, bytes)
+  opcode = bytes.getbyte(0)
+  out.puts format('    Cpu_read_pc(cpu, mem); // $%04X: $%02X', addr, opcode)
+
+  if opcode == PREFIX
+    out.puts '    Cpu_read_pc(cpu, mem);'
+    out.puts "    #{decode_prefixed(bytes.getbyte(1))};"
+  else
+    out.puts "    #{decode(opcode)};"
+  end
+end
+
+def emit_block(out, block)
+  bytes = block.ops.map { |_, op_bytes| op_bytes }.join.bytes
+  out.puts "static const u8 #{code_name(block)}[] = {"
+  bytes.each_slice(12) { |line| out.puts "    #{line.map { |byte| format('0x%02X', byte) }.join(', ')}," }
+  out.puts '};'
+  out.puts
+  out.puts "static void #{block_name(block)}(Cpu *const cpu, Memory *const mem)"
+  out.puts '{'
+  out.puts "    cpu->fetch = #{code_name(block)};"
+  block.ops.each { |addr, op_bytes| emit_op(out, addr, op_bytes) }
+  out.puts '    cpu->fetch = nullptr;'
+  out.puts '}'
+  out.puts
+end
+
+abort "usage: #{$PROGRAM_NAME} <rom-file> <output-file>" if ARGV.length != 2
+
+rom = File.binread(ARGV[0])
+blocks = discover_blocks(rom)
+
+File.open(ARGV[1], 'w') do |out|
+  out.puts "// Generated by #{File.basename($PROGRAM_NAME)} from #{File.basename(ARGV[0])}. Do not edit."
+  out.puts
+  out.puts "#define GEMU_AOT_NO_TRACE"
+  out.puts
+  out.puts '#include "aot.h"'
+  out.puts '#include "cpu.h"'
+  out.puts '#include "instructions_impl.h"'
+  out.puts '#include "stdinc.h"'
+  out.puts
+  blocks.each { |block| emit_block(out, block) }
+  out.puts 'static const AotBlock AOT_BLOCKS[] = {'
+  blocks.each do |block|
+    out.puts format('    {.bank = 0x%02X, .pc = 0x%04X, .op_count = %d, .run = %s},',
+                    block.bank, block.pc, block.ops.length, block_name(block))
+  end
+  out.puts '};'
+  out.puts
+  out.puts 'const AotImage AOT_IMAGE = {'
+  out.puts "    .rom_len = #{rom.bytesize},"
+  out.puts format('    .rom_hash = 0x%08X,', fnv1a(rom))
+  out.puts '    .block_count = sizeof(AOT_BLOCKS) / sizeof(AOT_BLOCKS[0]),'
+  out.puts '    .blocks = AOT_BLOCKS,'
+  out.puts '};'
+end
@@ -0,0 +1,69 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Generates one handler per SM83 opcode (256 unprefixed + 256 CB-prefixed)
+# along with the flat dispatch tables used by Cpu_execute, and the per-opcode
+# length, block-end and side-effect tables used to pre-decode code into the
+# block cache.
+#
+# Every handler calls into the Cpu_instr_* helpers in src/instructions_impl.h
+# with its register, condition and ALU operands spelled out as constants, so
+# the compiler can fold the operand switches away once the helpers are inlined.
+#
+# The output is meant to be #included by src/instructions.c.
+#
+# Usage: generate_opcode_table.rb <output-file>
+
+require_relative 'sm83'
+
+def handler_name(prefixed, opcode)
+  format('Cpu_op_%s%02X', prefixed ? 'cb_' : '', opcode)
+end
+
+def emit_handlers(out, prefixed)
+  256.times do |opcode|
+    name = handler_name(prefixed, opcode)
+    body = prefixed ? decode_prefixed(opcode) : decode(opcode)
+
+    out.puts "static void #{name}([[maybe_unused]] Cpu *const cpu,"
+    out.puts "#{' ' * (name.length + 13)}[[maybe_unused]] Memory *const mem)"
+    out.puts '{'
+    out.puts "    #{body};"
+    out.puts '}'
+    out.puts
+  end
+end
+
+def emit_table(out, name, prefixed)
+  out.puts "static const CpuOpHandler #{name}[0x100] = {"
+  256.times do |opcode|
+    out.puts format('    [0x%02X] = %s,', opcode, handler_name(prefixed, opcode))
+  end
+  out.puts '};'
+end
+
+def emit_byte_table(out, name)
+  out.puts "static const u8 #{name}[0x100] = {"
+  256.times.each_slice(8) do |opcodes|
+    out.puts "    #{opcodes.map { |opcode| yield(opcode) }.join(', ')},"
+  end
+  out.puts '};'
+end
+
+abort "usage: #{$PROGRAM_NAME} <output-file>" if ARGV.length != 1
+
+File.open(ARGV[0], 'w') do |out|
+  out.puts "// Generated by #{File.basename($PROGRAM_NAME)}. Do not edit."
+  out.puts
+  emit_handlers(out, true)
+  emit_table(out, 'CPU_PREFIX_TABLE', true)
+  out.puts
+  emit_handlers(out, false)
+  emit_table(out, 'CPU_OPCODE_TABLE', false)
+  out.puts
+  emit_byte_table(out, 'CPU_OPCODE_LENGTH') { |opcode| length(opcode) }
+  out.puts
+  emit_byte_table(out, 'CPU_OPCODE_ENDS_BLOCK') { |opcode| ends_block?(opcode) ? 1 : 0 }
+  out.puts
+  emit_byte_table(out, 'CPU_OPCODE_SIDE_EFFECT_FREE') { |opcode| side_effect_free?(opcode) ? 1 : 0 }
+end
@@ -0,0 +1,153 @@
+# frozen_string_literal: true
+
+# SM83 instruction decoding shared by the code generators in this directory.
+# decode and decode_prefixed return the C expression that runs an opcode,
+# written in terms of the Cpu_instr_* helpers in src/instructions_impl.h.
+#
+# Credit for the decoding scheme:
+# https://archive.gbdev.io/salvage/decoding_gbz80_opcodes/Decoding%20Gamboy%20Z80%20Opcodes.html
+
+R = %w[B C D E H L HL A].map { |r| "CpuTableR_#{r}" }.freeze
+RP = %w[BC DE HL SP].map { |rp| "CpuTableRp_#{rp}" }.freeze
+RP2 = %w[BC DE HL AF].map { |rp| "CpuTableRp2_#{rp}" }.freeze
+CC = %w[NZ Z NC C].map { |cc| "CpuTableCc_#{cc}" }.freeze
+ALU = %w[Add Adc Sub Sbc And Xor Or Cp].map { |alu| "CpuTableAlu_#{alu}" }.freeze
+ROT = %w[rlc rrc rl rr sla sra swap srl].freeze
+
+def removed(opcode)
+  format('BAIL("removed instruction ($%%02X)", 0x%02X)', opcode)
+end
+
+def decode_x0(y, z, p, q)
+  case z
+  when 0
+    case y
+    when 0 then 'Cpu_instr_nop()'
+    when 1 then 'Cpu_instr_ld_n16_sp(cpu, mem)'
+    when 2 then 'Cpu_instr_stop(cpu)'
+    when 3 then 'Cpu_instr_jr_e8(cpu, mem)'
+    else "Cpu_instr_jr_cc_e8(cpu, mem, #{CC[y - 4]})"
+    end
+  when 1
+    q.zero? ? "Cpu_instr_ld_r16_n16(cpu, mem, #{RP[p]})" : "Cpu_instr_add_hl_r16(cpu, #{RP[p]})"
+  when 2
+    stores = %w[ld_bc_a ld_de_a ld_hli_a ld_hld_a]
+    loads = %w[ld_a_bc ld_a_de ld_a_hli ld_a_hld]
+    "Cpu_instr_#{(q.zero? ? stores : loads)[p]}(cpu, mem)"
+  when 3
+    "Cpu_instr_#{q.zero? ? 'inc' : 'dec'}_r16(cpu, #{RP[p]})"
+  when 4 then "Cpu_instr_inc_r8(cpu, mem, #{R[y]})"
+  when 5 then "Cpu_instr_dec_r8(cpu, mem, #{R[y]})"
+  when 6 then "Cpu_instr_ld_r8_n(cpu, mem, #{R[y]})"
+  when 7 then "Cpu_instr_#{%w[rlca rrca rla rra daa cpl scf ccf][y]}(cpu)"
+  end
+end
+
+def decode_x3(opcode, y, z, p, q)
+  case z
+  when 0
+    case y
+    when 4 then 'Cpu_instr_ldh_n16_a(cpu, mem)'
+    when 5 then 'Cpu_instr_add_sp_e8(cpu, mem)'
+    when 6 then 'Cpu_instr_ldh_a_n16(cpu, mem)'
+    when 7 then 'Cpu_instr_ld_hl_sp_plus_e8(cpu, mem)'
+    else "Cpu_instr_ret_cc(cpu, mem, #{CC[y]})"
+    end
+  when 1
+    return "Cpu_instr_pop_r16(cpu, mem, #{RP2[p]})" if q.zero?
+
+    ['Cpu_instr_ret(cpu, mem)', 'Cpu_instr_reti(cpu, mem)', 'Cpu_instr_jp_hl(cpu)', 'Cpu_instr_ld_sp_hl(cpu)'][p]
+  when 2
+    case y
+    when 4 then 'Cpu_instr_ldh_c_a(cpu, mem)'
+    when 5 then 'Cpu_instr_ld_a16_a(cpu, mem)'
+    when 6 then 'Cpu_instr_ldh_a_c(cpu, mem)'
+    when 7 then 'Cpu_instr_ld_a_a16(cpu, mem)'
+    else "Cpu_instr_jp_cc_a16(cpu, mem, #{CC[y]})"
+    end
+  when 3
+    case y
+    when 0 then 'Cpu_instr_jp_a16(cpu, mem)'
+    when 1 then 'Cpu_instr_prefix(cpu, mem)'
+    when 6 then 'Cpu_instr_di(cpu)'
+    when 7 then 'Cpu_instr_ei(cpu)'
+    else removed(opcode)
+    end
+  when 4
+    y < 4 ? "Cpu_instr_call_cc_n16(cpu, mem, #{CC[y]})" : removed(opcode)
+  when 5
+    if q.zero?
+      "Cpu_instr_push_r16(cpu, mem, #{RP2[p]})"
+    elsif p.zero?
+      'Cpu_instr_call_n16(cpu, mem)'
+    else
+      removed(opcode)
+    end
+  when 6 then "Cpu_instr_alu_a_a8(cpu, mem, #{ALU[y]})"
+  when 7 then "Cpu_instr_rst_vec(cpu, mem, #{y})"
+  end
+end
+
+def decode(opcode)
+  x = opcode >> 6
+  y = (opcode >> 3) & 0b111
+  z = opcode & 0b111
+  p = y >> 1
+  q = y & 1
+
+  case x
+  when 0 then decode_x0(y, z, p, q)
+  when 1 then opcode == 0x76 ? 'Cpu_instr_halt(cpu)' : "Cpu_instr_ld_r8_r8(cpu, mem, #{R[y]}, #{R[z]})"
+  when 2 then "Cpu_instr_alu_r8(cpu, mem, #{ALU[y]}, #{R[z]})"
+  when 3 then decode_x3(opcode, y, z, p, q)
+  end
+end
+
+def decode_prefixed(opcode)
+  x = opcode >> 6
+  y = (opcode >> 3) & 0b111
+  z = opcode & 0b111
+
+  case x
+  when 0 then "Cpu_instr_#{ROT[y]}_r8(cpu, mem, #{R[z]})"
+  when 1 then "Cpu_instr_bit_u3_r8(cpu, mem, #{y}, #{R[z]})"
+  when 2 then "Cpu_instr_res_u3_r8(cpu, mem, #{y}, #{R[z]})"
+  when 3 then "Cpu_instr_set_u3_r8(cpu, mem, #{y}, #{R[z]})"
+  end
+end
+
+# Number of bytes the handler for an unprefixed opcode fetches, including the
+# opcode itself
+def length(opcode)
+  x = opcode >> 6
+  y = (opcode >> 3) & 0b111
+  z = opcode & 0b111
+
+  case x
+  when 0
+    return 3 if (z.zero? && y == 1) || (z == 1 && y.even?)
+    return 2 if (z.zero? && y >= 3) || z == 6
+  when 3
+    return 3 if (z == 2 && y != 4 && y != 6) || (z == 3 && y.zero?)
+    return 3 if (z == 4 && y < 4) || opcode == 0xCD
+    return 2 if (z.zero? && y >= 4) || opcode == 0xCB || z == 6
+  end
+
+  1
+end
+
+# Whether an unprefixed opcode may continue anywhere other than the next
+# instruction (or stops the CPU), which ends a pre-decoded block
+def ends_block?(opcode)
+  decode(opcode).match?(/Cpu_instr_(jr|jp|call|ret|rst|halt|stop)|BAIL/)
+end
+
+# Whether an unprefixed opcode leaves everything but the CPU registers alone:
+# no memory writes, no stack, interrupt or CPU mode changes. CB-prefixed
+# opcodes are not covered here, since that depends on the second byte.
+def side_effect_free?(opcode)
+  body = decode(opcode)
+  return false if body.match?(/ld_n16_sp|ld_(bc|de|hli|hld|a16)_a|ldh_(n16|c)_a|push|pop|call|ret|rst|halt|stop|di|ei|prefix|BAIL/)
+
+  !body.match?(/(inc_r8|dec_r8|ld_r8_n|ld_r8_r8)\(cpu, mem, CpuTableR_HL/)
+end